@@ -0,0 +1,34 @@
+
+# Measures the cold start of the UI: the time from main() until the main
+# window has been drawn for the first time, as reported by --startup-time.
+#
+# usage: cmake -DCERTALIZE=<binary> [-DRUNS=n] [-DFILE=<cert>] -P benchmark.cmake
+
+if(NOT CERTALIZE)
+  message(FATAL_ERROR "CERTALIZE not set")
+endif()
+
+if(NOT RUNS)
+  set(RUNS 5)
+endif()
+
+set(args --startup-time)
+if(FILE)
+  set(args ${args} ${FILE})
+endif()
+
+foreach(run RANGE 1 ${RUNS})
+
+  execute_process(COMMAND ${CERTALIZE} ${args}
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE error
+    OUTPUT_STRIP_TRAILING_WHITESPACE)
+
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "startup run ${run} failed (${result}): ${error}")
+  endif()
+
+  message(STATUS "startup run ${run}: ${output}")
+
+endforeach()
@@ -19,8 +19,6 @@
 #ifndef CERTALIZE_H
 #define CERTALIZE_H
 
-#include <config.h>
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,10 +26,6 @@
 #include <errno.h>
 #include <glib.h>
 
-#ifdef HAVE_GETOPT_H
-#include <getopt.h>
-#endif
-
 #define _U_ __attribute__((unused))
 
 #define PROGRAM_NAME "certalize"
@@ -53,9 +47,12 @@ enum {
    E_FATAL      = 255,
 };
 
-
-char *global_filename;
-
+/* output modes */
+enum {
+   OUTPUT_GUI    = 0,
+   OUTPUT_NDJSON = 1,
+   OUTPUT_JSON   = 2,
+};
 
 #endif   /* CERTALIZE_H */
 
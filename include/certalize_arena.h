@@ -0,0 +1,68 @@
+/* certalize_arena.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_ARENA_H
+#define CERTALIZE_ARENA_H
+
+#include <certalize.h>
+
+#define ARENA_ALIGN                 16
+#define ARENA_DEFAULT_CHUNK_SIZE    (64 * 1024)
+
+typedef struct arena_chunk {
+   struct arena_chunk *next;
+   gsize size;
+   gsize used;
+   /* payload follows the header */
+} arena_chunk_t;
+
+typedef struct arena_cleanup {
+   struct arena_cleanup *next;
+   gpointer data;
+   GDestroyNotify destroy;
+} arena_cleanup_t;
+
+/*
+ * bump allocator owning all memory of one loaded document;
+ * everything allocated from or adopted by it is released
+ * at once by arena_free()
+ */
+typedef struct arena {
+   arena_chunk_t *chunks;
+   arena_cleanup_t *cleanups;
+   gsize chunk_size;
+   gsize allocated;
+} arena_t;
+
+extern arena_t* arena_new(gsize chunk_size);
+extern void     arena_free(arena_t *arena);
+extern gpointer arena_alloc(arena_t *arena, gsize size);
+extern gpointer arena_alloc0(arena_t *arena, gsize size);
+extern gchar*   arena_strdup(arena_t *arena, const gchar *str);
+extern gchar*   arena_strdup_printf(arena_t *arena, const gchar *format, ...)
+                   G_GNUC_PRINTF(2, 3);
+extern gpointer arena_adopt(arena_t *arena, gpointer data,
+                   GDestroyNotify destroy);
+
+#define arena_new0(arena, type) ((type*)arena_alloc0((arena), sizeof(type)))
+
+#endif   /* CERTALIZE_ARENA_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -55,12 +55,17 @@
 #define ASN1_CLASS_CONTEXT_SPECIFIC 2
 #define ASN1_CLASS_PRIVATE          3
 
+/* indefinite or more than 8 length octets */
+#define ASN1_LENGTH_INVALID         0xff
+
+extern const guint8 asn1_length_octets[256];
+
 typedef struct asn1_hdr {
    guint8 class;
    guint8 constructed;
    guint32 tag;
    guint8 length_byte;
-   guint32 length;
+   guint64 length;
 } asn1_hdr_t;
 
 #define ASN1_MAX_OID_LEN            20
@@ -69,7 +74,85 @@ typedef struct asn1_oid {
    size_t len;
 } asn1_oid_t;
 
+/*
+ * reference to a complete TLV element inside a cbuf
+ */
+typedef struct asn1_tlv {
+   guint64 offset;      /* offset of the identifier octet */
+   guint hdr_len;       /* length of identifier and length octets */
+   guint64 length;      /* length of the contents */
+   guint32 tag;
+   guint8 class;
+   guint8 constructed;
+} asn1_tlv_t;
+
+/* pointer to the contents of the element (no copy) */
+#define ASN1_CONTENT(cbuf, tlv) ((cbuf)->buffer + (tlv)->offset + (tlv)->hdr_len)
+/* offset of the first byte following the element */
+#define ASN1_END(tlv)           ((tlv)->offset + (tlv)->hdr_len + (tlv)->length)
+#define ASN1_IS(tlv, cls, tg)   ((tlv)->class == (cls) && (tlv)->tag == (tg))
+
+/*
+ * resumable decoder for incrementally arriving DER data
+ */
+#define ASN1_STREAM_MAX_DEPTH       64
+
+/* return values of asn1_stream_feed() */
+#define ASN1_NEED_MORE_DATA         1
+#define ASN1_ELEMENT_COMPLETE       2
+
+enum {
+   ASN1_STATE_IDENTIFIER = 0,
+   ASN1_STATE_HIGH_TAG,
+   ASN1_STATE_LENGTH,
+   ASN1_STATE_LONG_LENGTH,
+   ASN1_STATE_CONTENTS,
+};
+
+/*
+ * event handlers, offsets are absolute from the start of the stream;
+ * a negative return value aborts asn1_stream_feed() with this value
+ */
+typedef struct asn1_stream_callbacks {
+   int (*element_begin)(asn1_tlv_t *tlv, guint depth, gpointer data);
+   int (*contents)(asn1_tlv_t *tlv, const guchar *buf, gsize len,
+                   gpointer data);
+   int (*element_end)(asn1_tlv_t *tlv, guint depth, gpointer data);
+} asn1_stream_callbacks_t;
+
+typedef struct asn1_stream {
+   guint state;
+   guint64 offset;
+   /* element currently decoded */
+   asn1_tlv_t tlv;
+   guint length_bytes;
+   guint64 remaining;
+   /* enclosing constructed elements */
+   guint depth;
+   asn1_tlv_t stack[ASN1_STREAM_MAX_DEPTH];
+   const asn1_stream_callbacks_t *callbacks;
+   gpointer data;
+} asn1_stream_t;
+
+extern void asn1_stream_init(asn1_stream_t *stream,
+                             const asn1_stream_callbacks_t *callbacks,
+                             gpointer data);
+extern int  asn1_stream_feed(asn1_stream_t *stream, const guchar *buf,
+                             gsize len, gsize *consumed);
+
 extern int asn1_parse_hdr(cbuf_t *cbuf, asn1_hdr_t *hdr);
+extern int asn1_parse_hdr_at(cbuf_t *cbuf, guint64 offset, asn1_hdr_t *hdr);
+extern int asn1_read_tlv(cbuf_t *cbuf, guint64 offset, asn1_tlv_t *tlv);
+extern int asn1_decode_header(const guchar *ptr, gsize avail, asn1_tlv_t *tlv);
+extern int asn1_first_child(cbuf_t *cbuf, asn1_tlv_t *parent,
+                            asn1_tlv_t *child);
+extern int asn1_next_child(cbuf_t *cbuf, asn1_tlv_t *parent,
+                           asn1_tlv_t *child);
+extern int asn1_decode_oid(cbuf_t *cbuf, asn1_tlv_t *tlv, asn1_oid_t *oid);
+extern gsize asn1_oid_to_string(asn1_oid_t *oid, gchar *buf, gsize size);
+extern int asn1_decode_time(cbuf_t *cbuf, asn1_tlv_t *tlv, gint64 *time);
+extern int asn1_decode_uint(cbuf_t *cbuf, asn1_tlv_t *tlv, guint64 *value);
+extern const gchar* asn1_tag_name(guint8 class, guint32 tag);
 
 
 #endif   /* CERTALIZE_ASN1_H */
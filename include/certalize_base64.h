@@ -21,8 +21,18 @@
 
 #include <certalize.h>
 
+/* input bytes per PEM line of 64 characters */
+#define PEM_LINE_BYTES              48
+
+#define BASE64_ENCODED_LEN(len)     (((len) + 2) / 3 * 4)
+#define PEM_ENCODED_LEN(len) \
+   (28 + 26 + BASE64_ENCODED_LEN(len) + \
+    ((len) + PEM_LINE_BYTES - 1) / PEM_LINE_BYTES)
+
 extern gsize pem_strip(const gchar *input, gsize len, gchar *output);
-extern gint base64_decode(const gchar *input, gsize len, gchar *output);
+extern gssize base64_decode(const gchar *input, gsize len, gchar *output);
+extern gsize base64_encode(const guchar *input, gsize len, gchar *output);
+extern gsize pem_encode(const guchar *der, gsize len, gchar *output);
 
 #endif   /* CERTALIZE_BASE64_H */
 
@@ -0,0 +1,74 @@
+/* certalize_batch.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_BATCH_H
+#define CERTALIZE_BATCH_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_json.h>
+#include <certalize_x509.h>
+#include <certalize_filter.h>
+
+typedef struct batch {
+   gint format;
+   /* only the decoded fields, no digests and byte ranges */
+   gboolean brief;
+   json_writer_t json;
+   guchar *outbuf;
+   /* reused for every certificate */
+   GChecksum *sha1;
+   GChecksum *sha256;
+   /* structural index of the current record */
+   asn1_index_t tlv_index;
+   guint64 records;
+   guint64 errors;
+   /* position and name of the record source while streaming */
+   const gchar *source;
+   guint64 index;
+   guint64 base_offset;
+   /* certificates not matching are left out, NULL for all */
+   filter_t *filter;
+   filter_fields_t fields;
+} batch_t;
+
+extern int  batch_run(GPtrArray *files, gint format, filter_t *filter,
+                       const asn1_limits_t *limits);
+extern void batch_init(batch_t *batch, gint format, gint fd);
+extern void batch_finish(batch_t *batch);
+extern int  batch_process_files(batch_t *batch, gchar **files,
+                                guint count);
+extern int  batch_process_cbuf(batch_t *batch, const gchar *source,
+                               cbuf_t *cbuf);
+extern int  batch_process_data(batch_t *batch, const gchar *source,
+                               const guchar *data, gsize len);
+extern int  batch_process_compressed(batch_t *batch, const gchar *source,
+                                     cbuf_t *cbuf, guint format);
+extern int  batch_process_fd(batch_t *batch, const gchar *source, gint fd);
+extern int  batch_process_pcap(batch_t *batch, const gchar *filename);
+extern void batch_emit_certificate(batch_t *batch, const gchar *source,
+                                   guint64 index, cbuf_t *cbuf,
+                                   x509_cert_t *cert);
+extern void batch_emit_error(batch_t *batch, const gchar *source,
+                             guint64 offset, const gchar *message);
+
+#endif   /* CERTALIZE_BATCH_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
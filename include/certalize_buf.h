@@ -20,18 +20,31 @@
 #define CERTALIZE_BUF_H
 
 #include <certalize.h>
+#include <certalize_arena.h>
+
+/* true if length bytes starting at offset are within the buffer */
+#define CBUF_HAS(cbuf, offset, len) \
+   ((offset) <= (cbuf)->length && (len) <= (cbuf)->length - (offset))
 
 typedef struct cbuf {
    guchar *buffer;
    gsize length;
-   guint offset;
+   guint64 offset;
+   /* owns the buffer and all parse state of the document */
+   arena_t *arena;
 } cbuf_t;
 
-extern cbuf_t* cbuf_load_file(const gchar *filename);
-extern guint16 cbuf_get_ntohs(cbuf_t *cbuf, guint offset);
-extern guint32 cbuf_get_ntohl(cbuf_t *cbuf, guint offset);
-extern gchar*  cbuf_get_bytes(cbuf_t *cbuf, guchar **buffer, guint offset, gsize length);
-extern gsize   cbuf_length_remaining(cbuf_t *cbuf, guint offset);
+extern cbuf_t* cbuf_load_file(const gchar *filename, gsize max);
+extern cbuf_t* cbuf_map_file(const gchar *filename);
+extern cbuf_t* cbuf_map_raw(const gchar *filename);
+extern cbuf_t* cbuf_new_from_data(const guchar *data, gsize length);
+extern cbuf_t* cbuf_new_raw(const guchar *data, gsize length);
+extern void    cbuf_free(cbuf_t *cbuf);
+extern guint16 cbuf_get_ntohs(cbuf_t *cbuf, guint64 offset);
+extern guint32 cbuf_get_ntoh24(cbuf_t *cbuf, guint64 offset);
+extern guint32 cbuf_get_ntohl(cbuf_t *cbuf, guint64 offset);
+extern gchar*  cbuf_get_bytes(cbuf_t *cbuf, guchar **buffer, guint64 offset, gsize length);
+extern gsize   cbuf_length_remaining(cbuf_t *cbuf, guint64 offset);
 
 
 #endif   /* CERTALIZE_BUF_H */
@@ -0,0 +1,34 @@
+/* certalize_compare.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_COMPARE_H
+#define CERTALIZE_COMPARE_H
+
+#include <certalize.h>
+#include <certalize_index.h>
+
+/* width of the column of the old document */
+#define COMPARE_COLUMN              56
+
+extern int compare_run(GPtrArray *files, const asn1_limits_t *limits);
+
+#endif   /* CERTALIZE_COMPARE_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,40 @@
+/* certalize_convert.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_CONVERT_H
+#define CERTALIZE_CONVERT_H
+
+#include <certalize.h>
+
+/* target encodings */
+enum {
+   CONVERT_NONE = 0,
+   CONVERT_PEM,
+   CONVERT_DER,
+};
+
+/* pieces written by one writev() */
+#define CONVERT_IOV_BATCH           64
+
+extern int convert_run(GPtrArray *files, gint target, const gchar *outdir);
+
+#endif   /* CERTALIZE_CONVERT_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,55 @@
+/* certalize_decomp.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_DECOMP_H
+#define CERTALIZE_DECOMP_H
+
+#include <certalize.h>
+
+/* size and number of the chunks passed between the threads */
+#define DECOMP_CHUNK_SIZE           (256 * 1024)
+#define DECOMP_CHUNKS               3
+
+/* decompressed size of a file loaded as a whole, unless limited further */
+#define DECOMP_MAX_BUFFER           (64 * 1024 * 1024)
+
+/* compression formats recognized by their magic */
+enum {
+   DECOMP_NONE = 0,
+   DECOMP_GZIP,
+   DECOMP_ZSTD,
+};
+
+/*
+ * called with every decompressed chunk in order; a negative
+ * return value stops decompression
+ */
+typedef int (*decomp_chunk_cb)(const guchar *buf, gsize len, gpointer data);
+
+extern guint        decomp_probe(const guchar *data, gsize len);
+extern const gchar* decomp_name(guint format);
+extern int          decomp_run(guint format, const guchar *data, gsize len,
+                               decomp_chunk_cb callback, gpointer cbdata);
+extern guchar*      decomp_buffer(guint format, const guchar *data,
+                                  gsize len, gsize max, gsize *outlen);
+
+#endif   /* CERTALIZE_DECOMP_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,96 @@
+/* certalize_diff.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_DIFF_H
+#define CERTALIZE_DIFF_H
+
+#include <certalize.h>
+#include <certalize_parser.h>
+
+/*
+ * structural difference of two DER documents
+ *   - every element is hashed bottom-up from its header and the
+ *     hashes of its children (its bytes if primitive), so differing
+ *     subtrees mostly differ by one hash; equal hashes are confirmed
+ *     by comparing the bytes, so an equal subtree is not descended
+ *     into but costs a memcmp() of its encoding, O(bytes) of the
+ *     equal region rather than a single hash check
+ *   - the elements of two differing constructed elements of the same
+ *     tag are aligned by their hashes; those found on one side only
+ *     are removed or added, those paired at the same place differ
+ *     and are descended into
+ *   - the top-level elements of both documents are aligned the same
+ *     way, so bundles and CRLs compare entry by entry
+ */
+
+/* kinds of a difference */
+enum {
+   DIFF_CHANGED = 0,
+   DIFF_REMOVED,
+   DIFF_ADDED,
+};
+
+/* contents shown of a primitive element by diff_preview() */
+#define DIFF_PREVIEW_BYTES          24
+
+typedef struct diff diff_t;
+
+/* one difference, nodes are ASN1_INDEX_NONE on the side lacking it */
+typedef struct diff_entry {
+   guint kind;
+   guint32 a;
+   guint32 b;
+} diff_entry_t;
+
+/*
+ * called for every difference in document order; a negative result
+ * stops comparing
+ */
+typedef int (*diff_cb)(diff_t *diff, const diff_entry_t *entry,
+                       gpointer data);
+
+/*
+ * compare state, reused for any number of document pairs; the parsers
+ * hold the documents compared last, borrowed like by parser_parse()
+ */
+struct diff {
+   parser_t a;
+   parser_t b;
+   /* subtree hash of every node */
+   guint64 *ha;
+   guint64 *hb;
+   guint32 ha_size;
+   guint32 hb_size;
+   diff_cb callback;
+   gpointer data;
+   guint64 count;
+   gboolean stop;
+};
+
+extern void diff_init(diff_t *diff);
+extern void diff_destroy(diff_t *diff);
+extern int  diff_documents(diff_t *diff, const guchar *a, gsize alen,
+                           const guchar *b, gsize blen, diff_cb callback,
+                           gpointer data);
+extern void diff_preview(parser_t *parser, guint32 node, GString *out);
+
+#endif   /* CERTALIZE_DIFF_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
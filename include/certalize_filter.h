@@ -0,0 +1,91 @@
+/* certalize_filter.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_FILTER_H
+#define CERTALIZE_FILTER_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_x509.h>
+#include <certalize_store.h>
+
+/*
+ * selection of certificates by an expression like
+ *
+ *    notAfter < now + 30d && keySize < 2048 && issuer ~ "Foo CA"
+ *
+ *   - fields are those of the column store: file, offset, serial,
+ *     issuer, subject, notBefore, notAfter, keyType, keySize (or
+ *     keyBits), san and fingerprint
+ *   - numbers may carry a unit of s, m, h, d, w or y (365 days);
+ *     "now" is the time the filter was compiled; a sum overflowing
+ *     64 bits makes the expression false
+ *   - keyType compares to RSA, DSA, EC, Ed25519 and Ed448
+ *   - strings compare with == and != to a literal; serial and
+ *     fingerprint as hex, colons and case do not matter
+ *   - "~" matches a regular expression (bytewise, "(?i)" ignores
+ *     case); san matches if any of its "DNS:name", "IP:addr", ...
+ *     entries does
+ *   - &&, || and ! combine comparisons, parentheses group them
+ *
+ * the expression is compiled once into instructions of a stack
+ * machine; filter_mask() tells which fields must be decoded
+ */
+#define FILTER_MAX_DEPTH            32
+
+/* longer serial numbers are compared by their leading bytes */
+#define FILTER_SERIAL_MAX           64
+
+typedef struct filter filter_t;
+
+/*
+ * the fields of one certificate, those of mask decoded; strings are
+ * not terminated and may point into the cbuf or the store
+ */
+typedef struct filter_fields {
+   guint32 mask;
+   gint64 ints[STORE_COLUMNS];
+   const gchar *strs[STORE_COLUMNS];
+   gsize lens[STORE_COLUMNS];
+   /* storage of what is decoded rather than referenced */
+   gchar issuer[X509_NAME_MAXLEN];
+   gchar subject[X509_NAME_MAXLEN];
+   gchar serial[FILTER_SERIAL_MAX * 2 + 1];
+   gchar fingerprint[32 * 2 + 1];
+   GByteArray *san;
+   GChecksum *digest;
+} filter_fields_t;
+
+extern filter_t* filter_new(const gchar *expression);
+extern void      filter_free(filter_t *filter);
+extern guint32   filter_mask(filter_t *filter);
+extern gboolean  filter_match(filter_t *filter, filter_fields_t *fields);
+
+extern void filter_fields_init(filter_fields_t *fields);
+extern void filter_fields_destroy(filter_fields_t *fields);
+extern void filter_fields_decode(filter_fields_t *fields, guint32 mask,
+                                 cbuf_t *cbuf, x509_cert_t *cert,
+                                 const gchar *file, guint64 offset);
+extern void filter_fields_load(filter_fields_t *fields, guint32 mask,
+                               store_t *store, guint64 row);
+
+#endif   /* CERTALIZE_FILTER_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
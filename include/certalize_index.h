@@ -0,0 +1,123 @@
+/* certalize_index.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_INDEX_H
+#define CERTALIZE_INDEX_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_asn1.h>
+
+#define ASN1_INDEX_NONE             G_MAXUINT32
+#define ASN1_INDEX_MAX_DEPTH        64
+
+/*
+ * one TLV element of the index
+ *   - nodes are stored in encoding order, so the first child of a
+ *     constructed element directly follows its parent
+ */
+typedef struct asn1_node {
+   guint64 offset;      /* offset of the identifier octet */
+   guint64 length;      /* length of the contents */
+   guint32 tag;
+   guint32 parent;      /* enclosing element or ASN1_INDEX_NONE */
+   guint32 next;        /* following sibling or ASN1_INDEX_NONE */
+   guint8 hdr_len;
+   guint8 class;
+   guint8 constructed;
+   guint8 depth;
+} asn1_node_t;
+
+/*
+ * budgets of decoding one document, that is one top-level element;
+ * input exceeding one of them is rejected as soon as it does
+ *   - depth: nesting of constructed elements, at most
+ *     ASN1_INDEX_MAX_DEPTH
+ *   - elements: TLV elements indexed
+ *   - size: bytes of the element, known from its header before
+ *     any of the contents is looked at
+ *   - work: steps of matching the document against the schema,
+ *     the one part not bounded by the number of elements
+ * 0 leaves elements, size and work unlimited
+ */
+typedef struct asn1_limits {
+   guint depth;
+   guint32 elements;
+   guint64 size;
+   guint64 work;
+} asn1_limits_t;
+
+/* set by asn1_index_init() */
+#define ASN1_LIMITS_DEFAULT         { ASN1_INDEX_MAX_DEPTH, 0, 0, 0 }
+/* for untrusted input; enough for certificates and most CRLs */
+#define ASN1_LIMITS_STRICT          { 16, 256 * 1024, 4 * 1024 * 1024, \
+                                      4 * 1024 * 1024 }
+
+/* why decoding failed */
+enum {
+   ASN1_INDEX_OK = 0,
+   ASN1_INDEX_MALFORMED,
+   ASN1_INDEX_DEPTH,
+   ASN1_INDEX_ELEMENTS,
+   ASN1_INDEX_SIZE,
+   ASN1_INDEX_WORK,
+};
+
+/*
+ * flat structural index of a DER buffer built in one pass;
+ * the node array is reused when the index is rebuilt
+ */
+typedef struct asn1_index {
+   asn1_node_t *nodes;
+   guint32 len;
+   guint32 size;
+   asn1_limits_t limits;
+   /* schema steps spent on the current document */
+   guint64 work;
+   /* where and why the structure broke if building failed */
+   guint64 error_offset;
+   guint8 error;
+} asn1_index_t;
+
+/* navigation, ASN1_INDEX_NONE propagates through both */
+#define ASN1_INDEX_NODE(index, i)   (&(index)->nodes[i])
+#define ASN1_INDEX_NEXT(index, i) \
+   ((i) == ASN1_INDEX_NONE ? ASN1_INDEX_NONE : (index)->nodes[i].next)
+#define ASN1_INDEX_CHILD(index, i) \
+   ((i) != ASN1_INDEX_NONE && (index)->nodes[i].constructed && \
+    (index)->nodes[i].length ? (guint32)(i) + 1 : ASN1_INDEX_NONE)
+
+extern void asn1_index_init(asn1_index_t *index);
+extern void asn1_index_destroy(asn1_index_t *index);
+extern void asn1_index_set_limits(asn1_index_t *index,
+                                  const asn1_limits_t *limits);
+extern const gchar* asn1_index_strerror(asn1_index_t *index);
+extern int  asn1_limits_parse(const gchar *spec, asn1_limits_t *limits);
+extern int  asn1_index_range(asn1_index_t *index, cbuf_t *cbuf,
+                             guint64 offset, guint64 length);
+extern int  asn1_index_element(asn1_index_t *index, cbuf_t *cbuf,
+                               guint64 offset);
+extern int  asn1_index_tlv(asn1_index_t *index, guint32 i, asn1_tlv_t *tlv);
+extern guint32 asn1_index_find(asn1_index_t *index, guint64 offset,
+                               guint64 length);
+
+#endif   /* CERTALIZE_INDEX_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
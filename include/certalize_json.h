@@ -0,0 +1,82 @@
+/* certalize_json.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_JSON_H
+#define CERTALIZE_JSON_H
+
+#include <certalize.h>
+
+#define JSON_MAX_DEPTH              32
+#define JSON_DEFAULT_BUFSIZE        (1024 * 1024)
+
+/*
+ * streaming JSON writer
+ *   - emits directly into a caller provided buffer which is
+ *     flushed to the file descriptor when it runs full
+ *   - never allocates memory
+ */
+typedef struct json_writer {
+   guchar *buffer;
+   gsize size;
+   gsize pos;
+   gint fd;
+   guint depth;
+   /* per nesting level: has the container already a member */
+   guint8 member[JSON_MAX_DEPTH];
+   /* a key has been written and waits for its value */
+   guint8 key;
+   guint8 error;
+} json_writer_t;
+
+extern void json_init(json_writer_t *w, gint fd, guchar *buffer, gsize size);
+extern int  json_flush(json_writer_t *w);
+
+extern void json_object_begin(json_writer_t *w);
+extern void json_object_end(json_writer_t *w);
+extern void json_array_begin(json_writer_t *w);
+extern void json_array_end(json_writer_t *w);
+extern void json_key(json_writer_t *w, const gchar *key);
+
+extern void json_string(json_writer_t *w, const gchar *str, gssize len);
+extern void json_string_begin(json_writer_t *w);
+extern void json_string_append(json_writer_t *w, const gchar *str, gssize len);
+extern void json_string_end(json_writer_t *w);
+extern void json_hex(json_writer_t *w, const guchar *data, gsize len,
+                     gchar separator);
+extern void json_uint(json_writer_t *w, guint64 value);
+extern void json_int(json_writer_t *w, gint64 value);
+extern void json_bool(json_writer_t *w, gboolean value);
+extern void json_null(json_writer_t *w);
+extern void json_raw(json_writer_t *w, const gchar *str, gsize len);
+extern void json_newline(json_writer_t *w);
+
+/* convenience wrappers for "key": value members */
+#define json_member_string(w, k, s) \
+   do { json_key((w), (k)); json_string((w), (s), -1); } while (0)
+#define json_member_uint(w, k, v) \
+   do { json_key((w), (k)); json_uint((w), (v)); } while (0)
+#define json_member_int(w, k, v) \
+   do { json_key((w), (k)); json_int((w), (v)); } while (0)
+#define json_member_bool(w, k, v) \
+   do { json_key((w), (k)); json_bool((w), (v)); } while (0)
+
+#endif   /* CERTALIZE_JSON_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,98 @@
+/* certalize_keycheck.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_KEYCHECK_H
+#define CERTALIZE_KEYCHECK_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_x509.h>
+
+/*
+ * weak public keys of a corpus
+ *   - keycheck_key() looks at one key on its own
+ *   - keycheck_add() collects the RSA moduli, deduplicated by their
+ *     hash, so a modulus shared by several certificates is found
+ *     without comparing pairs
+ *   - keycheck_batch_gcd() finds the distinct moduli sharing a prime
+ *     with any other by the batch GCD of a product tree and a
+ *     remainder tree, computed level by level in parallel; it needs
+ *     GMP (HAVE_GMP)
+ */
+
+/* smaller keys are reported as short */
+#define KEYCHECK_RSA_MIN_BITS       2048
+#define KEYCHECK_DSA_MIN_BITS       2048
+#define KEYCHECK_EC_MIN_BITS        224
+
+/* RSA moduli are divided by the odd primes below */
+#define KEYCHECK_TRIAL_PRIMES       256
+
+/* weaknesses of a single key */
+enum {
+   KEYCHECK_SHORT          = 0x01,
+   KEYCHECK_EVEN_MODULUS   = 0x02,
+   KEYCHECK_SMALL_FACTOR   = 0x04,
+   KEYCHECK_BAD_EXPONENT   = 0x08,  /* 1 or even */
+   KEYCHECK_NEGATIVE       = 0x10,  /* modulus encoded as negative */
+   KEYCHECK_CURVE          = 0x20,  /* explicit or unknown curve */
+};
+#define KEYCHECK_PROBLEMS           6
+
+/* a distinct RSA modulus and the certificates having it */
+typedef struct keycheck_modulus {
+   guint64 hash;
+   /* magnitude, big-endian without leading zero octets */
+   guchar *data;
+   gsize len;
+   /* references of the caller in the order added */
+   GPtrArray *refs;
+   /* another modulus of the same hash */
+   struct keycheck_modulus *next;
+   /*
+    * set by keycheck_batch_gcd(): bits of the factor shared with
+    * others and the group of moduli sharing factors, 0 for none
+    */
+   guint factor_bits;
+   guint group;
+} keycheck_modulus_t;
+
+typedef struct keycheck {
+   /* hash -> keycheck_modulus_t */
+   GHashTable *table;
+   /* distinct moduli in the order added */
+   GPtrArray *moduli;
+   guint64 keys;
+   /* number of groups of moduli sharing factors */
+   guint groups;
+} keycheck_t;
+
+extern void  keycheck_init(keycheck_t *kc);
+extern void  keycheck_destroy(keycheck_t *kc);
+extern guint keycheck_key(cbuf_t *cbuf, x509_key_t *key);
+extern const gchar* keycheck_problem_name(guint problem);
+extern void  keycheck_add(keycheck_t *kc, cbuf_t *cbuf, x509_key_t *key,
+                          gpointer ref);
+extern void  keycheck_merge(keycheck_t *kc, keycheck_t *other);
+extern int   keycheck_batch_gcd(keycheck_t *kc);
+
+#endif   /* CERTALIZE_KEYCHECK_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
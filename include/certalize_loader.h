@@ -0,0 +1,50 @@
+/* certalize_loader.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_LOADER_H
+#define CERTALIZE_LOADER_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_stream.h>
+
+/* files in flight at once */
+#define LOADER_QUEUE_DEPTH          64
+/* larger files are mapped by cbuf_map_raw() */
+#define LOADER_SLOT_SIZE            (16 * 1024)
+
+/*
+ * reads a list of files ahead of the consumer; with io_uring the
+ * open, statx, read and close of many files are in flight at once
+ */
+typedef struct loader loader_t;
+
+extern loader_t* loader_new(gchar **files, guint count);
+extern int       loader_next(loader_t *loader, const gchar **filename,
+                             cbuf_t **cbuf);
+extern void      loader_free(loader_t *loader);
+extern void      loader_expand(GPtrArray *inputs, const gchar *name);
+extern int       loader_stream(const gchar *filename, cstream_t *stream);
+extern int       loader_stream_map(const gchar *filename, cstream_t *stream,
+                                   GMappedFile **mapped);
+
+#endif   /* CERTALIZE_LOADER_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
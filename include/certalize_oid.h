@@ -0,0 +1,40 @@
+/* certalize_oid.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_OID_H
+#define CERTALIZE_OID_H
+
+#include <certalize.h>
+
+typedef struct oid_entry {
+   /* DER encoded contents of the OBJECT IDENTIFIER */
+   const gchar *der;
+   gsize der_len;
+   /* short name used in distinguished names (may be NULL) */
+   const gchar *short_name;
+   const gchar *name;
+   const gchar *dotted;
+} oid_entry_t;
+
+extern const oid_entry_t* oid_lookup(const guchar *der, gsize len);
+
+#endif   /* CERTALIZE_OID_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,83 @@
+/* certalize_parser.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_PARSER_H
+#define CERTALIZE_PARSER_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_index.h>
+#include <certalize_schema.h>
+#include <certalize_stream.h>
+#include <certalize_x509.h>
+
+/* flags of a parser */
+#define PARSER_SCHEMA               0x01  /* name elements by the schema */
+
+typedef struct parser parser_t;
+
+/*
+ * called for every record split off by parser_parse_records once it
+ * has been parsed; res is the result of parser_parse for the record,
+ * which is only valid during the call
+ */
+typedef int (*parser_record_cb)(parser_t *parser, guint64 offset, int res,
+                                gpointer data);
+
+/*
+ * parse state of one document at a time
+ *   - the library keeps no state of its own, so any number of
+ *     parsers can be used from different threads at once; a single
+ *     parser must not be shared between threads
+ *   - the buffers are reused and only grow, a long-lived parser
+ *     stops allocating after the largest document
+ *   - the document is borrowed, not copied
+ *   - untrusted documents are bounded by setting limits on the
+ *     index with asn1_index_set_limits()
+ */
+struct parser {
+   guint flags;
+   cbuf_t cbuf;
+   asn1_index_t index;
+   /* schema notes of the indexed nodes */
+   asn1_schema_note_t *notes;
+   guint32 notes_size;
+   /* record splitting of parser_parse_records */
+   cstream_t stream;
+   parser_record_cb callback;
+   gpointer data;
+};
+
+extern void parser_init(parser_t *parser, guint flags);
+extern void parser_destroy(parser_t *parser);
+extern int  parser_parse(parser_t *parser, const guchar *der, gsize len);
+extern int  parser_parse_records(parser_t *parser, const guchar *data,
+                                 gsize len, parser_record_cb callback,
+                                 gpointer cb_data);
+extern int  parser_certificate(parser_t *parser, guint32 node,
+                               x509_cert_t *cert);
+extern const asn1_schema_document_t* parser_document(parser_t *parser,
+                                                     guint32 node);
+extern guint32 parser_find(parser_t *parser, guint64 offset, guint64 length);
+extern void parser_path(parser_t *parser, guint32 node, GString *path);
+
+#endif   /* CERTALIZE_PARSER_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,45 @@
+/* certalize_pcap.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_PCAP_H
+#define CERTALIZE_PCAP_H
+
+#include <certalize.h>
+
+/* only the start of each TCP stream carries the handshake */
+#define PCAP_MAX_STREAM_BYTES       (1024 * 1024)
+#define PCAP_MAX_INTERFACES         64
+
+/*
+ * called for every certificate found in a TLS Certificate handshake
+ * message; flows are processed in parallel, but the calls are made
+ * from the calling thread, flow by flow in order of first packet
+ */
+typedef int (*pcap_cert_cb)(const guchar *der, gsize len,
+                            const gchar *flow, gpointer data);
+
+extern gboolean pcap_probe(const gchar *filename);
+extern gboolean pcap_probe_data(const guchar *data, gsize len);
+extern int pcap_extract(const gchar *filename, pcap_cert_cb callback,
+                        gpointer data);
+
+#endif   /* CERTALIZE_PCAP_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,109 @@
+/* certalize_schema.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_SCHEMA_H
+#define CERTALIZE_SCHEMA_H
+
+#include <certalize.h>
+#include <certalize_index.h>
+/* ASN1_SCHEMA_TYPE_* of the named types, generated with the tables */
+#include <certalize_schema_types.h>
+
+#define ASN1_SCHEMA_NONE            G_MAXUINT16
+
+/*
+ * decode tables generated by asn1gen from the modules in asn1/
+ *
+ *   - a type is matched against one TLV element; the tag of
+ *     universal and tagged types is resolved at build time
+ *   - SEQUENCE, SET and CHOICE list their components as a run of
+ *     "count" fields starting at "first"; SEQUENCE OF, SET OF and
+ *     TAGGED refer to their element type by "first"
+ */
+enum {
+   ASN1_SCHEMA_PRIMITIVE = 0,
+   ASN1_SCHEMA_ANY,
+   ASN1_SCHEMA_SEQUENCE,
+   ASN1_SCHEMA_SET,
+   ASN1_SCHEMA_SEQUENCE_OF,
+   ASN1_SCHEMA_SET_OF,
+   ASN1_SCHEMA_CHOICE,
+   ASN1_SCHEMA_TAGGED,
+};
+
+/* tagging of ASN1_SCHEMA_TAGGED */
+enum {
+   ASN1_SCHEMA_EXPLICIT = 0,
+   ASN1_SCHEMA_IMPLICIT,
+};
+
+/* flags of a component */
+#define ASN1_SCHEMA_OPTIONAL        0x01
+#define ASN1_SCHEMA_DEFAULT         0x02
+
+typedef struct asn1_schema_type {
+   /* NULL for anonymous and builtin types */
+   const gchar *name;
+   guint8 kind;
+   guint8 tagging;
+   guint8 class;
+   guint32 tag;
+   guint16 first;
+   guint16 count;
+} asn1_schema_type_t;
+
+typedef struct asn1_schema_field {
+   const gchar *name;
+   guint16 type;
+   guint8 flags;
+} asn1_schema_field_t;
+
+/*
+ * what a node of the index has been matched to; the component is
+ * ASN1_SCHEMA_NONE for the root and elements of SEQUENCE OF / SET OF
+ */
+typedef struct asn1_schema_note {
+   guint16 type;
+   guint16 field;
+} asn1_schema_note_t;
+
+/* documents recognized at the top level */
+typedef struct asn1_schema_document {
+   guint16 type;
+   const gchar *title;
+} asn1_schema_document_t;
+
+extern const asn1_schema_type_t  asn1_schema_types[];
+extern const asn1_schema_field_t asn1_schema_fields[];
+extern const guint asn1_schema_ntypes;
+
+extern void asn1_schema_notes_init(asn1_schema_note_t *notes, guint32 len);
+extern int  asn1_schema_decode(asn1_index_t *index, guint32 node,
+                               guint16 type, asn1_schema_note_t *notes);
+extern guint16 asn1_schema_find(const gchar *name);
+extern const asn1_schema_document_t* asn1_schema_recognize(asn1_index_t *index,
+                                     guint32 node, asn1_schema_note_t *notes);
+extern const asn1_schema_document_t* asn1_schema_document(guint16 type);
+extern void asn1_schema_path(asn1_index_t *index, guint32 node,
+                             asn1_schema_note_t *notes, GString *path);
+
+#endif   /* CERTALIZE_SCHEMA_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
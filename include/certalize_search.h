@@ -0,0 +1,58 @@
+/* certalize_search.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_SEARCH_H
+#define CERTALIZE_SEARCH_H
+
+#include <certalize.h>
+
+/* longest pattern accepted */
+#define SEARCH_MAX_PATTERN          1024
+
+/*
+ * set of byte patterns searched in one pass
+ *   - a single pattern is searched with a vectorized memmem
+ *   - several patterns are compiled into an Aho-Corasick automaton
+ *     with all transitions resolved, one table lookup per byte
+ *   - once compiled, a search may be scanned from several threads
+ */
+typedef struct search search_t;
+
+/*
+ * called for every match, overlapping ones included, in order of
+ * their end; returning FALSE stops the scan
+ */
+typedef gboolean (*search_hit_cb)(guint pattern, guint64 offset, gsize len,
+                                  gpointer data);
+
+extern search_t* search_new(void);
+extern void      search_free(search_t *search);
+extern int       search_add(search_t *search, const guchar *bytes, gsize len,
+                            const gchar *expr);
+extern int       search_add_expr(search_t *search, const gchar *expr);
+extern void      search_compile(search_t *search);
+extern guint     search_count(search_t *search);
+extern const gchar* search_expr(search_t *search, guint pattern);
+extern guint64   search_scan(search_t *search, const guchar *data, gsize len,
+                             search_hit_cb cb, gpointer cb_data);
+
+#endif   /* CERTALIZE_SEARCH_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
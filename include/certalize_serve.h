@@ -0,0 +1,76 @@
+/* certalize_serve.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_SERVE_H
+#define CERTALIZE_SERVE_H
+
+#include <certalize.h>
+#include <certalize_index.h>
+
+/*
+ * framed protocol spoken on the socket, integers in network byte order
+ *   request:   length (4 bytes) | opcode (1 byte) | payload
+ *   response:  length (4 bytes) | status (1 byte) | body
+ * the length counts the bytes following it; a connection carries
+ * any number of requests, each answered in order
+ */
+#define SERVE_HEADER_LEN            4
+#define SERVE_MAX_FRAME             (16 * 1024 * 1024)
+
+/* request opcodes, the payload holds DER or PEM records */
+enum {
+   /* JSON array of the certificates as printed by --output */
+   SERVE_OP_JSON = 'J',
+   /* the same with the decoded fields only */
+   SERVE_OP_FIELDS = 'F',
+   /* JSON object of counters and latency histograms, no payload */
+   SERVE_OP_STATS = 'S',
+};
+
+enum {
+   SERVE_STATUS_OK = 0,
+   /* the body holds a message */
+   SERVE_STATUS_ERROR,
+};
+
+/*
+ * connections served at once; further ones are answered with an error
+ * and closed rather than queued behind idle ones
+ */
+#define SERVE_MAX_CONNECTIONS       64
+/* answers growing beyond are refused with an error */
+#define SERVE_MAX_ANSWER            (4 * SERVE_MAX_FRAME)
+/* answers kept for repeated payloads and the bytes they may take */
+#define SERVE_CACHE_ENTRIES         4096
+#define SERVE_CACHE_BYTES           (64 * 1024 * 1024)
+/* larger answers are not cached, a few of them would flush the cache */
+#define SERVE_CACHE_MAX_ANSWER      (1024 * 1024)
+/* request buffers grown beyond are released after the request */
+#define SERVE_KEEP_REQUEST          (1024 * 1024)
+/* power of two buckets of microseconds */
+#define SERVE_HIST_BUCKETS          24
+/* seconds an idle connection keeps its worker */
+#define SERVE_IDLE_TIMEOUT          30
+
+extern int serve_run(const gchar *path, const asn1_limits_t *limits);
+
+#endif   /* CERTALIZE_SERVE_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
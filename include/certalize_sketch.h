@@ -0,0 +1,95 @@
+/* certalize_sketch.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_SKETCH_H
+#define CERTALIZE_SKETCH_H
+
+#include <certalize.h>
+
+/*
+ * summaries of fixed size which are filled independently, e.g. by
+ * one thread each, and merged into one at the end
+ */
+
+/* HyperLogLog with 2^14 registers, about 0.8% standard error */
+#define HLL_PRECISION               14
+#define HLL_REGISTERS               (1 << HLL_PRECISION)
+
+typedef struct hll {
+   guint8 registers[HLL_REGISTERS];
+} hll_t;
+
+/*
+ * quantiles of positive values within 1% of the true value; the
+ * buckets grow geometrically and cover up to about 2^45
+ */
+#define QSKETCH_ACCURACY            0.01
+#define QSKETCH_BUCKETS             1600
+
+typedef struct qsketch {
+   guint64 buckets[QSKETCH_BUCKETS];
+   /* values of 0, and below 0 */
+   guint64 zero;
+   guint64 negative;
+   guint64 count;
+   gint64 min;
+   gint64 max;
+} qsketch_t;
+
+/*
+ * most frequent strings (Misra-Gries): any string occurring more
+ * often than count / (k + 1) times is kept, with a count which is
+ * too low by at most that much
+ */
+typedef struct topk {
+   guint k;
+   /* string to guint64 count */
+   GHashTable *counts;
+   /* strings added, including those not kept */
+   guint64 total;
+} topk_t;
+
+typedef struct topk_entry {
+   const gchar *key;
+   guint64 count;
+} topk_entry_t;
+
+extern guint64 sketch_hash(const guchar *data, gsize len);
+
+extern void    hll_init(hll_t *hll);
+extern void    hll_add(hll_t *hll, guint64 hash);
+extern void    hll_merge(hll_t *hll, const hll_t *other);
+extern guint64 hll_count(const hll_t *hll);
+
+extern void    qsketch_init(qsketch_t *q);
+extern void    qsketch_add(qsketch_t *q, gint64 value);
+extern void    qsketch_merge(qsketch_t *q, const qsketch_t *other);
+extern gint64  qsketch_quantile(const qsketch_t *q, gdouble rank);
+
+extern void    topk_init(topk_t *t, guint k);
+extern void    topk_destroy(topk_t *t);
+extern void    topk_add(topk_t *t, const gchar *key);
+extern void    topk_merge(topk_t *t, const topk_t *other);
+extern GArray* topk_sorted(const topk_t *t);
+extern guint64 topk_uncounted(const topk_t *t);
+
+#endif   /* CERTALIZE_SKETCH_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,40 @@
+/* certalize_stats.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_STATS_H
+#define CERTALIZE_STATS_H
+
+#include <certalize.h>
+#include <certalize_filter.h>
+
+/* issuers reported as most frequent */
+#define STATS_TOP_ISSUERS           100
+/*
+ * distinct signature algorithms, key types and extensions counted;
+ * beyond, the rarest are dropped and reported as uncounted
+ */
+#define STATS_TOP_COUNTS            256
+
+extern int stats_run(GPtrArray *files, filter_t *filter,
+                     const asn1_limits_t *limits);
+
+#endif   /* CERTALIZE_STATS_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
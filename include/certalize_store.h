@@ -0,0 +1,143 @@
+/* certalize_store.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_STORE_H
+#define CERTALIZE_STORE_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_x509.h>
+
+/*
+ * column store of the fields extracted from a corpus, one row per
+ * certificate; the file is mapped and only the columns asked for
+ * are decompressed
+ *
+ * layout, all numbers little endian:
+ *   header      "CERTCOL\0", guint32 version, guint32 columns,
+ *               guint64 rows
+ *   directory   per column: guint32 id, guint32 codec, guint64 offset,
+ *               guint64 length (stored), guint64 size (decompressed),
+ *               guint64 count (values)
+ *   data        the columns, each starting 8 byte aligned
+ *
+ * a column of fixed width is an array of count values; a column of
+ * variable width starts with count + 1 guint64 offsets into the bytes
+ * which follow them
+ */
+#define STORE_MAGIC                 "CERTCOL"
+#define STORE_MAGIC_LEN             8
+#define STORE_VERSION               1
+#define STORE_HEADER_SIZE           24
+#define STORE_DIRENT_SIZE           40
+
+/* columns; the file and name columns are indices into dictionaries */
+enum {
+   STORE_COL_FILE = 0,              /* guint32, into STORE_COL_FILES */
+   STORE_COL_OFFSET,                /* guint64, of the record in the file */
+   STORE_COL_SERIAL,                /* bytes, content of the INTEGER */
+   STORE_COL_ISSUER,                /* guint32, into STORE_COL_NAMES */
+   STORE_COL_SUBJECT,               /* guint32, into STORE_COL_NAMES */
+   STORE_COL_NOT_BEFORE,            /* gint64, seconds since the epoch */
+   STORE_COL_NOT_AFTER,             /* gint64 */
+   STORE_COL_KEY_TYPE,              /* guint8, X509_KEY_* */
+   STORE_COL_KEY_BITS,              /* guint32 */
+   STORE_COL_SAN,                   /* bytes, "DNS:name\0IP:addr\0..." */
+   STORE_COL_FINGERPRINT,           /* 32 bytes, SHA-256 of the DER */
+   STORE_COL_NAMES,                 /* bytes, names as UTF-8 strings */
+   STORE_COL_FILES,                 /* bytes, file names */
+   STORE_COLUMNS
+};
+
+#define STORE_MASK(col)             (1U << (col))
+#define STORE_MASK_ALL              (STORE_MASK(STORE_COLUMNS) - 1)
+
+/* compression of a column */
+enum {
+   STORE_CODEC_NONE = 0,
+   STORE_CODEC_GZIP,
+   STORE_CODEC_ZSTD,
+};
+
+/* columns smaller than this are not compressed */
+#define STORE_COMPRESS_MIN          64
+
+typedef struct store_column {
+   guint64 count;
+   /* the values, or the offsets of a column of variable width */
+   const guchar *data;
+   gsize size;
+   /* decompressed copy, NULL while data points into the map */
+   guchar *owned;
+   gboolean loaded;
+} store_column_t;
+
+typedef struct store {
+   GMappedFile *map;
+   guint64 rows;
+   store_column_t columns[STORE_COLUMNS];
+   /* directory entries by column, NULL if absent */
+   const guchar *entries[STORE_COLUMNS];
+} store_t;
+
+/* fixed width values, valid after store_load() of the column */
+#define STORE_U8(store, col, row) \
+   ((store)->columns[col].data[row])
+#define STORE_U32(store, col, row) \
+   GUINT32_FROM_LE(((const guint32*)(store)->columns[col].data)[row])
+#define STORE_U64(store, col, row) \
+   GUINT64_FROM_LE(((const guint64*)(store)->columns[col].data)[row])
+#define STORE_I64(store, col, row) \
+   ((gint64)STORE_U64(store, col, row))
+
+/*
+ * collects the rows of a store in memory; writers filled in parallel
+ * are appended to one another with store_writer_merge()
+ */
+typedef struct store_writer {
+   guint64 rows;
+   GByteArray *data[STORE_COLUMNS];
+   /* offsets of the columns of variable width, NULL for the others */
+   GArray *offsets[STORE_COLUMNS];
+   /* string to dictionary index + 1 */
+   GHashTable *names;
+   GHashTable *files;
+   GChecksum *digest;
+} store_writer_t;
+
+extern void     store_writer_init(store_writer_t *w);
+extern void     store_writer_destroy(store_writer_t *w);
+extern int      store_writer_add(store_writer_t *w, cbuf_t *cbuf,
+                                 x509_cert_t *cert, const gchar *file,
+                                 guint64 offset);
+extern void     store_writer_merge(store_writer_t *w, store_writer_t *other);
+extern int      store_writer_save(store_writer_t *w, const gchar *filename);
+
+extern gboolean store_probe(const guchar *data, gsize len);
+extern int      store_open(store_t *store, const gchar *filename);
+extern int      store_load(store_t *store, guint32 mask);
+extern void     store_close(store_t *store);
+extern const guchar* store_bytes(store_t *store, guint col, guint64 row,
+                                 gsize *len);
+extern const gchar*  store_column_name(guint col);
+
+#endif   /* CERTALIZE_STORE_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,86 @@
+/* certalize_stream.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_STREAM_H
+#define CERTALIZE_STREAM_H
+
+#include <certalize.h>
+#include <certalize_asn1.h>
+
+#define CSTREAM_READ_SIZE           (64 * 1024)
+#define CSTREAM_MAX_RECORD          (16 * 1024 * 1024)
+#define CSTREAM_MAX_LINE            (64 * 1024)
+
+enum {
+   CSTREAM_DETECT = 0,
+   CSTREAM_DER,
+   CSTREAM_PEM,
+};
+
+/*
+ * called for every complete DER record found in the stream;
+ * offset is the position of the record (DER) or of its PEM
+ * header line within the stream
+ */
+typedef int (*cstream_record_cb)(const guchar *der, gsize len,
+                                 guint64 offset, gpointer data);
+
+/*
+ * splits a never-ending stream of concatenated DER and PEM records
+ */
+typedef struct cstream {
+   guint mode;
+   guint64 offset;
+   guint64 record_offset;
+   /*
+    * origin of the record passed to the callback: CSTREAM_DER if it
+    * is the stream's own bytes at record_offset, CSTREAM_PEM if it
+    * has been decoded from a PEM block
+    */
+   guint record_mode;
+   /* DER framing */
+   asn1_stream_t asn1;
+   GByteArray *record;
+   /* a record may start, no text has been seen since the last one */
+   gboolean boundary;
+   /* a SEQUENCE header taken before deciding on DER */
+   guchar head[6];
+   guint head_len;
+   /* PEM lines */
+   GString *line;
+   guint64 line_offset;
+   GString *base64;
+   guint pem_state;
+   cstream_record_cb callback;
+   gpointer data;
+} cstream_t;
+
+extern void cstream_init(cstream_t *stream, cstream_record_cb callback,
+                         gpointer data);
+extern void cstream_reset(cstream_t *stream);
+extern void cstream_destroy(cstream_t *stream);
+extern int  cstream_feed(cstream_t *stream, const guchar *buf, gsize len);
+extern int  cstream_finish(cstream_t *stream);
+extern int  cstream_read_fd(cstream_t *stream, gint fd,
+                            void (*idle)(gpointer), gpointer data);
+
+#endif   /* CERTALIZE_STREAM_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
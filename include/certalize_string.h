@@ -0,0 +1,51 @@
+/* certalize_string.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_STRING_H
+#define CERTALIZE_STRING_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_asn1.h>
+
+/* flags of a decoded string */
+#define ASN1_STRING_BORROWED        0x01  /* str points into the cbuf */
+#define ASN1_STRING_TRUNCATED       0x02  /* did not fit into the buffer */
+#define ASN1_STRING_CHARSET         0x04  /* characters the type forbids */
+
+/*
+ * a character string as UTF-8, not NUL terminated
+ *   - strings which are UTF-8 already, above all the ASCII of
+ *     PrintableString and IA5String, are not copied
+ *   - others are converted into the buffer given to the decoder
+ */
+typedef struct asn1_string {
+   const gchar *str;
+   gsize len;
+   guint flags;
+} asn1_string_t;
+
+extern gboolean asn1_is_string(asn1_tlv_t *tlv);
+extern int asn1_decode_string(cbuf_t *cbuf, asn1_tlv_t *tlv, gchar *buf,
+                              gsize size, asn1_string_t *str);
+
+#endif   /* CERTALIZE_STRING_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -20,6 +20,10 @@
 #define CERTALIZE_UI_H
 
 #include <gtk/gtk.h>
+#include <certalize_buf.h>
+
+/* prefix of the UI files compiled in from Certalize.gresource.xml */
+#define UI_RESOURCE_PATH "/org/gnome/Certalize/ui"
 
 typedef struct gtk_accel_map {
    /* detailed action name */
@@ -31,15 +35,70 @@ typedef struct gtk_accel_map {
 } ui_accel_map_t;
 
 typedef struct bytepointer {
-   guint32 offset;
-   guint32 length;
+   guint64 offset;
+   guint64 length;
 } bytepointer_t;
 
+/* first match of a search at or after "from" */
+typedef struct searchmatch {
+   guint64 from;
+   bytepointer_t match;
+} searchmatch_t;
+
 typedef struct gridcoordinates {
    guint top;
    guint left;
 } gridcoord_t;
 
+/*
+ * decoded state of the documents in background tabs is kept up to
+ * this many MiB (-m); the least recently shown are released first
+ * and rebuilt when their tab is shown again
+ */
+#define UI_MEMORY_BUDGET            256
+
+/* estimated cost of the two labels showing a byte in the byte view */
+#define UI_HEXVIEW_BYTE_COST        2048
+
+/* columns of a page of differences, all G_TYPE_STRING */
+enum {
+   UI_DIFF_COL_KIND = 0,
+   UI_DIFF_COL_PATH,
+   UI_DIFF_COL_OLD_RANGE,
+   UI_DIFF_COL_OLD_VALUE,
+   UI_DIFF_COL_NEW_RANGE,
+   UI_DIFF_COL_NEW_VALUE,
+   UI_DIFF_N_COLUMNS,
+};
+
+/* an open document, the page of the notebook showing it */
+typedef struct ui_tab {
+   gchar *filename;
+   /* the file, kept while the tab is open */
+   cbuf_t *cbuf;
+   GtkWidget *page;
+   GtkWidget *detailsview;
+   GtkWidget *bytesbox;
+   /* NULL while released, rebuilt when the tab is shown */
+   GtkTreeModel *model;
+   GtkWidget *bytespane;
+   GObject *offsetgrid;
+   GObject *bytesgrid;
+   GObject *asciigrid;
+   GObject *bytessearch;
+   /* labels of the bytes found last */
+   GPtrArray *bytesmatched;
+   /* the next search continues after this offset */
+   guint64 searchoffset;
+   /* expanded rows and cursor saved when the model is released */
+   GPtrArray *expanded;
+   gchar *cursor;
+   /* estimated bytes of the model and the byte view */
+   gsize cost;
+   /* in the LRU of the tabs, most recently shown first */
+   GList link;
+} ui_tab_t;
+
 /* prototypes */
 extern int ui_start(void);
 
@@ -0,0 +1,47 @@
+/* certalize_ui_model.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_UI_MODEL_H
+#define CERTALIZE_UI_MODEL_H
+
+#include <gtk/gtk.h>
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_index.h>
+
+/* columns of the node model */
+enum {
+   UI_NODE_MODEL_COL_LABEL = 0,     /* G_TYPE_STRING, formatted on demand */
+   UI_NODE_MODEL_COL_OFFSET,        /* G_TYPE_UINT64 */
+   UI_NODE_MODEL_COL_LENGTH,        /* G_TYPE_UINT64, header and contents */
+   UI_NODE_MODEL_N_COLUMNS,
+};
+
+#define UI_TYPE_NODE_MODEL (ui_node_model_get_type())
+G_DECLARE_FINAL_TYPE(UiNodeModel, ui_node_model, UI, NODE_MODEL, GObject)
+
+extern UiNodeModel* ui_node_model_new(cbuf_t *cbuf);
+extern GtkTreePath* ui_node_model_find(UiNodeModel *m, guint64 offset,
+                                       guint64 length);
+extern gsize        ui_node_model_get_size(UiNodeModel *m);
+
+#endif   /* CERTALIZE_UI_MODEL_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,54 @@
+/* certalize_watch.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_WATCH_H
+#define CERTALIZE_WATCH_H
+
+#include <certalize.h>
+#include <certalize_filter.h>
+
+/*
+ * keeps an index of the certificates in directories and writes one
+ * JSON object per line to stdout for every change
+ *   {"event":"added", "file", "offset", "fingerprint", "serial",
+ *    "subject", "issuer", "not_after", "issuer_fingerprint", "expired"}
+ *   {"event":"removed", "file", "offset", "fingerprint"}
+ *   {"event":"linked", "fingerprint", "issuer_fingerprint"}
+ *      the issuer of an indexed certificate appeared or went away,
+ *      "issuer_fingerprint" is null if none is left in the index
+ *   {"event":"expired", "file", "offset", "fingerprint"}
+ *   {"event":"error", "file", "offset", "error"}
+ *   {"event":"ready", "files", "certificates"}
+ *      the directories have been indexed, changes follow
+ *
+ * files rewritten or moved into a directory are parsed again, only
+ * the certificates which differ are reported; files whose name
+ * begins with a dot are ignored
+ */
+
+/* bytes of inotify events read at once */
+#define WATCH_EVENT_BUFSIZE         (64 * 1024)
+
+extern int watch_run(GPtrArray *dirs, filter_t *filter,
+                     const asn1_limits_t *limits);
+
+#endif   /* CERTALIZE_WATCH_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,97 @@
+/* certalize_x509.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_X509_H
+#define CERTALIZE_X509_H
+
+#include <certalize.h>
+#include <certalize_buf.h>
+#include <certalize_asn1.h>
+#include <certalize_index.h>
+
+#define X509_NAME_MAXLEN            1024
+
+/*
+ * the fields of a certificate as references into the cbuf
+ *   - elements which are not present have a length of 0
+ *     and an offset of 0
+ */
+typedef struct x509_cert {
+   asn1_tlv_t certificate;
+   asn1_tlv_t tbs;
+   guint version;
+   asn1_tlv_t serial;
+   asn1_tlv_t signature;
+   asn1_tlv_t issuer;
+   asn1_tlv_t validity;
+   asn1_tlv_t not_before;
+   asn1_tlv_t not_after;
+   gint64 not_before_time;
+   gint64 not_after_time;
+   asn1_tlv_t subject;
+   asn1_tlv_t spki;
+   asn1_tlv_t spki_algorithm;
+   asn1_tlv_t spki_key;
+   asn1_tlv_t extensions;
+   asn1_tlv_t signature_algorithm;
+   asn1_tlv_t signature_value;
+} x509_cert_t;
+
+/* types of subject public keys */
+enum {
+   X509_KEY_UNKNOWN = 0,
+   X509_KEY_RSA,
+   X509_KEY_DSA,
+   X509_KEY_EC,
+   X509_KEY_ED25519,
+   X509_KEY_ED448,
+};
+
+/*
+ * the subject public key, as references into the cbuf
+ *   - bits is the size of the RSA modulus, of the DSA prime or of
+ *     the EC field, 0 if unknown
+ *   - modulus and exponent are those of an RSA key, curve the OID
+ *     of the named curve of an EC key
+ */
+typedef struct x509_key {
+   guint type;
+   guint bits;
+   asn1_tlv_t modulus;
+   asn1_tlv_t exponent;
+   asn1_tlv_t curve;
+} x509_key_t;
+
+extern int x509_parse(cbuf_t *cbuf, guint64 offset, x509_cert_t *cert);
+extern int x509_parse_index(cbuf_t *cbuf, asn1_index_t *index, guint32 node,
+                            x509_cert_t *cert);
+extern int x509_public_key(cbuf_t *cbuf, x509_cert_t *cert, x509_key_t *key);
+extern const gchar* x509_key_type_name(guint type);
+extern void x509_subject_alt_names(cbuf_t *cbuf, x509_cert_t *cert,
+                                   GByteArray *out);
+extern gsize x509_name_to_string(cbuf_t *cbuf, asn1_tlv_t *name,
+                                 gchar *buf, gsize size);
+extern const gchar* x509_algorithm_name(cbuf_t *cbuf, asn1_tlv_t *algid,
+                                        gchar *buf, gsize size);
+extern gsize x509_time_to_string(gint64 time, gchar *buf, gsize size);
+
+#endif   /* CERTALIZE_X509_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -9,6 +9,10 @@
 #cmakedefine HAVE_CTYPE_H
 #cmakedefine HAVE_INTTYPES_H
 #cmakedefine HAVE_GETOPT_H
+#cmakedefine HAVE_IO_URING
+#cmakedefine HAVE_ZLIB
+#cmakedefine HAVE_ZSTD
+#cmakedefine HAVE_GMP
 
 #cmakedefine INSTALL_PREFIX         "@INSTALL_PREFIX@"
 #cmakedefine INSTALL_SYSCONFDIR     "@INSTALL_SYSCONFDIR@"
@@ -0,0 +1,214 @@
+/* arena.c - per-document bump allocator
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_arena.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* prototypes */
+static arena_chunk_t* arena_chunk_new(gsize size);
+
+#define ARENA_ROUNDUP(x) (((x) + ARENA_ALIGN - 1) & ~((gsize)ARENA_ALIGN - 1))
+#define ARENA_CHUNK_HDR  ARENA_ROUNDUP(sizeof(arena_chunk_t))
+#define ARENA_CHUNK_DATA(c) ((guchar*)(c) + ARENA_CHUNK_HDR)
+
+
+/*************/
+
+/*
+ * create a new, empty arena
+ * chunk_size of 0 selects the default chunk size
+ */
+arena_t* arena_new(gsize chunk_size)
+{
+   arena_t *arena;
+
+   arena = g_malloc0(sizeof(arena_t));
+   arena->chunk_size = chunk_size ? ARENA_ROUNDUP(chunk_size)
+                                  : ARENA_DEFAULT_CHUNK_SIZE;
+
+   return arena;
+}
+
+/*
+ * release all chunks and run all cleanup handlers in reverse order
+ * of registration
+ */
+void arena_free(arena_t *arena)
+{
+   arena_chunk_t *chunk, *next;
+   arena_cleanup_t *cleanup;
+
+   if (arena == NULL)
+      return;
+
+   DEBUG_MSG("arena_free: releasing %lu bytes", arena->allocated);
+
+   /* cleanup records live in the chunks themselves */
+   for (cleanup = arena->cleanups; cleanup; cleanup = cleanup->next)
+      cleanup->destroy(cleanup->data);
+
+   for (chunk = arena->chunks; chunk; chunk = next) {
+      next = chunk->next;
+      g_free(chunk);
+   }
+
+   g_free(arena);
+}
+
+/*
+ * allocate size bytes aligned to ARENA_ALIGN
+ * memory is not initialized and only released by arena_free()
+ */
+gpointer arena_alloc(arena_t *arena, gsize size)
+{
+   arena_chunk_t *chunk;
+   gpointer ptr;
+
+   size = ARENA_ROUNDUP(size ? size : 1);
+   chunk = arena->chunks;
+
+   if (chunk == NULL || chunk->size - chunk->used < size) {
+
+      if (size > arena->chunk_size / 4) {
+         /*
+          * large allocations get a dedicated chunk which is linked
+          * behind the current one so its free space is not wasted
+          */
+         chunk = arena_chunk_new(size);
+         chunk->used = size;
+         if (arena->chunks) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+         }
+         else {
+            arena->chunks = chunk;
+         }
+         arena->allocated += size;
+         return ARENA_CHUNK_DATA(chunk);
+      }
+
+      chunk = arena_chunk_new(arena->chunk_size);
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+   }
+
+   ptr = ARENA_CHUNK_DATA(chunk) + chunk->used;
+   chunk->used += size;
+   arena->allocated += size;
+
+   return ptr;
+}
+
+/*
+ * same as arena_alloc() but zero-initializes the memory
+ */
+gpointer arena_alloc0(arena_t *arena, gsize size)
+{
+   gpointer ptr;
+
+   ptr = arena_alloc(arena, size);
+   memset(ptr, 0, size);
+
+   return ptr;
+}
+
+/*
+ * duplicates a NUL terminated string into the arena
+ */
+gchar* arena_strdup(arena_t *arena, const gchar *str)
+{
+   gchar *dup;
+   gsize len;
+
+   if (str == NULL)
+      return NULL;
+
+   len = strlen(str) + 1;
+   dup = arena_alloc(arena, len);
+   memcpy(dup, str, len);
+
+   return dup;
+}
+
+/*
+ * formats a string directly into the arena
+ */
+gchar* arena_strdup_printf(arena_t *arena, const gchar *format, ...)
+{
+   va_list ap;
+   gchar *str;
+   gint len;
+
+   va_start(ap, format);
+   len = g_vsnprintf(NULL, 0, format, ap);
+   va_end(ap);
+
+   if (len < 0)
+      return NULL;
+
+   str = arena_alloc(arena, len + 1);
+
+   va_start(ap, format);
+   g_vsnprintf(str, len + 1, format, ap);
+   va_end(ap);
+
+   return str;
+}
+
+/*
+ * hands over ownership of externally allocated memory to the arena;
+ * destroy is called with data when the arena is released
+ */
+gpointer arena_adopt(arena_t *arena, gpointer data, GDestroyNotify destroy)
+{
+   arena_cleanup_t *cleanup;
+
+   if (data == NULL || destroy == NULL)
+      return data;
+
+   cleanup = arena_alloc(arena, sizeof(arena_cleanup_t));
+   cleanup->data = data;
+   cleanup->destroy = destroy;
+   cleanup->next = arena->cleanups;
+   arena->cleanups = cleanup;
+
+   return data;
+}
+
+/*
+ * allocates a new chunk with a payload of at least size bytes
+ */
+static arena_chunk_t* arena_chunk_new(gsize size)
+{
+   arena_chunk_t *chunk;
+
+   chunk = g_malloc(ARENA_CHUNK_HDR + size);
+   chunk->next = NULL;
+   chunk->size = size;
+   chunk->used = 0;
+
+   return chunk;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -23,77 +23,617 @@
 
 /* globals    */
 
-/* prototypes */
+#define X ASN1_LENGTH_INVALID
+
+/* number of subsequent length octets by the first length octet */
+const guint8 asn1_length_octets[256] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   X, 1, 2, 3, 4, 5, 6, 7, 8, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+   X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+};
+
+#undef X
 
+/* names of the universal tags */
+static const gchar *asn1_universal_names[] = {
+   [ASN1_TAG_EOC]                = "EOC",
+   [ASN1_TAG_BOOLEAN]            = "BOOLEAN",
+   [ASN1_TAG_INTEGER]            = "INTEGER",
+   [ASN1_TAG_BITSTRING]          = "BIT STRING",
+   [ASN1_TAG_OCTETSTRING]        = "OCTET STRING",
+   [ASN1_TAG_NULL]               = "NULL",
+   [ASN1_TAG_OID]                = "OBJECT IDENTIFIER",
+   [ASN1_TAG_OBJECT_DESCRIPTOR]  = "ObjectDescriptor",
+   [ASN1_TAG_EXTERNAL]           = "EXTERNAL",
+   [ASN1_TAG_REAL]               = "REAL",
+   [ASN1_TAG_ENUMERATED]         = "ENUMERATED",
+   [ASN1_TAG_UTF8STRING]         = "UTF8String",
+   [ASN1_TAG_RELATIVE_OID]       = "RELATIVE-OID",
+   [ASN1_TAG_SEQUENCE]           = "SEQUENCE",
+   [ASN1_TAG_SET]                = "SET",
+   [ASN1_TAG_NUMERIC_STRING]     = "NumericString",
+   [ASN1_TAG_PRINTABLE_STRING]   = "PrintableString",
+   [ASN1_TAG_TG1_STRING]         = "T61String",
+   [ASN1_TAG_VIDEO_STRING]       = "VideotexString",
+   [ASN1_TAG_IA5_STRING]         = "IA5String",
+   [ASN1_TAG_UTC_TIME]           = "UTCTime",
+   [ASN1_TAG_GERNERALIZED_TIME]  = "GeneralizedTime",
+   [ASN1_TAG_GRAPHIC_STRING]     = "GraphicString",
+   [ASN1_TAG_VISIBLE_STRING]     = "VisibleString",
+   [ASN1_TAG_GENERAL_STRING]     = "GeneralString",
+   [ASN1_TAG_UNIVERSAL_STRING]   = "UniversalString",
+   [ASN1_TAG_BMP_STRING]         = "BMPString",
+};
+
+/* prototypes */
+static int asn1_stream_header_complete(asn1_stream_t *stream);
+static int asn1_stream_element_complete(asn1_stream_t *stream,
+                                        asn1_tlv_t *tlv);
 
 
 /*************/
 
 
+/*
+ * parses the ASN.1 header at the current offset of the cbuf
+ * returns the number of bytes of the header
+ */
 int asn1_parse_hdr(cbuf_t *cbuf, asn1_hdr_t *asn1)
 {
-   int offset = cbuf->offset;
-   guchar buf, *ptr, tmp;
+   return asn1_parse_hdr_at(cbuf, cbuf->offset, asn1);
+}
+
+/*
+ * parses the ASN.1 header at offset
+ * returns the number of bytes of the header or -E_INVALID
+ */
+int asn1_parse_hdr_at(cbuf_t *cbuf, guint64 start, asn1_hdr_t *asn1)
+{
+   const guchar *ptr;
+   asn1_tlv_t tlv;
+   int len;
 
    memset(asn1, 0, sizeof(asn1_hdr_t));
 
-   ptr = &buf;
+   if (start >= cbuf->length)
+      return -E_INVALID;
+
+   len = asn1_decode_header(cbuf->buffer + start, cbuf->length - start, &tlv);
+   if (len < 0)
+      return len;
+
+   asn1->class = tlv.class;
+   asn1->constructed = tlv.constructed ? (1<<5) : 0;
+   asn1->tag = tlv.tag;
+   asn1->length = tlv.length;
+   /* the first length octet follows the identifier octets */
+   ptr = cbuf->buffer + start + 1;
+   if ((ptr[-1] & 0x1f) == 0x1f)
+      while (*ptr++ & 0x80);
+   asn1->length_byte = *ptr;
+
+   return len;
+}
+
+/*
+ * reads the complete element at offset and makes sure its
+ * contents are within the buffer
+ */
+int asn1_read_tlv(cbuf_t *cbuf, guint64 offset, asn1_tlv_t *tlv)
+{
+   int len;
+
+   if (offset >= cbuf->length)
+      return -E_INVALID;
+
+   len = asn1_decode_header(cbuf->buffer + offset, cbuf->length - offset, tlv);
+   if (len < 0)
+      return len;
 
-   /* get 1st byte of ASN.1 header */
-   cbuf_get_bytes(cbuf, &ptr, offset++, 1);
+   if (tlv->length > cbuf->length - offset - len) {
+      DEBUG_MSG("asn1_read_tlv: element at %" G_GUINT64_FORMAT
+            " exceeds buffer", offset);
+      return -E_INVALID;
+   }
+
+   tlv->offset = offset;
 
-   asn1->class = buf >> 6; // first MSB's of ID are the CLASS
-   asn1->constructed = (buf & (1<<5)); // constructed if 6th bit is set
+   return E_SUCCESS;
+}
+
+/*
+ * decodes identifier and length octets at ptr of which avail
+ * bytes are accessible; the offset of tlv is left untouched
+ * returns the number of bytes of the header or -E_INVALID
+ *
+ *   - the length form is looked up in asn1_length_octets, so the
+ *     common short and one or two octet forms are decoded without
+ *     a loop
+ *   - tags not fitting into 32 bits, indefinite lengths and lengths
+ *     not fitting into 64 bits are rejected instead of wrapping
+ */
+int asn1_decode_header(const guchar *ptr, gsize avail, asn1_tlv_t *tlv)
+{
+   const guchar *p = ptr, *end = ptr + avail;
+   guint8 n;
+   guchar b;
 
-   if ((buf & 0x1f) == 0x1f) {
-      // High Tag if all 5 LSB's are set
-      asn1->tag = 0;
+   if (avail < 2)
+      return -E_INVALID;
 
-      cbuf_get_bytes(cbuf, &ptr, offset++, 1);
+   b = *p++;
+   tlv->class = b >> 6;
+   tlv->constructed = (b >> 5) & 1;
+   tlv->tag = b & 0x1f;
 
+   if (G_UNLIKELY(tlv->tag == 0x1f)) {
+      /* high tag number form, 7 bits per octet */
+      tlv->tag = 0;
       do {
-         // append the 7 LSB's to the tag value
-         // TODO prevent against integer overflow
-         asn1->tag = (asn1->tag << 7) | (buf & 0x7f);
+         if (p == end || (tlv->tag >> 25))
+            return -E_INVALID;
+         b = *p++;
+         tlv->tag = (tlv->tag << 7) | (b & 0x7f);
+      } while (b & 0x80);
 
-         tmp = buf;
-         if (buf & 0x80) { // still one more byte for the tag left
-            cbuf_get_bytes(cbuf, &ptr, offset++, 1);
-         }
+      if (p == end)
+         return -E_INVALID;
+   }
 
-      } while (tmp & 0x80);
+   b = *p++;
+   n = asn1_length_octets[b];
+
+   if (G_LIKELY(n == 0)) {
+      tlv->length = b;
+   }
+   else if (n == ASN1_LENGTH_INVALID || n > end - p) {
+      return -E_INVALID;
+   }
+   else if (n == 1) {
+      tlv->length = p[0];
+      p += 1;
+   }
+   else if (n == 2) {
+      tlv->length = p[0] << 8 | p[1];
+      p += 2;
    }
    else {
-      // tag is just the 5 LSB's of the ID
-      asn1->tag = buf & 0x1f;
-   }
-   
-
-   /* 
-    * parsing tag byte(s) complete, 
-    * now proceed with the length byte(s)
-    */
-   cbuf_get_bytes(cbuf, &ptr, offset++, 1);
-   asn1->length_byte = buf;
-   
-   if (asn1->length_byte & 0x80) {
-      tmp = asn1->length_byte & 0x7f;
-      while (tmp--) {
-         cbuf_get_bytes(cbuf, &ptr, offset++, 1);
-         // TODO avoid integer overflow
-         asn1->length = (asn1->length << 8) | buf;
+      tlv->length = 0;
+      while (n--)
+         tlv->length = (tlv->length << 8) | *p++;
+   }
+
+   tlv->hdr_len = p - ptr;
+
+   return tlv->hdr_len;
+}
+
+/*
+ * reads the first element enclosed by the constructed parent
+ * returns -E_NOTFOUND if the parent is empty
+ */
+int asn1_first_child(cbuf_t *cbuf, asn1_tlv_t *parent, asn1_tlv_t *child)
+{
+   if (!parent->constructed)
+      return -E_INVALID;
+
+   if (parent->length == 0)
+      return -E_NOTFOUND;
+
+   if (asn1_read_tlv(cbuf, parent->offset + parent->hdr_len, child) < 0 ||
+       ASN1_END(child) > ASN1_END(parent))
+      return -E_INVALID;
+
+   return E_SUCCESS;
+}
+
+/*
+ * advances child to the following element within parent
+ * returns -E_NOTFOUND if child was the last one
+ */
+int asn1_next_child(cbuf_t *cbuf, asn1_tlv_t *parent, asn1_tlv_t *child)
+{
+   guint64 next = ASN1_END(child);
+
+   if (next >= ASN1_END(parent))
+      return -E_NOTFOUND;
+
+   if (asn1_read_tlv(cbuf, next, child) < 0 ||
+       ASN1_END(child) > ASN1_END(parent))
+      return -E_INVALID;
+
+   return E_SUCCESS;
+}
+
+/*
+ * decodes the arcs of an OBJECT IDENTIFIER
+ */
+int asn1_decode_oid(cbuf_t *cbuf, asn1_tlv_t *tlv, asn1_oid_t *oid)
+{
+   const guchar *ptr = ASN1_CONTENT(cbuf, tlv);
+   guint64 arc = 0;
+   gsize i;
+
+   memset(oid, 0, sizeof(asn1_oid_t));
+
+   if (tlv->length == 0 || (ptr[tlv->length - 1] & 0x80))
+      return -E_INVALID;
+
+   for (i = 0; i < tlv->length; i++) {
+      /* another 7 bits would not fit */
+      if (arc >> 57)
+         return -E_INVALID;
+
+      arc = (arc << 7) | (ptr[i] & 0x7f);
+      if (ptr[i] & 0x80)
+         continue;
+
+      if (oid->len == 0) {
+         /* the first subidentifier encodes the first two arcs */
+         oid->oid[0] = arc < 80 ? arc / 40 : 2;
+         oid->oid[1] = arc - oid->oid[0] * 40;
+         oid->len = 2;
       }
+      else {
+         if (oid->len == ASN1_MAX_OID_LEN)
+            return -E_INVALID;
+         oid->oid[oid->len++] = arc;
+      }
+      arc = 0;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * formats the OID in dotted notation into buf
+ * returns the length of the string
+ */
+gsize asn1_oid_to_string(asn1_oid_t *oid, gchar *buf, gsize size)
+{
+   gsize pos = 0;
+   guint i;
+   gint len;
+
+   if (size == 0)
+      return 0;
+
+   buf[0] = 0;
+   for (i = 0; i < oid->len && pos < size; i++) {
+      len = g_snprintf(buf + pos, size - pos,
+            i ? ".%" G_GUINT64_FORMAT : "%" G_GUINT64_FORMAT, oid->oid[i]);
+      if (len < 0)
+         break;
+      pos += len;
+   }
+
+   return MIN(pos, size - 1);
+}
+
+/*
+ * decodes UTCTime and GeneralizedTime to seconds since the epoch
+ *   - only the DER profile (seconds and 'Z' present) is accepted
+ */
+int asn1_decode_time(cbuf_t *cbuf, asn1_tlv_t *tlv, gint64 *time)
+{
+   const guchar *ptr = ASN1_CONTENT(cbuf, tlv);
+   guint digits, i;
+   gint year, month, day, hour, min, sec, era, doe, yoe, doy;
+   gint v[7];
+
+   if (tlv->tag == ASN1_TAG_UTC_TIME && tlv->length == 13)
+      digits = 12;
+   else if (tlv->tag == ASN1_TAG_GERNERALIZED_TIME && tlv->length == 15)
+      digits = 14;
+   else
+      return -E_INVALID;
+
+   if (ptr[digits] != 'Z')
+      return -E_INVALID;
+
+   for (i = 0; i < digits; i++)
+      if (ptr[i] < '0' || ptr[i] > '9')
+         return -E_INVALID;
+
+   for (i = 0; i < digits / 2; i++)
+      v[i] = (ptr[2*i] - '0') * 10 + (ptr[2*i+1] - '0');
+
+   if (digits == 12) {
+      /* RFC 5280: YY >= 50 is 19YY, otherwise 20YY */
+      year = v[0] >= 50 ? 1900 + v[0] : 2000 + v[0];
+      i = 1;
    }
    else {
-      asn1->length = asn1->length_byte & 0x7f;
+      year = v[0] * 100 + v[1];
+      i = 2;
    }
+   month = v[i++]; day = v[i++]; hour = v[i++]; min = v[i++]; sec = v[i];
+
+   if (month < 1 || month > 12 || day < 1 || day > 31 ||
+       hour > 23 || min > 59 || sec > 60)
+      return -E_INVALID;
+
+   /* days since the epoch of the proleptic Gregorian calendar */
+   year -= month <= 2;
+   era = (year >= 0 ? year : year - 399) / 400;
+   yoe = year - era * 400;
+   doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+   doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+   *time = ((gint64)era * 146097 + doe - 719468) * 86400 +
+           hour * 3600 + min * 60 + sec;
+
+   return E_SUCCESS;
+}
+
+/*
+ * decodes a non-negative INTEGER fitting into 64 bits
+ */
+int asn1_decode_uint(cbuf_t *cbuf, asn1_tlv_t *tlv, guint64 *value)
+{
+   const guchar *ptr = ASN1_CONTENT(cbuf, tlv);
+   guint64 i, len = tlv->length;
+
+   if (len == 0 || (ptr[0] & 0x80))
+      return -E_INVALID;
+
+   /* skip the leading zero of positive numbers */
+   if (ptr[0] == 0 && len > 1) {
+      ptr++;
+      len--;
+   }
+
+   if (len > 8)
+      return -E_INVALID;
+
+   *value = 0;
+   for (i = 0; i < len; i++)
+      *value = (*value << 8) | ptr[i];
+
+   return E_SUCCESS;
+}
+
+/*
+ * returns the name of a universal tag or NULL
+ */
+const gchar* asn1_tag_name(guint8 class, guint32 tag)
+{
+   if (class != ASN1_CLASS_UNIVERSAL || tag >= G_N_ELEMENTS(asn1_universal_names))
+      return NULL;
+
+   return asn1_universal_names[tag];
+}
+
+/*
+ * prepares a stream decoder; callbacks may be NULL
+ * if only the framing of top-level elements is of interest
+ */
+void asn1_stream_init(asn1_stream_t *stream,
+                      const asn1_stream_callbacks_t *callbacks,
+                      gpointer data)
+{
+   static const asn1_stream_callbacks_t no_callbacks;
+
+   memset(stream, 0, sizeof(asn1_stream_t));
+
+   stream->state = ASN1_STATE_IDENTIFIER;
+   stream->callbacks = callbacks ? callbacks : &no_callbacks;
+   stream->data = data;
+}
+
+/*
+ * feeds the next chunk of data of any size into the decoder
+ *
+ * returns
+ *   ASN1_NEED_MORE_DATA    all of buf has been consumed
+ *   ASN1_ELEMENT_COMPLETE  a top-level element has been completed
+ *                          and *consumed tells how much of buf
+ *                          belongs to it; feed the rest again
+ *   < 0                    malformed encoding or aborted by a callback
+ */
+int asn1_stream_feed(asn1_stream_t *stream, const guchar *buf, gsize len,
+                     gsize *consumed)
+{
+   asn1_tlv_t *tlv = &stream->tlv;
+   gsize pos = 0, chunk;
+   guchar byte;
+   int res;
+
+   while (pos < len) {
+
+      switch (stream->state) {
+
+         case ASN1_STATE_IDENTIFIER:
+            byte = buf[pos++];
+            memset(tlv, 0, sizeof(asn1_tlv_t));
+            tlv->offset = stream->offset + pos - 1;
+            tlv->hdr_len = 1;
+            tlv->class = byte >> 6;
+            tlv->constructed = (byte & (1<<5)) ? 1 : 0;
+            tlv->tag = byte & 0x1f;
+
+            stream->state = tlv->tag == 0x1f ? ASN1_STATE_HIGH_TAG
+                                             : ASN1_STATE_LENGTH;
+            if (tlv->tag == 0x1f)
+               tlv->tag = 0;
+            break;
+
+         case ASN1_STATE_HIGH_TAG:
+            byte = buf[pos++];
+            tlv->hdr_len++;
+
+            /* another 7 bits would not fit into the tag */
+            if (tlv->tag >> 25)
+               return -E_INVALID;
+
+            tlv->tag = (tlv->tag << 7) | (byte & 0x7f);
+            if (!(byte & 0x80))
+               stream->state = ASN1_STATE_LENGTH;
+            break;
 
+         case ASN1_STATE_LENGTH:
+            byte = buf[pos++];
+            tlv->hdr_len++;
 
-   /*
-    * offset is now the amount of bytes processed for the ASN.1 header
-    */
-   return offset;
+            if (byte & 0x80) {
+               stream->length_bytes = byte & 0x7f;
+               /* indefinite length is not allowed in DER */
+               if (stream->length_bytes == 0 ||
+                   stream->length_bytes > sizeof(tlv->length))
+                  return -E_INVALID;
+               stream->state = ASN1_STATE_LONG_LENGTH;
+               break;
+            }
+
+            tlv->length = byte;
+            res = asn1_stream_header_complete(stream);
+            if (res < 0)
+               return res;
+            if (res == ASN1_ELEMENT_COMPLETE) {
+               stream->offset += pos;
+               *consumed = pos;
+               return res;
+            }
+            break;
+
+         case ASN1_STATE_LONG_LENGTH:
+            byte = buf[pos++];
+            tlv->hdr_len++;
+            tlv->length = (tlv->length << 8) | byte;
+
+            if (--stream->length_bytes)
+               break;
+
+            res = asn1_stream_header_complete(stream);
+            if (res < 0)
+               return res;
+            if (res == ASN1_ELEMENT_COMPLETE) {
+               stream->offset += pos;
+               *consumed = pos;
+               return res;
+            }
+            break;
+
+         case ASN1_STATE_CONTENTS:
+            chunk = MIN(stream->remaining, len - pos);
+
+            if (stream->callbacks->contents) {
+               res = stream->callbacks->contents(tlv, buf + pos, chunk,
+                     stream->data);
+               if (res < 0)
+                  return res;
+            }
+
+            pos += chunk;
+            stream->remaining -= chunk;
+
+            if (stream->remaining == 0) {
+               stream->state = ASN1_STATE_IDENTIFIER;
+               res = asn1_stream_element_complete(stream, tlv);
+               if (res < 0)
+                  return res;
+               if (res == ASN1_ELEMENT_COMPLETE) {
+                  stream->offset += pos;
+                  *consumed = pos;
+                  return res;
+               }
+            }
+            break;
+      }
+   }
+
+   stream->offset += pos;
+   *consumed = pos;
+
+   return ASN1_NEED_MORE_DATA;
+}
+
+/*
+ * the header of the current element has been decoded completely
+ */
+static int asn1_stream_header_complete(asn1_stream_t *stream)
+{
+   asn1_tlv_t *tlv = &stream->tlv;
+   int res;
+
+   /* the end of the element has to be addressable */
+   if (tlv->length > G_MAXUINT64 - tlv->offset - tlv->hdr_len)
+      return -E_INVALID;
+
+   /* the element has to fit into its parent */
+   if (stream->depth &&
+       ASN1_END(tlv) > ASN1_END(&stream->stack[stream->depth-1]))
+      return -E_INVALID;
+
+   if (stream->callbacks->element_begin) {
+      res = stream->callbacks->element_begin(tlv, stream->depth, stream->data);
+      if (res < 0)
+         return res;
+   }
+
+   stream->state = ASN1_STATE_IDENTIFIER;
+
+   if (tlv->constructed) {
+      if (stream->depth == ASN1_STREAM_MAX_DEPTH)
+         return -E_INVALID;
+      stream->stack[stream->depth++] = *tlv;
+
+      if (tlv->length == 0)
+         return asn1_stream_element_complete(stream,
+               &stream->stack[--stream->depth]);
+
+      return E_SUCCESS;
+   }
+
+   if (tlv->length == 0)
+      return asn1_stream_element_complete(stream, tlv);
+
+   stream->remaining = tlv->length;
+   stream->state = ASN1_STATE_CONTENTS;
+
+   return E_SUCCESS;
+}
+
+/*
+ * reports the end of tlv and of all enclosing elements
+ * ending at the same position
+ */
+static int asn1_stream_element_complete(asn1_stream_t *stream,
+                                        asn1_tlv_t *tlv)
+{
+   guint64 end = ASN1_END(tlv);
+   int res;
+
+   if (stream->callbacks->element_end) {
+      res = stream->callbacks->element_end(tlv, stream->depth, stream->data);
+      if (res < 0)
+         return res;
+   }
+
+   while (stream->depth && ASN1_END(&stream->stack[stream->depth-1]) == end) {
+      stream->depth--;
+      if (stream->callbacks->element_end) {
+         res = stream->callbacks->element_end(&stream->stack[stream->depth],
+               stream->depth, stream->data);
+         if (res < 0)
+            return res;
+      }
+   }
 
+   return stream->depth ? E_SUCCESS : ASN1_ELEMENT_COMPLETE;
 }
 
 /* EOF */
@@ -33,7 +33,14 @@ const gchar decode_matrix[] = {
 /* 112 */41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, 
 };
 
+static const gchar encode_alphabet[] =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* the two characters of every 12-bit value, built on first use */
+static gchar encode_pairs[4096][2];
+
 /* prototypes */
+static void base64_init_pairs(void);
 
 
 
@@ -47,18 +54,25 @@ const gchar decode_matrix[] = {
 gsize pem_strip(const gchar *input, gsize len, gchar *output)
 {
    gsize out;
-   guint i;
+   gsize i;
+   const gchar *end = input + len;
+   const gchar *endptr;
    gchar *outptr;
    gchar *begin_token = "-----BEGIN CERTIFICATE";
    gchar *end_token = "-----END CERTIFICATE";
 
    /* forward pointer to actual base64 content */
-   input = g_strstr_len(input, 100, begin_token);
-   input = g_strstr_len(input, 30, "\n");
-
-   /* reset end of string to end of base64 content*/
-   outptr = g_strstr_len(input, len, end_token);
-   memset(outptr, 0, strlen(end_token));
+   input = g_strstr_len(input, MIN(len, 100), begin_token);
+   if (input)
+      input = g_strstr_len(input, MIN((gsize)(end - input), 30), "\n");
+   if (input == NULL)
+      return 0;
+
+   /* the input may not be terminated, stop at the end token */
+   len = end - input;
+   endptr = g_strstr_len(input, len, end_token);
+   if (endptr)
+      len = endptr - input;
 
    /* go through byte for byte */
    for (outptr=output, i=0; i<len && input[i] != 0; i++)
@@ -73,24 +87,32 @@ gsize pem_strip(const gchar *input, gsize len, gchar *output)
  * decode Base64 encoded string and store decoded result in output
  * output must provide sufficient memory to store the result
  */
-gint base64_decode(const gchar *input, gsize len, gchar *output)
+gssize base64_decode(const gchar *input, gsize len, gchar *output)
 {
    gsize out;
    gchar *outptr;
-   guint i;
+   gsize i;
 
    /* santiy check: base64 decoded must always be dividable by 4 */
    if (len == 0 || len % 4) {
-      DEBUG_MSG("base64_decode: %d is not an incremental of 4", len);
+      DEBUG_MSG("base64_decode: %" G_GSIZE_FORMAT
+            " is not an incremental of 4", len);
       return -1;
    }
 
-   /* check for Base64 alphabet */
+   /* check for Base64 alphabet, the table covers 7 bits only */
    for (i=0; i<len; i++) {
-      if (input[i] >= 127 || decode_matrix[ (guint8)input[i] ] == -1) {
+      if ((guint8)input[i] > 127 || decode_matrix[ (guint8)input[i] ] == -1) {
          DEBUG_MSG("base64_decode: not a valid Base64 character");
          return -1;
       }
+
+      /* padding only on the last char or the last two */
+      if (decode_matrix[ (guint8)input[i] ] == -2 &&
+          (i < len - 2 || (i == len - 2 && input[len - 1] != '='))) {
+         DEBUG_MSG("base64_decode: padding before the end");
+         return -1;
+      }
    }
 
    i = 0;
@@ -142,6 +164,84 @@ gint base64_decode(const gchar *input, gsize len, gchar *output)
    return out;
 }
 
+/*
+ * encode input as Base64 with padding and store result in output;
+ * output must provide BASE64_ENCODED_LEN(len) bytes
+ *
+ * every 3 input bytes are turned into 4 characters by two lookups
+ * of 12 bits each instead of four lookups of 6 bits
+ */
+gsize base64_encode(const guchar *input, gsize len, gchar *output)
+{
+   static gsize initialized = 0;
+   gchar *outptr = output;
+   guint32 w;
+   gsize i;
+
+   if (g_once_init_enter(&initialized)) {
+      base64_init_pairs();
+      g_once_init_leave(&initialized, 1);
+   }
+
+   for (i = 0; i + 3 <= len; i += 3) {
+      w = (guint32)input[i] << 16 | (guint32)input[i+1] << 8 | input[i+2];
+      memcpy(outptr, encode_pairs[w >> 12], 2);
+      memcpy(outptr + 2, encode_pairs[w & 0xfff], 2);
+      outptr += 4;
+   }
+
+   /* remaining 1 or 2 bytes are padded */
+   if (i < len) {
+      w = (guint32)input[i] << 16;
+      if (i + 1 < len)
+         w |= (guint32)input[i+1] << 8;
+
+      memcpy(outptr, encode_pairs[w >> 12], 2);
+      outptr[2] = i + 1 < len ? encode_alphabet[(w >> 6) & 0x3f] : '=';
+      outptr[3] = '=';
+      outptr += 4;
+   }
+
+   return outptr - output;
+}
+
+/*
+ * wraps DER in a PEM certificate block with lines of 64 characters;
+ * output must provide PEM_ENCODED_LEN(len) bytes
+ */
+gsize pem_encode(const guchar *der, gsize len, gchar *output)
+{
+   static const gchar header[] = "-----BEGIN CERTIFICATE-----\n";
+   static const gchar footer[] = "-----END CERTIFICATE-----\n";
+   gchar *outptr = output;
+   gsize i, n;
+
+   memcpy(outptr, header, sizeof(header) - 1);
+   outptr += sizeof(header) - 1;
+
+   /* 48 bytes make one line */
+   for (i = 0; i < len; i += n) {
+      n = MIN(len - i, PEM_LINE_BYTES);
+      outptr += base64_encode(der + i, n, outptr);
+      *outptr++ = '\n';
+   }
+
+   memcpy(outptr, footer, sizeof(footer) - 1);
+   outptr += sizeof(footer) - 1;
+
+   return outptr - output;
+}
+
+static void base64_init_pairs(void)
+{
+   guint i;
+
+   for (i = 0; i < 4096; i++) {
+      encode_pairs[i][0] = encode_alphabet[i >> 6];
+      encode_pairs[i][1] = encode_alphabet[i & 0x3f];
+   }
+}
+
 /* EOF */
 
 // vim:ts=3:expandtab
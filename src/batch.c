@@ -0,0 +1,576 @@
+/* batch.c - headless processing with machine readable output
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_batch.h>
+#include <certalize_stream.h>
+#include <certalize_pcap.h>
+#include <certalize_loader.h>
+#include <certalize_decomp.h>
+#include <certalize_oid.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+/* globals    */
+
+/* prototypes */
+static const gchar* batch_record_error(batch_t *batch);
+static int  batch_stream_record(const guchar *der, gsize len,
+                                guint64 offset, gpointer data);
+static void batch_stream_idle(gpointer data);
+static int  batch_decomp_chunk(const guchar *buf, gsize len, gpointer data);
+static int  batch_pcap_record(const guchar *der, gsize len,
+                              const gchar *flow, gpointer data);
+static void batch_emit_tlv(json_writer_t *w, const gchar *key,
+                           asn1_tlv_t *tlv);
+static void batch_emit_key(json_writer_t *w, cbuf_t *cbuf,
+                           x509_cert_t *cert);
+static void batch_emit_digest(json_writer_t *w, const gchar *key,
+                              GChecksum *checksum, const guchar *data,
+                              gsize len);
+
+
+/*************/
+
+/*
+ * parses all given files and writes the certificates matching the
+ * filter, if any, to stdout; records exceeding the limits are
+ * reported as errors
+ */
+int batch_run(GPtrArray *files, gint format, filter_t *filter,
+              const asn1_limits_t *limits)
+{
+   batch_t batch;
+   guint i, j;
+   gchar *filename;
+
+   batch_init(&batch, format, STDOUT_FILENO);
+   batch.filter = filter;
+   asn1_index_set_limits(&batch.tlv_index, limits);
+
+   for (i = 0; i < files->len; i = j) {
+      filename = g_ptr_array_index(files, i);
+
+      /* "-" reads a stream of records from stdin */
+      if (!strcmp(filename, "-")) {
+         batch_process_fd(&batch, "-", STDIN_FILENO);
+         j = i + 1;
+         continue;
+      }
+
+      /* the files up to the next "-" are read ahead together */
+      for (j = i + 1; j < files->len; j++)
+         if (!strcmp(g_ptr_array_index(files, j), "-"))
+            break;
+
+      batch_process_files(&batch, (gchar**)files->pdata + i, j - i);
+   }
+
+   batch_finish(&batch);
+
+   return batch.errors ? E_INVALID : E_SUCCESS;
+}
+
+/*
+ * sets up the output writer and the reusable digest contexts
+ */
+void batch_init(batch_t *batch, gint format, gint fd)
+{
+   memset(batch, 0, sizeof(batch_t));
+
+   batch->format = format;
+   batch->outbuf = g_malloc(JSON_DEFAULT_BUFSIZE);
+   batch->sha1 = g_checksum_new(G_CHECKSUM_SHA1);
+   batch->sha256 = g_checksum_new(G_CHECKSUM_SHA256);
+   asn1_index_init(&batch->tlv_index);
+   filter_fields_init(&batch->fields);
+
+   json_init(&batch->json, fd, batch->outbuf, JSON_DEFAULT_BUFSIZE);
+
+   if (format == OUTPUT_JSON)
+      json_array_begin(&batch->json);
+}
+
+/*
+ * terminates the output and releases the batch resources
+ */
+void batch_finish(batch_t *batch)
+{
+   if (batch->format == OUTPUT_JSON) {
+      json_array_end(&batch->json);
+      json_newline(&batch->json);
+   }
+
+   json_flush(&batch->json);
+
+   g_checksum_free(batch->sha1);
+   g_checksum_free(batch->sha256);
+   asn1_index_destroy(&batch->tlv_index);
+   filter_fields_destroy(&batch->fields);
+   g_free(batch->outbuf);
+}
+
+/*
+ * emits the certificates of all files in the order given; the loader
+ * keeps many of them in flight so small files are not read one by one
+ */
+int batch_process_files(batch_t *batch, gchar **files, guint count)
+{
+   loader_t *loader;
+   const gchar *filename;
+   cbuf_t *cbuf;
+   guint format;
+   int res;
+
+   loader = loader_new(files, count);
+
+   while ((res = loader_next(loader, &filename, &cbuf)) != -E_NOTFOUND) {
+      if (res < 0) {
+         batch_emit_error(batch, filename, 0, "unable to load file");
+         continue;
+      }
+
+      /* compressed files are streamed while being decompressed */
+      format = decomp_probe(cbuf->buffer, cbuf->length);
+      if (format != DECOMP_NONE) {
+         batch_process_compressed(batch, filename, cbuf, format);
+         continue;
+      }
+
+      /* captures are searched for TLS handshakes */
+      if (pcap_probe_data(cbuf->buffer, cbuf->length)) {
+         batch_process_pcap(batch, filename);
+         continue;
+      }
+
+      /* bundles of DER or PEM records, with text around them */
+      batch_process_data(batch, filename, cbuf->buffer, cbuf->length);
+   }
+
+   loader_free(loader);
+
+   return E_SUCCESS;
+}
+
+/*
+ * emits every certificate found one after the other in the cbuf;
+ * each one is indexed on its own to keep the index small
+ */
+int batch_process_cbuf(batch_t *batch, const gchar *source, cbuf_t *cbuf)
+{
+   x509_cert_t cert;
+   guint64 offset = 0;
+   guint64 index = 0;
+
+   while (offset < cbuf->length) {
+      if (asn1_index_element(&batch->tlv_index, cbuf, offset) < 0 ||
+          x509_parse_index(cbuf, &batch->tlv_index, 0, &cert) < 0) {
+         batch_emit_error(batch, source, offset, batch_record_error(batch));
+         return -E_INVALID;
+      }
+
+      batch_emit_certificate(batch, source, index++, cbuf, &cert);
+      offset = ASN1_END(&cert.certificate);
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * processes a possibly never-ending stream of concatenated
+ * DER or PEM records, emitting each certificate once it is complete
+ */
+int batch_process_fd(batch_t *batch, const gchar *source, gint fd)
+{
+   cstream_t stream;
+   int res;
+
+   batch->source = source;
+   batch->index = 0;
+
+   cstream_init(&stream, batch_stream_record, batch);
+   res = cstream_read_fd(&stream, fd, batch_stream_idle, batch);
+
+   if (res < 0)
+      batch_emit_error(batch, source, stream.record_offset,
+            "invalid or truncated record");
+
+   cstream_destroy(&stream);
+   batch->base_offset = 0;
+
+   return res;
+}
+
+/*
+ * emits the certificates of DER or PEM records held in memory
+ */
+int batch_process_data(batch_t *batch, const gchar *source,
+                       const guchar *data, gsize len)
+{
+   cstream_t stream;
+   int res;
+
+   batch->source = source;
+   batch->index = 0;
+
+   cstream_init(&stream, batch_stream_record, batch);
+
+   res = cstream_feed(&stream, data, len);
+   if (res == E_SUCCESS)
+      res = cstream_finish(&stream);
+
+   if (res < 0)
+      batch_emit_error(batch, source, stream.record_offset,
+            "invalid or truncated record");
+
+   cstream_destroy(&stream);
+
+   return res;
+}
+
+/*
+ * emits the records of a gzip or zstd compressed file; the records
+ * are split off each decompressed chunk while the next one is
+ * inflated, offsets refer to the decompressed stream
+ */
+int batch_process_compressed(batch_t *batch, const gchar *source,
+                             cbuf_t *cbuf, guint format)
+{
+   cstream_t stream;
+   int res;
+
+   batch->source = source;
+   batch->index = 0;
+
+   cstream_init(&stream, batch_stream_record, batch);
+
+   res = decomp_run(format, cbuf->buffer, cbuf->length,
+         batch_decomp_chunk, &stream);
+
+   if (res == -E_NOTHANDLED)
+      batch_emit_error(batch, source, 0, "unsupported compression");
+   else if (res < 0 || (res = cstream_finish(&stream)) < 0)
+      batch_emit_error(batch, source, stream.record_offset,
+            "invalid or truncated record");
+
+   cstream_destroy(&stream);
+   batch->base_offset = 0;
+
+   return res;
+}
+
+/*
+ * emits the certificates exchanged in the TLS handshakes of a
+ * pcap or pcapng capture, "source" names the file and the flow
+ */
+int batch_process_pcap(batch_t *batch, const gchar *filename)
+{
+   int res;
+
+   batch->index = 0;
+
+   res = pcap_extract(filename, batch_pcap_record, batch);
+   if (res < 0)
+      batch_emit_error(batch, filename, 0, "invalid capture file");
+
+   batch->source = NULL;
+
+   return res;
+}
+
+/*
+ * writes one JSON object describing the certificate
+ *   - "offset" is the position of the record within the source,
+ *     the byte ranges of "fields" are relative to the DER encoding
+ *   - a brief batch leaves out the digests and byte ranges
+ *   - nothing is written if the certificate does not match the filter
+ */
+void batch_emit_certificate(batch_t *batch, const gchar *source,
+                            guint64 index, cbuf_t *cbuf, x509_cert_t *cert)
+{
+   json_writer_t *w = &batch->json;
+   gchar tmp[X509_NAME_MAXLEN];
+   const gchar *name;
+   gsize len;
+
+   if (batch->filter) {
+      filter_fields_decode(&batch->fields, filter_mask(batch->filter),
+            cbuf, cert, source, batch->base_offset + cert->certificate.offset);
+      if (!filter_match(batch->filter, &batch->fields))
+         return;
+   }
+
+   json_object_begin(w);
+
+   json_member_string(w, "source", source);
+   json_member_uint(w, "index", index);
+   json_member_uint(w, "offset",
+         batch->base_offset + cert->certificate.offset);
+   json_member_uint(w, "length",
+         cert->certificate.hdr_len + cert->certificate.length);
+
+   if (!batch->brief) {
+      batch_emit_digest(w, "sha256", batch->sha256,
+            cbuf->buffer + cert->certificate.offset,
+            cert->certificate.hdr_len + cert->certificate.length);
+      batch_emit_digest(w, "sha1", batch->sha1,
+            cbuf->buffer + cert->certificate.offset,
+            cert->certificate.hdr_len + cert->certificate.length);
+   }
+
+   json_member_uint(w, "version", cert->version);
+
+   json_key(w, "serial");
+   json_hex(w, ASN1_CONTENT(cbuf, &cert->serial), cert->serial.length, ':');
+
+   name = x509_algorithm_name(cbuf, &cert->signature_algorithm,
+         tmp, sizeof(tmp));
+   json_key(w, "signature_algorithm");
+   json_string(w, name, -1);
+
+   len = x509_name_to_string(cbuf, &cert->issuer, tmp, sizeof(tmp));
+   json_key(w, "issuer");
+   json_string(w, tmp, len);
+
+   len = x509_name_to_string(cbuf, &cert->subject, tmp, sizeof(tmp));
+   json_key(w, "subject");
+   json_string(w, tmp, len);
+
+   len = x509_time_to_string(cert->not_before_time, tmp, sizeof(tmp));
+   json_key(w, "not_before");
+   json_string(w, tmp, len);
+
+   len = x509_time_to_string(cert->not_after_time, tmp, sizeof(tmp));
+   json_key(w, "not_after");
+   json_string(w, tmp, len);
+
+   name = x509_algorithm_name(cbuf, &cert->spki_algorithm, tmp, sizeof(tmp));
+   json_key(w, "public_key_algorithm");
+   json_string(w, name, -1);
+
+   batch_emit_key(w, cbuf, cert);
+
+   /* byte ranges of the decoded fields */
+   if (!batch->brief) {
+      json_key(w, "fields");
+      json_object_begin(w);
+      batch_emit_tlv(w, "tbs_certificate", &cert->tbs);
+      batch_emit_tlv(w, "serial", &cert->serial);
+      batch_emit_tlv(w, "signature", &cert->signature);
+      batch_emit_tlv(w, "issuer", &cert->issuer);
+      batch_emit_tlv(w, "validity", &cert->validity);
+      batch_emit_tlv(w, "subject", &cert->subject);
+      batch_emit_tlv(w, "subject_public_key_info", &cert->spki);
+      batch_emit_tlv(w, "extensions", &cert->extensions);
+      batch_emit_tlv(w, "signature_algorithm", &cert->signature_algorithm);
+      batch_emit_tlv(w, "signature_value", &cert->signature_value);
+      json_object_end(w);
+   }
+
+   json_object_end(w);
+
+   if (batch->format == OUTPUT_NDJSON)
+      json_newline(w);
+
+   batch->records++;
+}
+
+/*
+ * writes a record for input which could not be parsed
+ */
+void batch_emit_error(batch_t *batch, const gchar *source, guint64 offset,
+                      const gchar *message)
+{
+   json_writer_t *w = &batch->json;
+
+   json_object_begin(w);
+   json_member_string(w, "source", source);
+   json_member_uint(w, "offset", offset);
+   json_member_string(w, "error", message);
+   json_object_end(w);
+
+   if (batch->format == OUTPUT_NDJSON)
+      json_newline(w);
+
+   batch->errors++;
+}
+
+/*
+ * a record exceeding the limits is told apart from a broken one
+ */
+static const gchar* batch_record_error(batch_t *batch)
+{
+   if (batch->tlv_index.error > ASN1_INDEX_MALFORMED)
+      return asn1_index_strerror(&batch->tlv_index);
+
+   return "invalid certificate";
+}
+
+/*
+ * handles a record split off the input stream
+ */
+static int batch_stream_record(const guchar *der, gsize len, guint64 offset,
+                               gpointer data)
+{
+   batch_t *batch = data;
+   x509_cert_t cert;
+   cbuf_t cbuf;
+
+   if (der == NULL) {
+      batch_emit_error(batch, batch->source, offset, "invalid PEM record");
+      return E_SUCCESS;
+   }
+
+   /* the record is only borrowed for the time of the callback */
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = (guchar*)der;
+   cbuf.length = len;
+
+   if (asn1_index_element(&batch->tlv_index, &cbuf, 0) < 0 ||
+       x509_parse_index(&cbuf, &batch->tlv_index, 0, &cert) < 0) {
+      batch_emit_error(batch, batch->source, offset,
+            batch_record_error(batch));
+      return E_SUCCESS;
+   }
+
+   batch->base_offset = offset;
+   batch_emit_certificate(batch, batch->source, batch->index++, &cbuf, &cert);
+   batch->base_offset = 0;
+
+   return E_SUCCESS;
+}
+
+/*
+ * splits the records off a decompressed chunk
+ */
+static int batch_decomp_chunk(const guchar *buf, gsize len, gpointer data)
+{
+   return cstream_feed(data, buf, len);
+}
+
+/*
+ * handles a certificate found in a captured TLS flow
+ */
+static int batch_pcap_record(const guchar *der, gsize len,
+                             const gchar *flow, gpointer data)
+{
+   batch_t *batch = data;
+
+   batch->source = flow;
+
+   return batch_stream_record(der, len, 0, batch);
+}
+
+/*
+ * pushes out what has been written so far before blocking
+ * on the next read, so consumers see records without delay
+ */
+static void batch_stream_idle(gpointer data)
+{
+   batch_t *batch = data;
+
+   json_flush(&batch->json);
+}
+
+/*
+ * writes "key": {"offset": .., "header_length": .., "length": ..}
+ * for elements present in the certificate
+ */
+static void batch_emit_tlv(json_writer_t *w, const gchar *key,
+                           asn1_tlv_t *tlv)
+{
+   if (tlv->hdr_len == 0)
+      return;
+
+   json_key(w, key);
+   json_object_begin(w);
+   json_member_uint(w, "offset", tlv->offset);
+   json_member_uint(w, "header_length", tlv->hdr_len);
+   json_member_uint(w, "length", tlv->length);
+   json_object_end(w);
+}
+
+/*
+ * writes "public_key": {"type", "bits", "exponent", "curve"} as far as
+ * the key is understood; an exponent too large for a number is hex
+ */
+static void batch_emit_key(json_writer_t *w, cbuf_t *cbuf,
+                           x509_cert_t *cert)
+{
+   const oid_entry_t *entry;
+   x509_key_t key;
+   asn1_oid_t oid;
+   guint64 exponent;
+   gchar dotted[128];
+
+   if (x509_public_key(cbuf, cert, &key) < 0)
+      return;
+
+   json_key(w, "public_key");
+   json_object_begin(w);
+   json_member_string(w, "type", x509_key_type_name(key.type));
+
+   if (key.bits)
+      json_member_uint(w, "bits", key.bits);
+
+   if (key.type == X509_KEY_RSA) {
+      json_key(w, "exponent");
+      if (asn1_decode_uint(cbuf, &key.exponent, &exponent) == E_SUCCESS)
+         json_uint(w, exponent);
+      else
+         json_hex(w, ASN1_CONTENT(cbuf, &key.exponent), key.exponent.length,
+               ':');
+   }
+
+   if (key.curve.length) {
+      entry = oid_lookup(ASN1_CONTENT(cbuf, &key.curve), key.curve.length);
+      if (entry) {
+         json_member_string(w, "curve", entry->name);
+      }
+      else if (asn1_decode_oid(cbuf, &key.curve, &oid) == E_SUCCESS) {
+         asn1_oid_to_string(&oid, dotted, sizeof(dotted));
+         json_member_string(w, "curve", dotted);
+      }
+   }
+
+   json_object_end(w);
+}
+
+/*
+ * writes the hex digest of data
+ */
+static void batch_emit_digest(json_writer_t *w, const gchar *key,
+                              GChecksum *checksum, const guchar *data,
+                              gsize len)
+{
+   guint8 digest[64];
+   gsize digest_len = sizeof(digest);
+
+   g_checksum_reset(checksum);
+   g_checksum_update(checksum, data, len);
+   g_checksum_get_digest(checksum, digest, &digest_len);
+
+   json_key(w, key);
+   json_hex(w, digest, digest_len, 0);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -20,85 +20,176 @@
 #include <certalize.h>
 #include <certalize_buf.h>
 #include <certalize_base64.h>
+#include <certalize_decomp.h>
 #include <certalize_debug.h>
 
 /* globals    */
 
 /* prototypes */
-
+static cbuf_t* cbuf_map(const gchar *filename,
+                        cbuf_t* (*wrap)(const guchar *data, gsize length));
 
 
 /*************/
 
-cbuf_t* cbuf_load_file(const gchar *filename)
+/*
+ * Loads the file into a new cbuf, compressed files are decompressed
+ * into at most max bytes, DECOMP_MAX_BUFFER if 0
+ */
+cbuf_t* cbuf_load_file(const gchar *filename, gsize max)
 {
-   gchar *content;
-   gsize readlen;
-   GError *error;
-   cbuf_t *cbuf;
-   gchar *pemident = "-----BEGIN CERTIFICATE";
+   cbuf_t *cbuf, *plain;
+   guchar *data;
+   gsize len = 0;
+   guint format;
 
    DEBUG_MSG("cbuf_load_file('%s')", filename);
-   cbuf = g_malloc0(sizeof(cbuf_t));
 
-   if (cbuf == NULL) {
-      g_print("memory allocation failed: %s\n", strerror(errno));
+   if ((cbuf = cbuf_map_file(filename)) == NULL)
       return NULL;
-   }
 
-   if (!g_file_get_contents(filename, &content, &readlen, &error)) {
-      g_print("reading file '%s' failed: '%s'\n", filename, error->message);
-      g_free(cbuf);
+   format = decomp_probe(cbuf->buffer, cbuf->length);
+   if (format == DECOMP_NONE)
+      return cbuf;
+
+   DEBUG_MSG("cbuf_load_file: %s compressed file", decomp_name(format));
+
+   data = decomp_buffer(format, cbuf->buffer, cbuf->length, max, &len);
+   cbuf_free(cbuf);
+
+   if (data == NULL) {
+      g_printerr("decompressing file '%s' failed or exceeded %lu bytes\n",
+            filename, (gulong)(max ? max : DECOMP_MAX_BUFFER));
       return NULL;
    }
 
+   plain = cbuf_new_from_data(data, len);
+
+   if (plain && plain->buffer == data)
+      arena_adopt(plain->arena, data, g_free);
+   else
+      g_free(data);
+
+   return plain;
+}
+
+/*
+ * Maps the file into a new cbuf, decoding it if it is PEM
+ */
+cbuf_t* cbuf_map_file(const gchar *filename)
+{
+   return cbuf_map(filename, cbuf_new_from_data);
+}
+
+/*
+ * Maps the file into a new cbuf as it is, for callers splitting
+ * the records themselves
+ */
+cbuf_t* cbuf_map_raw(const gchar *filename)
+{
+   return cbuf_map(filename, cbuf_new_raw);
+}
+
+/*
+ * Creates a cbuf referencing data as it is, without looking at it;
+ * data has to stay valid for the lifetime of the cbuf
+ */
+cbuf_t* cbuf_new_raw(const guchar *data, gsize length)
+{
+   arena_t *arena;
+   cbuf_t *cbuf;
+
+   arena = arena_new(0);
+   cbuf = arena_new0(arena, cbuf_t);
+   cbuf->arena = arena;
+   cbuf->buffer = (guchar*)data;
+   cbuf->length = length;
+
+   return cbuf;
+}
+
+/*
+ * Creates a cbuf for file content already in memory
+ *   - DER content is referenced, not copied, so it has to stay
+ *     valid for the lifetime of the cbuf
+ *   - PEM content is decoded into the document arena
+ */
+cbuf_t* cbuf_new_from_data(const guchar *data, gsize length)
+{
+   const gchar *content = (const gchar*)data;
+   arena_t *arena;
+   cbuf_t *cbuf;
+   gchar *pemident = "-----BEGIN CERTIFICATE";
+
+   /* the document arena owns everything from here on */
+   arena = arena_new(0);
+   cbuf = arena_new0(arena, cbuf_t);
+   cbuf->arena = arena;
+
    /* try to determine if the file is direclty DER or wrapped in PEM */
-   if (strncmp(content, pemident, strlen(pemident)) == 0) {
+   if (length > strlen(pemident) &&
+       strncmp(content, pemident, strlen(pemident)) == 0) {
       gsize len = 0;
-      gint dlen = 0;
+      gssize dlen = 0;
       gchar *base64, *der;
-      DEBUG_MSG("cbuf_load_file: PEM endcoded file");
+      DEBUG_MSG("cbuf_new_from_data: PEM endcoded file");
 
-      base64 = g_malloc0(readlen);
-      len = pem_strip(content, readlen, base64);
-      der = g_malloc0((len/4)*3);
+      base64 = g_malloc0(length);
+      len = pem_strip(content, length, base64);
+      der = arena_alloc(arena, (len/4)*3);
       dlen = base64_decode(base64, len, der);
-      g_print("decoded: (%d)\n", dlen);
+      DEBUG_MSG("cbuf_new_from_data: decoded %" G_GSSIZE_FORMAT " bytes",
+            dlen);
 
       g_free(base64);
-      g_free(content);
 
-      if (dlen == -1)
+      if (dlen == -1) {
+         arena_free(arena);
          return NULL;
+      }
 
-      content = der;
-      readlen = dlen;
-      
-   }
-   else if (memcmp(content, "0", 1) == 0) {
-      /* this is a very vague determination of DER encoded X.509 cert */
-      DEBUG_MSG("cbuf_load_file: DER encoded file");
+      cbuf->buffer = (guchar*)der;
+      cbuf->length = dlen;
    }
    else {
-      /* something else */
-      DEBUG_MSG("cbuf_load_file: Something else");
+      /* this is a very vague determination of DER encoded X.509 cert */
+      if (length && memcmp(content, "0", 1) == 0) {
+         DEBUG_MSG("cbuf_new_from_data: DER encoded file");
+      }
+      else {
+         DEBUG_MSG("cbuf_new_from_data: Something else");
+      }
+
+      cbuf->buffer = (guchar*)data;
+      cbuf->length = length;
    }
 
-   cbuf->buffer = content;
-   cbuf->length = readlen;
    cbuf->offset = 0;
 
    return cbuf;
 }
 
+/*
+ * Releases the buffer together with all parse state
+ * allocated from its arena
+ */
+void cbuf_free(cbuf_t *cbuf)
+{
+   if (cbuf == NULL)
+      return;
+
+   /* cbuf itself lives in the arena */
+   arena_free(cbuf->arena);
+}
+
 /*
  * Returns 16-bits from buffer in host-byte order
  */
-guint16 cbuf_get_ntohs(cbuf_t *cbuf, guint offset)
+guint16 cbuf_get_ntohs(cbuf_t *cbuf, guint64 offset)
 {
    guint16 result;
 
-   if (offset + 2 > cbuf->length) {
+   if (!CBUF_HAS(cbuf, offset, 2)) {
       DEBUG_MSG("cbuf_get_ntohs: not enough buffer available");
       return 0;
    }
@@ -109,14 +200,34 @@ guint16 cbuf_get_ntohs(cbuf_t *cbuf, guint offset)
    return result;
 }
 
+/*
+ * Returns 24-bits from buffer in host-byte order
+ * (as used for lengths in TLS handshake messages)
+ */
+guint32 cbuf_get_ntoh24(cbuf_t *cbuf, guint64 offset)
+{
+   guint32 result;
+
+   if (!CBUF_HAS(cbuf, offset, 3)) {
+      DEBUG_MSG("cbuf_get_ntoh24: not enough buffer available");
+      return 0;
+   }
+
+   result = (guint32)*(cbuf->buffer + offset+0) << 16 |
+            (guint32)*(cbuf->buffer + offset+1) <<  8 |
+            (guint32)*(cbuf->buffer + offset+2);
+
+   return result;
+}
+
 /*
  * Returns 32-bits from buffer in host-byte order
  */
-guint32 cbuf_get_ntohl(cbuf_t *cbuf, guint offset)
+guint32 cbuf_get_ntohl(cbuf_t *cbuf, guint64 offset)
 {
    guint32 result;
 
-   if (offset + 4 > cbuf->length) {
+   if (!CBUF_HAS(cbuf, offset, 4)) {
       DEBUG_MSG("cbuf_get_ntohl: not enough buffer available");
       return 0;
    }
@@ -133,10 +244,10 @@ guint32 cbuf_get_ntohl(cbuf_t *cbuf, guint offset)
  * Copies number of bytes into a externally provided buffer
  * Buffer have to provide enough memory to hold the data
  */
-gchar* cbuf_get_bytes(cbuf_t *cbuf, guchar **buffer, guint offset, gsize length)
+gchar* cbuf_get_bytes(cbuf_t *cbuf, guchar **buffer, guint64 offset, gsize length)
 {
 
-   if(offset + length > cbuf->length) {
+   if (!CBUF_HAS(cbuf, offset, length)) {
       DEBUG_MSG("cbuf_get_bytes: not enough buffer available");
       return NULL;
    }
@@ -149,11 +260,48 @@ gchar* cbuf_get_bytes(cbuf_t *cbuf, guchar **buffer, guint offset, gsize length)
 /*
  * Returns the remaining length relative from offset
  */
-gsize cbuf_length_remaining(cbuf_t *cbuf, guint offset)
+gsize cbuf_length_remaining(cbuf_t *cbuf, guint64 offset)
 {
+   if (offset > cbuf->length)
+      return 0;
+
    return cbuf->length - offset;
 }
 
+/*
+ * maps the file and hands its content to wrap
+ */
+static cbuf_t* cbuf_map(const gchar *filename,
+                        cbuf_t* (*wrap)(const guchar *data, gsize length))
+{
+   GMappedFile *map;
+   GError *error = NULL;
+   cbuf_t *cbuf;
+
+   DEBUG_MSG("cbuf_map('%s')", filename);
+
+   /*
+    * the file is mapped instead of read, so inputs of any size
+    * are only paged in as far as they are parsed
+    */
+   map = g_mapped_file_new(filename, FALSE, &error);
+   if (map == NULL) {
+      g_printerr("reading file '%s' failed: '%s'\n", filename, error->message);
+      g_error_free(error);
+      return NULL;
+   }
+
+   cbuf = wrap((guchar*)g_mapped_file_get_contents(map),
+         g_mapped_file_get_length(map));
+
+   if (cbuf && cbuf->buffer == (guchar*)g_mapped_file_get_contents(map))
+      /* the document keeps referencing the mapping */
+      arena_adopt(cbuf->arena, map, (GDestroyNotify)g_mapped_file_unref);
+   else
+      g_mapped_file_unref(map);
+
+   return cbuf;
+}
 
 /* EOF */
 
@@ -0,0 +1,51 @@
+/* certalize_globals.h
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CERTALIZE_GLOBALS_H
+#define CERTALIZE_GLOBALS_H
+
+/*
+ * command line state shared by main.c and ui.c, not part of the
+ * installed library interface
+ */
+
+#include <certalize.h>
+
+extern char *global_filename;
+extern GPtrArray *global_files;
+extern int global_output;
+extern gint global_convert;
+extern char *global_outdir;
+extern char *global_serve;
+extern GPtrArray *global_patterns;
+extern gboolean global_stats;
+extern char *global_extract;
+extern char *global_filter;
+extern gboolean global_watch;
+extern gboolean global_diff;
+extern gboolean global_keys;
+extern char *global_limits;
+extern guint global_memory;
+extern gboolean global_startup_time;
+extern gint64 global_starttime;
+
+#endif   /* CERTALIZE_GLOBALS_H */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,152 @@
+/* compare.c - structural difference of two files
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_compare.h>
+#include <certalize_diff.h>
+#include <certalize_buf.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* prototypes */
+static int  compare_entry(diff_t *diff, const diff_entry_t *entry,
+                          gpointer data);
+static void compare_side(parser_t *parser, guint32 node, GString *out);
+
+
+/*************/
+
+/*
+ * prints where the second file differs from the first, one entry per
+ * element added, removed or changed
+ *
+ *   ~ PATH
+ *       [OFFSET+LENGTH] OLD VALUE          [OFFSET+LENGTH] NEW VALUE
+ *
+ * "-" marks removed and "+" added elements, PATH names the element in
+ * the document having it and the byte ranges span header and contents
+ */
+int compare_run(GPtrArray *files, const asn1_limits_t *limits)
+{
+   cbuf_t *a, *b;
+   diff_t diff;
+   GString *out;
+   int res;
+
+   if (files->len != 2) {
+      g_printerr("comparing needs exactly two files\n");
+      return E_INVALID;
+   }
+
+   a = cbuf_load_file(g_ptr_array_index(files, 0), limits->size);
+   b = cbuf_load_file(g_ptr_array_index(files, 1), limits->size);
+   if (a == NULL || b == NULL) {
+      g_printerr("unable to load '%s'\n",
+            (gchar*)g_ptr_array_index(files, a == NULL ? 0 : 1));
+      cbuf_free(a);
+      cbuf_free(b);
+      return E_INVALID;
+   }
+
+   diff_init(&diff);
+   asn1_index_set_limits(&diff.a.index, limits);
+   asn1_index_set_limits(&diff.b.index, limits);
+
+   out = g_string_new(NULL);
+   g_string_append_printf(out, "--- %s\n+++ %s\n",
+         (gchar*)g_ptr_array_index(files, 0),
+         (gchar*)g_ptr_array_index(files, 1));
+
+   res = diff_documents(&diff, a->buffer, a->length, b->buffer, b->length,
+         compare_entry, out);
+   if (res < 0) {
+      g_printerr("'%s': %s\n",
+            (gchar*)g_ptr_array_index(files, diff.a.index.error ? 0 : 1),
+            asn1_index_strerror(diff.a.index.error ?
+               &diff.a.index : &diff.b.index));
+   }
+   else {
+      fwrite(out->str, 1, out->len, stdout);
+   }
+
+   g_string_free(out, TRUE);
+   diff_destroy(&diff);
+   cbuf_free(a);
+   cbuf_free(b);
+
+   if (res < 0)
+      return E_INVALID;
+
+   /* like diff(1): 1 if the documents differ */
+   return diff.count ? E_NOTFOUND : E_SUCCESS;
+}
+
+static int compare_entry(diff_t *diff, const diff_entry_t *entry,
+                         gpointer data)
+{
+   GString *out = data;
+   gsize start;
+
+   switch (entry->kind) {
+      case DIFF_REMOVED:
+         g_string_append(out, "- ");
+         parser_path(&diff->a, entry->a, out);
+         break;
+      case DIFF_ADDED:
+         g_string_append(out, "+ ");
+         parser_path(&diff->b, entry->b, out);
+         break;
+      default:
+         g_string_append(out, "~ ");
+         parser_path(&diff->b, entry->b, out);
+         break;
+   }
+
+   g_string_append(out, "\n    ");
+
+   /* the old document on the left, the new one on the right */
+   start = out->len;
+   if (entry->a != ASN1_INDEX_NONE)
+      compare_side(&diff->a, entry->a, out);
+
+   if (entry->b != ASN1_INDEX_NONE) {
+      do {
+         g_string_append_c(out, ' ');
+      } while (out->len - start < COMPARE_COLUMN);
+      compare_side(&diff->b, entry->b, out);
+   }
+
+   g_string_append_c(out, '\n');
+
+   return E_SUCCESS;
+}
+
+static void compare_side(parser_t *parser, guint32 node, GString *out)
+{
+   asn1_node_t *n = &parser->index.nodes[node];
+
+   g_string_append_printf(out, "[%" G_GUINT64_FORMAT "+%" G_GUINT64_FORMAT
+         "] ", n->offset, n->hdr_len + n->length);
+   diff_preview(parser, node, out);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
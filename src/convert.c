@@ -0,0 +1,427 @@
+/* convert.c - bulk conversion between DER and PEM
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_convert.h>
+#include <certalize_base64.h>
+#include <certalize_stream.h>
+#include <certalize_loader.h>
+#include <certalize_debug.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+/* globals    */
+
+/*
+ * part of the output; either referencing the input mapping
+ * directly or a range of the job's output buffer
+ */
+typedef struct convert_piece {
+   const guchar *map;
+   guint64 offset;
+   gsize len;
+} convert_piece_t;
+
+/* conversion of one input file */
+typedef struct convert_job {
+   const gchar *filename;
+   /* the file written in outdir */
+   gchar *target;
+   struct convert_ctx *ctx;
+   cstream_t stream;
+   /* input records can be referenced while this is set */
+   GMappedFile *map;
+   GByteArray *out;
+   GArray *pieces;
+   guint64 records;
+   guint64 errors;
+   gboolean done;
+} convert_job_t;
+
+typedef struct convert_ctx {
+   gint target;
+   const gchar *outdir;
+   GMutex lock;
+   GCond cond;
+} convert_ctx_t;
+
+/* prototypes */
+static void convert_job_run(gpointer data, gpointer user_data);
+static int  convert_record(const guchar *der, gsize len, guint64 offset,
+                           gpointer data);
+static void convert_piece(convert_job_t *job, const guchar *map,
+                          guint64 offset, gsize len);
+static int  convert_write(convert_job_t *job, gint fd);
+static int  convert_targets(convert_job_t *jobs, guint count,
+                            const gchar *outdir, gint target);
+static int  convert_write_file(convert_job_t *job);
+static void convert_job_release(convert_job_t *job);
+
+
+/*************/
+
+/*
+ * converts all certificates of the given files, bundles and
+ * directories into the target encoding
+ *   - without outdir everything is written to stdout as one bundle,
+ *     in the order given
+ *   - with outdir every input file is rewritten into a file of the
+ *     same name with the extension of the target encoding; inputs
+ *     sharing a name and inputs which would be overwritten are
+ *     refused before anything is written
+ *   - files are converted in parallel; without outdir no more than
+ *     two per thread are converted ahead of the one being written,
+ *     as the finished ones hold their output until then
+ */
+int convert_run(GPtrArray *files, gint target, const gchar *outdir)
+{
+   convert_ctx_t ctx;
+   convert_job_t *jobs;
+   GPtrArray *inputs;
+   GThreadPool *pool;
+   guint64 errors = 0;
+   guint i, pushed, window;
+
+   inputs = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < files->len; i++)
+      loader_expand(inputs, g_ptr_array_index(files, i));
+
+   if (outdir && g_mkdir_with_parents(outdir, 0755) < 0) {
+      g_printerr("creating directory '%s' failed: %s\n", outdir,
+            g_strerror(errno));
+      g_ptr_array_free(inputs, TRUE);
+      return E_INVALID;
+   }
+
+   memset(&ctx, 0, sizeof(convert_ctx_t));
+   ctx.target = target;
+   ctx.outdir = outdir;
+   g_mutex_init(&ctx.lock);
+   g_cond_init(&ctx.cond);
+
+   jobs = g_new0(convert_job_t, inputs->len);
+   for (i = 0; i < inputs->len; i++) {
+      jobs[i].filename = g_ptr_array_index(inputs, i);
+      jobs[i].ctx = &ctx;
+   }
+
+   if (outdir && convert_targets(jobs, inputs->len, outdir, target) < 0) {
+      for (i = 0; i < inputs->len; i++)
+         g_free(jobs[i].target);
+      g_mutex_clear(&ctx.lock);
+      g_cond_clear(&ctx.cond);
+      g_free(jobs);
+      g_ptr_array_free(inputs, TRUE);
+      return E_INVALID;
+   }
+
+   pool = g_thread_pool_new(convert_job_run, NULL,
+         g_get_num_processors(), FALSE, NULL);
+
+   window = outdir ? inputs->len : 2 * g_get_num_processors();
+
+   for (pushed = 0; pushed < MIN(window, inputs->len); pushed++)
+      g_thread_pool_push(pool, &jobs[pushed], NULL);
+
+   /* the bundle is written in order while later files are converted */
+   for (i = 0; i < inputs->len; i++) {
+      g_mutex_lock(&ctx.lock);
+      while (!jobs[i].done)
+         g_cond_wait(&ctx.cond, &ctx.lock);
+      g_mutex_unlock(&ctx.lock);
+
+      if (outdir == NULL && convert_write(&jobs[i], STDOUT_FILENO) < 0)
+         jobs[i].errors++;
+
+      convert_job_release(&jobs[i]);
+      errors += jobs[i].errors;
+      g_free(jobs[i].target);
+
+      /* the window moves on with the written job */
+      if (pushed < inputs->len)
+         g_thread_pool_push(pool, &jobs[pushed++], NULL);
+   }
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   g_mutex_clear(&ctx.lock);
+   g_cond_clear(&ctx.cond);
+   g_free(jobs);
+   g_ptr_array_free(inputs, TRUE);
+
+   return errors ? E_INVALID : E_SUCCESS;
+}
+
+/*
+ * worker: splits the input into records and converts them
+ */
+static void convert_job_run(gpointer data, gpointer user_data _U_)
+{
+   convert_job_t *job = data;
+   convert_ctx_t *ctx = job->ctx;
+
+   job->out = g_byte_array_new();
+   job->pieces = g_array_new(FALSE, FALSE, sizeof(convert_piece_t));
+
+   cstream_init(&job->stream, convert_record, job);
+
+   /* DER records of a plain file are written straight from the mapping */
+   if (loader_stream_map(job->filename, &job->stream, &job->map) < 0) {
+      job->errors++;
+   }
+   else if (job->records == 0) {
+      g_printerr("%s: no certificates found\n", job->filename);
+      job->errors++;
+   }
+
+   cstream_destroy(&job->stream);
+
+   if (ctx->outdir) {
+      if (job->records && convert_write_file(job) < 0)
+         job->errors++;
+      convert_job_release(job);
+   }
+
+   g_mutex_lock(&ctx->lock);
+   job->done = TRUE;
+   g_cond_broadcast(&ctx->cond);
+   g_mutex_unlock(&ctx->lock);
+}
+
+/*
+ * converts one record split off the input
+ */
+static int convert_record(const guchar *der, gsize len, guint64 offset,
+                          gpointer data)
+{
+   convert_job_t *job = data;
+   gsize used;
+
+   if (der == NULL) {
+      g_printerr("%s: invalid PEM record at offset %" G_GUINT64_FORMAT "\n",
+            job->filename, offset);
+      job->errors++;
+      return E_SUCCESS;
+   }
+
+   job->records++;
+
+   if (job->ctx->target == CONVERT_DER) {
+      /* a DER record of the input is its own output */
+      if (job->map && job->stream.record_mode == CSTREAM_DER) {
+         convert_piece(job, (const guchar*)
+               g_mapped_file_get_contents(job->map), offset, len);
+      }
+      else {
+         convert_piece(job, NULL, job->out->len, len);
+         g_byte_array_append(job->out, der, len);
+      }
+   }
+   else {
+      used = job->out->len;
+      g_byte_array_set_size(job->out, used + PEM_ENCODED_LEN(len));
+      len = pem_encode(der, len, (gchar*)job->out->data + used);
+      g_byte_array_set_size(job->out, used + len);
+      convert_piece(job, NULL, used, len);
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * appends to the output, adjacent pieces are merged
+ */
+static void convert_piece(convert_job_t *job, const guchar *map,
+                          guint64 offset, gsize len)
+{
+   convert_piece_t *last, piece;
+
+   if (job->pieces->len) {
+      last = &g_array_index(job->pieces, convert_piece_t,
+            job->pieces->len - 1);
+      if (last->map == map && last->offset + last->len == offset) {
+         last->len += len;
+         return;
+      }
+   }
+
+   piece.map = map;
+   piece.offset = offset;
+   piece.len = len;
+   g_array_append_val(job->pieces, piece);
+}
+
+/*
+ * gathers the pieces into as few writes as possible
+ */
+static int convert_write(convert_job_t *job, gint fd)
+{
+   struct iovec iov[CONVERT_IOV_BATCH];
+   convert_piece_t *piece;
+   guint i = 0, n;
+   gssize written;
+
+   while (i < job->pieces->len) {
+      for (n = 0; n < CONVERT_IOV_BATCH && i + n < job->pieces->len; n++) {
+         piece = &g_array_index(job->pieces, convert_piece_t, i + n);
+         iov[n].iov_base = (guchar*)(piece->map ? piece->map :
+               job->out->data) + piece->offset;
+         iov[n].iov_len = piece->len;
+      }
+
+      written = writev(fd, iov, n);
+      if (written < 0) {
+         if (errno == EINTR)
+            continue;
+         g_printerr("writing '%s' failed: %s\n", job->filename,
+               g_strerror(errno));
+         return -E_INVALID;
+      }
+
+      /* skip what has been written, partially written pieces shrink */
+      while (written > 0) {
+         piece = &g_array_index(job->pieces, convert_piece_t, i);
+         if ((gsize)written >= piece->len) {
+            written -= piece->len;
+            i++;
+         }
+         else {
+            piece->offset += written;
+            piece->len -= written;
+            written = 0;
+         }
+      }
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * names the output of every job: the name of the input with the
+ * extension of the target encoding
+ *   - inputs of the same name but for the extension would overwrite
+ *     each other's output
+ *   - an input may not be its own output, which would be truncated
+ *     while its records are still written from the mapping
+ */
+static int convert_targets(convert_job_t *jobs, guint count,
+                           const gchar *outdir, gint target)
+{
+   GHashTable *names;
+   convert_job_t *other;
+   struct stat in, out;
+   gchar *base, *dot, *name;
+   guint i;
+   int res = E_SUCCESS;
+
+   names = g_hash_table_new(g_str_hash, g_str_equal);
+
+   for (i = 0; i < count; i++) {
+      base = strcmp(jobs[i].filename, "-") ?
+         g_path_get_basename(jobs[i].filename) : g_strdup("stdin");
+      if ((dot = strrchr(base, '.')) != NULL && dot != base)
+         *dot = '\0';
+
+      name = g_strconcat(base, target == CONVERT_DER ? ".der" : ".pem", NULL);
+      jobs[i].target = g_build_filename(outdir, name, NULL);
+      g_free(name);
+      g_free(base);
+
+      if ((other = g_hash_table_lookup(names, jobs[i].target)) != NULL) {
+         g_printerr("'%s' and '%s' would both be written to '%s'\n",
+               other->filename, jobs[i].filename, jobs[i].target);
+         res = -E_INVALID;
+         continue;
+      }
+      g_hash_table_insert(names, jobs[i].target, &jobs[i]);
+
+      if (strcmp(jobs[i].filename, "-") &&
+          stat(jobs[i].filename, &in) == 0 &&
+          stat(jobs[i].target, &out) == 0 &&
+          in.st_dev == out.st_dev && in.st_ino == out.st_ino) {
+         g_printerr("'%s' would be overwritten by its own conversion\n",
+               jobs[i].filename);
+         res = -E_INVALID;
+      }
+   }
+
+   g_hash_table_destroy(names);
+
+   return res;
+}
+
+/*
+ * writes the output of the job next to the others in outdir; it
+ * replaces an existing file only once it is complete
+ */
+static int convert_write_file(convert_job_t *job)
+{
+   gchar *tmp;
+   gint fd;
+   int res;
+
+   tmp = g_strconcat(job->target, ".tmp", NULL);
+
+   fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      g_printerr("creating '%s' failed: %s\n", tmp, g_strerror(errno));
+      g_free(tmp);
+      return -E_INVALID;
+   }
+
+   res = convert_write(job, fd);
+
+   if (close(fd) < 0 && res == E_SUCCESS) {
+      g_printerr("writing '%s' failed: %s\n", tmp, g_strerror(errno));
+      res = -E_INVALID;
+   }
+
+   if (res == E_SUCCESS && rename(tmp, job->target) < 0) {
+      g_printerr("renaming '%s' failed: %s\n", tmp, g_strerror(errno));
+      res = -E_INVALID;
+   }
+
+   if (res != E_SUCCESS)
+      unlink(tmp);
+
+   g_free(tmp);
+
+   return res;
+}
+
+static void convert_job_release(convert_job_t *job)
+{
+   if (job->map)
+      g_mapped_file_unref(job->map);
+   if (job->out)
+      g_byte_array_free(job->out, TRUE);
+   if (job->pieces)
+      g_array_free(job->pieces, TRUE);
+
+   job->map = NULL;
+   job->out = NULL;
+   job->pieces = NULL;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
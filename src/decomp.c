@@ -0,0 +1,383 @@
+/* decomp.c - decompression of gzip and zstd inputs
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <certalize.h>
+#include <certalize_decomp.h>
+#include <certalize_debug.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* globals    */
+
+typedef struct decomp_chunk {
+   guchar *buf;
+   gsize len;
+} decomp_chunk_t;
+
+/*
+ * the decompressing thread fills chunks taken from the free queue and
+ * passes them on in order through the full queue; an empty chunk
+ * marks the end
+ */
+typedef struct decomp_ctx {
+   guint format;
+   const guchar *data;
+   gsize len;
+   GAsyncQueue *free;
+   GAsyncQueue *full;
+   /* chunk currently filled */
+   decomp_chunk_t *chunk;
+   /* set by the consumer to stop early */
+   gint abort;
+   int result;
+} decomp_ctx_t;
+
+/* output of decomp_buffer() */
+typedef struct decomp_out {
+   GByteArray *buf;
+   gsize max;
+} decomp_out_t;
+
+/* prototypes */
+static gpointer decomp_thread(gpointer data);
+static int decomp_push(decomp_ctx_t *ctx);
+#ifdef HAVE_ZLIB
+static int decomp_gzip(decomp_ctx_t *ctx);
+#endif
+#ifdef HAVE_ZSTD
+static int decomp_zstd(decomp_ctx_t *ctx);
+#endif
+static int decomp_append(const guchar *buf, gsize len, gpointer data);
+
+
+/*************/
+
+/*
+ * detects compressed data by its magic
+ */
+guint decomp_probe(const guchar *data, gsize len)
+{
+   if (len >= 3 && data[0] == 0x1f && data[1] == 0x8b && data[2] == 0x08)
+      return DECOMP_GZIP;
+
+   if (len >= 4 && data[0] == 0x28 && data[1] == 0xb5 &&
+       data[2] == 0x2f && data[3] == 0xfd)
+      return DECOMP_ZSTD;
+
+   return DECOMP_NONE;
+}
+
+const gchar* decomp_name(guint format)
+{
+   switch (format) {
+      case DECOMP_GZIP:
+         return "gzip";
+      case DECOMP_ZSTD:
+         return "zstd";
+      default:
+         return "none";
+   }
+}
+
+/*
+ * decompresses data on a separate thread while the callback
+ * consumes the previous chunk
+ *   - returns -E_NOTHANDLED if the format is not compiled in,
+ *     -E_INVALID for corrupt or truncated input or the first
+ *     error returned by the callback
+ */
+int decomp_run(guint format, const guchar *data, gsize len,
+               decomp_chunk_cb callback, gpointer cbdata)
+{
+   decomp_ctx_t ctx;
+   decomp_chunk_t *chunk;
+   GThread *thread;
+   int res = E_SUCCESS;
+   guint i;
+
+   switch (format) {
+#ifdef HAVE_ZLIB
+      case DECOMP_GZIP:
+         break;
+#endif
+#ifdef HAVE_ZSTD
+      case DECOMP_ZSTD:
+         break;
+#endif
+      default:
+         DEBUG_MSG("decomp_run: %s not supported", decomp_name(format));
+         return -E_NOTHANDLED;
+   }
+
+   memset(&ctx, 0, sizeof(decomp_ctx_t));
+   ctx.format = format;
+   ctx.data = data;
+   ctx.len = len;
+   ctx.free = g_async_queue_new();
+   ctx.full = g_async_queue_new();
+
+   for (i = 0; i < DECOMP_CHUNKS; i++) {
+      chunk = g_new0(decomp_chunk_t, 1);
+      chunk->buf = g_malloc(DECOMP_CHUNK_SIZE);
+      g_async_queue_push(ctx.free, chunk);
+   }
+
+   thread = g_thread_new("decomp", decomp_thread, &ctx);
+
+   for (;;) {
+      chunk = g_async_queue_pop(ctx.full);
+
+      if (chunk->len == 0) {
+         g_async_queue_push(ctx.free, chunk);
+         break;
+      }
+
+      /* after an error the remaining chunks are only drained */
+      if (res == E_SUCCESS &&
+          (res = callback(chunk->buf, chunk->len, cbdata)) < 0)
+         g_atomic_int_set(&ctx.abort, TRUE);
+
+      g_async_queue_push(ctx.free, chunk);
+   }
+
+   g_thread_join(thread);
+
+   if (res == E_SUCCESS)
+      res = ctx.result;
+
+   for (i = 0; i < DECOMP_CHUNKS; i++) {
+      chunk = g_async_queue_pop(ctx.free);
+      g_free(chunk->buf);
+      g_free(chunk);
+   }
+
+   g_async_queue_unref(ctx.free);
+   g_async_queue_unref(ctx.full);
+
+   return res;
+}
+
+/*
+ * decompresses data as a whole into a newly allocated buffer of at
+ * most max bytes, DECOMP_MAX_BUFFER if 0; more fails, so a small
+ * input can not expand to fill the memory
+ */
+guchar* decomp_buffer(guint format, const guchar *data, gsize len,
+                      gsize max, gsize *outlen)
+{
+   decomp_out_t out;
+
+   out.max = MIN(max ? max : DECOMP_MAX_BUFFER, G_MAXUINT);
+   out.buf = g_byte_array_sized_new(MIN(len * 4, out.max));
+
+   if (decomp_run(format, data, len, decomp_append, &out) < 0) {
+      g_byte_array_free(out.buf, TRUE);
+      return NULL;
+   }
+
+   *outlen = out.buf->len;
+
+   return g_byte_array_free(out.buf, FALSE);
+}
+
+static int decomp_append(const guchar *buf, gsize len, gpointer data)
+{
+   decomp_out_t *out = data;
+
+   if (out->buf->len + len > out->max) {
+      DEBUG_MSG("decomp_append: more than %lu bytes", (gulong)out->max);
+      return -E_INVALID;
+   }
+
+   g_byte_array_append(out->buf, buf, len);
+
+   return E_SUCCESS;
+}
+
+static gpointer decomp_thread(gpointer data)
+{
+   decomp_ctx_t *ctx = data;
+   int res = -E_NOTHANDLED;
+
+   ctx->chunk = g_async_queue_pop(ctx->free);
+   ctx->chunk->len = 0;
+
+   switch (ctx->format) {
+#ifdef HAVE_ZLIB
+      case DECOMP_GZIP:
+         res = decomp_gzip(ctx);
+         break;
+#endif
+#ifdef HAVE_ZSTD
+      case DECOMP_ZSTD:
+         res = decomp_zstd(ctx);
+         break;
+#endif
+   }
+
+   /* the last partial chunk */
+   if (res == E_SUCCESS && ctx->chunk->len)
+      res = decomp_push(ctx);
+
+   ctx->result = res;
+
+   /* end marker */
+   ctx->chunk->len = 0;
+   g_async_queue_push(ctx->full, ctx->chunk);
+   ctx->chunk = NULL;
+
+   return NULL;
+}
+
+/*
+ * hands the current chunk to the consumer and waits for a free one
+ */
+static int decomp_push(decomp_ctx_t *ctx)
+{
+   if (g_atomic_int_get(&ctx->abort))
+      return -E_NOTHANDLED;
+
+   g_async_queue_push(ctx->full, ctx->chunk);
+
+   ctx->chunk = g_async_queue_pop(ctx->free);
+   ctx->chunk->len = 0;
+
+   return E_SUCCESS;
+}
+
+#ifdef HAVE_ZLIB
+/*
+ * inflates all members of a gzip file
+ */
+static int decomp_gzip(decomp_ctx_t *ctx)
+{
+   z_stream z;
+   gsize pos = 0;
+   int ret, res = E_SUCCESS;
+
+   memset(&z, 0, sizeof(z_stream));
+
+   /* gzip wrapper only */
+   if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+      return -E_INITFAIL;
+
+   for (;;) {
+      /* avail_in is 32-bit wide, large inputs are fed in parts */
+      if (z.avail_in == 0 && pos < ctx->len) {
+         z.next_in = (Bytef*)ctx->data + pos;
+         z.avail_in = MIN(ctx->len - pos, G_MAXUINT32);
+         pos += z.avail_in;
+      }
+
+      z.next_out = ctx->chunk->buf + ctx->chunk->len;
+      z.avail_out = DECOMP_CHUNK_SIZE - ctx->chunk->len;
+
+      ret = inflate(&z, Z_NO_FLUSH);
+      ctx->chunk->len = DECOMP_CHUNK_SIZE - z.avail_out;
+
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+         DEBUG_MSG("decomp_gzip: inflate failed (%d) after %lu bytes",
+               ret, z.total_in);
+         res = -E_INVALID;
+         break;
+      }
+
+      if (ctx->chunk->len == DECOMP_CHUNK_SIZE &&
+          (res = decomp_push(ctx)) < 0)
+         break;
+
+      if (ret == Z_STREAM_END) {
+         if (z.avail_in == 0 && pos == ctx->len)
+            break;
+         /* the next member of a concatenated file */
+         inflateReset(&z);
+      }
+   }
+
+   inflateEnd(&z);
+
+   return res;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * decompresses all frames of a zstd file
+ */
+static int decomp_zstd(decomp_ctx_t *ctx)
+{
+   ZSTD_DStream *ds;
+   ZSTD_inBuffer in;
+   ZSTD_outBuffer out;
+   size_t ret;
+   int res = E_SUCCESS;
+
+   if ((ds = ZSTD_createDStream()) == NULL)
+      return -E_INITFAIL;
+
+   ZSTD_initDStream(ds);
+
+   in.src = ctx->data;
+   in.size = ctx->len;
+   in.pos = 0;
+
+   for (;;) {
+      out.dst = ctx->chunk->buf;
+      out.size = DECOMP_CHUNK_SIZE;
+      out.pos = ctx->chunk->len;
+
+      ret = ZSTD_decompressStream(ds, &out, &in);
+      ctx->chunk->len = out.pos;
+
+      if (ZSTD_isError(ret)) {
+         DEBUG_MSG("decomp_zstd: %s", ZSTD_getErrorName(ret));
+         res = -E_INVALID;
+         break;
+      }
+
+      if (ctx->chunk->len == DECOMP_CHUNK_SIZE) {
+         if ((res = decomp_push(ctx)) < 0)
+            break;
+         continue;
+      }
+
+      /* output space is left, so all input has been decoded */
+      if (in.pos == in.size) {
+         /* a frame is still open */
+         if (ret != 0)
+            res = -E_INVALID;
+         break;
+      }
+   }
+
+   ZSTD_freeDStream(ds);
+
+   return res;
+}
+#endif
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,411 @@
+/* diff.c - structural difference of documents by subtree hashes
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_diff.h>
+#include <certalize_sketch.h>
+#include <certalize_oid.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* prototypes */
+static guint64* diff_hash(parser_t *parser, guint64 *hashes, guint32 *size);
+static void diff_children(diff_t *diff, guint32 pa, guint32 pb);
+static gboolean diff_equal(diff_t *diff, guint32 a, guint32 b);
+static void diff_pair(diff_t *diff, guint32 a, guint32 b);
+static void diff_emit(diff_t *diff, guint kind, guint32 a, guint32 b);
+static GArray* diff_list(asn1_index_t *index, guint32 parent);
+static GHashTable* diff_table(const guint64 *hashes, GArray *list,
+                              guint from, guint to);
+static guint diff_lookup(diff_t *diff, GHashTable *table, GArray *list,
+                         guint from, guint32 node, gboolean in_a);
+
+
+/*************/
+
+void diff_init(diff_t *diff)
+{
+   memset(diff, 0, sizeof(diff_t));
+
+   parser_init(&diff->a, PARSER_SCHEMA);
+   parser_init(&diff->b, PARSER_SCHEMA);
+}
+
+void diff_destroy(diff_t *diff)
+{
+   parser_destroy(&diff->a);
+   parser_destroy(&diff->b);
+   g_free(diff->ha);
+   g_free(diff->hb);
+}
+
+/*
+ * compares document b to document a, reporting every difference to
+ * the callback; diff->count tells how many there were
+ */
+int diff_documents(diff_t *diff, const guchar *a, gsize alen,
+                   const guchar *b, gsize blen, diff_cb callback,
+                   gpointer data)
+{
+   if (parser_parse(&diff->a, a, alen) < 0 ||
+       parser_parse(&diff->b, b, blen) < 0)
+      return -E_INVALID;
+
+   diff->ha = diff_hash(&diff->a, diff->ha, &diff->ha_size);
+   diff->hb = diff_hash(&diff->b, diff->hb, &diff->hb_size);
+
+   diff->callback = callback;
+   diff->data = data;
+   diff->count = 0;
+   diff->stop = FALSE;
+
+   diff_children(diff, ASN1_INDEX_NONE, ASN1_INDEX_NONE);
+
+   DEBUG_MSG("diff_documents: %" G_GUINT64_FORMAT " differences",
+         diff->count);
+
+   return E_SUCCESS;
+}
+
+/*
+ * the value of an element in a line: OIDs dotted and named, strings
+ * and times as text, anything else as hex
+ */
+void diff_preview(parser_t *parser, guint32 node, GString *out)
+{
+   const oid_entry_t *entry;
+   const guchar *ptr;
+   asn1_tlv_t tlv;
+   asn1_oid_t oid;
+   gchar dotted[128];
+   gsize i, len;
+
+   if (asn1_index_tlv(&parser->index, node, &tlv) < 0)
+      return;
+
+   if (tlv.constructed) {
+      g_string_append_printf(out, "(%" G_GUINT64_FORMAT " bytes)",
+            tlv.length);
+      return;
+   }
+
+   ptr = ASN1_CONTENT(&parser->cbuf, &tlv);
+   len = MIN(tlv.length, DIFF_PREVIEW_BYTES);
+
+   if (tlv.class == ASN1_CLASS_UNIVERSAL) {
+      switch (tlv.tag) {
+         case ASN1_TAG_OID:
+            if (asn1_decode_oid(&parser->cbuf, &tlv, &oid) == E_SUCCESS) {
+               asn1_oid_to_string(&oid, dotted, sizeof(dotted));
+               g_string_append(out, dotted);
+               entry = oid_lookup(ptr, tlv.length);
+               if (entry)
+                  g_string_append_printf(out, " (%s)", entry->name);
+               return;
+            }
+            break;
+         case ASN1_TAG_UTF8STRING:
+         case ASN1_TAG_NUMERIC_STRING:
+         case ASN1_TAG_PRINTABLE_STRING:
+         case ASN1_TAG_TG1_STRING:
+         case ASN1_TAG_IA5_STRING:
+         case ASN1_TAG_UTC_TIME:
+         case ASN1_TAG_GERNERALIZED_TIME:
+         case ASN1_TAG_VISIBLE_STRING:
+            g_string_append_c(out, '"');
+            for (i = 0; i < len; i++)
+               g_string_append_c(out, g_ascii_isprint(ptr[i]) ? ptr[i] : '.');
+            g_string_append(out, tlv.length > len ? "\"..." : "\"");
+            return;
+         default:
+            break;
+      }
+   }
+
+   for (i = 0; i < len; i++)
+      g_string_append_printf(out, "%02x", ptr[i]);
+   if (tlv.length > len)
+      g_string_append(out, "...");
+}
+
+/*
+ * hashes of all nodes of the document parsed last; children follow
+ * their parent in the index, so going backwards every child is done
+ * before its parent
+ */
+static guint64* diff_hash(parser_t *parser, guint64 *hashes, guint32 *size)
+{
+   asn1_index_t *index = &parser->index;
+   cbuf_t *cbuf = &parser->cbuf;
+   asn1_node_t *node;
+   guint64 h, end;
+   guint32 i, c;
+
+   if (index->len > *size) {
+      *size = index->len;
+      hashes = g_renew(guint64, hashes, *size);
+   }
+
+   for (i = index->len; i-- > 0; ) {
+      node = &index->nodes[i];
+      end = MIN(node->offset + node->hdr_len + node->length, cbuf->length);
+
+      if (!node->constructed) {
+         hashes[i] = sketch_hash(cbuf->buffer + node->offset,
+               end - node->offset);
+         continue;
+      }
+
+      /* the header holds the length, so appended bytes differ too */
+      h = sketch_hash(cbuf->buffer + node->offset, node->hdr_len);
+
+      for (c = ASN1_INDEX_CHILD(index, i); c < index->len;
+           c = index->nodes[c].next)
+         h ^= hashes[c] + G_GUINT64_CONSTANT(0x9e3779b97f4a7c15) +
+            (h << 6) + (h >> 2);
+
+      hashes[i] = h;
+   }
+
+   return hashes;
+}
+
+/*
+ * aligns the children of pa and pb, the top-level elements if none
+ *   - equal runs at both ends are skipped without looking further
+ *   - in between, an element whose hash is found later on the other
+ *     side marks the elements up to there as added or removed,
+ *     whichever are fewer; two elements found nowhere else are paired
+ */
+static void diff_children(diff_t *diff, guint32 pa, guint32 pb)
+{
+   GArray *la, *lb;
+   GHashTable *ta = NULL, *tb = NULL;
+   guint32 *ca, *cb;
+   guint i, j, ea, eb, fa, fb;
+
+   la = diff_list(&diff->a.index, pa);
+   lb = diff_list(&diff->b.index, pb);
+   ca = (guint32*)la->data;
+   cb = (guint32*)lb->data;
+
+   i = 0;
+   while (i < la->len && i < lb->len && diff_equal(diff, ca[i], cb[i]))
+      i++;
+   j = i;
+
+   ea = la->len;
+   eb = lb->len;
+   while (ea > i && eb > j && diff_equal(diff, ca[ea - 1], cb[eb - 1])) {
+      ea--;
+      eb--;
+   }
+
+   /* a single element on each side needs no alignment */
+   if (ea - i > 1 || eb - j > 1) {
+      ta = diff_table(diff->ha, la, i, ea);
+      tb = diff_table(diff->hb, lb, j, eb);
+   }
+
+   while (i < ea && j < eb && !diff->stop) {
+      if (diff_equal(diff, ca[i], cb[j])) {
+         i++;
+         j++;
+         continue;
+      }
+
+      fb = tb ? diff_lookup(diff, tb, lb, j, ca[i], FALSE) : G_MAXUINT;
+      fa = ta ? diff_lookup(diff, ta, la, i, cb[j], TRUE) : G_MAXUINT;
+
+      if (fb != G_MAXUINT && (fa == G_MAXUINT || fb - j <= fa - i)) {
+         while (j < fb)
+            diff_emit(diff, DIFF_ADDED, ASN1_INDEX_NONE, cb[j++]);
+      }
+      else if (fa != G_MAXUINT) {
+         while (i < fa)
+            diff_emit(diff, DIFF_REMOVED, ca[i++], ASN1_INDEX_NONE);
+      }
+      else {
+         diff_pair(diff, ca[i++], cb[j++]);
+      }
+   }
+
+   while (i < ea)
+      diff_emit(diff, DIFF_REMOVED, ca[i++], ASN1_INDEX_NONE);
+   while (j < eb)
+      diff_emit(diff, DIFF_ADDED, ASN1_INDEX_NONE, cb[j++]);
+
+   if (ta)
+      g_hash_table_destroy(ta);
+   if (tb)
+      g_hash_table_destroy(tb);
+   g_array_free(la, TRUE);
+   g_array_free(lb, TRUE);
+}
+
+/*
+ * whether element a of the first document and b of the second are
+ * the same; equal hashes are confirmed by their bytes, as 64 bits
+ * of an unkeyed hash may collide, so a match costs a memcmp() of
+ * the whole element
+ */
+static gboolean diff_equal(diff_t *diff, guint32 a, guint32 b)
+{
+   asn1_node_t *na = &diff->a.index.nodes[a];
+   asn1_node_t *nb = &diff->b.index.nodes[b];
+   guint64 ea, eb;
+
+   if (diff->ha[a] != diff->hb[b] || na->hdr_len != nb->hdr_len ||
+       na->length != nb->length)
+      return FALSE;
+
+   ea = MIN(na->offset + na->hdr_len + na->length, diff->a.cbuf.length);
+   eb = MIN(nb->offset + nb->hdr_len + nb->length, diff->b.cbuf.length);
+
+   return ea - na->offset == eb - nb->offset &&
+      !memcmp(diff->a.cbuf.buffer + na->offset,
+              diff->b.cbuf.buffer + nb->offset, ea - na->offset);
+}
+
+/*
+ * two differing elements at the same place; constructed ones of the
+ * same tag are descended into, which only finds nothing if their
+ * headers differ
+ */
+static void diff_pair(diff_t *diff, guint32 a, guint32 b)
+{
+   asn1_node_t *na = &diff->a.index.nodes[a];
+   asn1_node_t *nb = &diff->b.index.nodes[b];
+   guint64 count = diff->count;
+
+   if (na->constructed && nb->constructed &&
+       na->class == nb->class && na->tag == nb->tag) {
+      diff_children(diff, a, b);
+      if (diff->count > count)
+         return;
+   }
+
+   diff_emit(diff, DIFF_CHANGED, a, b);
+}
+
+static void diff_emit(diff_t *diff, guint kind, guint32 a, guint32 b)
+{
+   diff_entry_t entry;
+
+   if (diff->stop)
+      return;
+
+   entry.kind = kind;
+   entry.a = a;
+   entry.b = b;
+
+   diff->count++;
+
+   if (diff->callback(diff, &entry, diff->data) < 0)
+      diff->stop = TRUE;
+}
+
+/*
+ * the children of parent in order, the top-level elements if none
+ */
+static GArray* diff_list(asn1_index_t *index, guint32 parent)
+{
+   GArray *list;
+   guint32 c;
+
+   list = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+   if (parent == ASN1_INDEX_NONE)
+      c = index->len ? 0 : ASN1_INDEX_NONE;
+   else
+      c = ASN1_INDEX_CHILD(index, parent);
+
+   for (; c < index->len; c = index->nodes[c].next)
+      g_array_append_val(list, c);
+
+   return list;
+}
+
+/*
+ * all positions of every hash among the elements from .. to - 1, in
+ * ascending order, so repeated elements are told apart
+ */
+static GHashTable* diff_table(const guint64 *hashes, GArray *list,
+                              guint from, guint to)
+{
+   GHashTable *table;
+   GArray *pos;
+   const guint64 *hash;
+   guint i;
+
+   table = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+         (GDestroyNotify)g_array_unref);
+
+   for (i = from; i < to; i++) {
+      hash = &hashes[g_array_index(list, guint32, i)];
+      if ((pos = g_hash_table_lookup(table, hash)) == NULL) {
+         pos = g_array_new(FALSE, FALSE, sizeof(guint));
+         g_hash_table_insert(table, (gpointer)hash, pos);
+      }
+      g_array_append_val(pos, i);
+   }
+
+   return table;
+}
+
+/*
+ * first position at or after from in the table of one side holding
+ * the same element as node of the other side, G_MAXUINT if there is
+ * none; in_a tells the table is of the first document
+ */
+static guint diff_lookup(diff_t *diff, GHashTable *table, GArray *list,
+                         guint from, guint32 node, gboolean in_a)
+{
+   GArray *pos;
+   guint32 c;
+   guint lo, hi, mid;
+
+   pos = g_hash_table_lookup(table, in_a ? &diff->hb[node] : &diff->ha[node]);
+   if (pos == NULL)
+      return G_MAXUINT;
+
+   /* positions are ascending, skip those before from */
+   lo = 0;
+   hi = pos->len;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (g_array_index(pos, guint, mid) < from)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (; lo < pos->len; lo++) {
+      c = g_array_index(list, guint32, g_array_index(pos, guint, lo));
+      if (in_a ? diff_equal(diff, c, node) : diff_equal(diff, node, c))
+         return g_array_index(pos, guint, lo);
+   }
+
+   return G_MAXUINT;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,179 @@
+/* extract.c - extraction of a corpus into a column store
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_extract.h>
+#include <certalize_store.h>
+#include <certalize_stream.h>
+#include <certalize_loader.h>
+#include <certalize_index.h>
+#include <certalize_x509.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/*
+ * rows of one input file; the files are extracted in parallel and
+ * appended to the store in the order they were given
+ */
+typedef struct extract_job {
+   const gchar *filename;
+   store_writer_t writer;
+   guint64 invalid;
+   gboolean failed;
+} extract_job_t;
+
+/* parser state of one worker thread */
+typedef struct extract_worker {
+   asn1_index_t index;
+   cstream_t stream;
+   extract_job_t *job;
+} extract_worker_t;
+
+/* prototypes */
+static void extract_job_run(gpointer data, gpointer user_data);
+static int  extract_record(const guchar *der, gsize len, guint64 offset,
+                           gpointer data);
+
+
+/*************/
+
+/*
+ * extracts the fields of the certificates of all files and
+ * directories into the column store at path; records exceeding
+ * the limits are skipped as invalid
+ */
+int extract_run(GPtrArray *files, const gchar *path,
+                const asn1_limits_t *limits)
+{
+   GAsyncQueue *workers;
+   GThreadPool *pool;
+   GPtrArray *inputs;
+   extract_job_t *jobs;
+   extract_worker_t *worker;
+   store_writer_t store;
+   guint64 invalid = 0;
+   guint i, threads;
+   gboolean failed = FALSE;
+   int res;
+
+   inputs = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < files->len; i++)
+      loader_expand(inputs, g_ptr_array_index(files, i));
+
+   threads = g_get_num_processors();
+   workers = g_async_queue_new();
+   for (i = 0; i < threads; i++) {
+      worker = g_new0(extract_worker_t, 1);
+      asn1_index_init(&worker->index);
+      asn1_index_set_limits(&worker->index, limits);
+      cstream_init(&worker->stream, extract_record, worker);
+      g_async_queue_push(workers, worker);
+   }
+
+   jobs = g_new0(extract_job_t, MAX(inputs->len, 1));
+   pool = g_thread_pool_new(extract_job_run, workers, threads, FALSE, NULL);
+
+   for (i = 0; i < inputs->len; i++) {
+      jobs[i].filename = g_ptr_array_index(inputs, i);
+      store_writer_init(&jobs[i].writer);
+      g_thread_pool_push(pool, &jobs[i], NULL);
+   }
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   store_writer_init(&store);
+   for (i = 0; i < inputs->len; i++) {
+      store_writer_merge(&store, &jobs[i].writer);
+      store_writer_destroy(&jobs[i].writer);
+      invalid += jobs[i].invalid;
+      failed = failed || jobs[i].failed;
+   }
+
+   res = store_writer_save(&store, path);
+   if (res == E_SUCCESS)
+      g_printerr("%" G_GUINT64_FORMAT " certificates written to '%s', "
+            "%" G_GUINT64_FORMAT " invalid records skipped\n",
+            store.rows, path, invalid);
+
+   store_writer_destroy(&store);
+
+   while ((worker = g_async_queue_try_pop(workers)) != NULL) {
+      asn1_index_destroy(&worker->index);
+      cstream_destroy(&worker->stream);
+      g_free(worker);
+   }
+   g_async_queue_unref(workers);
+   g_free(jobs);
+   g_ptr_array_free(inputs, TRUE);
+
+   return res == E_SUCCESS && !failed ? E_SUCCESS : E_INVALID;
+}
+
+/*
+ * worker: splits one input file into records
+ */
+static void extract_job_run(gpointer data, gpointer user_data)
+{
+   extract_job_t *job = data;
+   GAsyncQueue *workers = user_data;
+   extract_worker_t *worker;
+
+   worker = g_async_queue_pop(workers);
+   worker->job = job;
+
+   if (loader_stream(job->filename, &worker->stream) < 0)
+      job->failed = TRUE;
+
+   worker->job = NULL;
+   g_async_queue_push(workers, worker);
+}
+
+/*
+ * adds the row of one record to the writer of the file
+ */
+static int extract_record(const guchar *der, gsize len, guint64 offset,
+                          gpointer data)
+{
+   extract_worker_t *worker = data;
+   extract_job_t *job = worker->job;
+   x509_cert_t cert;
+   cbuf_t cbuf;
+
+   if (der == NULL) {
+      job->invalid++;
+      return E_SUCCESS;
+   }
+
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = (guchar*)der;
+   cbuf.length = len;
+
+   if (asn1_index_element(&worker->index, &cbuf, 0) < 0 ||
+       x509_parse_index(&cbuf, &worker->index, 0, &cert) < 0 ||
+       store_writer_add(&job->writer, &cbuf, &cert, job->filename,
+          offset) < 0)
+      job->invalid++;
+
+   return E_SUCCESS;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
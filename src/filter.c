@@ -0,0 +1,1011 @@
+/* filter.c - selection of certificates by an expression
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_filter.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* instructions of the stack machine */
+enum {
+   FILTER_OP_PUSH = 0,        /* value */
+   FILTER_OP_LOAD,            /* integer field */
+   FILTER_OP_ADD,
+   FILTER_OP_SUB,
+   FILTER_OP_LT,
+   FILTER_OP_LE,
+   FILTER_OP_GT,
+   FILTER_OP_GE,
+   FILTER_OP_EQ,
+   FILTER_OP_NE,
+   FILTER_OP_NOT,
+   FILTER_OP_JZ,              /* to arg if the top is 0, keeping it */
+   FILTER_OP_JNZ,             /* to arg if the top is not 0, keeping it */
+   FILTER_OP_POP,
+   /* push the result of a string field against literal arg */
+   FILTER_OP_STR_EQ,
+   FILTER_OP_MATCH,
+   /* as above, TRUE if any entry of a list field is */
+   FILTER_OP_LIST_EQ,
+   FILTER_OP_LIST_MATCH,
+};
+
+typedef struct filter_insn {
+   guint8 op;
+   guint8 field;
+   guint32 arg;
+   gint64 value;
+} filter_insn_t;
+
+struct filter {
+   GArray *code;
+   /* literals and regular expressions referenced by arg */
+   GPtrArray *strings;
+   GPtrArray *regexes;
+   guint32 mask;
+   gint64 now;
+};
+
+/* tokens */
+enum {
+   FILTER_TOK_END = 0,
+   FILTER_TOK_NUMBER,
+   FILTER_TOK_STRING,
+   FILTER_TOK_IDENT,
+   FILTER_TOK_AND,
+   FILTER_TOK_OR,
+   FILTER_TOK_NOT,
+   FILTER_TOK_LPAREN,
+   FILTER_TOK_RPAREN,
+   FILTER_TOK_PLUS,
+   FILTER_TOK_MINUS,
+   FILTER_TOK_LT,
+   FILTER_TOK_LE,
+   FILTER_TOK_GT,
+   FILTER_TOK_GE,
+   FILTER_TOK_EQ,
+   FILTER_TOK_NE,
+   FILTER_TOK_MATCH,
+};
+
+/* what an operand of a comparison is */
+enum {
+   FILTER_TYPE_INT = 0,       /* on the stack */
+   FILTER_TYPE_STR,           /* string field, not loaded yet */
+   FILTER_TYPE_LIST,          /* list field, not loaded yet */
+   FILTER_TYPE_LITERAL,       /* string literal */
+};
+
+typedef struct filter_operand {
+   guint type;
+   guint field;
+   /* the literal, for FILTER_TYPE_LITERAL */
+   gchar *string;
+} filter_operand_t;
+
+typedef struct filter_parser {
+   filter_t *filter;
+   const gchar *expression;
+   const gchar *pos;
+   /* current token */
+   guint token;
+   const gchar *start;
+   gsize len;
+   gint64 number;
+   GString *string;
+   /* values on the stack at this point of the code, and at most */
+   guint depth;
+   guint max_depth;
+   guint nesting;
+} filter_parser_t;
+
+/* names of the fields besides the column names */
+static const struct {
+   const gchar *name;
+   guint field;
+} filter_aliases[] = {
+   { "keySize", STORE_COL_KEY_BITS },
+};
+
+/* prototypes */
+static int  filter_next(filter_parser_t *p);
+static int  filter_error(filter_parser_t *p, const gchar *message);
+static int  filter_or(filter_parser_t *p);
+static int  filter_and(filter_parser_t *p);
+static int  filter_unary(filter_parser_t *p);
+static int  filter_comparison(filter_parser_t *p);
+static int  filter_sum(filter_parser_t *p, filter_operand_t *operand);
+static int  filter_term(filter_parser_t *p, filter_operand_t *operand);
+static int  filter_field(const gchar *name, gsize len);
+static guint filter_field_type(guint field);
+static guint filter_emit(filter_parser_t *p, guint op, guint field,
+                         guint32 arg, gint64 value);
+static int  filter_emit_string(filter_parser_t *p, guint tok,
+                               filter_operand_t *field,
+                               filter_operand_t *literal);
+static gboolean filter_list_match(filter_t *filter, filter_insn_t *insn,
+                                  filter_fields_t *fields);
+static void filter_hex(const guchar *data, gsize len, gchar *out);
+static void filter_serial(filter_fields_t *fields, const guchar *data,
+                          gsize len);
+
+
+/*************/
+
+/*
+ * compiles an expression; syntax errors are reported on stderr and
+ * yield NULL
+ */
+filter_t* filter_new(const gchar *expression)
+{
+   filter_parser_t p;
+   filter_t *filter;
+   int res;
+
+   filter = g_new0(filter_t, 1);
+   filter->code = g_array_new(FALSE, FALSE, sizeof(filter_insn_t));
+   filter->strings = g_ptr_array_new_with_free_func(g_free);
+   filter->regexes = g_ptr_array_new_with_free_func(
+         (GDestroyNotify)g_regex_unref);
+   filter->now = g_get_real_time() / G_USEC_PER_SEC;
+
+   memset(&p, 0, sizeof(filter_parser_t));
+   p.filter = filter;
+   p.expression = expression;
+   p.pos = expression;
+   p.string = g_string_new(NULL);
+
+   res = filter_next(&p);
+   if (res == E_SUCCESS)
+      res = filter_or(&p);
+   if (res == E_SUCCESS && p.token != FILTER_TOK_END)
+      res = filter_error(&p, "unexpected input");
+   if (res == E_SUCCESS && p.max_depth > FILTER_MAX_DEPTH)
+      res = filter_error(&p, "expression too large");
+
+   g_string_free(p.string, TRUE);
+
+   if (res != E_SUCCESS) {
+      filter_free(filter);
+      return NULL;
+   }
+
+   return filter;
+}
+
+void filter_free(filter_t *filter)
+{
+   g_array_free(filter->code, TRUE);
+   g_ptr_array_free(filter->strings, TRUE);
+   g_ptr_array_free(filter->regexes, TRUE);
+   g_free(filter);
+}
+
+/*
+ * the fields the expression refers to, as STORE_MASK() bits
+ */
+guint32 filter_mask(filter_t *filter)
+{
+   return filter->mask;
+}
+
+/*
+ * runs the expression on the fields of one certificate; safe to be
+ * called by several threads at once. A sum overflowing 64 bits
+ * makes the expression false
+ */
+gboolean filter_match(filter_t *filter, filter_fields_t *fields)
+{
+   filter_insn_t *code = (filter_insn_t*)filter->code->data, *insn;
+   gint64 stack[FILTER_MAX_DEPTH];
+   const gchar *literal;
+   guint pc, sp = 0;
+
+   for (pc = 0; pc < filter->code->len; pc++) {
+      insn = &code[pc];
+
+      switch (insn->op) {
+         case FILTER_OP_PUSH:
+            stack[sp++] = insn->value;
+            break;
+         case FILTER_OP_LOAD:
+            stack[sp++] = fields->ints[insn->field];
+            break;
+         case FILTER_OP_ADD:
+            sp--;
+            if (__builtin_add_overflow(stack[sp - 1], stack[sp],
+                     &stack[sp - 1]))
+               return FALSE;
+            break;
+         case FILTER_OP_SUB:
+            sp--;
+            if (__builtin_sub_overflow(stack[sp - 1], stack[sp],
+                     &stack[sp - 1]))
+               return FALSE;
+            break;
+         case FILTER_OP_LT:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] < stack[sp];
+            break;
+         case FILTER_OP_LE:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] <= stack[sp];
+            break;
+         case FILTER_OP_GT:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] > stack[sp];
+            break;
+         case FILTER_OP_GE:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] >= stack[sp];
+            break;
+         case FILTER_OP_EQ:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] == stack[sp];
+            break;
+         case FILTER_OP_NE:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] != stack[sp];
+            break;
+         case FILTER_OP_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+         case FILTER_OP_JZ:
+            if (stack[sp - 1] == 0)
+               pc = insn->arg - 1;
+            break;
+         case FILTER_OP_JNZ:
+            if (stack[sp - 1] != 0)
+               pc = insn->arg - 1;
+            break;
+         case FILTER_OP_POP:
+            sp--;
+            break;
+         case FILTER_OP_STR_EQ:
+            literal = g_ptr_array_index(filter->strings, insn->arg);
+            stack[sp++] = fields->lens[insn->field] == strlen(literal) &&
+                  !memcmp(fields->strs[insn->field], literal,
+                        fields->lens[insn->field]);
+            break;
+         case FILTER_OP_MATCH:
+            stack[sp++] = g_regex_match_full(
+                  g_ptr_array_index(filter->regexes, insn->arg),
+                  fields->strs[insn->field] ? fields->strs[insn->field] : "",
+                  fields->lens[insn->field], 0, 0, NULL, NULL);
+            break;
+         case FILTER_OP_LIST_EQ:
+         case FILTER_OP_LIST_MATCH:
+            stack[sp++] = filter_list_match(filter, insn, fields);
+            break;
+      }
+   }
+
+   return sp && stack[sp - 1] != 0;
+}
+
+void filter_fields_init(filter_fields_t *fields)
+{
+   memset(fields, 0, sizeof(filter_fields_t));
+   fields->san = g_byte_array_new();
+   fields->digest = g_checksum_new(G_CHECKSUM_SHA256);
+}
+
+void filter_fields_destroy(filter_fields_t *fields)
+{
+   g_byte_array_free(fields->san, TRUE);
+   g_checksum_free(fields->digest);
+}
+
+/*
+ * decodes the fields of mask from a parsed certificate; the others
+ * are left alone
+ */
+void filter_fields_decode(filter_fields_t *fields, guint32 mask,
+                          cbuf_t *cbuf, x509_cert_t *cert,
+                          const gchar *file, guint64 offset)
+{
+   x509_key_t key;
+   guint8 digest[32];
+   gsize len = sizeof(digest);
+
+   fields->mask = mask;
+
+   if (mask & STORE_MASK(STORE_COL_FILE)) {
+      fields->strs[STORE_COL_FILE] = file;
+      fields->lens[STORE_COL_FILE] = strlen(file);
+   }
+
+   fields->ints[STORE_COL_OFFSET] = offset;
+   fields->ints[STORE_COL_NOT_BEFORE] = cert->not_before_time;
+   fields->ints[STORE_COL_NOT_AFTER] = cert->not_after_time;
+
+   if (mask & STORE_MASK(STORE_COL_SERIAL))
+      filter_serial(fields, ASN1_CONTENT(cbuf, &cert->serial),
+            cert->serial.length);
+
+   if (mask & STORE_MASK(STORE_COL_ISSUER)) {
+      fields->strs[STORE_COL_ISSUER] = fields->issuer;
+      fields->lens[STORE_COL_ISSUER] = x509_name_to_string(cbuf,
+            &cert->issuer, fields->issuer, sizeof(fields->issuer));
+   }
+
+   if (mask & STORE_MASK(STORE_COL_SUBJECT)) {
+      fields->strs[STORE_COL_SUBJECT] = fields->subject;
+      fields->lens[STORE_COL_SUBJECT] = x509_name_to_string(cbuf,
+            &cert->subject, fields->subject, sizeof(fields->subject));
+   }
+
+   if (mask & (STORE_MASK(STORE_COL_KEY_TYPE) |
+               STORE_MASK(STORE_COL_KEY_BITS))) {
+      if (x509_public_key(cbuf, cert, &key) < 0)
+         memset(&key, 0, sizeof(x509_key_t));
+      fields->ints[STORE_COL_KEY_TYPE] = key.type;
+      fields->ints[STORE_COL_KEY_BITS] = key.bits;
+   }
+
+   if (mask & STORE_MASK(STORE_COL_SAN)) {
+      g_byte_array_set_size(fields->san, 0);
+      x509_subject_alt_names(cbuf, cert, fields->san);
+      fields->strs[STORE_COL_SAN] = (const gchar*)fields->san->data;
+      fields->lens[STORE_COL_SAN] = fields->san->len;
+   }
+
+   if (mask & STORE_MASK(STORE_COL_FINGERPRINT)) {
+      g_checksum_reset(fields->digest);
+      g_checksum_update(fields->digest,
+            cbuf->buffer + cert->certificate.offset,
+            cert->certificate.hdr_len + cert->certificate.length);
+      g_checksum_get_digest(fields->digest, digest, &len);
+      filter_hex(digest, len, fields->fingerprint);
+      fields->strs[STORE_COL_FINGERPRINT] = fields->fingerprint;
+      fields->lens[STORE_COL_FINGERPRINT] = len * 2;
+   }
+}
+
+/*
+ * takes the fields of mask from a row of the store; the columns must
+ * have been loaded
+ */
+void filter_fields_load(filter_fields_t *fields, guint32 mask,
+                        store_t *store, guint64 row)
+{
+   const guchar *data;
+   guint64 index;
+   gsize len;
+   guint col;
+
+   fields->mask = mask;
+
+   for (col = 0; col < STORE_COLUMNS; col++) {
+      if (!(mask & STORE_MASK(col)))
+         continue;
+
+      switch (col) {
+         case STORE_COL_OFFSET:
+         case STORE_COL_NOT_BEFORE:
+         case STORE_COL_NOT_AFTER:
+            fields->ints[col] = STORE_I64(store, col, row);
+            break;
+
+         case STORE_COL_KEY_TYPE:
+            fields->ints[col] = STORE_U8(store, col, row);
+            break;
+
+         case STORE_COL_KEY_BITS:
+            fields->ints[col] = STORE_U32(store, col, row);
+            break;
+
+         case STORE_COL_FILE:
+         case STORE_COL_ISSUER:
+         case STORE_COL_SUBJECT:
+            /* indices into the dictionaries */
+            index = STORE_U32(store, col, row);
+            data = NULL;
+            len = 0;
+            if (col == STORE_COL_FILE &&
+                index < store->columns[STORE_COL_FILES].count)
+               data = store_bytes(store, STORE_COL_FILES, index, &len);
+            else if (col != STORE_COL_FILE &&
+                     index < store->columns[STORE_COL_NAMES].count)
+               data = store_bytes(store, STORE_COL_NAMES, index, &len);
+            fields->strs[col] = (const gchar*)data;
+            fields->lens[col] = len;
+            break;
+
+         case STORE_COL_SERIAL:
+            data = store_bytes(store, col, row, &len);
+            filter_serial(fields, data, len);
+            break;
+
+         case STORE_COL_SAN:
+            data = store_bytes(store, col, row, &len);
+            fields->strs[col] = (const gchar*)data;
+            fields->lens[col] = len;
+            break;
+
+         case STORE_COL_FINGERPRINT:
+            filter_hex(store->columns[col].data + row * 32, 32,
+                  fields->fingerprint);
+            fields->strs[col] = fields->fingerprint;
+            fields->lens[col] = 64;
+            break;
+      }
+   }
+}
+
+/*
+ * reads the next token
+ */
+static int filter_next(filter_parser_t *p)
+{
+   const gchar *s;
+   gint64 unit;
+
+   while (g_ascii_isspace(*p->pos))
+      p->pos++;
+
+   s = p->start = p->pos;
+
+   if (*s == '\0') {
+      p->token = FILTER_TOK_END;
+      p->len = 0;
+      return E_SUCCESS;
+   }
+
+   if (g_ascii_isdigit(*s)) {
+      p->number = 0;
+      for (; g_ascii_isdigit(*s); s++) {
+         if (p->number > (G_MAXINT64 - 9) / 10)
+            return filter_error(p, "number too large");
+         p->number = p->number * 10 + (*s - '0');
+      }
+
+      switch (*s) {
+         case 's': unit = 1; break;
+         case 'm': unit = 60; break;
+         case 'h': unit = 3600; break;
+         case 'd': unit = 86400; break;
+         case 'w': unit = 7 * 86400; break;
+         case 'y': unit = 365 * 86400; break;
+         default:  unit = 0; break;
+      }
+      if (unit) {
+         if (p->number > G_MAXINT64 / unit)
+            return filter_error(p, "number too large");
+         p->number *= unit;
+         s++;
+      }
+
+      if (g_ascii_isalnum(*s) || *s == '_')
+         return filter_error(p, "unknown unit");
+
+      p->token = FILTER_TOK_NUMBER;
+   }
+   else if (g_ascii_isalpha(*s) || *s == '_') {
+      while (g_ascii_isalnum(*s) || *s == '_')
+         s++;
+      p->token = FILTER_TOK_IDENT;
+   }
+   else if (*s == '"') {
+      g_string_truncate(p->string, 0);
+      for (s++; *s != '"'; s++) {
+         if (*s == '\0')
+            return filter_error(p, "unterminated string");
+         if (*s == '\\' && (s[1] == '"' || s[1] == '\\'))
+            s++;
+         g_string_append_c(p->string, *s);
+      }
+      s++;
+      p->token = FILTER_TOK_STRING;
+   }
+   else {
+      switch (*s++) {
+         case '(': p->token = FILTER_TOK_LPAREN; break;
+         case ')': p->token = FILTER_TOK_RPAREN; break;
+         case '+': p->token = FILTER_TOK_PLUS; break;
+         case '-': p->token = FILTER_TOK_MINUS; break;
+         case '~': p->token = FILTER_TOK_MATCH; break;
+         case '&':
+            if (*s++ != '&')
+               return filter_error(p, "expected '&&'");
+            p->token = FILTER_TOK_AND;
+            break;
+         case '|':
+            if (*s++ != '|')
+               return filter_error(p, "expected '||'");
+            p->token = FILTER_TOK_OR;
+            break;
+         case '=':
+            if (*s++ != '=')
+               return filter_error(p, "expected '=='");
+            p->token = FILTER_TOK_EQ;
+            break;
+         case '!':
+            p->token = FILTER_TOK_NOT;
+            if (*s == '=') {
+               s++;
+               p->token = FILTER_TOK_NE;
+            }
+            break;
+         case '<':
+            p->token = FILTER_TOK_LT;
+            if (*s == '=') {
+               s++;
+               p->token = FILTER_TOK_LE;
+            }
+            break;
+         case '>':
+            p->token = FILTER_TOK_GT;
+            if (*s == '=') {
+               s++;
+               p->token = FILTER_TOK_GE;
+            }
+            break;
+         default:
+            return filter_error(p, "unexpected character");
+      }
+   }
+
+   p->len = s - p->start;
+   p->pos = s;
+
+   return E_SUCCESS;
+}
+
+static int filter_error(filter_parser_t *p, const gchar *message)
+{
+   g_printerr("filter: %s at position %u of '%s'\n", message,
+         (guint)(p->start - p->expression) + 1, p->expression);
+
+   return -E_INVALID;
+}
+
+/*
+ * a || b: b is only run if a is 0
+ */
+static int filter_or(filter_parser_t *p)
+{
+   guint jump;
+   int res;
+
+   if ((res = filter_and(p)) != E_SUCCESS)
+      return res;
+
+   while (p->token == FILTER_TOK_OR) {
+      if ((res = filter_next(p)) != E_SUCCESS)
+         return res;
+
+      jump = filter_emit(p, FILTER_OP_JNZ, 0, 0, 0);
+      filter_emit(p, FILTER_OP_POP, 0, 0, 0);
+
+      if ((res = filter_and(p)) != E_SUCCESS)
+         return res;
+
+      g_array_index(p->filter->code, filter_insn_t, jump).arg =
+            p->filter->code->len;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * a && b: b is only run if a is not 0
+ */
+static int filter_and(filter_parser_t *p)
+{
+   guint jump;
+   int res;
+
+   if ((res = filter_unary(p)) != E_SUCCESS)
+      return res;
+
+   while (p->token == FILTER_TOK_AND) {
+      if ((res = filter_next(p)) != E_SUCCESS)
+         return res;
+
+      jump = filter_emit(p, FILTER_OP_JZ, 0, 0, 0);
+      filter_emit(p, FILTER_OP_POP, 0, 0, 0);
+
+      if ((res = filter_unary(p)) != E_SUCCESS)
+         return res;
+
+      g_array_index(p->filter->code, filter_insn_t, jump).arg =
+            p->filter->code->len;
+   }
+
+   return E_SUCCESS;
+}
+
+static int filter_unary(filter_parser_t *p)
+{
+   int res;
+
+   if (++p->nesting > FILTER_MAX_DEPTH)
+      return filter_error(p, "expression nested too deeply");
+
+   if (p->token == FILTER_TOK_NOT) {
+      if ((res = filter_next(p)) != E_SUCCESS ||
+          (res = filter_unary(p)) != E_SUCCESS)
+         return res;
+      filter_emit(p, FILTER_OP_NOT, 0, 0, 0);
+   }
+   else if (p->token == FILTER_TOK_LPAREN) {
+      if ((res = filter_next(p)) != E_SUCCESS ||
+          (res = filter_or(p)) != E_SUCCESS)
+         return res;
+      if (p->token != FILTER_TOK_RPAREN)
+         return filter_error(p, "expected ')'");
+      if ((res = filter_next(p)) != E_SUCCESS)
+         return res;
+   }
+   else if ((res = filter_comparison(p)) != E_SUCCESS) {
+      return res;
+   }
+
+   p->nesting--;
+
+   return E_SUCCESS;
+}
+
+static int filter_comparison(filter_parser_t *p)
+{
+   filter_operand_t left, right;
+   guint tok, op;
+   int res;
+
+   memset(&left, 0, sizeof(filter_operand_t));
+   memset(&right, 0, sizeof(filter_operand_t));
+
+   if ((res = filter_sum(p, &left)) != E_SUCCESS)
+      goto out;
+
+   tok = p->token;
+   switch (tok) {
+      case FILTER_TOK_LT: op = FILTER_OP_LT; break;
+      case FILTER_TOK_LE: op = FILTER_OP_LE; break;
+      case FILTER_TOK_GT: op = FILTER_OP_GT; break;
+      case FILTER_TOK_GE: op = FILTER_OP_GE; break;
+      case FILTER_TOK_EQ: op = FILTER_OP_EQ; break;
+      case FILTER_TOK_NE: op = FILTER_OP_NE; break;
+      case FILTER_TOK_MATCH: op = FILTER_OP_MATCH; break;
+      default:
+         res = filter_error(p, "expected a comparison");
+         goto out;
+   }
+
+   if ((res = filter_next(p)) != E_SUCCESS ||
+       (res = filter_sum(p, &right)) != E_SUCCESS)
+      goto out;
+
+   if (left.type == FILTER_TYPE_INT && right.type == FILTER_TYPE_INT &&
+       op != FILTER_OP_MATCH) {
+      filter_emit(p, op, 0, 0, 0);
+   }
+   else if (left.type == FILTER_TYPE_LITERAL &&
+            right.type != FILTER_TYPE_INT && right.type != left.type &&
+            (tok == FILTER_TOK_EQ || tok == FILTER_TOK_NE)) {
+      res = filter_emit_string(p, tok, &right, &left);
+   }
+   else if (right.type == FILTER_TYPE_LITERAL &&
+            left.type != FILTER_TYPE_INT && left.type != right.type) {
+      res = filter_emit_string(p, tok, &left, &right);
+   }
+   else {
+      res = filter_error(p, "operands cannot be compared");
+   }
+
+out:
+   g_free(left.string);
+   g_free(right.string);
+
+   return res;
+}
+
+/*
+ * a + b - c ...; only integers take part in arithmetic
+ */
+static int filter_sum(filter_parser_t *p, filter_operand_t *operand)
+{
+   filter_operand_t next;
+   guint op;
+   int res;
+
+   if ((res = filter_term(p, operand)) != E_SUCCESS)
+      return res;
+
+   while (p->token == FILTER_TOK_PLUS || p->token == FILTER_TOK_MINUS) {
+      op = p->token == FILTER_TOK_PLUS ? FILTER_OP_ADD : FILTER_OP_SUB;
+
+      if (operand->type != FILTER_TYPE_INT)
+         return filter_error(p, "arithmetic on a string");
+
+      if ((res = filter_next(p)) != E_SUCCESS ||
+          (res = filter_term(p, &next)) != E_SUCCESS)
+         return res;
+
+      if (next.type != FILTER_TYPE_INT) {
+         g_free(next.string);
+         return filter_error(p, "arithmetic on a string");
+      }
+
+      filter_emit(p, op, 0, 0, 0);
+   }
+
+   return E_SUCCESS;
+}
+
+static int filter_term(filter_parser_t *p, filter_operand_t *operand)
+{
+   gint field;
+   guint type;
+
+   memset(operand, 0, sizeof(filter_operand_t));
+
+   switch (p->token) {
+      case FILTER_TOK_NUMBER:
+         filter_emit(p, FILTER_OP_PUSH, 0, 0, p->number);
+         break;
+
+      case FILTER_TOK_STRING:
+         operand->type = FILTER_TYPE_LITERAL;
+         operand->string = g_strndup(p->string->str, p->string->len);
+         break;
+
+      case FILTER_TOK_IDENT:
+         if (p->len == 3 && !strncmp(p->start, "now", 3)) {
+            filter_emit(p, FILTER_OP_PUSH, 0, 0, p->filter->now);
+            break;
+         }
+
+         /* key types */
+         for (type = X509_KEY_RSA; type <= X509_KEY_ED448; type++) {
+            if (strlen(x509_key_type_name(type)) == p->len &&
+                !g_ascii_strncasecmp(p->start, x509_key_type_name(type),
+                   p->len))
+               break;
+         }
+         if (type <= X509_KEY_ED448) {
+            filter_emit(p, FILTER_OP_PUSH, 0, 0, type);
+            break;
+         }
+
+         if ((field = filter_field(p->start, p->len)) < 0)
+            return filter_error(p, "unknown field");
+
+         p->filter->mask |= STORE_MASK(field);
+         operand->type = filter_field_type(field);
+         operand->field = field;
+         if (operand->type == FILTER_TYPE_INT)
+            filter_emit(p, FILTER_OP_LOAD, field, 0, 0);
+         break;
+
+      default:
+         return filter_error(p, "expected a field, number or string");
+   }
+
+   return filter_next(p);
+}
+
+static int filter_field(const gchar *name, gsize len)
+{
+   const gchar *column;
+   guint i;
+
+   for (i = 0; i < G_N_ELEMENTS(filter_aliases); i++)
+      if (strlen(filter_aliases[i].name) == len &&
+          !strncmp(name, filter_aliases[i].name, len))
+         return filter_aliases[i].field;
+
+   /* the dictionaries are no fields */
+   for (i = 0; i < STORE_COL_NAMES; i++) {
+      column = store_column_name(i);
+      if (strlen(column) == len && !strncmp(name, column, len))
+         return i;
+   }
+
+   return -1;
+}
+
+static guint filter_field_type(guint field)
+{
+   switch (field) {
+      case STORE_COL_FILE:
+      case STORE_COL_SERIAL:
+      case STORE_COL_ISSUER:
+      case STORE_COL_SUBJECT:
+      case STORE_COL_FINGERPRINT:
+         return FILTER_TYPE_STR;
+      case STORE_COL_SAN:
+         return FILTER_TYPE_LIST;
+   }
+
+   return FILTER_TYPE_INT;
+}
+
+/*
+ * appends an instruction and keeps track of the stack depth; the sum
+ * of two constants is computed right away unless it overflows
+ */
+static guint filter_emit(filter_parser_t *p, guint op, guint field,
+                         guint32 arg, gint64 value)
+{
+   GArray *code = p->filter->code;
+   filter_insn_t insn, *a, *b;
+   gboolean overflow;
+   gint64 sum;
+
+   if ((op == FILTER_OP_ADD || op == FILTER_OP_SUB) && code->len >= 2) {
+      a = &g_array_index(code, filter_insn_t, code->len - 2);
+      b = &g_array_index(code, filter_insn_t, code->len - 1);
+      overflow = op == FILTER_OP_ADD ?
+         __builtin_add_overflow(a->value, b->value, &sum) :
+         __builtin_sub_overflow(a->value, b->value, &sum);
+      if (a->op == FILTER_OP_PUSH && b->op == FILTER_OP_PUSH && !overflow) {
+         a->value = sum;
+         g_array_set_size(code, code->len - 1);
+         p->depth--;
+         return code->len - 1;
+      }
+   }
+
+   switch (op) {
+      case FILTER_OP_PUSH:
+      case FILTER_OP_LOAD:
+      case FILTER_OP_STR_EQ:
+      case FILTER_OP_MATCH:
+      case FILTER_OP_LIST_EQ:
+      case FILTER_OP_LIST_MATCH:
+         p->depth++;
+         break;
+      case FILTER_OP_NOT:
+      case FILTER_OP_JZ:
+      case FILTER_OP_JNZ:
+         break;
+      default:
+         p->depth--;
+         break;
+   }
+   p->max_depth = MAX(p->max_depth, p->depth);
+
+   insn.op = op;
+   insn.field = field;
+   insn.arg = arg;
+   insn.value = value;
+   g_array_append_val(code, insn);
+
+   return code->len - 1;
+}
+
+/*
+ * a string or list field against a literal; hex fields compare
+ * without colons and in upper case
+ */
+static int filter_emit_string(filter_parser_t *p, guint tok,
+                              filter_operand_t *field,
+                              filter_operand_t *literal)
+{
+   GRegex *regex;
+   GError *error = NULL;
+   const gchar *c;
+   gchar *s, *d;
+   gboolean list = field->type == FILTER_TYPE_LIST;
+
+   if (tok == FILTER_TOK_MATCH) {
+      regex = g_regex_new(literal->string, G_REGEX_RAW | G_REGEX_OPTIMIZE,
+            0, &error);
+      if (regex == NULL) {
+         g_printerr("filter: %s\n", error->message);
+         g_error_free(error);
+         return -E_INVALID;
+      }
+      g_ptr_array_add(p->filter->regexes, regex);
+      filter_emit(p, list ? FILTER_OP_LIST_MATCH : FILTER_OP_MATCH,
+            field->field, p->filter->regexes->len - 1, 0);
+      return E_SUCCESS;
+   }
+
+   if (tok != FILTER_TOK_EQ && tok != FILTER_TOK_NE)
+      return filter_error(p, "strings compare by ==, != and ~ only");
+
+   s = g_strdup(literal->string);
+   if (field->field == STORE_COL_SERIAL ||
+       field->field == STORE_COL_FINGERPRINT) {
+      for (c = literal->string, d = s; *c; c++)
+         if (*c != ':')
+            *d++ = g_ascii_toupper(*c);
+      *d = '\0';
+   }
+
+   g_ptr_array_add(p->filter->strings, s);
+   filter_emit(p, list ? FILTER_OP_LIST_EQ : FILTER_OP_STR_EQ, field->field,
+         p->filter->strings->len - 1, 0);
+
+   if (tok == FILTER_TOK_NE)
+      filter_emit(p, FILTER_OP_NOT, 0, 0, 0);
+
+   return E_SUCCESS;
+}
+
+/*
+ * TRUE if any of the NUL terminated entries of the list field is
+ * equal to or matches the literal
+ */
+static gboolean filter_list_match(filter_t *filter, filter_insn_t *insn,
+                                  filter_fields_t *fields)
+{
+   const gchar *s = fields->strs[insn->field], *end, *literal;
+   gsize len;
+
+   if (s == NULL)
+      return FALSE;
+
+   end = s + fields->lens[insn->field];
+
+   for (; s < end; s += len + 1) {
+      len = strnlen(s, end - s);
+
+      if (insn->op == FILTER_OP_LIST_EQ) {
+         literal = g_ptr_array_index(filter->strings, insn->arg);
+         if (len == strlen(literal) && !memcmp(s, literal, len))
+            return TRUE;
+      }
+      else if (g_regex_match_full(g_ptr_array_index(filter->regexes,
+                  insn->arg), s, len, 0, 0, NULL, NULL)) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+static void filter_hex(const guchar *data, gsize len, gchar *out)
+{
+   static const gchar digits[] = "0123456789ABCDEF";
+   gsize i;
+
+   for (i = 0; i < len; i++) {
+      *out++ = digits[data[i] >> 4];
+      *out++ = digits[data[i] & 0x0f];
+   }
+   *out = '\0';
+}
+
+/*
+ * the serial number in hex as other tools print it, without the
+ * 0 octet which keeps a positive INTEGER positive
+ */
+static void filter_serial(filter_fields_t *fields, const guchar *data,
+                          gsize len)
+{
+   if (len > 1 && data[0] == 0 && data[1] & 0x80) {
+      data++;
+      len--;
+   }
+
+   len = MIN(len, FILTER_SERIAL_MAX);
+   filter_hex(data, len, fields->serial);
+
+   fields->strs[STORE_COL_SERIAL] = fields->serial;
+   fields->lens[STORE_COL_SERIAL] = len * 2;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
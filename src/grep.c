@@ -0,0 +1,277 @@
+/* grep.c - byte pattern search across a corpus
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_grep.h>
+#include <certalize_search.h>
+#include <certalize_stream.h>
+#include <certalize_loader.h>
+#include <certalize_parser.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+/* globals    */
+
+typedef struct grep_hit {
+   guint pattern;
+   guint64 offset;
+   gsize len;
+} grep_hit_t;
+
+/* search of one input file */
+typedef struct grep_job {
+   const gchar *filename;
+   struct grep_ctx *ctx;
+   /* report lines, written in input order */
+   GString *out;
+   /* hits of the current record */
+   GArray *hits;
+   parser_t parser;
+   guint64 matches;
+   guint64 errors;
+   gboolean done;
+} grep_job_t;
+
+typedef struct grep_ctx {
+   search_t *search;
+   /* of the parsers naming the elements */
+   const asn1_limits_t *limits;
+   GMutex lock;
+   GCond cond;
+} grep_ctx_t;
+
+/* prototypes */
+static void grep_job_run(gpointer data, gpointer user_data);
+static int  grep_record(const guchar *der, gsize len, guint64 offset,
+                        gpointer data);
+static gboolean grep_hit(guint pattern, guint64 offset, gsize len,
+                         gpointer data);
+static int  grep_write(GString *out);
+
+
+/*************/
+
+/*
+ * reports where the patterns occur in the certificates of the given
+ * files and directories; one line per match
+ *
+ *   FILE:RECORD:OFFSET: PATTERN in PATH
+ *
+ * RECORD is the position of the DER or PEM record in the file, OFFSET
+ * the position of the match within its DER encoding and PATH names
+ * the innermost element enclosing the match; "-" reads stdin
+ *
+ *   - files are searched in parallel, no more than two per thread
+ *     ahead of the one whose report is being written
+ *   - records exceeding the limits are still searched, but their
+ *     elements are only named up to where the limits were hit
+ */
+int grep_run(GPtrArray *files, GPtrArray *patterns,
+             const asn1_limits_t *limits)
+{
+   grep_ctx_t ctx;
+   grep_job_t *jobs;
+   GPtrArray *inputs;
+   GThreadPool *pool;
+   guint64 matches = 0, errors = 0;
+   guint i, pushed, window;
+
+   memset(&ctx, 0, sizeof(grep_ctx_t));
+   ctx.search = search_new();
+   ctx.limits = limits;
+
+   for (i = 0; i < patterns->len; i++) {
+      if (search_add_expr(ctx.search, g_ptr_array_index(patterns, i)) < 0) {
+         g_printerr("invalid pattern '%s'\n",
+               (gchar*)g_ptr_array_index(patterns, i));
+         search_free(ctx.search);
+         return E_INVALID;
+      }
+   }
+
+   /* the workers share the automaton */
+   search_compile(ctx.search);
+
+   inputs = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < files->len; i++)
+      loader_expand(inputs, g_ptr_array_index(files, i));
+
+   g_mutex_init(&ctx.lock);
+   g_cond_init(&ctx.cond);
+
+   jobs = g_new0(grep_job_t, inputs->len);
+
+   for (i = 0; i < inputs->len; i++) {
+      jobs[i].filename = g_ptr_array_index(inputs, i);
+      jobs[i].ctx = &ctx;
+   }
+
+   pool = g_thread_pool_new(grep_job_run, NULL,
+         g_get_num_processors(), FALSE, NULL);
+
+   /* finished jobs hold their report until it is written */
+   window = 2 * g_get_num_processors();
+
+   for (pushed = 0; pushed < MIN(window, inputs->len); pushed++)
+      g_thread_pool_push(pool, &jobs[pushed], NULL);
+
+   /* reports are written in order while later files are searched */
+   for (i = 0; i < inputs->len; i++) {
+      g_mutex_lock(&ctx.lock);
+      while (!jobs[i].done)
+         g_cond_wait(&ctx.cond, &ctx.lock);
+      g_mutex_unlock(&ctx.lock);
+
+      if (grep_write(jobs[i].out) < 0)
+         jobs[i].errors++;
+
+      g_string_free(jobs[i].out, TRUE);
+      matches += jobs[i].matches;
+      errors += jobs[i].errors;
+
+      if (pushed < inputs->len)
+         g_thread_pool_push(pool, &jobs[pushed++], NULL);
+   }
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   g_mutex_clear(&ctx.lock);
+   g_cond_clear(&ctx.cond);
+   g_free(jobs);
+   g_ptr_array_free(inputs, TRUE);
+   search_free(ctx.search);
+
+   /* like grep(1): nothing found is not an error, but told apart */
+   if (errors)
+      return E_INVALID;
+
+   return matches ? E_SUCCESS : E_NOTFOUND;
+}
+
+/*
+ * worker: splits the input into records and searches each of them
+ */
+static void grep_job_run(gpointer data, gpointer user_data _U_)
+{
+   grep_job_t *job = data;
+   grep_ctx_t *ctx = job->ctx;
+   cstream_t stream;
+
+   job->out = g_string_new(NULL);
+   job->hits = g_array_new(FALSE, FALSE, sizeof(grep_hit_t));
+   parser_init(&job->parser, PARSER_SCHEMA);
+   asn1_index_set_limits(&job->parser.index, ctx->limits);
+
+   cstream_init(&stream, grep_record, job);
+
+   if (loader_stream(job->filename, &stream) < 0)
+      job->errors++;
+
+   cstream_destroy(&stream);
+
+   g_array_free(job->hits, TRUE);
+   parser_destroy(&job->parser);
+
+   g_mutex_lock(&ctx->lock);
+   job->done = TRUE;
+   g_cond_broadcast(&ctx->cond);
+   g_mutex_unlock(&ctx->lock);
+}
+
+/*
+ * searches one record; only records with matches are indexed to
+ * find the elements enclosing them
+ */
+static int grep_record(const guchar *der, gsize len, guint64 offset,
+                       gpointer data)
+{
+   grep_job_t *job = data;
+   grep_hit_t *hit;
+   guint32 node, i;
+
+   if (der == NULL)
+      return E_SUCCESS;
+
+   g_array_set_size(job->hits, 0);
+   search_scan(job->ctx->search, der, len, grep_hit, job);
+
+   if (job->hits->len == 0)
+      return E_SUCCESS;
+
+   /* a broken record still names the elements up to the defect */
+   parser_parse(&job->parser, der, len);
+
+   for (i = 0; i < job->hits->len; i++) {
+      hit = &g_array_index(job->hits, grep_hit_t, i);
+
+      g_string_append_printf(job->out, "%s:%" G_GUINT64_FORMAT ":%"
+            G_GUINT64_FORMAT ": %s in ", job->filename, offset, hit->offset,
+            search_expr(job->ctx->search, hit->pattern));
+
+      node = parser_find(&job->parser, hit->offset, hit->len);
+      if (node != ASN1_INDEX_NONE)
+         parser_path(&job->parser, node, job->out);
+      else
+         g_string_append(job->out, "-");
+
+      g_string_append_c(job->out, '\n');
+   }
+
+   job->matches += job->hits->len;
+
+   return E_SUCCESS;
+}
+
+static gboolean grep_hit(guint pattern, guint64 offset, gsize len,
+                         gpointer data)
+{
+   grep_job_t *job = data;
+   grep_hit_t hit;
+
+   hit.pattern = pattern;
+   hit.offset = offset;
+   hit.len = len;
+   g_array_append_val(job->hits, hit);
+
+   return TRUE;
+}
+
+static int grep_write(GString *out)
+{
+   gsize done = 0;
+   gssize n;
+
+   while (done < out->len) {
+      n = write(STDOUT_FILENO, out->str + done, out->len - done);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n < 0) {
+         g_printerr("writing the report failed: %s\n", g_strerror(errno));
+         return -E_INVALID;
+      }
+      done += n;
+   }
+
+   return E_SUCCESS;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
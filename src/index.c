@@ -0,0 +1,337 @@
+/* index.c - structural index of DER encoded data
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_index.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+#define ASN1_INDEX_INITIAL_SIZE     256
+
+/* prototypes */
+static int asn1_index_build(asn1_index_t *index, cbuf_t *cbuf,
+                            guint64 offset, guint64 limit, guint32 count);
+static int asn1_index_fail(asn1_index_t *index, guint64 offset, guint8 error);
+
+
+/*************/
+
+void asn1_index_init(asn1_index_t *index)
+{
+   const asn1_limits_t limits = ASN1_LIMITS_DEFAULT;
+
+   memset(index, 0, sizeof(asn1_index_t));
+   index->limits = limits;
+}
+
+void asn1_index_destroy(asn1_index_t *index)
+{
+   g_free(index->nodes);
+   memset(index, 0, sizeof(asn1_index_t));
+}
+
+/*
+ * sets the budgets of the documents indexed from now on; NULL
+ * restores the defaults
+ */
+void asn1_index_set_limits(asn1_index_t *index, const asn1_limits_t *limits)
+{
+   const asn1_limits_t defaults = ASN1_LIMITS_DEFAULT;
+
+   index->limits = limits ? *limits : defaults;
+
+   /* the stacks of the scanner are not any deeper */
+   if (index->limits.depth == 0 || index->limits.depth > ASN1_INDEX_MAX_DEPTH)
+      index->limits.depth = ASN1_INDEX_MAX_DEPTH;
+}
+
+/*
+ * describes why decoding failed
+ */
+const gchar* asn1_index_strerror(asn1_index_t *index)
+{
+   switch (index->error) {
+      case ASN1_INDEX_OK:
+         return "no error";
+      case ASN1_INDEX_DEPTH:
+         return "nesting too deep";
+      case ASN1_INDEX_ELEMENTS:
+         return "too many elements";
+      case ASN1_INDEX_SIZE:
+         return "element too large";
+      case ASN1_INDEX_WORK:
+         return "decoding too expensive";
+      default:
+         return "invalid encoding";
+   }
+}
+
+/*
+ * reads limits like "strict,size=1M" into limits, starting from
+ * what they hold: "strict" sets ASN1_LIMITS_STRICT, "depth",
+ * "elements", "size" and "work" set one of them, sizes may be
+ * given in k, M or G
+ * returns E_SUCCESS or -E_INVALID, having printed why
+ */
+int asn1_limits_parse(const gchar *spec, asn1_limits_t *limits)
+{
+   const asn1_limits_t strict = ASN1_LIMITS_STRICT;
+   gchar **items, *value, *end;
+   guint64 n;
+   guint i;
+   int res = E_SUCCESS;
+
+   items = g_strsplit(spec, ",", -1);
+
+   for (i = 0; items[i] && res == E_SUCCESS; i++) {
+      if (!strcmp(items[i], "strict")) {
+         *limits = strict;
+         continue;
+      }
+
+      if ((value = strchr(items[i], '=')) == NULL) {
+         g_printerr("limit '%s' lacks a value\n", items[i]);
+         res = -E_INVALID;
+         break;
+      }
+      *value++ = '\0';
+
+      n = g_ascii_strtoull(value, &end, 10);
+      if (end == value) {
+         g_printerr("invalid value of limit '%s'\n", items[i]);
+         res = -E_INVALID;
+         break;
+      }
+
+      switch (*end) {
+         case 'k': n <<= 10; end++; break;
+         case 'M': n <<= 20; end++; break;
+         case 'G': n <<= 30; end++; break;
+      }
+
+      if (*end != '\0') {
+         g_printerr("invalid value of limit '%s'\n", items[i]);
+         res = -E_INVALID;
+      }
+      else if (!strcmp(items[i], "depth"))
+         limits->depth = MIN(n, ASN1_INDEX_MAX_DEPTH);
+      else if (!strcmp(items[i], "elements"))
+         limits->elements = MIN(n, G_MAXUINT32);
+      else if (!strcmp(items[i], "size"))
+         limits->size = n;
+      else if (!strcmp(items[i], "work"))
+         limits->work = n;
+      else {
+         g_printerr("unknown limit '%s'\n", items[i]);
+         res = -E_INVALID;
+      }
+   }
+
+   g_strfreev(items);
+
+   return res;
+}
+
+/*
+ * indexes all elements within length bytes from offset
+ */
+int asn1_index_range(asn1_index_t *index, cbuf_t *cbuf,
+                     guint64 offset, guint64 length)
+{
+   if (!CBUF_HAS(cbuf, offset, length))
+      return -E_INVALID;
+
+   return asn1_index_build(index, cbuf, offset, offset + length,
+         ASN1_INDEX_NONE);
+}
+
+/*
+ * indexes the single element at offset including all its descendants;
+ * used to keep the index small when walking large bundles
+ */
+int asn1_index_element(asn1_index_t *index, cbuf_t *cbuf, guint64 offset)
+{
+   if (offset >= cbuf->length)
+      return -E_INVALID;
+
+   return asn1_index_build(index, cbuf, offset, cbuf->length, 1);
+}
+
+/*
+ * the innermost element whose encoding covers length bytes from
+ * offset, ASN1_INDEX_NONE if none does
+ */
+guint32 asn1_index_find(asn1_index_t *index, guint64 offset, guint64 length)
+{
+   guint32 lo = 0, hi = index->len, mid, i;
+   asn1_node_t *node;
+
+   /* nodes are in encoding order: the last one starting before offset */
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (index->nodes[mid].offset <= offset)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (i = lo ? lo - 1 : ASN1_INDEX_NONE; i != ASN1_INDEX_NONE;
+        i = index->nodes[i].parent) {
+      node = &index->nodes[i];
+      if (offset + length <= node->offset + node->hdr_len + node->length)
+         return i;
+   }
+
+   return ASN1_INDEX_NONE;
+}
+
+/*
+ * copies node i into a TLV reference
+ */
+int asn1_index_tlv(asn1_index_t *index, guint32 i, asn1_tlv_t *tlv)
+{
+   asn1_node_t *node;
+
+   if (i >= index->len)
+      return -E_NOTFOUND;
+
+   node = &index->nodes[i];
+   tlv->offset = node->offset;
+   tlv->hdr_len = node->hdr_len;
+   tlv->length = node->length;
+   tlv->tag = node->tag;
+   tlv->class = node->class;
+   tlv->constructed = node->constructed;
+
+   return E_SUCCESS;
+}
+
+/*
+ * the scanner: one loop over the buffer decoding every header exactly
+ * once, with the open constructed elements kept on a small stack
+ *
+ *   - every element has to end within its parent
+ *   - at most count top-level elements are indexed
+ *   - the limits apply to each top-level element, so a hostile one
+ *     is rejected at its header or once it goes too deep or holds
+ *     too many elements, before the index grows any further
+ */
+static int asn1_index_build(asn1_index_t *index, cbuf_t *cbuf,
+                            guint64 offset, guint64 limit, guint32 count)
+{
+   guint64 end[ASN1_INDEX_MAX_DEPTH];
+   guint32 open[ASN1_INDEX_MAX_DEPTH];
+   guint32 last[ASN1_INDEX_MAX_DEPTH + 1];
+   guint64 pos = offset, bound;
+   guint32 first = 0;
+   guint depth = 0;
+   asn1_node_t *node;
+   asn1_tlv_t tlv;
+   int len;
+
+   index->len = 0;
+   index->error_offset = 0;
+   index->error = ASN1_INDEX_OK;
+   last[0] = ASN1_INDEX_NONE;
+
+   for (;;) {
+      /* close the constructed elements ending here */
+      while (depth && pos == end[depth - 1])
+         depth--;
+
+      if (depth == 0 && (pos >= limit || count == 0))
+         break;
+
+      bound = depth ? end[depth - 1] : limit;
+
+      len = asn1_decode_header(cbuf->buffer + pos, bound - pos, &tlv);
+      if (len < 0 || tlv.length > bound - pos - len) {
+         DEBUG_MSG("asn1_index_build: invalid element at %" G_GUINT64_FORMAT,
+               pos);
+         return asn1_index_fail(index, pos, ASN1_INDEX_MALFORMED);
+      }
+
+      if (depth == 0) {
+         first = index->len;
+         if (index->limits.size && len + tlv.length > index->limits.size)
+            return asn1_index_fail(index, pos, ASN1_INDEX_SIZE);
+      }
+      else if (index->limits.elements &&
+               index->len - first >= index->limits.elements) {
+         return asn1_index_fail(index, pos, ASN1_INDEX_ELEMENTS);
+      }
+
+      if (index->len == index->size) {
+         if (index->size >= ASN1_INDEX_NONE / 2)
+            return asn1_index_fail(index, pos, ASN1_INDEX_ELEMENTS);
+         index->size = index->size ? index->size * 2 : ASN1_INDEX_INITIAL_SIZE;
+         index->nodes = g_realloc(index->nodes,
+               (gsize)index->size * sizeof(asn1_node_t));
+      }
+
+      node = &index->nodes[index->len];
+      node->offset = pos;
+      node->length = tlv.length;
+      node->tag = tlv.tag;
+      node->hdr_len = len;
+      node->class = tlv.class;
+      node->constructed = tlv.constructed;
+      node->depth = depth;
+      node->parent = depth ? open[depth - 1] : ASN1_INDEX_NONE;
+      node->next = ASN1_INDEX_NONE;
+
+      /* link to the previous sibling */
+      if (last[depth] != ASN1_INDEX_NONE)
+         index->nodes[last[depth]].next = index->len;
+      last[depth] = index->len;
+
+      if (depth == 0)
+         count--;
+
+      if (tlv.constructed && tlv.length) {
+         if (depth >= index->limits.depth || depth == ASN1_INDEX_MAX_DEPTH)
+            return asn1_index_fail(index, pos, ASN1_INDEX_DEPTH);
+         open[depth] = index->len;
+         end[depth] = pos + len + tlv.length;
+         depth++;
+         last[depth] = ASN1_INDEX_NONE;
+         pos += len;
+      }
+      else {
+         pos += len + tlv.length;
+      }
+
+      index->len++;
+   }
+
+   return E_SUCCESS;
+}
+
+static int asn1_index_fail(asn1_index_t *index, guint64 offset, guint8 error)
+{
+   index->error_offset = offset;
+   index->error = error;
+
+   return -E_INVALID;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
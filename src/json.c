@@ -0,0 +1,355 @@
+/* json.c - streaming JSON writer
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_json.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+/* globals    */
+
+/*
+ * characters which have to be escaped inside a JSON string
+ *   0 = copy verbatim, 'u' = \u00XX, other = \<char>
+ */
+static const gchar escape_matrix[256] = {
+/* 0  */ 'u','u','u','u','u','u','u','u','b','t','n','u','f','r','u','u',
+/* 16 */ 'u','u','u','u','u','u','u','u','u','u','u','u','u','u','u','u',
+/* 32 */  0,  0, '"', 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+/* 48 */  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+/* 64 */  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+/* 80 */  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,'\\', 0,  0,  0,
+/* 96 */  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+/* 112 */ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,'u',
+};
+
+static const gchar hex_digits[] = "0123456789abcdef";
+
+/* prototypes */
+static inline void json_put(json_writer_t *w, const gchar *data, gsize len);
+static inline void json_putc(json_writer_t *w, gchar c);
+static inline void json_separator(json_writer_t *w);
+static void json_escape(json_writer_t *w, const gchar *str, gsize len);
+
+
+/*************/
+
+/*
+ * prepares the writer to emit into buffer;
+ * a fd of -1 turns off flushing, running out of buffer
+ * then marks the writer as failed
+ */
+void json_init(json_writer_t *w, gint fd, guchar *buffer, gsize size)
+{
+   memset(w, 0, sizeof(json_writer_t));
+
+   w->buffer = buffer;
+   w->size = size;
+   w->fd = fd;
+}
+
+/*
+ * writes the buffered output to the file descriptor
+ */
+int json_flush(json_writer_t *w)
+{
+   gsize done = 0;
+   gssize ret;
+
+   if (w->fd < 0)
+      return w->error ? -E_INVALID : E_SUCCESS;
+
+   while (done < w->pos) {
+      ret = write(w->fd, w->buffer + done, w->pos - done);
+      if (ret < 0) {
+         if (errno == EINTR)
+            continue;
+         DEBUG_MSG("json_flush: write failed: %s", g_strerror(errno));
+         w->error = 1;
+         w->pos = 0;
+         return -E_INVALID;
+      }
+      done += ret;
+   }
+
+   w->pos = 0;
+
+   return E_SUCCESS;
+}
+
+void json_object_begin(json_writer_t *w)
+{
+   json_separator(w);
+   json_putc(w, '{');
+
+   if (w->depth + 1 >= JSON_MAX_DEPTH) {
+      w->error = 1;
+      return;
+   }
+   w->member[++w->depth] = 0;
+}
+
+void json_object_end(json_writer_t *w)
+{
+   json_putc(w, '}');
+   if (w->depth)
+      w->depth--;
+}
+
+void json_array_begin(json_writer_t *w)
+{
+   json_separator(w);
+   json_putc(w, '[');
+
+   if (w->depth + 1 >= JSON_MAX_DEPTH) {
+      w->error = 1;
+      return;
+   }
+   w->member[++w->depth] = 0;
+}
+
+void json_array_end(json_writer_t *w)
+{
+   json_putc(w, ']');
+   if (w->depth)
+      w->depth--;
+}
+
+/*
+ * key names are expected to be plain ASCII and are not escaped
+ */
+void json_key(json_writer_t *w, const gchar *key)
+{
+   json_separator(w);
+   json_putc(w, '"');
+   json_put(w, key, strlen(key));
+   json_put(w, "\":", 2);
+   w->key = 1;
+}
+
+/*
+ * writes a complete string value; len of -1 means NUL terminated
+ */
+void json_string(json_writer_t *w, const gchar *str, gssize len)
+{
+   if (str == NULL) {
+      json_null(w);
+      return;
+   }
+
+   json_string_begin(w);
+   json_string_append(w, str, len);
+   json_string_end(w);
+}
+
+/*
+ * a string value can be assembled from several pieces
+ * without the need to concatenate them first
+ */
+void json_string_begin(json_writer_t *w)
+{
+   json_separator(w);
+   json_putc(w, '"');
+}
+
+void json_string_append(json_writer_t *w, const gchar *str, gssize len)
+{
+   json_escape(w, str, len < 0 ? strlen(str) : (gsize)len);
+}
+
+void json_string_end(json_writer_t *w)
+{
+   json_putc(w, '"');
+}
+
+/*
+ * writes binary data as a hex string, optionally separated
+ */
+void json_hex(json_writer_t *w, const guchar *data, gsize len, gchar separator)
+{
+   gchar tmp[3];
+   gsize i;
+
+   json_string_begin(w);
+
+   for (i = 0; i < len; i++) {
+      tmp[0] = hex_digits[data[i] >> 4];
+      tmp[1] = hex_digits[data[i] & 0x0f];
+      tmp[2] = separator;
+      json_put(w, tmp, (separator && i + 1 < len) ? 3 : 2);
+   }
+
+   json_string_end(w);
+}
+
+void json_uint(json_writer_t *w, guint64 value)
+{
+   gchar tmp[20];
+   guint pos = sizeof(tmp);
+
+   /* digits are produced from the end of the scratch buffer */
+   do {
+      tmp[--pos] = '0' + (value % 10);
+      value /= 10;
+   } while (value);
+
+   json_separator(w);
+   json_put(w, tmp + pos, sizeof(tmp) - pos);
+}
+
+void json_int(json_writer_t *w, gint64 value)
+{
+   if (value < 0) {
+      json_separator(w);
+      json_putc(w, '-');
+      /* the separator has been written already */
+      w->key = 1;
+      json_uint(w, -(guint64)value);
+   }
+   else {
+      json_uint(w, value);
+   }
+}
+
+void json_bool(json_writer_t *w, gboolean value)
+{
+   json_separator(w);
+   if (value)
+      json_put(w, "true", 4);
+   else
+      json_put(w, "false", 5);
+}
+
+void json_null(json_writer_t *w)
+{
+   json_separator(w);
+   json_put(w, "null", 4);
+}
+
+/*
+ * appends pre-formatted JSON as a value
+ */
+void json_raw(json_writer_t *w, const gchar *str, gsize len)
+{
+   json_separator(w);
+   json_put(w, str, len);
+}
+
+/*
+ * terminates a record in NDJSON output
+ */
+void json_newline(json_writer_t *w)
+{
+   json_putc(w, '\n');
+   w->member[w->depth] = 0;
+}
+
+/*
+ * appends raw bytes, flushing the buffer if necessary
+ */
+static inline void json_put(json_writer_t *w, const gchar *data, gsize len)
+{
+   gsize chunk;
+
+   while (G_UNLIKELY(w->pos + len > w->size)) {
+      chunk = w->size - w->pos;
+      memcpy(w->buffer + w->pos, data, chunk);
+      w->pos += chunk;
+      data += chunk;
+      len -= chunk;
+
+      if (w->fd < 0) {
+         w->error = 1;
+         return;
+      }
+      if (json_flush(w) != E_SUCCESS)
+         return;
+   }
+
+   memcpy(w->buffer + w->pos, data, len);
+   w->pos += len;
+}
+
+static inline void json_putc(json_writer_t *w, gchar c)
+{
+   if (G_UNLIKELY(w->pos == w->size)) {
+      if (w->fd < 0 || json_flush(w) != E_SUCCESS) {
+         w->error = 1;
+         return;
+      }
+   }
+
+   w->buffer[w->pos++] = c;
+}
+
+/*
+ * emits the comma between members unless a key is pending
+ */
+static inline void json_separator(json_writer_t *w)
+{
+   if (w->key) {
+      w->key = 0;
+      return;
+   }
+
+   if (w->member[w->depth])
+      json_putc(w, ',');
+   w->member[w->depth] = 1;
+}
+
+/*
+ * copies runs of characters not requiring escaping at once
+ */
+static void json_escape(json_writer_t *w, const gchar *str, gsize len)
+{
+   const guchar *ptr = (const guchar*)str, *end = ptr + len, *run;
+   gchar tmp[6];
+
+   while (ptr < end) {
+      run = ptr;
+      while (ptr < end && escape_matrix[*ptr] == 0)
+         ptr++;
+
+      if (ptr > run)
+         json_put(w, (const gchar*)run, ptr - run);
+
+      if (ptr == end)
+         break;
+
+      tmp[0] = '\\';
+      if (escape_matrix[*ptr] == 'u') {
+         tmp[1] = 'u';
+         tmp[2] = '0';
+         tmp[3] = '0';
+         tmp[4] = hex_digits[*ptr >> 4];
+         tmp[5] = hex_digits[*ptr & 0x0f];
+         json_put(w, tmp, 6);
+      }
+      else {
+         tmp[1] = escape_matrix[*ptr];
+         json_put(w, tmp, 2);
+      }
+      ptr++;
+   }
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,621 @@
+/* keycheck.c - weak public keys and RSA moduli sharing factors
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <certalize.h>
+#include <certalize_keycheck.h>
+#include <certalize_sketch.h>
+#include <certalize_debug.h>
+
+#ifdef HAVE_GMP
+#include <gmp.h>
+#endif
+
+/* globals    */
+
+/* the odd primes below KEYCHECK_TRIAL_PRIMES */
+static const guint8 keycheck_primes[] = {
+     3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,
+    53,  59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109,
+   113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191,
+   193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251,
+};
+
+static const gchar *keycheck_names[KEYCHECK_PROBLEMS] = {
+   "short key",
+   "even modulus",
+   "small factor",
+   "bad exponent",
+   "negative modulus",
+   "explicit or unknown curve",
+};
+
+#ifdef HAVE_GMP
+/*
+ * product tree over the moduli, level 0 holding the moduli and the
+ * last the product of all; the remainders replace it level by level
+ * on the way down
+ */
+typedef struct keycheck_tree {
+   mpz_t **levels;
+   guint *sizes;
+   guint depth;
+   mpz_t *rem;
+   mpz_t *next;
+   /* the level the workers are computing */
+   guint level;
+   void (*step)(struct keycheck_tree *tree, guint i);
+   guint pending;
+   GMutex lock;
+   GCond cond;
+} keycheck_tree_t;
+#endif
+
+/* prototypes */
+static gboolean keycheck_trial(const guchar *ptr, gsize len);
+static keycheck_modulus_t* keycheck_find(keycheck_t *kc, guint64 hash,
+                                         const guchar *data, gsize len);
+static void keycheck_insert(keycheck_t *kc, keycheck_modulus_t *m);
+static void keycheck_modulus_free(keycheck_modulus_t *m);
+#ifdef HAVE_GMP
+static void keycheck_level(keycheck_tree_t *tree, GThreadPool *pool,
+                           guint level, guint count,
+                           void (*step)(keycheck_tree_t *tree, guint i));
+static void keycheck_worker(gpointer data, gpointer user_data);
+static void keycheck_product(keycheck_tree_t *tree, guint i);
+static void keycheck_remainder(keycheck_tree_t *tree, guint i);
+static void keycheck_leaf(keycheck_tree_t *tree, guint i);
+static void keycheck_group(keycheck_t *kc, mpz_t *moduli, mpz_t *factors);
+static void keycheck_join(guint *parent, mpz_t a, mpz_t b, guint i, guint j);
+static guint keycheck_root(guint *parent, guint i);
+#endif
+
+
+/*************/
+
+void keycheck_init(keycheck_t *kc)
+{
+   memset(kc, 0, sizeof(keycheck_t));
+
+   kc->table = g_hash_table_new(g_int64_hash, g_int64_equal);
+   kc->moduli = g_ptr_array_new();
+}
+
+/*
+ * releases the moduli, the references are the caller's
+ */
+void keycheck_destroy(keycheck_t *kc)
+{
+   guint i;
+
+   for (i = 0; i < kc->moduli->len; i++)
+      keycheck_modulus_free(g_ptr_array_index(kc->moduli, i));
+
+   g_ptr_array_free(kc->moduli, TRUE);
+   g_hash_table_destroy(kc->table);
+}
+
+/*
+ * the weaknesses of a key found by looking at it alone
+ */
+guint keycheck_key(cbuf_t *cbuf, x509_key_t *key)
+{
+   const guchar *ptr;
+   guint problems = 0;
+   guint64 exponent;
+   gsize len;
+
+   switch (key->type) {
+      case X509_KEY_RSA:
+         if (key->bits < KEYCHECK_RSA_MIN_BITS)
+            problems |= KEYCHECK_SHORT;
+
+         ptr = ASN1_CONTENT(cbuf, &key->modulus);
+         len = key->modulus.length;
+         if (len == 0)
+            break;
+
+         if (ptr[0] & 0x80)
+            problems |= KEYCHECK_NEGATIVE;
+
+         if ((ptr[len - 1] & 1) == 0)
+            problems |= KEYCHECK_EVEN_MODULUS;
+         else if (keycheck_trial(ptr, len))
+            problems |= KEYCHECK_SMALL_FACTOR;
+
+         ptr = ASN1_CONTENT(cbuf, &key->exponent);
+         len = key->exponent.length;
+         if (len == 0 || (ptr[len - 1] & 1) == 0 ||
+             (asn1_decode_uint(cbuf, &key->exponent, &exponent) == E_SUCCESS &&
+              exponent == 1))
+            problems |= KEYCHECK_BAD_EXPONENT;
+         break;
+
+      case X509_KEY_DSA:
+         if (key->bits && key->bits < KEYCHECK_DSA_MIN_BITS)
+            problems |= KEYCHECK_SHORT;
+         break;
+
+      case X509_KEY_EC:
+         if (key->curve.length == 0 || key->bits == 0)
+            problems |= KEYCHECK_CURVE;
+         else if (key->bits < KEYCHECK_EC_MIN_BITS)
+            problems |= KEYCHECK_SHORT;
+         break;
+   }
+
+   return problems;
+}
+
+/*
+ * name of one of the KEYCHECK_* bits
+ */
+const gchar* keycheck_problem_name(guint problem)
+{
+   guint i;
+
+   for (i = 0; i < KEYCHECK_PROBLEMS; i++)
+      if (problem == 1U << i)
+         return keycheck_names[i];
+
+   return "unknown";
+}
+
+/*
+ * adds the modulus of an RSA key, other keys are ignored; ref is kept
+ * with the modulus to tell the certificates having it
+ */
+void keycheck_add(keycheck_t *kc, cbuf_t *cbuf, x509_key_t *key,
+                  gpointer ref)
+{
+   keycheck_modulus_t *m;
+   const guchar *ptr;
+   gsize len;
+   guint64 hash;
+
+   if (key->type != X509_KEY_RSA)
+      return;
+
+   ptr = ASN1_CONTENT(cbuf, &key->modulus);
+   len = key->modulus.length;
+   while (len && *ptr == 0) {
+      ptr++;
+      len--;
+   }
+
+   if (len == 0)
+      return;
+
+   kc->keys++;
+
+   hash = sketch_hash(ptr, len);
+
+   m = keycheck_find(kc, hash, ptr, len);
+   if (m == NULL) {
+      m = g_new0(keycheck_modulus_t, 1);
+      m->hash = hash;
+      m->data = g_malloc(len);
+      memcpy(m->data, ptr, len);
+      m->len = len;
+      m->refs = g_ptr_array_new();
+      keycheck_insert(kc, m);
+   }
+
+   g_ptr_array_add(m->refs, ref);
+}
+
+/*
+ * moves the moduli of other into kc, leaving other empty
+ */
+void keycheck_merge(keycheck_t *kc, keycheck_t *other)
+{
+   keycheck_modulus_t *m, *known;
+   guint i, j;
+
+   for (i = 0; i < other->moduli->len; i++) {
+      m = g_ptr_array_index(other->moduli, i);
+
+      known = keycheck_find(kc, m->hash, m->data, m->len);
+      if (known) {
+         for (j = 0; j < m->refs->len; j++)
+            g_ptr_array_add(known->refs, g_ptr_array_index(m->refs, j));
+         keycheck_modulus_free(m);
+      }
+      else {
+         m->next = NULL;
+         keycheck_insert(kc, m);
+      }
+   }
+
+   kc->keys += other->keys;
+   other->keys = 0;
+
+   g_ptr_array_set_size(other->moduli, 0);
+   g_hash_table_remove_all(other->table);
+}
+
+/*
+ * sets factor_bits of every distinct modulus sharing a prime with
+ * another one and groups those sharing primes
+ *   - the product P of all moduli is built bottom-up, then P mod N^2
+ *     top-down for every modulus N; gcd((P mod N^2) / N, N) is the
+ *     part of N dividing the product of the others
+ *   - every level of both trees is spread over a thread pool
+ * returns -E_NOTHANDLED if built without GMP
+ */
+int keycheck_batch_gcd(keycheck_t *kc)
+{
+#ifdef HAVE_GMP
+   keycheck_tree_t tree;
+   keycheck_modulus_t *m;
+   GThreadPool *pool;
+   guint i, n, k;
+
+   n = kc->moduli->len;
+   if (n < 2)
+      return E_SUCCESS;
+
+   memset(&tree, 0, sizeof(keycheck_tree_t));
+   g_mutex_init(&tree.lock);
+   g_cond_init(&tree.cond);
+
+   /* levels of ceil(n / 2^k) nodes up to the root */
+   for (k = n, tree.depth = 1; k > 1; k = (k + 1) / 2)
+      tree.depth++;
+
+   tree.levels = g_new0(mpz_t*, tree.depth);
+   tree.sizes = g_new0(guint, tree.depth);
+
+   tree.sizes[0] = n;
+   tree.levels[0] = g_new(mpz_t, n);
+   for (i = 0; i < n; i++) {
+      m = g_ptr_array_index(kc->moduli, i);
+      mpz_init(tree.levels[0][i]);
+      mpz_import(tree.levels[0][i], m->len, 1, 1, 1, 0, m->data);
+   }
+
+   pool = g_thread_pool_new(keycheck_worker, &tree,
+         g_get_num_processors(), FALSE, NULL);
+
+   for (k = 1; k < tree.depth; k++) {
+      tree.sizes[k] = (tree.sizes[k - 1] + 1) / 2;
+      tree.levels[k] = g_new(mpz_t, tree.sizes[k]);
+      for (i = 0; i < tree.sizes[k]; i++)
+         mpz_init(tree.levels[k][i]);
+      keycheck_level(&tree, pool, k, tree.sizes[k], keycheck_product);
+   }
+
+   DEBUG_MSG("keycheck_batch_gcd: %u moduli, product of %lu bits", n,
+         (gulong)mpz_sizeinbase(tree.levels[tree.depth - 1][0], 2));
+
+   /* the remainders of a level replace those of the level above */
+   tree.rem = tree.levels[tree.depth - 1];
+   tree.levels[tree.depth - 1] = NULL;
+
+   for (k = tree.depth - 1; k-- > 0; ) {
+      tree.next = g_new(mpz_t, tree.sizes[k]);
+      for (i = 0; i < tree.sizes[k]; i++)
+         mpz_init(tree.next[i]);
+      keycheck_level(&tree, pool, k, tree.sizes[k], keycheck_remainder);
+
+      for (i = 0; i < tree.sizes[k + 1]; i++)
+         mpz_clear(tree.rem[i]);
+      g_free(tree.rem);
+      tree.rem = tree.next;
+
+      /* the products above are done with */
+      if (tree.levels[k + 1]) {
+         for (i = 0; i < tree.sizes[k + 1]; i++)
+            mpz_clear(tree.levels[k + 1][i]);
+         g_free(tree.levels[k + 1]);
+         tree.levels[k + 1] = NULL;
+      }
+   }
+
+   /* the results go into the remainders, the moduli are kept */
+   keycheck_level(&tree, pool, 0, n, keycheck_leaf);
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   for (i = 0; i < n; i++) {
+      m = g_ptr_array_index(kc->moduli, i);
+      m->factor_bits = mpz_cmp_ui(tree.rem[i], 1) == 0 ? 0 :
+         mpz_sizeinbase(tree.rem[i], 2);
+      m->group = 0;
+   }
+
+   keycheck_group(kc, tree.levels[0], tree.rem);
+
+   for (i = 0; i < n; i++) {
+      mpz_clear(tree.levels[0][i]);
+      mpz_clear(tree.rem[i]);
+   }
+   g_free(tree.rem);
+   g_free(tree.levels[0]);
+   g_free(tree.levels);
+   g_free(tree.sizes);
+   g_mutex_clear(&tree.lock);
+   g_cond_clear(&tree.cond);
+
+   return E_SUCCESS;
+#else
+   (void)kc;
+   return -E_NOTHANDLED;
+#endif
+}
+
+/*
+ * whether the odd modulus is divisible by one of the small primes;
+ * as many primes as fit are multiplied to divide by them at once
+ */
+static gboolean keycheck_trial(const guchar *ptr, gsize len)
+{
+   guint64 m, r;
+   guint i, j, first;
+   gsize k;
+
+   for (i = 0; i < G_N_ELEMENTS(keycheck_primes); ) {
+      first = i;
+      for (m = 1; i < G_N_ELEMENTS(keycheck_primes) &&
+           m * keycheck_primes[i] <= G_MAXUINT32; i++)
+         m *= keycheck_primes[i];
+
+      for (r = 0, k = 0; k < len; k++)
+         r = ((r << 8) | ptr[k]) % m;
+
+      for (j = first; j < i; j++)
+         if (r % keycheck_primes[j] == 0)
+            return TRUE;
+   }
+
+   return FALSE;
+}
+
+static keycheck_modulus_t* keycheck_find(keycheck_t *kc, guint64 hash,
+                                         const guchar *data, gsize len)
+{
+   keycheck_modulus_t *m;
+
+   /* distinct moduli of one hash are chained */
+   for (m = g_hash_table_lookup(kc->table, &hash); m; m = m->next)
+      if (m->len == len && !memcmp(m->data, data, len))
+         return m;
+
+   return NULL;
+}
+
+static void keycheck_insert(keycheck_t *kc, keycheck_modulus_t *m)
+{
+   keycheck_modulus_t *head;
+
+   head = g_hash_table_lookup(kc->table, &m->hash);
+   if (head) {
+      m->next = head->next;
+      head->next = m;
+   }
+   else {
+      g_hash_table_insert(kc->table, &m->hash, m);
+   }
+
+   g_ptr_array_add(kc->moduli, m);
+}
+
+static void keycheck_modulus_free(keycheck_modulus_t *m)
+{
+   g_free(m->data);
+   g_ptr_array_free(m->refs, TRUE);
+   g_free(m);
+}
+
+#ifdef HAVE_GMP
+/*
+ * computes the nodes of one level with the thread pool
+ */
+static void keycheck_level(keycheck_tree_t *tree, GThreadPool *pool,
+                           guint level, guint count,
+                           void (*step)(keycheck_tree_t *tree, guint i))
+{
+   guint i;
+
+   tree->level = level;
+   tree->step = step;
+   tree->pending = count;
+
+   for (i = 0; i < count; i++)
+      g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+
+   g_mutex_lock(&tree->lock);
+   while (tree->pending)
+      g_cond_wait(&tree->cond, &tree->lock);
+   g_mutex_unlock(&tree->lock);
+}
+
+static void keycheck_worker(gpointer data, gpointer user_data)
+{
+   keycheck_tree_t *tree = user_data;
+
+   tree->step(tree, GPOINTER_TO_UINT(data) - 1);
+
+   g_mutex_lock(&tree->lock);
+   if (--tree->pending == 0)
+      g_cond_signal(&tree->cond);
+   g_mutex_unlock(&tree->lock);
+}
+
+static void keycheck_product(keycheck_tree_t *tree, guint i)
+{
+   mpz_t *below = tree->levels[tree->level - 1];
+
+   if (2 * i + 1 < tree->sizes[tree->level - 1])
+      mpz_mul(tree->levels[tree->level][i], below[2 * i], below[2 * i + 1]);
+   else
+      mpz_set(tree->levels[tree->level][i], below[2 * i]);
+}
+
+static void keycheck_remainder(keycheck_tree_t *tree, guint i)
+{
+   mpz_t square;
+
+   mpz_init(square);
+   mpz_mul(square, tree->levels[tree->level][i], tree->levels[tree->level][i]);
+   mpz_mod(tree->next[i], tree->rem[i / 2], square);
+   mpz_clear(square);
+}
+
+static void keycheck_leaf(keycheck_tree_t *tree, guint i)
+{
+   mpz_t *n = &tree->levels[0][i];
+
+   mpz_divexact(tree->rem[i], tree->rem[i], *n);
+   mpz_gcd(tree->rem[i], tree->rem[i], *n);
+}
+
+/*
+ * numbers the groups of moduli sharing primes with each other by the
+ * factor every one shares with the others
+ *   - a prime factor is looked up by its lowest limb, so the moduli
+ *     of the same prime are joined without comparing pairs
+ *   - distinct primes are coprime; only the few composite factors,
+ *     of a modulus sharing both its primes or different primes with
+ *     different moduli, are compared to the others by their GCD
+ */
+static void keycheck_group(keycheck_t *kc, mpz_t *moduli, mpz_t *factors)
+{
+   keycheck_modulus_t *m;
+   GHashTable *primes;
+   GArray *found, *distinct, *composite;
+   guint64 *keys;
+   guint *parent, *group;
+   guint i, j, a, b, x;
+   gpointer first;
+
+   found = g_array_new(FALSE, FALSE, sizeof(guint));
+   for (i = 0; i < kc->moduli->len; i++) {
+      m = g_ptr_array_index(kc->moduli, i);
+      if (m->factor_bits)
+         g_array_append_val(found, i);
+   }
+
+   kc->groups = 0;
+   if (found->len == 0) {
+      g_array_free(found, TRUE);
+      return;
+   }
+
+   parent = g_new(guint, found->len);
+   group = g_new0(guint, found->len);
+   keys = g_new(guint64, found->len);
+   for (i = 0; i < found->len; i++)
+      parent[i] = i;
+
+   /* prime -> first position in found holding it */
+   primes = g_hash_table_new(g_int64_hash, g_int64_equal);
+   distinct = g_array_new(FALSE, FALSE, sizeof(guint));
+   composite = g_array_new(FALSE, FALSE, sizeof(guint));
+
+   for (i = 0; i < found->len; i++) {
+      a = g_array_index(found, guint, i);
+      if (mpz_cmp(factors[a], moduli[a]) == 0 ||
+          mpz_probab_prime_p(factors[a], 24) == 0) {
+         g_array_append_val(composite, i);
+         continue;
+      }
+
+      keys[i] = mpz_getlimbn(factors[a], 0);
+      first = g_hash_table_lookup(primes, &keys[i]);
+      if (first == NULL) {
+         g_hash_table_insert(primes, &keys[i], GUINT_TO_POINTER(i + 1));
+         g_array_append_val(distinct, i);
+         continue;
+      }
+
+      j = GPOINTER_TO_UINT(first) - 1;
+      b = g_array_index(found, guint, j);
+      /* another prime of the same limb is compared like a composite */
+      if (mpz_cmp(factors[a], factors[b]) == 0)
+         parent[i] = keycheck_root(parent, j);
+      else
+         g_array_append_val(composite, i);
+   }
+
+   for (i = 0; i < composite->len; i++) {
+      a = g_array_index(composite, guint, i);
+      for (j = 0; j < distinct->len; j++) {
+         b = g_array_index(distinct, guint, j);
+         keycheck_join(parent, factors[g_array_index(found, guint, a)],
+               factors[g_array_index(found, guint, b)], a, b);
+      }
+      for (j = i + 1; j < composite->len; j++) {
+         b = g_array_index(composite, guint, j);
+         keycheck_join(parent, factors[g_array_index(found, guint, a)],
+               factors[g_array_index(found, guint, b)], a, b);
+      }
+   }
+
+   /* numbered by their first modulus */
+   for (i = 0; i < found->len; i++) {
+      x = keycheck_root(parent, i);
+      if (group[x] == 0)
+         group[x] = ++kc->groups;
+      m = g_ptr_array_index(kc->moduli, g_array_index(found, guint, i));
+      m->group = group[x];
+   }
+
+   g_hash_table_destroy(primes);
+   g_array_free(distinct, TRUE);
+   g_array_free(composite, TRUE);
+   g_free(keys);
+   g_free(parent);
+   g_free(group);
+   g_array_free(found, TRUE);
+}
+
+/*
+ * puts the moduli at i and j of the found ones into the same group
+ * if their factors a and b have one in common
+ */
+static void keycheck_join(guint *parent, mpz_t a, mpz_t b, guint i, guint j)
+{
+   guint x, y;
+   mpz_t g;
+
+   x = keycheck_root(parent, i);
+   y = keycheck_root(parent, j);
+   if (x == y)
+      return;
+
+   mpz_init(g);
+   mpz_gcd(g, a, b);
+   if (mpz_cmp_ui(g, 1) != 0)
+      parent[MAX(x, y)] = MIN(x, y);
+   mpz_clear(g);
+}
+
+static guint keycheck_root(guint *parent, guint i)
+{
+   while (parent[i] != i)
+      i = parent[i] = parent[parent[i]];
+
+   return i;
+}
+#endif
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,488 @@
+/* keys.c - weak public keys of a corpus
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_keys.h>
+#include <certalize_keycheck.h>
+#include <certalize_stream.h>
+#include <certalize_loader.h>
+#include <certalize_index.h>
+#include <certalize_x509.h>
+#include <certalize_json.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+/* globals    */
+
+/* SHA-256 */
+#define KEYS_FINGERPRINT_LEN        32
+
+/* a certificate with an RSA key or a weak key of any type */
+typedef struct keys_cert {
+   /* the name of the input, owned by keys_run() */
+   const gchar *source;
+   guint64 offset;
+   gchar *subject;
+   guint type;
+   guint bits;
+   guint problems;
+   /* SHA-256 of the DER, telling copies in several inputs apart */
+   guchar fingerprint[KEYS_FINGERPRINT_LEN];
+} keys_cert_t;
+
+/* what one worker thread has seen */
+typedef struct keys_acc {
+   asn1_index_t index;
+   cstream_t stream;
+   guint64 records;
+   guint64 invalid;
+   guint64 errors;
+   keycheck_t check;
+   /* keys_cert_t, the references of the moduli */
+   GPtrArray *certs;
+   /* the keys_cert_t with problems */
+   GPtrArray *weak;
+   filter_t *filter;
+   filter_fields_t fields;
+   GChecksum *digest;
+   const gchar *filename;
+} keys_acc_t;
+
+/* prototypes */
+static keys_acc_t* keys_acc_new(filter_t *filter,
+                                const asn1_limits_t *limits);
+static void keys_acc_free(keys_acc_t *acc);
+static void keys_acc_merge(keys_acc_t *acc, keys_acc_t *other);
+static void keys_cert_free(gpointer data);
+static void keys_job_run(gpointer data, gpointer user_data);
+static int  keys_record(const guchar *der, gsize len, guint64 offset,
+                        gpointer data);
+static void keys_distinct(GPtrArray *refs, GHashTable *seen);
+static guint keys_fingerprint_hash(gconstpointer key);
+static gboolean keys_fingerprint_equal(gconstpointer a, gconstpointer b);
+static void keys_emit(keys_acc_t *acc, int gcd);
+static void keys_emit_cert(json_writer_t *w, keys_cert_t *cert);
+static void keys_emit_modulus(json_writer_t *w, keycheck_modulus_t *m);
+static gint keys_compare_cert(gconstpointer a, gconstpointer b);
+static gint keys_compare_modulus(gconstpointer a, gconstpointer b);
+
+
+/*************/
+
+/*
+ * checks the public keys of the certificates of all files and
+ * directories which match the filter, if any, and prints those found
+ * weak as one JSON object: keys weak on their own, RSA moduli shared
+ * by several distinct certificates and those sharing a prime with
+ * another one
+ *
+ * the files are read by a thread pool into accumulators as by
+ * stats_run(); the moduli of all are then checked at once
+ */
+int keys_run(GPtrArray *files, filter_t *filter,
+             const asn1_limits_t *limits)
+{
+   GAsyncQueue *accs;
+   GThreadPool *pool;
+   GPtrArray *inputs;
+   keys_acc_t *total, *acc;
+   guint i, threads;
+   int res;
+
+   inputs = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < files->len; i++)
+      loader_expand(inputs, g_ptr_array_index(files, i));
+
+   threads = g_get_num_processors();
+   accs = g_async_queue_new();
+   for (i = 0; i < threads; i++)
+      g_async_queue_push(accs, keys_acc_new(filter, limits));
+
+   pool = g_thread_pool_new(keys_job_run, accs, threads, FALSE, NULL);
+
+   for (i = 0; i < inputs->len; i++)
+      g_thread_pool_push(pool, g_ptr_array_index(inputs, i), NULL);
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   total = g_async_queue_pop(accs);
+   while ((acc = g_async_queue_try_pop(accs)) != NULL) {
+      keys_acc_merge(total, acc);
+      keys_acc_free(acc);
+   }
+
+   res = keycheck_batch_gcd(&total->check);
+   if (res == -E_NOTHANDLED)
+      g_printerr("built without GMP, moduli sharing a prime are not "
+            "searched\n");
+
+   keys_emit(total, res);
+
+   res = total->errors ? E_INVALID : E_SUCCESS;
+
+   keys_acc_free(total);
+   g_async_queue_unref(accs);
+   g_ptr_array_free(inputs, TRUE);
+
+   return res;
+}
+
+static keys_acc_t* keys_acc_new(filter_t *filter,
+                                const asn1_limits_t *limits)
+{
+   keys_acc_t *acc = g_new0(keys_acc_t, 1);
+
+   asn1_index_init(&acc->index);
+   asn1_index_set_limits(&acc->index, limits);
+   cstream_init(&acc->stream, keys_record, acc);
+   keycheck_init(&acc->check);
+   acc->certs = g_ptr_array_new_with_free_func(keys_cert_free);
+   acc->weak = g_ptr_array_new();
+   acc->filter = filter;
+   filter_fields_init(&acc->fields);
+   acc->digest = g_checksum_new(G_CHECKSUM_SHA256);
+
+   return acc;
+}
+
+static void keys_acc_free(keys_acc_t *acc)
+{
+   asn1_index_destroy(&acc->index);
+   cstream_destroy(&acc->stream);
+   keycheck_destroy(&acc->check);
+   g_ptr_array_free(acc->weak, TRUE);
+   g_ptr_array_free(acc->certs, TRUE);
+   filter_fields_destroy(&acc->fields);
+   g_checksum_free(acc->digest);
+   g_free(acc);
+}
+
+/*
+ * moves the certificates and moduli of other into acc
+ */
+static void keys_acc_merge(keys_acc_t *acc, keys_acc_t *other)
+{
+   guint i;
+
+   acc->records += other->records;
+   acc->invalid += other->invalid;
+   acc->errors += other->errors;
+
+   keycheck_merge(&acc->check, &other->check);
+
+   for (i = 0; i < other->certs->len; i++)
+      g_ptr_array_add(acc->certs, g_ptr_array_index(other->certs, i));
+   g_ptr_array_set_free_func(other->certs, NULL);
+   g_ptr_array_set_size(other->certs, 0);
+   g_ptr_array_set_free_func(other->certs, keys_cert_free);
+
+   for (i = 0; i < other->weak->len; i++)
+      g_ptr_array_add(acc->weak, g_ptr_array_index(other->weak, i));
+   g_ptr_array_set_size(other->weak, 0);
+}
+
+static void keys_cert_free(gpointer data)
+{
+   keys_cert_t *cert = data;
+
+   g_free(cert->subject);
+   g_free(cert);
+}
+
+/*
+ * worker: splits one input file into records
+ */
+static void keys_job_run(gpointer data, gpointer user_data)
+{
+   const gchar *filename = data;
+   GAsyncQueue *accs = user_data;
+   keys_acc_t *acc;
+
+   acc = g_async_queue_pop(accs);
+   acc->filename = filename;
+
+   if (loader_stream(filename, &acc->stream) < 0)
+      acc->errors++;
+
+   g_async_queue_push(accs, acc);
+}
+
+/*
+ * checks the key of one record; the modulus is copied, the record
+ * is not kept
+ */
+static int keys_record(const guchar *der, gsize len, guint64 offset,
+                       gpointer data)
+{
+   keys_acc_t *acc = data;
+   keys_cert_t *ref;
+   x509_cert_t cert;
+   x509_key_t key;
+   cbuf_t cbuf;
+   gchar subject[X509_NAME_MAXLEN];
+   gsize digest_len;
+   guint problems;
+
+   if (der == NULL) {
+      acc->invalid++;
+      return E_SUCCESS;
+   }
+
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = (guchar*)der;
+   cbuf.length = len;
+
+   if (asn1_index_element(&acc->index, &cbuf, 0) < 0 ||
+       x509_parse_index(&cbuf, &acc->index, 0, &cert) < 0) {
+      acc->invalid++;
+      return E_SUCCESS;
+   }
+
+   if (acc->filter) {
+      filter_fields_decode(&acc->fields, filter_mask(acc->filter), &cbuf,
+            &cert, acc->filename, offset);
+      if (!filter_match(acc->filter, &acc->fields))
+         return E_SUCCESS;
+   }
+
+   acc->records++;
+
+   if (x509_public_key(&cbuf, &cert, &key) != E_SUCCESS)
+      return E_SUCCESS;
+
+   problems = keycheck_key(&cbuf, &key);
+   if (problems == 0 && key.type != X509_KEY_RSA)
+      return E_SUCCESS;
+
+   x509_name_to_string(&cbuf, &cert.subject, subject, sizeof(subject));
+
+   ref = g_new0(keys_cert_t, 1);
+   ref->source = acc->filename;
+   ref->offset = offset;
+   ref->subject = g_strdup(subject);
+   ref->type = key.type;
+   ref->bits = key.bits;
+   ref->problems = problems;
+   g_ptr_array_add(acc->certs, ref);
+
+   g_checksum_reset(acc->digest);
+   g_checksum_update(acc->digest, der, len);
+   digest_len = KEYS_FINGERPRINT_LEN;
+   g_checksum_get_digest(acc->digest, ref->fingerprint, &digest_len);
+
+   if (problems)
+      g_ptr_array_add(acc->weak, ref);
+
+   keycheck_add(&acc->check, &cbuf, &key, ref);
+
+   return E_SUCCESS;
+}
+
+/*
+ * drops the references to a certificate seen before in the sorted
+ * references of a modulus, so a certificate contained in several
+ * inputs counts once and only distinct ones share a modulus
+ */
+static void keys_distinct(GPtrArray *refs, GHashTable *seen)
+{
+   keys_cert_t *ref;
+   guint i, n;
+
+   g_hash_table_remove_all(seen);
+
+   for (i = 0, n = 0; i < refs->len; i++) {
+      ref = g_ptr_array_index(refs, i);
+      if (g_hash_table_contains(seen, ref->fingerprint))
+         continue;
+      g_hash_table_add(seen, ref->fingerprint);
+      refs->pdata[n++] = ref;
+   }
+
+   g_ptr_array_set_size(refs, n);
+}
+
+static guint keys_fingerprint_hash(gconstpointer key)
+{
+   guint h;
+
+   memcpy(&h, key, sizeof(h));
+
+   return h;
+}
+
+static gboolean keys_fingerprint_equal(gconstpointer a, gconstpointer b)
+{
+   return !memcmp(a, b, KEYS_FINGERPRINT_LEN);
+}
+
+/*
+ * everything ordered by input and offset, independent of the threads
+ */
+static void keys_emit(keys_acc_t *acc, int gcd)
+{
+   keycheck_t *kc = &acc->check;
+   keycheck_modulus_t *m, *n;
+   json_writer_t w;
+   GPtrArray *shared, *factors;
+   GHashTable *seen;
+   guchar *buffer;
+   guint i, j;
+
+   shared = g_ptr_array_new();
+   factors = g_ptr_array_new();
+   seen = g_hash_table_new(keys_fingerprint_hash, keys_fingerprint_equal);
+
+   for (i = 0; i < kc->moduli->len; i++) {
+      m = g_ptr_array_index(kc->moduli, i);
+      g_ptr_array_sort(m->refs, keys_compare_cert);
+      keys_distinct(m->refs, seen);
+      if (m->refs->len > 1)
+         g_ptr_array_add(shared, m);
+      if (m->group)
+         g_ptr_array_add(factors, m);
+   }
+   g_ptr_array_sort(shared, keys_compare_modulus);
+   g_ptr_array_sort(factors, keys_compare_modulus);
+   g_ptr_array_sort(acc->weak, keys_compare_cert);
+
+   buffer = g_malloc(JSON_DEFAULT_BUFSIZE);
+   json_init(&w, STDOUT_FILENO, buffer, JSON_DEFAULT_BUFSIZE);
+
+   json_object_begin(&w);
+   json_member_uint(&w, "certificates", acc->records);
+   json_member_uint(&w, "invalid", acc->invalid);
+   json_member_uint(&w, "rsa_keys", kc->keys);
+   json_member_uint(&w, "distinct_moduli", kc->moduli->len);
+
+   json_key(&w, "weak_keys");
+   json_array_begin(&w);
+   for (i = 0; i < acc->weak->len; i++)
+      keys_emit_cert(&w, g_ptr_array_index(acc->weak, i));
+   json_array_end(&w);
+
+   json_key(&w, "shared_moduli");
+   json_array_begin(&w);
+   for (i = 0; i < shared->len; i++)
+      keys_emit_modulus(&w, g_ptr_array_index(shared, i));
+   json_array_end(&w);
+
+   json_member_bool(&w, "batch_gcd", gcd == E_SUCCESS);
+
+   /* groups in the order of their first modulus */
+   json_key(&w, "common_factors");
+   json_array_begin(&w);
+   for (i = 0; i < factors->len; i++) {
+      m = g_ptr_array_index(factors, i);
+      if (m->group == 0)
+         continue;
+
+      json_array_begin(&w);
+      keys_emit_modulus(&w, m);
+      for (j = i + 1; j < factors->len; j++) {
+         n = g_ptr_array_index(factors, j);
+         if (n->group != m->group)
+            continue;
+         keys_emit_modulus(&w, n);
+         n->group = 0;
+      }
+      m->group = 0;
+      json_array_end(&w);
+   }
+   json_array_end(&w);
+
+   json_object_end(&w);
+   json_newline(&w);
+   json_flush(&w);
+
+   g_free(buffer);
+   g_hash_table_destroy(seen);
+   g_ptr_array_free(shared, TRUE);
+   g_ptr_array_free(factors, TRUE);
+}
+
+static void keys_emit_cert(json_writer_t *w, keys_cert_t *cert)
+{
+   guint i;
+
+   json_object_begin(w);
+   json_member_string(w, "source", cert->source);
+   json_member_uint(w, "offset", cert->offset);
+   json_member_string(w, "subject", cert->subject);
+   json_member_string(w, "type", x509_key_type_name(cert->type));
+   json_member_uint(w, "bits", cert->bits);
+   if (cert->problems) {
+      json_key(w, "problems");
+      json_array_begin(w);
+      for (i = 0; i < KEYCHECK_PROBLEMS; i++)
+         if (cert->problems & (1U << i))
+            json_string(w, keycheck_problem_name(1U << i), -1);
+      json_array_end(w);
+   }
+   json_object_end(w);
+}
+
+/*
+ * a modulus, the bits of the factor it shares and its certificates
+ */
+static void keys_emit_modulus(json_writer_t *w, keycheck_modulus_t *m)
+{
+   guint i;
+
+   json_object_begin(w);
+   json_member_uint(w, "bits", (m->len - 1) * 8 + g_bit_storage(m->data[0]));
+   if (m->factor_bits)
+      json_member_uint(w, "factor_bits", m->factor_bits);
+   json_key(w, "certificates");
+   json_array_begin(w);
+   for (i = 0; i < m->refs->len; i++)
+      keys_emit_cert(w, g_ptr_array_index(m->refs, i));
+   json_array_end(w);
+   json_object_end(w);
+}
+
+/* by input, then offset */
+static gint keys_compare_cert(gconstpointer a, gconstpointer b)
+{
+   const keys_cert_t *x = *(keys_cert_t* const*)a;
+   const keys_cert_t *y = *(keys_cert_t* const*)b;
+   gint res;
+
+   if ((res = strcmp(x->source, y->source)) != 0)
+      return res;
+
+   if (x->offset != y->offset)
+      return x->offset < y->offset ? -1 : 1;
+
+   return 0;
+}
+
+/* by the first certificate, the references being sorted */
+static gint keys_compare_modulus(gconstpointer a, gconstpointer b)
+{
+   const keycheck_modulus_t *x = *(keycheck_modulus_t* const*)a;
+   const keycheck_modulus_t *y = *(keycheck_modulus_t* const*)b;
+
+   return keys_compare_cert(&g_ptr_array_index(x->refs, 0),
+         &g_ptr_array_index(y->refs, 0));
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
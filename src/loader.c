@@ -0,0 +1,621 @@
+/* loader.c - batched reading of many small files
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <certalize.h>
+#include <certalize_loader.h>
+#include <certalize_decomp.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#endif
+
+/* globals    */
+
+#ifdef HAVE_IO_URING
+
+/* every file is an open, statx, read and close chain */
+enum {
+   LOADER_OP_OPEN = 0,
+   LOADER_OP_STATX,
+   LOADER_OP_READ,
+   LOADER_OP_CLOSE,
+   LOADER_OPS,
+};
+
+#ifndef IORING_FEAT_CQE_SKIP
+#define IORING_FEAT_CQE_SKIP        (1U << 11)
+#endif
+
+#define LOADER_RING_ENTRIES         (LOADER_QUEUE_DEPTH * LOADER_OPS)
+
+/*
+ * file i is always read through slot i % LOADER_QUEUE_DEPTH, using the
+ * fixed file and the part of the buffer of the same number
+ */
+typedef struct loader_slot {
+   guint pending;
+   gint res[LOADER_OPS];
+   struct statx stx;
+   guchar *buffer;
+} loader_slot_t;
+
+#endif
+
+struct loader {
+   gchar **files;
+   guint count;
+   /* next file to hand out */
+   guint next;
+   /* the document handed out last, released on the next call */
+   cbuf_t *current;
+   gboolean uring;
+#ifdef HAVE_IO_URING
+   int ring_fd;
+   /* submission queue */
+   guint32 *sq_head, *sq_tail, *sq_mask;
+   struct io_uring_sqe *sqes;
+   guint32 sq_queued;
+   /* completion queue */
+   guint32 *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_cqe *cqes;
+   gpointer ring_map;
+   gsize ring_size;
+   gpointer sqe_map;
+   gsize sqe_size;
+   /* all slot buffers, registered with the ring if permitted */
+   guchar *slab;
+   gboolean fixed_buffers;
+   /* next file to submit */
+   guint submit;
+   loader_slot_t slots[LOADER_QUEUE_DEPTH];
+#endif
+};
+
+/* prototypes */
+static gint loader_compare(gconstpointer a, gconstpointer b);
+static int  loader_chunk(const guchar *buf, gsize len, gpointer data);
+#ifdef HAVE_IO_URING
+static gboolean loader_ring_init(loader_t *loader);
+static void loader_ring_destroy(loader_t *loader);
+static void loader_ring_queue(loader_t *loader, guint file);
+static int  loader_ring_wait(loader_t *loader, loader_slot_t *slot);
+static int  loader_ring_result(loader_t *loader, loader_slot_t *slot,
+                               const gchar *filename, cbuf_t **cbuf);
+#endif
+
+
+/*************/
+
+/*
+ * creates a loader for the given files; the names are referenced
+ * and have to outlive the loader
+ */
+loader_t* loader_new(gchar **files, guint count)
+{
+   loader_t *loader;
+
+   loader = g_new0(loader_t, 1);
+   loader->files = files;
+   loader->count = count;
+
+#ifdef HAVE_IO_URING
+   /* a single file is not worth setting up a ring */
+   if (count > 1)
+      loader->uring = loader_ring_init(loader);
+
+   if (loader->uring) {
+      while (loader->submit < count &&
+             loader->submit < LOADER_QUEUE_DEPTH)
+         loader_ring_queue(loader, loader->submit++);
+   }
+#endif
+
+   DEBUG_MSG("loader_new: %u files, io_uring %s", count,
+         loader->uring ? "enabled" : "disabled");
+
+   return loader;
+}
+
+/*
+ * hands out the next file in the order given
+ *   - returns -E_NOTFOUND after the last file
+ *   - returns -E_INVALID with the cbuf set to NULL if the file
+ *     could not be loaded
+ *   - the cbuf is owned by the loader and valid until the next call
+ *   - the content is handed out as it is, neither decompressed nor
+ *     PEM decoded
+ */
+int loader_next(loader_t *loader, const gchar **filename, cbuf_t **cbuf)
+{
+   int res = E_SUCCESS;
+   guint file;
+
+   cbuf_free(loader->current);
+   loader->current = NULL;
+
+#ifdef HAVE_IO_URING
+   /* the slot handed out last is free again */
+   if (loader->uring && loader->next > 0 && loader->submit < loader->count)
+      loader_ring_queue(loader, loader->submit++);
+#endif
+
+   if (loader->next == loader->count)
+      return -E_NOTFOUND;
+
+   file = loader->next++;
+   *filename = loader->files[file];
+
+#ifdef HAVE_IO_URING
+   if (loader->uring) {
+      loader_slot_t *slot = &loader->slots[file % LOADER_QUEUE_DEPTH];
+
+      res = loader_ring_wait(loader, slot);
+      if (res == E_SUCCESS)
+         res = loader_ring_result(loader, slot, *filename, &loader->current);
+   }
+   else
+#endif
+   {
+      loader->current = cbuf_map_raw(*filename);
+      if (loader->current == NULL)
+         res = -E_INVALID;
+   }
+
+   *cbuf = loader->current;
+
+   return res;
+}
+
+/*
+ * releases the loader, files still in flight are waited for
+ */
+void loader_free(loader_t *loader)
+{
+   if (loader == NULL)
+      return;
+
+   cbuf_free(loader->current);
+
+#ifdef HAVE_IO_URING
+   if (loader->uring) {
+      guint file;
+
+      /* the kernel may still write into the buffers */
+      for (file = loader->next; file < loader->submit; file++)
+         loader_ring_wait(loader, &loader->slots[file % LOADER_QUEUE_DEPTH]);
+
+      loader_ring_destroy(loader);
+   }
+#endif
+
+   g_free(loader);
+}
+
+/*
+ * adds name to the inputs; directories are replaced by the regular
+ * files they contain, sorted by name
+ */
+void loader_expand(GPtrArray *inputs, const gchar *name)
+{
+   GPtrArray *entries;
+   const gchar *entry;
+   gchar *path;
+   GDir *dir;
+   guint i;
+
+   if (!g_file_test(name, G_FILE_TEST_IS_DIR)) {
+      g_ptr_array_add(inputs, g_strdup(name));
+      return;
+   }
+
+   if ((dir = g_dir_open(name, 0, NULL)) == NULL) {
+      g_printerr("reading directory '%s' failed\n", name);
+      return;
+   }
+
+   entries = g_ptr_array_new();
+
+   while ((entry = g_dir_read_name(dir)) != NULL) {
+      path = g_build_filename(name, entry, NULL);
+      if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+         g_ptr_array_add(entries, path);
+      else
+         g_free(path);
+   }
+
+   g_dir_close(dir);
+
+   /* a stable order for the output */
+   g_ptr_array_sort(entries, loader_compare);
+
+   for (i = 0; i < entries->len; i++)
+      g_ptr_array_add(inputs, g_ptr_array_index(entries, i));
+
+   g_ptr_array_free(entries, TRUE);
+}
+
+static gint loader_compare(gconstpointer a, gconstpointer b)
+{
+   return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+/*
+ * feeds all records of a file into the stream, reset before, through
+ * the decompressor if the file is compressed; "-" reads stdin.
+ * Failures are reported naming the file and make the result negative,
+ * -E_NOTFOUND if the file could not be read at all
+ */
+int loader_stream(const gchar *filename, cstream_t *stream)
+{
+   return loader_stream_map(filename, stream, NULL);
+}
+
+/*
+ * the same, keeping the mapping of an uncompressed file
+ *   - *map is set before the first record is passed on, records
+ *     of mode CSTREAM_DER can then be referenced in the mapping
+ *     at their offset; the caller unrefs it
+ *   - *map stays NULL for compressed files and stdin
+ */
+int loader_stream_map(const gchar *filename, cstream_t *stream,
+                      GMappedFile **mapped)
+{
+   GMappedFile *map;
+   GError *error = NULL;
+   const guchar *content;
+   gsize length;
+   guint format;
+   int res;
+
+   if (mapped)
+      *mapped = NULL;
+
+   cstream_reset(stream);
+
+   if (!strcmp(filename, "-")) {
+      res = cstream_read_fd(stream, STDIN_FILENO, NULL, NULL);
+      if (res < 0)
+         g_printerr("%s: invalid or truncated record at offset %"
+               G_GUINT64_FORMAT "\n", filename, stream->record_offset);
+      return res;
+   }
+
+   if ((map = g_mapped_file_new(filename, FALSE, &error)) == NULL) {
+      g_printerr("reading file '%s' failed: '%s'\n", filename,
+            error->message);
+      g_error_free(error);
+      return -E_NOTFOUND;
+   }
+
+   content = (const guchar*)g_mapped_file_get_contents(map);
+   length = g_mapped_file_get_length(map);
+
+   format = decomp_probe(content, length);
+   if (format != DECOMP_NONE) {
+      res = decomp_run(format, content, length, loader_chunk, stream);
+      if (res == -E_NOTHANDLED)
+         g_printerr("%s: %s compression not supported\n", filename,
+               decomp_name(format));
+   }
+   else {
+      if (mapped)
+         *mapped = g_mapped_file_ref(map);
+      res = cstream_feed(stream, content, length);
+   }
+
+   if (res == E_SUCCESS)
+      res = cstream_finish(stream);
+
+   if (res < 0 && res != -E_NOTHANDLED)
+      g_printerr("%s: invalid or truncated record at offset %"
+            G_GUINT64_FORMAT "\n", filename, stream->record_offset);
+
+   g_mapped_file_unref(map);
+
+   return res;
+}
+
+static int loader_chunk(const guchar *buf, gsize len, gpointer data)
+{
+   return cstream_feed(data, buf, len);
+}
+
+#ifdef HAVE_IO_URING
+
+static int io_uring_setup(guint entries, struct io_uring_params *params)
+{
+   return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, guint to_submit, guint min_complete,
+                          guint flags)
+{
+   return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+         NULL, 0);
+}
+
+static int io_uring_register(int fd, guint opcode, gpointer arg, guint nargs)
+{
+   return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+/*
+ * sets up the ring with a sparse table of fixed files and the slot
+ * buffers; FALSE makes the loader fall back to cbuf_map_raw()
+ */
+static gboolean loader_ring_init(loader_t *loader)
+{
+   struct io_uring_params params;
+   struct iovec iov;
+   int files[LOADER_QUEUE_DEPTH];
+   guint32 *sq_array;
+   gsize slab_size = LOADER_QUEUE_DEPTH * LOADER_SLOT_SIZE;
+   guint i;
+   int fd;
+
+   memset(&params, 0, sizeof(params));
+
+   fd = io_uring_setup(LOADER_RING_ENTRIES, &params);
+   if (fd < 0) {
+      DEBUG_MSG("loader_ring_init: io_uring unavailable (%s)",
+            g_strerror(errno));
+      return FALSE;
+   }
+
+   /*
+    * opening into fixed files needs 5.15, single mmap and skipped
+    * completions (5.17) are checked instead as there is no probe for it
+    */
+   if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+       !(params.features & IORING_FEAT_CQE_SKIP)) {
+      DEBUG_MSG("loader_ring_init: kernel too old");
+      close(fd);
+      return FALSE;
+   }
+
+   loader->ring_fd = fd;
+   loader->ring_size = MAX(
+         params.sq_off.array + params.sq_entries * sizeof(guint32),
+         params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+   loader->ring_map = mmap(NULL, loader->ring_size, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+   loader->sqe_size = params.sq_entries * sizeof(struct io_uring_sqe);
+   loader->sqe_map = mmap(NULL, loader->sqe_size, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+   loader->slab = mmap(NULL, slab_size, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+   if (loader->ring_map == MAP_FAILED || loader->sqe_map == MAP_FAILED ||
+       loader->slab == MAP_FAILED) {
+      loader_ring_destroy(loader);
+      return FALSE;
+   }
+
+   loader->sq_head = (guint32*)((guchar*)loader->ring_map + params.sq_off.head);
+   loader->sq_tail = (guint32*)((guchar*)loader->ring_map + params.sq_off.tail);
+   loader->sq_mask = (guint32*)((guchar*)loader->ring_map +
+         params.sq_off.ring_mask);
+   loader->cq_head = (guint32*)((guchar*)loader->ring_map + params.cq_off.head);
+   loader->cq_tail = (guint32*)((guchar*)loader->ring_map + params.cq_off.tail);
+   loader->cq_mask = (guint32*)((guchar*)loader->ring_map +
+         params.cq_off.ring_mask);
+   loader->cqes = (struct io_uring_cqe*)((guchar*)loader->ring_map +
+         params.cq_off.cqes);
+   loader->sqes = loader->sqe_map;
+
+   /* submission entries are used in order */
+   sq_array = (guint32*)((guchar*)loader->ring_map + params.sq_off.array);
+   for (i = 0; i < params.sq_entries; i++)
+      sq_array[i] = i;
+
+   /* every slot opens its file into the fixed file of the same number */
+   for (i = 0; i < LOADER_QUEUE_DEPTH; i++)
+      files[i] = -1;
+
+   if (io_uring_register(fd, IORING_REGISTER_FILES, files,
+            LOADER_QUEUE_DEPTH) < 0) {
+      DEBUG_MSG("loader_ring_init: registering files failed (%s)",
+            g_strerror(errno));
+      loader_ring_destroy(loader);
+      return FALSE;
+   }
+
+   /* pinning the buffers may exceed RLIMIT_MEMLOCK, plain reads work too */
+   iov.iov_base = loader->slab;
+   iov.iov_len = slab_size;
+   loader->fixed_buffers =
+      io_uring_register(fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+   for (i = 0; i < LOADER_QUEUE_DEPTH; i++)
+      loader->slots[i].buffer = loader->slab + i * LOADER_SLOT_SIZE;
+
+   return TRUE;
+}
+
+static void loader_ring_destroy(loader_t *loader)
+{
+   if (loader->slab && loader->slab != MAP_FAILED)
+      munmap(loader->slab, LOADER_QUEUE_DEPTH * LOADER_SLOT_SIZE);
+   if (loader->sqe_map && loader->sqe_map != MAP_FAILED)
+      munmap(loader->sqe_map, loader->sqe_size);
+   if (loader->ring_map && loader->ring_map != MAP_FAILED)
+      munmap(loader->ring_map, loader->ring_size);
+
+   /* also drops the registered files and buffers */
+   close(loader->ring_fd);
+}
+
+static struct io_uring_sqe* loader_ring_sqe(loader_t *loader)
+{
+   struct io_uring_sqe *sqe;
+   guint32 tail;
+
+   /* four entries per slot, the ring never runs full */
+   tail = *loader->sq_tail + loader->sq_queued++;
+   sqe = &loader->sqes[tail & *loader->sq_mask];
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+   return sqe;
+}
+
+/*
+ * queues the chain for one file; the links are hard so the fixed
+ * file gets closed whatever failed before
+ */
+static void loader_ring_queue(loader_t *loader, guint file)
+{
+   guint n = file % LOADER_QUEUE_DEPTH;
+   loader_slot_t *slot = &loader->slots[n];
+   const gchar *filename = loader->files[file];
+   struct io_uring_sqe *sqe;
+
+   slot->pending = LOADER_OPS;
+
+   sqe = loader_ring_sqe(loader);
+   sqe->opcode = IORING_OP_OPENAT;
+   sqe->flags = IOSQE_IO_HARDLINK;
+   sqe->fd = AT_FDCWD;
+   sqe->addr = (guint64)(guintptr)filename;
+   sqe->open_flags = O_RDONLY;
+   sqe->file_index = n + 1;
+   sqe->user_data = n * LOADER_OPS + LOADER_OP_OPEN;
+
+   sqe = loader_ring_sqe(loader);
+   sqe->opcode = IORING_OP_STATX;
+   sqe->flags = IOSQE_IO_HARDLINK;
+   sqe->fd = AT_FDCWD;
+   sqe->addr = (guint64)(guintptr)filename;
+   sqe->len = STATX_TYPE | STATX_SIZE;
+   sqe->off = (guint64)(guintptr)&slot->stx;
+   sqe->user_data = n * LOADER_OPS + LOADER_OP_STATX;
+
+   sqe = loader_ring_sqe(loader);
+   sqe->opcode = loader->fixed_buffers ? IORING_OP_READ_FIXED :
+                                         IORING_OP_READ;
+   sqe->flags = IOSQE_IO_HARDLINK | IOSQE_FIXED_FILE;
+   sqe->fd = n;
+   sqe->addr = (guint64)(guintptr)slot->buffer;
+   sqe->len = LOADER_SLOT_SIZE;
+   sqe->off = 0;
+   sqe->buf_index = 0;
+   sqe->user_data = n * LOADER_OPS + LOADER_OP_READ;
+
+   sqe = loader_ring_sqe(loader);
+   sqe->opcode = IORING_OP_CLOSE;
+   sqe->file_index = n + 1;
+   sqe->user_data = n * LOADER_OPS + LOADER_OP_CLOSE;
+}
+
+/*
+ * submits what is queued and reaps completions until the
+ * chain of the slot has finished
+ */
+static int loader_ring_wait(loader_t *loader, loader_slot_t *slot)
+{
+   struct io_uring_cqe *cqe;
+   guint32 head, tail;
+   guint submit;
+   int ret;
+
+   for (;;) {
+      /* reap everything available */
+      head = *loader->cq_head;
+      tail = __atomic_load_n(loader->cq_tail, __ATOMIC_ACQUIRE);
+
+      for (; head != tail; head++) {
+         cqe = &loader->cqes[head & *loader->cq_mask];
+         loader->slots[cqe->user_data / LOADER_OPS]
+            .res[cqe->user_data % LOADER_OPS] = cqe->res;
+         loader->slots[cqe->user_data / LOADER_OPS].pending--;
+      }
+
+      __atomic_store_n(loader->cq_head, head, __ATOMIC_RELEASE);
+
+      if (slot->pending == 0)
+         return E_SUCCESS;
+
+      /* publish the queued entries and block for more completions */
+      if (loader->sq_queued) {
+         __atomic_store_n(loader->sq_tail,
+               *loader->sq_tail + loader->sq_queued, __ATOMIC_RELEASE);
+         loader->sq_queued = 0;
+      }
+
+      submit = *loader->sq_tail -
+               __atomic_load_n(loader->sq_head, __ATOMIC_ACQUIRE);
+
+      ret = io_uring_enter(loader->ring_fd, submit, 1,
+            IORING_ENTER_GETEVENTS);
+
+      if (ret < 0 && errno != EINTR) {
+         g_printerr("io_uring_enter failed: '%s'\n", g_strerror(errno));
+         return -E_FATAL;
+      }
+   }
+}
+
+/*
+ * turns the completed chain into a document
+ */
+static int loader_ring_result(loader_t *loader _U_, loader_slot_t *slot,
+                              const gchar *filename, cbuf_t **cbuf)
+{
+   int err = 0;
+
+   if (slot->res[LOADER_OP_OPEN] < 0)
+      err = slot->res[LOADER_OP_OPEN];
+   else if (slot->res[LOADER_OP_STATX] < 0)
+      err = slot->res[LOADER_OP_STATX];
+
+   if (err == 0 &&
+       (!S_ISREG(slot->stx.stx_mode) ||
+        slot->stx.stx_size > LOADER_SLOT_SIZE ||
+        slot->res[LOADER_OP_READ] != (gint)slot->stx.stx_size)) {
+      /* large, special or changing files are left to the regular path */
+      DEBUG_MSG("loader_ring_result: '%s' falls back", filename);
+      *cbuf = cbuf_map_raw(filename);
+      return *cbuf ? E_SUCCESS : -E_INVALID;
+   }
+
+   if (err) {
+      g_printerr("reading file '%s' failed: '%s'\n", filename,
+            g_strerror(-err));
+      return -E_INVALID;
+   }
+
+   *cbuf = cbuf_new_raw(slot->buffer, slot->res[LOADER_OP_READ]);
+
+   return *cbuf ? E_SUCCESS : -E_INVALID;
+}
+
+#endif   /* HAVE_IO_URING */
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -16,14 +16,108 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <certalize.h>
 #include <certalize_ui.h>
+#include <certalize_index.h>
+#include <certalize_batch.h>
+#include <certalize_convert.h>
+#include <certalize_serve.h>
+#include <certalize_grep.h>
+#include <certalize_stats.h>
+#include <certalize_extract.h>
+#include <certalize_filter.h>
+#include <certalize_watch.h>
+#include <certalize_compare.h>
+#include <certalize_keys.h>
+#include "certalize_globals.h"
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+/* globals    */
+char *global_filename;
+GPtrArray *global_files;
+int global_output;
+gint global_convert;
+char *global_outdir;
+char *global_serve;
+GPtrArray *global_patterns;
+gboolean global_stats;
+char *global_extract;
+char *global_filter;
+gboolean global_watch;
+gboolean global_diff;
+gboolean global_keys;
+char *global_limits;
+guint global_memory;
+gboolean global_startup_time;
+gint64 global_starttime;
+
+/* prototypes */
+static const gchar* select_mode(gboolean *filters, gboolean *limits);
 
 void print_usage(void)
 {
-   g_print("\nUsage: %s [OPTIONS] [FILE]\n", PROGRAM_NAME);
+   g_print("\nUsage: %s [OPTIONS] [FILE...]\n", PROGRAM_NAME);
    g_print("\nOptions:\n");
    g_print("   -f, --file         reads and parses specified file\n");
+   g_print("   -o, --output FMT   prints the parsed certificates of all files\n");
+   g_print("                      as 'ndjson' or 'json' instead of starting the UI\n");
+   g_print("                      a FILE of '-' reads concatenated DER or PEM\n");
+   g_print("                      records from stdin until end of file\n");
+   g_print("                      pcap and pcapng captures yield the certificates\n");
+   g_print("                      of their TLS (up to 1.2) handshakes\n");
+   g_print("                      gzip and zstd compressed files are read\n");
+   g_print("                      while being decompressed\n");
+   g_print("   -c, --convert ENC  rewrites the certificates of all files and\n");
+   g_print("                      directories as 'pem' or 'der', written to\n");
+   g_print("                      stdout as one bundle unless -d is given\n");
+   g_print("   -d, --output-dir DIR\n");
+   g_print("                      writes one converted file per input to DIR\n");
+   g_print("   -S, --serve SOCKET answers parse requests on a UNIX domain socket\n");
+   g_print("                      until SIGINT or SIGTERM, see certalize_serve.h\n");
+   g_print("                      for the protocol\n");
+   g_print("   -g, --grep PATTERN prints where PATTERN occurs in the certificates\n");
+   g_print("                      of all files and directories, may be repeated;\n");
+   g_print("                      PATTERN is a dotted OID, 'text:STRING' or hex\n");
+   g_print("                      bytes as in '04:14' (see certalize_search.h)\n");
+   g_print("   -s, --stats        prints statistics of the certificates of all\n");
+   g_print("                      files and directories as one JSON object;\n");
+   g_print("                      of a column store written by -x, without\n");
+   g_print("                      algorithms and extensions\n");
+   g_print("   -F, --filter EXPR  selects the certificates of -o and -s by an\n");
+   g_print("                      expression like 'notAfter < now + 30d &&\n");
+   g_print("                      keySize < 2048 && issuer ~ \"Foo CA\"'\n");
+   g_print("                      (see certalize_filter.h); refused by -S, -g,\n");
+   g_print("                      -D, -x, -c and the UI\n");
+   g_print("   -x, --extract STORE\n");
+   g_print("                      writes the fields of the certificates of all\n");
+   g_print("                      files and directories to the column store\n");
+   g_print("                      STORE (see certalize_store.h)\n");
+   g_print("   -D, --diff         prints where the second of two files differs\n");
+   g_print("                      from the first, element by element with the\n");
+   g_print("                      byte ranges of both sides\n");
+   g_print("   -K, --keys         prints the weak public keys of the certificates\n");
+   g_print("                      of all files and directories as one JSON\n");
+   g_print("                      object: short keys, bad RSA exponents, RSA\n");
+   g_print("                      moduli shared or sharing a prime with another\n");
+   g_print("                      (see certalize_keycheck.h); -F restricts them\n");
+   g_print("   -L, --limits LIST  rejects documents exceeding the budgets of\n");
+   g_print("                      LIST, like 'strict' or 'depth=16,elements=1M,\n");
+   g_print("                      size=4M,work=4M' (see certalize_index.h);\n");
+   g_print("                      refused by -c and the UI\n");
+   g_print("   -w, --watch        indexes the certificates of the directories\n");
+   g_print("                      given and prints their changes as they happen\n");
+   g_print("                      until SIGINT or SIGTERM, one JSON object per\n");
+   g_print("                      line (see certalize_watch.h); -F restricts\n");
+   g_print("                      the index\n");
+   g_print("   -m, --memory MB    keeps the decoded documents of the tabs of the\n");
+   g_print("                      UI within MB MiB, releasing those shown least\n");
+   g_print("                      recently (default %d)\n", UI_MEMORY_BUDGET);
+   g_print("   -T, --startup-time prints the time until the main window is drawn\n");
+   g_print("                      and exits (used by the benchmark target)\n");
    g_print("   -v, --version      prints the version and exits\n");
    g_print("   -h, --help         this help screen\n");
    g_print("\n\n");
@@ -31,23 +125,145 @@ void print_usage(void)
    exit(0);
 }
 
+/*
+ * the option selecting what main() runs, NULL for the UI;
+ * filters and limits tell whether it takes -F and -L
+ */
+static const gchar* select_mode(gboolean *filters, gboolean *limits)
+{
+   *filters = FALSE;
+   *limits = TRUE;
+
+   if (global_serve)
+      return "-S";
+   if (global_patterns->len)
+      return "-g";
+   if (global_watch) {
+      *filters = TRUE;
+      return "-w";
+   }
+   if (global_diff)
+      return "-D";
+   if (global_keys) {
+      *filters = TRUE;
+      return "-K";
+   }
+   if (global_extract)
+      return "-x";
+   if (global_stats) {
+      *filters = TRUE;
+      return "-s";
+   }
+
+   *limits = FALSE;
+
+   if (global_convert != CONVERT_NONE)
+      return "-c";
+
+   if (global_output != OUTPUT_GUI) {
+      *filters = *limits = TRUE;
+      return "-o";
+   }
+
+   return NULL;
+}
+
 int parse_options(int argc, char *argv[])
 {
    int c;
    int option_index = 0;
+   const gchar *mode;
+   gboolean filters, limits;
+   guint64 memory;
+   gchar *end;
 
    static struct option long_options[] = {
       { "file", required_argument, NULL, 'f' },
+      { "output", required_argument, NULL, 'o' },
+      { "convert", required_argument, NULL, 'c' },
+      { "output-dir", required_argument, NULL, 'd' },
+      { "serve", required_argument, NULL, 'S' },
+      { "grep", required_argument, NULL, 'g' },
+      { "stats", no_argument, NULL, 's' },
+      { "extract", required_argument, NULL, 'x' },
+      { "filter", required_argument, NULL, 'F' },
+      { "watch", no_argument, NULL, 'w' },
+      { "diff", no_argument, NULL, 'D' },
+      { "keys", no_argument, NULL, 'K' },
+      { "limits", required_argument, NULL, 'L' },
+      { "memory", required_argument, NULL, 'm' },
+      { "startup-time", no_argument, NULL, 'T' },
       { "version", no_argument, NULL, 'v' },
       { "help", no_argument, NULL, 'h' },
       { "help", no_argument, NULL, '?' },
       { 0, 0, 0, 0 }
    };
 
-   while ((c = getopt_long(argc, argv, "f:vh?", long_options, &option_index)) != EOF) {
+   while ((c = getopt_long(argc, argv, "f:o:c:d:S:g:sx:F:wDKL:m:Tvh?", long_options, &option_index)) != EOF) {
       switch (c) {
          case 'f':
-            global_filename = optarg;
+            g_ptr_array_add(global_files, optarg);
+            break;
+         case 'o':
+            if (!strcmp(optarg, "ndjson"))
+               global_output = OUTPUT_NDJSON;
+            else if (!strcmp(optarg, "json"))
+               global_output = OUTPUT_JSON;
+            else {
+               g_print("unknown output format '%s'\n", optarg);
+               return E_INVALID;
+            }
+            break;
+         case 'c':
+            if (!strcmp(optarg, "pem"))
+               global_convert = CONVERT_PEM;
+            else if (!strcmp(optarg, "der"))
+               global_convert = CONVERT_DER;
+            else {
+               g_print("unknown encoding '%s'\n", optarg);
+               return E_INVALID;
+            }
+            break;
+         case 'd':
+            global_outdir = optarg;
+            break;
+         case 'S':
+            global_serve = optarg;
+            break;
+         case 'g':
+            g_ptr_array_add(global_patterns, optarg);
+            break;
+         case 's':
+            global_stats = TRUE;
+            break;
+         case 'x':
+            global_extract = optarg;
+            break;
+         case 'F':
+            global_filter = optarg;
+            break;
+         case 'w':
+            global_watch = TRUE;
+            break;
+         case 'D':
+            global_diff = TRUE;
+            break;
+         case 'K':
+            global_keys = TRUE;
+            break;
+         case 'L':
+            global_limits = optarg;
+            break;
+         case 'm':
+            memory = g_ascii_strtoull(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || memory > G_MAXUINT / 2) {
+               g_print("invalid memory budget '%s'\n", optarg);
+               return E_INVALID;
+            }
+            global_memory = memory;
+            break;
+         case 'T':
+            global_startup_time = TRUE;
             break;
          case 'v':
             g_print("%s's version is %s\n", PROGRAM_NAME, PROGRAM_VERSION);
@@ -63,9 +279,26 @@ int parse_options(int argc, char *argv[])
       }
    }
 
-   /* if argument left parse it as filename */
-   if (argv[optind]) {
-      global_filename = argv[optind];
+   /* if arguments left parse them as filenames */
+   while (argv[optind]) {
+      g_ptr_array_add(global_files, argv[optind++]);
+   }
+
+   if (global_files->len) {
+      global_filename = g_ptr_array_index(global_files, 0);
+   }
+
+   /* rather than silently ignored */
+   mode = select_mode(&filters, &limits);
+
+   if (global_filter && !filters) {
+      g_print("-F can not be used with %s\n", mode ? mode : "the UI");
+      return E_INVALID;
+   }
+
+   if (global_limits && !limits) {
+      g_print("-L can not be used with %s\n", mode ? mode : "the UI");
+      return E_INVALID;
    }
 
    return E_SUCCESS;
@@ -73,17 +306,87 @@ int parse_options(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
+   asn1_limits_t limits = ASN1_LIMITS_DEFAULT;
+   filter_t *filter = NULL;
    int ret = 0;
 
+   global_starttime = g_get_monotonic_time();
+   global_startup_time = FALSE;
+   global_convert = CONVERT_NONE;
+   global_outdir = NULL;
+   global_serve = NULL;
+   global_patterns = g_ptr_array_new();
+   global_stats = FALSE;
+   global_extract = NULL;
+   global_filter = NULL;
+   global_watch = FALSE;
+   global_diff = FALSE;
+   global_keys = FALSE;
+   global_limits = NULL;
+   global_memory = UI_MEMORY_BUDGET;
    global_filename = NULL;
+   global_files = g_ptr_array_new();
+   global_output = OUTPUT_GUI;
 
    ret = parse_options(argc, argv);
    if (ret != E_SUCCESS) {
       return ret;
    }
 
-   /* start UI */
-   ret = ui_start();
+   if (global_limits && asn1_limits_parse(global_limits, &limits) < 0) {
+      return E_INVALID;
+   }
+
+   /* compiled once for all certificates */
+   if (global_filter && (filter = filter_new(global_filter)) == NULL) {
+      return E_INVALID;
+   }
+
+   if (global_serve) {
+      /* parsing daemon */
+      ret = serve_run(global_serve, &limits);
+   }
+   else if (global_patterns->len) {
+      /* corpus search */
+      ret = grep_run(global_files, global_patterns, &limits);
+   }
+   else if (global_watch) {
+      /* incremental index of directories */
+      ret = watch_run(global_files, filter, &limits);
+   }
+   else if (global_diff) {
+      /* structural difference of two files */
+      ret = compare_run(global_files, &limits);
+   }
+   else if (global_keys) {
+      /* weak public keys */
+      ret = keys_run(global_files, filter, &limits);
+   }
+   else if (global_extract) {
+      /* column store of the extracted fields */
+      ret = extract_run(global_files, global_extract, &limits);
+   }
+   else if (global_stats) {
+      /* corpus statistics */
+      ret = stats_run(global_files, filter, &limits);
+   }
+   else if (global_convert != CONVERT_NONE) {
+      /* bulk conversion */
+      ret = convert_run(global_files, global_convert, global_outdir);
+   }
+   else if (global_output != OUTPUT_GUI) {
+      /* headless batch processing */
+      ret = batch_run(global_files, global_output, filter, &limits);
+   }
+   else {
+      /* start UI */
+      ret = ui_start();
+   }
+
+   g_ptr_array_free(global_files, TRUE);
+   g_ptr_array_free(global_patterns, TRUE);
+   if (filter)
+      filter_free(filter);
 
    return ret;
 }
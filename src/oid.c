@@ -0,0 +1,101 @@
+/* oid.c - well-known object identifiers
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_oid.h>
+
+/* globals    */
+static const oid_entry_t oid_table[] = {
+   /* attribute types (X.520) */
+   { "\x55\x04\x03", 3, "CN", "commonName", "2.5.4.3" },
+   { "\x55\x04\x04", 3, "SN", "surname", "2.5.4.4" },
+   { "\x55\x04\x05", 3, "serialNumber", "serialNumber", "2.5.4.5" },
+   { "\x55\x04\x06", 3, "C", "countryName", "2.5.4.6" },
+   { "\x55\x04\x07", 3, "L", "localityName", "2.5.4.7" },
+   { "\x55\x04\x08", 3, "ST", "stateOrProvinceName", "2.5.4.8" },
+   { "\x55\x04\x09", 3, "street", "streetAddress", "2.5.4.9" },
+   { "\x55\x04\x0a", 3, "O", "organizationName", "2.5.4.10" },
+   { "\x55\x04\x0b", 3, "OU", "organizationalUnitName", "2.5.4.11" },
+   { "\x55\x04\x0c", 3, "title", "title", "2.5.4.12" },
+   { "\x55\x04\x2a", 3, "GN", "givenName", "2.5.4.42" },
+   { "\x55\x04\x61", 3, "organizationIdentifier", "organizationIdentifier", "2.5.4.97" },
+   { "\x09\x92\x26\x89\x93\xf2\x2c\x64\x01\x19", 10, "DC", "domainComponent", "0.9.2342.19200300.100.1.25" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x09\x01", 9, "emailAddress", "emailAddress", "1.2.840.113549.1.9.1" },
+
+   /* public key and signature algorithms */
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x01", 9, NULL, "rsaEncryption", "1.2.840.113549.1.1.1" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x04", 9, NULL, "md5WithRSAEncryption", "1.2.840.113549.1.1.4" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x05", 9, NULL, "sha1WithRSAEncryption", "1.2.840.113549.1.1.5" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0a", 9, NULL, "rsassaPss", "1.2.840.113549.1.1.10" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0b", 9, NULL, "sha256WithRSAEncryption", "1.2.840.113549.1.1.11" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0c", 9, NULL, "sha384WithRSAEncryption", "1.2.840.113549.1.1.12" },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0d", 9, NULL, "sha512WithRSAEncryption", "1.2.840.113549.1.1.13" },
+   { "\x2a\x86\x48\xce\x3d\x02\x01", 7, NULL, "ecPublicKey", "1.2.840.10045.2.1" },
+   { "\x2a\x86\x48\xce\x3d\x04\x01", 7, NULL, "ecdsa-with-SHA1", "1.2.840.10045.4.1" },
+   { "\x2a\x86\x48\xce\x3d\x04\x03\x02", 8, NULL, "ecdsa-with-SHA256", "1.2.840.10045.4.3.2" },
+   { "\x2a\x86\x48\xce\x3d\x04\x03\x03", 8, NULL, "ecdsa-with-SHA384", "1.2.840.10045.4.3.3" },
+   { "\x2a\x86\x48\xce\x3d\x04\x03\x04", 8, NULL, "ecdsa-with-SHA512", "1.2.840.10045.4.3.4" },
+   { "\x2b\x65\x70", 3, NULL, "Ed25519", "1.3.101.112" },
+   { "\x2b\x65\x71", 3, NULL, "Ed448", "1.3.101.113" },
+   { "\x2a\x86\x48\xce\x38\x04\x01", 7, NULL, "dsa", "1.2.840.10040.4.1" },
+   { "\x60\x86\x48\x01\x65\x03\x04\x03\x02", 9, NULL, "dsa-with-sha256", "2.16.840.1.101.3.4.3.2" },
+
+   /* named curves */
+   { "\x2a\x86\x48\xce\x3d\x03\x01\x07", 8, NULL, "prime256v1", "1.2.840.10045.3.1.7" },
+   { "\x2b\x81\x04\x00\x22", 5, NULL, "secp384r1", "1.3.132.0.34" },
+   { "\x2b\x81\x04\x00\x23", 5, NULL, "secp521r1", "1.3.132.0.35" },
+
+   /* certificate extensions */
+   { "\x55\x1d\x0e", 3, NULL, "subjectKeyIdentifier", "2.5.29.14" },
+   { "\x55\x1d\x0f", 3, NULL, "keyUsage", "2.5.29.15" },
+   { "\x55\x1d\x11", 3, NULL, "subjectAltName", "2.5.29.17" },
+   { "\x55\x1d\x13", 3, NULL, "basicConstraints", "2.5.29.19" },
+   { "\x55\x1d\x1e", 3, NULL, "nameConstraints", "2.5.29.30" },
+   { "\x55\x1d\x1f", 3, NULL, "cRLDistributionPoints", "2.5.29.31" },
+   { "\x55\x1d\x20", 3, NULL, "certificatePolicies", "2.5.29.32" },
+   { "\x55\x1d\x23", 3, NULL, "authorityKeyIdentifier", "2.5.29.35" },
+   { "\x55\x1d\x25", 3, NULL, "extKeyUsage", "2.5.29.37" },
+   { "\x2b\x06\x01\x05\x05\x07\x01\x01", 8, NULL, "authorityInfoAccess", "1.3.6.1.5.5.7.1.1" },
+   { "\x2b\x06\x01\x04\x01\xd6\x79\x02\x04\x02", 10, NULL, "ctPrecertificateSCTs", "1.3.6.1.4.1.11129.2.4.2" },
+};
+
+/* prototypes */
+
+
+
+/*************/
+
+/*
+ * looks up a well-known OID by its DER encoded contents
+ * returns NULL if the OID is not known
+ */
+const oid_entry_t* oid_lookup(const guchar *der, gsize len)
+{
+   guint i;
+
+   for (i = 0; i < G_N_ELEMENTS(oid_table); i++)
+      if (oid_table[i].der_len == len && memcmp(oid_table[i].der, der, len) == 0)
+         return &oid_table[i];
+
+   return NULL;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
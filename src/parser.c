@@ -0,0 +1,170 @@
+/* parser.c - reusable parse contexts
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_parser.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* prototypes */
+static int parser_record(const guchar *der, gsize len, guint64 offset,
+                         gpointer data);
+
+
+/*************/
+
+void parser_init(parser_t *parser, guint flags)
+{
+   memset(parser, 0, sizeof(parser_t));
+
+   parser->flags = flags;
+   asn1_index_init(&parser->index);
+   cstream_init(&parser->stream, parser_record, parser);
+}
+
+void parser_destroy(parser_t *parser)
+{
+   asn1_index_destroy(&parser->index);
+   cstream_destroy(&parser->stream);
+   g_free(parser->notes);
+}
+
+/*
+ * indexes the DER document and, with PARSER_SCHEMA, decodes every
+ * top-level element by the first document type it matches; a broken
+ * document is still indexed up to the defect
+ */
+int parser_parse(parser_t *parser, const guchar *der, gsize len)
+{
+   guint32 i;
+   int res;
+
+   memset(&parser->cbuf, 0, sizeof(cbuf_t));
+   parser->cbuf.buffer = (guchar*)der;
+   parser->cbuf.length = len;
+
+   res = asn1_index_range(&parser->index, &parser->cbuf, 0, len);
+   if (res < 0) {
+      DEBUG_MSG("parser_parse: broken structure at %lu",
+            parser->index.error_offset);
+   }
+
+   if (parser->index.len > parser->notes_size) {
+      parser->notes_size = parser->index.len;
+      parser->notes = g_renew(asn1_schema_note_t, parser->notes,
+            parser->notes_size);
+   }
+   asn1_schema_notes_init(parser->notes, parser->index.len);
+
+   if (parser->flags & PARSER_SCHEMA)
+      for (i = 0; i < parser->index.len; i = parser->index.nodes[i].next)
+         asn1_schema_recognize(&parser->index, i, parser->notes);
+
+   /* a document left undecoded as it was too expensive */
+   if (res == E_SUCCESS && parser->index.error == ASN1_INDEX_WORK)
+      res = -E_INVALID;
+
+   return res < 0 ? res : E_SUCCESS;
+}
+
+/*
+ * splits concatenated DER and PEM records held in memory and parses
+ * them one after the other; a negative result of the callback stops
+ */
+int parser_parse_records(parser_t *parser, const guchar *data, gsize len,
+                         parser_record_cb callback, gpointer cb_data)
+{
+   int res;
+
+   parser->callback = callback;
+   parser->data = cb_data;
+
+   cstream_reset(&parser->stream);
+
+   res = cstream_feed(&parser->stream, data, len);
+   if (res == E_SUCCESS)
+      res = cstream_finish(&parser->stream);
+
+   return res;
+}
+
+/*
+ * decodes the certificate at node of the document parsed last
+ */
+int parser_certificate(parser_t *parser, guint32 node, x509_cert_t *cert)
+{
+   if (node >= parser->index.len)
+      return -E_NOTFOUND;
+
+   return x509_parse_index(&parser->cbuf, &parser->index, node, cert);
+}
+
+/*
+ * the document type recognized at node, NULL if none
+ */
+const asn1_schema_document_t* parser_document(parser_t *parser, guint32 node)
+{
+   if (node >= parser->index.len)
+      return NULL;
+
+   return asn1_schema_document(parser->notes[node].type);
+}
+
+/*
+ * innermost node enclosing the byte range
+ */
+guint32 parser_find(parser_t *parser, guint64 offset, guint64 length)
+{
+   return asn1_index_find(&parser->index, offset, length);
+}
+
+/*
+ * appends the dotted name of node, see asn1_schema_path()
+ */
+void parser_path(parser_t *parser, guint32 node, GString *path)
+{
+   asn1_schema_path(&parser->index, node, parser->notes, path);
+}
+
+/*
+ * parses a record split off by parser_parse_records
+ */
+static int parser_record(const guchar *der, gsize len, guint64 offset,
+                         gpointer data)
+{
+   parser_t *parser = data;
+   int res;
+
+   if (der != NULL) {
+      res = parser_parse(parser, der, len);
+   }
+   else {
+      /* a PEM record which did not decode leaves nothing to look at */
+      memset(&parser->cbuf, 0, sizeof(cbuf_t));
+      parser->index.len = 0;
+      res = -E_INVALID;
+   }
+
+   return parser->callback(parser, offset, res, parser->data);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,735 @@
+/* pcap.c - extracting TLS certificates from capture files
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_pcap.h>
+#include <certalize_buf.h>
+#include <certalize_debug.h>
+
+#include <arpa/inet.h>
+
+/* globals    */
+
+#define PCAP_MAGIC_USEC             0xa1b2c3d4
+#define PCAP_MAGIC_NSEC             0xa1b23c4d
+#define PCAPNG_BLOCK_SHB            0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB            0x00000001
+#define PCAPNG_BLOCK_OPB            0x00000002
+#define PCAPNG_BLOCK_SPB            0x00000003
+#define PCAPNG_BLOCK_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1a2b3c4d
+
+#define LINKTYPE_NULL               0
+#define LINKTYPE_ETHERNET           1
+#define LINKTYPE_RAW                101
+#define LINKTYPE_LINUX_SLL          113
+#define LINKTYPE_IPV4               228
+#define LINKTYPE_IPV6               229
+#define LINKTYPE_LINUX_SLL2         276
+
+#define ETHERTYPE_IPV4              0x0800
+#define ETHERTYPE_IPV6              0x86dd
+#define ETHERTYPE_VLAN              0x8100
+#define ETHERTYPE_QINQ              0x88a8
+
+#define IPPROTO_TCP_                6
+#define TCP_FLAG_SYN                0x02
+
+#define TLS_CHANGE_CIPHER_SPEC      20
+#define TLS_HANDSHAKE               22
+#define TLS_HS_CERTIFICATE          11
+
+typedef struct pcap_flowkey {
+   guint8 family;
+   guint8 pad;
+   guint16 sport;
+   guint16 dport;
+   guint8 src[16];
+   guint8 dst[16];
+} pcap_flowkey_t;
+
+/* TCP payload of one packet, pointing into the mapped file */
+typedef struct pcap_segment {
+   guint32 seq;
+   guint32 len;
+   const guchar *data;
+} pcap_segment_t;
+
+/* one direction of a TCP connection */
+typedef struct pcap_flow {
+   pcap_flowkey_t key;
+   GArray *segments;
+   guint32 isn;
+   gboolean syn;
+   guint64 bytes;
+   /* GBytes of the certificates found, NULL if none */
+   GPtrArray *certs;
+} pcap_flow_t;
+
+typedef struct pcap_ctx {
+   const gchar *filename;
+   GHashTable *flows;
+   /* flows in order of their first packet */
+   GPtrArray *order;
+   guint linktype[PCAP_MAX_INTERFACES];
+   guint interfaces;
+   gboolean big_endian;
+   pcap_cert_cb callback;
+   gpointer data;
+   guint64 packets;
+   guint64 certificates;
+} pcap_ctx_t;
+
+/* prototypes */
+static int  pcap_read_classic(pcap_ctx_t *ctx, const guchar *buf, gsize len);
+static int  pcap_read_ng(pcap_ctx_t *ctx, const guchar *buf, gsize len);
+static void pcap_packet(pcap_ctx_t *ctx, guint linktype,
+                        const guchar *pkt, gsize len);
+static void pcap_ip(pcap_ctx_t *ctx, const guchar *pkt, gsize len);
+static void pcap_tcp(pcap_ctx_t *ctx, pcap_flowkey_t *key,
+                     const guchar *pkt, gsize len);
+static void pcap_flow_worker(gpointer item, gpointer data);
+static void pcap_flow_emit(pcap_ctx_t *ctx, pcap_flow_t *flow);
+static void pcap_tls(pcap_ctx_t *ctx, pcap_flow_t *flow, cbuf_t *stream);
+static void pcap_certificates(pcap_flow_t *flow, cbuf_t *hs,
+                              guint offset, guint32 len);
+static gint pcap_segment_compare(gconstpointer a, gconstpointer b,
+                                 gpointer base);
+static guint pcap_flowkey_hash(gconstpointer key);
+static gboolean pcap_flowkey_equal(gconstpointer a, gconstpointer b);
+static void pcap_flow_free(gpointer flow);
+static gchar* pcap_flow_name(pcap_ctx_t *ctx, pcap_flow_t *flow);
+
+static inline guint16 rd16(const guchar *p, gboolean big)
+{
+   return big ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static inline guint32 rd32(const guchar *p, gboolean big)
+{
+   return big ? ((guint32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3])
+              : ((guint32)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+
+/*************/
+
+/*
+ * checks the magic number of the file for pcap or pcapng format
+ */
+gboolean pcap_probe(const gchar *filename)
+{
+   guchar magic[4];
+   FILE *fp;
+   gsize len;
+
+   if ((fp = fopen(filename, "rb")) == NULL)
+      return FALSE;
+
+   len = fread(magic, 1, sizeof(magic), fp);
+   fclose(fp);
+
+   return pcap_probe_data(magic, len);
+}
+
+/*
+ * same check for file content already read
+ */
+gboolean pcap_probe_data(const guchar *data, gsize len)
+{
+   guint32 le;
+
+   if (len < 4)
+      return FALSE;
+
+   le = rd32(data, FALSE);
+
+   return le == PCAP_MAGIC_USEC || le == PCAP_MAGIC_NSEC ||
+          rd32(data, TRUE) == PCAP_MAGIC_USEC ||
+          rd32(data, TRUE) == PCAP_MAGIC_NSEC ||
+          le == PCAPNG_BLOCK_SHB;
+}
+
+/*
+ * extracts all certificates sent in TLS Certificate handshake
+ * messages (TLS 1.2 and earlier) of the capture file
+ *
+ *   - the file is memory mapped, TCP payload is never copied
+ *     before reassembly
+ *   - flows are reassembled and dissected in parallel, the
+ *     certificates are passed on afterwards in order of the
+ *     flows' first packets, so the output does not depend on
+ *     which flow finished first
+ */
+int pcap_extract(const gchar *filename, pcap_cert_cb callback, gpointer data)
+{
+   GMappedFile *map;
+   GError *error = NULL;
+   GThreadPool *pool;
+   pcap_ctx_t ctx;
+   const guchar *buf;
+   gsize len;
+   guint i;
+   int res;
+
+   map = g_mapped_file_new(filename, FALSE, &error);
+   if (map == NULL) {
+      g_printerr("mapping file '%s' failed: '%s'\n", filename, error->message);
+      g_error_free(error);
+      return -E_NOTFOUND;
+   }
+
+   buf = (const guchar*)g_mapped_file_get_contents(map);
+   len = g_mapped_file_get_length(map);
+
+   memset(&ctx, 0, sizeof(pcap_ctx_t));
+   ctx.filename = filename;
+   ctx.flows = g_hash_table_new_full(pcap_flowkey_hash, pcap_flowkey_equal,
+         NULL, pcap_flow_free);
+   ctx.order = g_ptr_array_new();
+   ctx.callback = callback;
+   ctx.data = data;
+
+   /* first pass: demultiplex the packets into flows */
+   if (len >= 4 && rd32(buf, FALSE) == PCAPNG_BLOCK_SHB)
+      res = pcap_read_ng(&ctx, buf, len);
+   else
+      res = pcap_read_classic(&ctx, buf, len);
+
+   DEBUG_MSG("pcap_extract: %lu packets in %u flows", ctx.packets,
+         ctx.order->len);
+
+   /* second pass: reassemble and dissect the flows in parallel */
+   if (res == E_SUCCESS) {
+      pool = g_thread_pool_new(pcap_flow_worker, &ctx,
+            g_get_num_processors(), TRUE, NULL);
+
+      for (i = 0; i < ctx.order->len; i++)
+         g_thread_pool_push(pool, g_ptr_array_index(ctx.order, i), NULL);
+
+      g_thread_pool_free(pool, FALSE, TRUE);
+
+      for (i = 0; i < ctx.order->len; i++)
+         pcap_flow_emit(&ctx, g_ptr_array_index(ctx.order, i));
+   }
+
+   g_ptr_array_free(ctx.order, TRUE);
+   g_hash_table_destroy(ctx.flows);
+   g_mapped_file_unref(map);
+
+   return res;
+}
+
+/*
+ * classic libpcap format
+ */
+static int pcap_read_classic(pcap_ctx_t *ctx, const guchar *buf, gsize len)
+{
+   gsize offset = 24;
+   guint32 caplen, magic;
+   guint linktype;
+
+   if (len < 24)
+      return -E_INVALID;
+
+   magic = rd32(buf, FALSE);
+   ctx->big_endian = !(magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC);
+   linktype = rd32(buf + 20, ctx->big_endian) & 0xffff;
+
+   while (offset + 16 <= len) {
+      caplen = rd32(buf + offset + 8, ctx->big_endian);
+      offset += 16;
+
+      if (caplen > len - offset) {
+         DEBUG_MSG("pcap_read_classic: truncated packet at %lu", offset);
+         break;
+      }
+
+      pcap_packet(ctx, linktype, buf + offset, caplen);
+      offset += caplen;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * pcapng format
+ */
+static int pcap_read_ng(pcap_ctx_t *ctx, const guchar *buf, gsize len)
+{
+   gsize offset = 0;
+   guint32 type, blocklen, caplen, ifid, bom;
+   const guchar *body;
+
+   while (offset + 12 <= len) {
+      type = rd32(buf + offset, ctx->big_endian);
+
+      if (type == PCAPNG_BLOCK_SHB) {
+         /* a new section may change the byte order */
+         bom = rd32(buf + offset + 8, TRUE);
+         if (bom == PCAPNG_BYTE_ORDER_MAGIC)
+            ctx->big_endian = TRUE;
+         else if (bom == GUINT32_SWAP_LE_BE(PCAPNG_BYTE_ORDER_MAGIC))
+            ctx->big_endian = FALSE;
+         else
+            return -E_INVALID;
+         ctx->interfaces = 0;
+      }
+
+      blocklen = rd32(buf + offset + 4, ctx->big_endian);
+      if (blocklen < 12 || blocklen % 4 || blocklen > len - offset) {
+         DEBUG_MSG("pcap_read_ng: invalid block at %lu", offset);
+         break;
+      }
+
+      body = buf + offset + 8;
+
+      switch (type) {
+         case PCAPNG_BLOCK_IDB:
+            if (ctx->interfaces < PCAP_MAX_INTERFACES && blocklen >= 20)
+               ctx->linktype[ctx->interfaces++] = rd16(body, ctx->big_endian);
+            break;
+
+         case PCAPNG_BLOCK_EPB:
+         case PCAPNG_BLOCK_OPB:
+            if (blocklen < 32)
+               break;
+            ifid = type == PCAPNG_BLOCK_EPB ? rd32(body, ctx->big_endian)
+                                            : rd16(body, ctx->big_endian);
+            caplen = rd32(body + 12, ctx->big_endian);
+            if (ifid < ctx->interfaces && caplen <= blocklen - 32)
+               pcap_packet(ctx, ctx->linktype[ifid], body + 20, caplen);
+            break;
+
+         case PCAPNG_BLOCK_SPB:
+            if (blocklen < 16 || ctx->interfaces == 0)
+               break;
+            caplen = MIN(rd32(body, ctx->big_endian), blocklen - 16);
+            pcap_packet(ctx, ctx->linktype[0], body + 4, caplen);
+            break;
+
+         default:
+            break;
+      }
+
+      offset += blocklen;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * strips the link layer
+ */
+static void pcap_packet(pcap_ctx_t *ctx, guint linktype,
+                        const guchar *pkt, gsize len)
+{
+   guint16 ethertype;
+
+   ctx->packets++;
+
+   switch (linktype) {
+      case LINKTYPE_ETHERNET:
+         if (len < 14)
+            return;
+         ethertype = pkt[12] << 8 | pkt[13];
+         pkt += 14;
+         len -= 14;
+
+         while (ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) {
+            if (len < 4)
+               return;
+            ethertype = pkt[2] << 8 | pkt[3];
+            pkt += 4;
+            len -= 4;
+         }
+
+         if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6)
+            return;
+         break;
+
+      case LINKTYPE_LINUX_SLL:
+         if (len < 16)
+            return;
+         pkt += 16;
+         len -= 16;
+         break;
+
+      case LINKTYPE_LINUX_SLL2:
+         if (len < 20)
+            return;
+         pkt += 20;
+         len -= 20;
+         break;
+
+      case LINKTYPE_NULL:
+         if (len < 4)
+            return;
+         pkt += 4;
+         len -= 4;
+         break;
+
+      case LINKTYPE_RAW:
+      case LINKTYPE_IPV4:
+      case LINKTYPE_IPV6:
+         break;
+
+      default:
+         return;
+   }
+
+   /* the IP version is taken from the packet itself */
+   pcap_ip(ctx, pkt, len);
+}
+
+/*
+ * strips IPv4 or IPv6 header, fragments are ignored
+ */
+static void pcap_ip(pcap_ctx_t *ctx, const guchar *pkt, gsize len)
+{
+   pcap_flowkey_t key;
+   guint hdrlen, next;
+   gsize total;
+
+   if (len < 1)
+      return;
+
+   memset(&key, 0, sizeof(pcap_flowkey_t));
+
+   if ((pkt[0] >> 4) == 4) {
+      if (len < 20)
+         return;
+      hdrlen = (pkt[0] & 0x0f) * 4;
+      total = pkt[2] << 8 | pkt[3];
+      if (hdrlen < 20 || total < hdrlen || total > len)
+         return;
+      /* more fragments or fragment offset */
+      if (((pkt[6] << 8 | pkt[7]) & 0x3fff) || pkt[9] != IPPROTO_TCP_)
+         return;
+
+      key.family = 4;
+      memcpy(key.src, pkt + 12, 4);
+      memcpy(key.dst, pkt + 16, 4);
+      pcap_tcp(ctx, &key, pkt + hdrlen, total - hdrlen);
+   }
+   else if ((pkt[0] >> 4) == 6) {
+      if (len < 40)
+         return;
+      total = 40 + (pkt[4] << 8 | pkt[5]);
+      if (total > len)
+         return;
+      next = pkt[6];
+
+      key.family = 6;
+      memcpy(key.src, pkt + 8, 16);
+      memcpy(key.dst, pkt + 24, 16);
+
+      pkt += 40;
+      total -= 40;
+
+      /* hop-by-hop, routing and destination options */
+      while (next == 0 || next == 43 || next == 60) {
+         if (total < 8)
+            return;
+         hdrlen = (pkt[1] + 1) * 8;
+         if (hdrlen > total)
+            return;
+         next = pkt[0];
+         pkt += hdrlen;
+         total -= hdrlen;
+      }
+
+      if (next != IPPROTO_TCP_)
+         return;
+
+      pcap_tcp(ctx, &key, pkt, total);
+   }
+}
+
+/*
+ * assigns the TCP payload to its flow
+ */
+static void pcap_tcp(pcap_ctx_t *ctx, pcap_flowkey_t *key,
+                     const guchar *pkt, gsize len)
+{
+   pcap_segment_t segment;
+   pcap_flow_t *flow;
+   guint hdrlen;
+
+   if (len < 20)
+      return;
+
+   hdrlen = (pkt[12] >> 4) * 4;
+   if (hdrlen < 20 || hdrlen > len)
+      return;
+
+   key->sport = pkt[0] << 8 | pkt[1];
+   key->dport = pkt[2] << 8 | pkt[3];
+
+   flow = g_hash_table_lookup(ctx->flows, key);
+   if (flow == NULL) {
+      flow = g_malloc0(sizeof(pcap_flow_t));
+      flow->key = *key;
+      flow->segments = g_array_new(FALSE, FALSE, sizeof(pcap_segment_t));
+      g_hash_table_insert(ctx->flows, &flow->key, flow);
+      g_ptr_array_add(ctx->order, flow);
+   }
+
+   segment.seq = (guint32)pkt[4] << 24 | pkt[5] << 16 | pkt[6] << 8 | pkt[7];
+
+   if (pkt[13] & TCP_FLAG_SYN) {
+      flow->isn = segment.seq;
+      flow->syn = TRUE;
+      segment.seq++;
+   }
+
+   if (len == hdrlen || flow->bytes >= PCAP_MAX_STREAM_BYTES)
+      return;
+
+   segment.len = len - hdrlen;
+   segment.data = pkt + hdrlen;
+   flow->bytes += segment.len;
+
+   g_array_append_val(flow->segments, segment);
+}
+
+/*
+ * reassembles the beginning of one flow and looks for TLS
+ * handshake messages in it
+ */
+static void pcap_flow_worker(gpointer item, gpointer data)
+{
+   pcap_ctx_t *ctx = data;
+   pcap_flow_t *flow = item;
+   pcap_segment_t *seg;
+   GByteArray *stream;
+   guint32 base, rel, expected = 0;
+   cbuf_t cbuf;
+   guint i;
+
+   if (flow->segments->len == 0)
+      return;
+
+   /* sequence numbers relative to the start of the stream */
+   base = flow->syn ? flow->isn + 1
+                    : g_array_index(flow->segments, pcap_segment_t, 0).seq;
+
+   g_qsort_with_data(flow->segments->data, flow->segments->len,
+         sizeof(pcap_segment_t), pcap_segment_compare, &base);
+
+   seg = &g_array_index(flow->segments, pcap_segment_t, 0);
+   if (seg->seq != base || seg->data[0] != TLS_HANDSHAKE)
+      return;
+
+   stream = g_byte_array_sized_new(MIN(flow->bytes, PCAP_MAX_STREAM_BYTES));
+
+   for (i = 0; i < flow->segments->len; i++) {
+      seg = &g_array_index(flow->segments, pcap_segment_t, i);
+      rel = seg->seq - base;
+
+      /* stop at the first gap */
+      if (rel > expected)
+         break;
+
+      /* skip retransmissions */
+      if (rel + seg->len <= expected)
+         continue;
+
+      g_byte_array_append(stream, seg->data + (expected - rel),
+            seg->len - (expected - rel));
+      expected = rel + seg->len;
+   }
+
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = stream->data;
+   cbuf.length = stream->len;
+
+   pcap_tls(ctx, flow, &cbuf);
+
+   g_byte_array_free(stream, TRUE);
+}
+
+/*
+ * passes the certificates of the flow to the callback
+ */
+static void pcap_flow_emit(pcap_ctx_t *ctx, pcap_flow_t *flow)
+{
+   const guchar *der;
+   GBytes *cert;
+   gchar *name;
+   gsize len;
+   guint i;
+
+   if (flow->certs == NULL)
+      return;
+
+   name = pcap_flow_name(ctx, flow);
+
+   for (i = 0; i < flow->certs->len; i++) {
+      cert = g_ptr_array_index(flow->certs, i);
+      der = g_bytes_get_data(cert, &len);
+      ctx->callback(der, len, name, ctx->data);
+      ctx->certificates++;
+   }
+
+   g_free(name);
+}
+
+/*
+ * collects the handshake protocol from the TLS records and
+ * dissects the handshake messages up to ChangeCipherSpec
+ */
+static void pcap_tls(pcap_ctx_t *ctx, pcap_flow_t *flow, cbuf_t *stream)
+{
+   GByteArray *handshake;
+   guint offset = 0;
+   guint16 reclen;
+   guint32 msglen;
+   cbuf_t hs;
+
+   handshake = g_byte_array_new();
+
+   /* TLSPlaintext: type(1) version(2) length(2) fragment */
+   while (cbuf_length_remaining(stream, offset) >= 5) {
+      if (stream->buffer[offset] != TLS_HANDSHAKE)
+         break;
+
+      reclen = cbuf_get_ntohs(stream, offset + 3);
+      if (reclen > cbuf_length_remaining(stream, offset + 5))
+         reclen = cbuf_length_remaining(stream, offset + 5);
+
+      g_byte_array_append(handshake, stream->buffer + offset + 5, reclen);
+      offset += 5 + reclen;
+   }
+
+   memset(&hs, 0, sizeof(cbuf_t));
+   hs.buffer = handshake->data;
+   hs.length = handshake->len;
+
+   /* Handshake: msg_type(1) length(3) body */
+   offset = 0;
+   while (cbuf_length_remaining(&hs, offset) >= 4) {
+      msglen = cbuf_get_ntoh24(&hs, offset + 1);
+      if (msglen > cbuf_length_remaining(&hs, offset + 4))
+         break;
+
+      if (hs.buffer[offset] == TLS_HS_CERTIFICATE)
+         pcap_certificates(flow, &hs, offset + 4, msglen);
+
+      offset += 4 + msglen;
+   }
+
+   g_byte_array_free(handshake, TRUE);
+}
+
+/*
+ * Certificate: certificate_list<0..2^24-1> of ASN.1Cert<1..2^24-1>;
+ * the certificates are kept with the flow until all flows are done
+ */
+static void pcap_certificates(pcap_flow_t *flow, cbuf_t *hs,
+                              guint offset, guint32 len)
+{
+   guint32 listlen, certlen;
+   guint end;
+
+   if (len < 3)
+      return;
+
+   listlen = cbuf_get_ntoh24(hs, offset);
+   if (listlen + 3 > len)
+      return;
+
+   offset += 3;
+   end = offset + listlen;
+
+   if (flow->certs == NULL)
+      flow->certs = g_ptr_array_new_with_free_func(
+            (GDestroyNotify)g_bytes_unref);
+
+   while (offset + 3 <= end) {
+      certlen = cbuf_get_ntoh24(hs, offset);
+      offset += 3;
+      if (certlen == 0 || certlen > end - offset)
+         break;
+
+      g_ptr_array_add(flow->certs, g_bytes_new(hs->buffer + offset, certlen));
+
+      offset += certlen;
+   }
+}
+
+static gint pcap_segment_compare(gconstpointer a, gconstpointer b,
+                                 gpointer base)
+{
+   guint32 ra = ((const pcap_segment_t*)a)->seq - *(guint32*)base;
+   guint32 rb = ((const pcap_segment_t*)b)->seq - *(guint32*)base;
+
+   return ra < rb ? -1 : ra > rb;
+}
+
+static guint pcap_flowkey_hash(gconstpointer key)
+{
+   const guchar *p = key;
+   guint hash = 2166136261u;
+   guint i;
+
+   /* FNV-1a over the whole key */
+   for (i = 0; i < sizeof(pcap_flowkey_t); i++)
+      hash = (hash ^ p[i]) * 16777619u;
+
+   return hash;
+}
+
+static gboolean pcap_flowkey_equal(gconstpointer a, gconstpointer b)
+{
+   return memcmp(a, b, sizeof(pcap_flowkey_t)) == 0;
+}
+
+static void pcap_flow_free(gpointer data)
+{
+   pcap_flow_t *flow = data;
+
+   g_array_free(flow->segments, TRUE);
+   if (flow->certs)
+      g_ptr_array_free(flow->certs, TRUE);
+   g_free(flow);
+}
+
+/*
+ * "file: src:port > dst:port", to be freed by the caller
+ */
+static gchar* pcap_flow_name(pcap_ctx_t *ctx, pcap_flow_t *flow)
+{
+   gchar src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+   int af = flow->key.family == 4 ? AF_INET : AF_INET6;
+
+   inet_ntop(af, flow->key.src, src, sizeof(src));
+   inet_ntop(af, flow->key.dst, dst, sizeof(dst));
+
+   if (af == AF_INET)
+      return g_strdup_printf("%s: %s:%u > %s:%u", ctx->filename,
+            src, flow->key.sport, dst, flow->key.dport);
+
+   return g_strdup_printf("%s: [%s]:%u > [%s]:%u", ctx->filename,
+         src, flow->key.sport, dst, flow->key.dport);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
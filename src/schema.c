@@ -0,0 +1,358 @@
+/* schema.c
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_schema.h>
+#include <certalize_asn1.h>
+
+/* globals    */
+
+/* tried in order */
+static const asn1_schema_document_t asn1_schema_documents[] = {
+   { ASN1_SCHEMA_TYPE_CERTIFICATE, "X.509 signed certificate" },
+   { ASN1_SCHEMA_TYPE_CERTIFICATE_LIST, "X.509 certificate revocation list" },
+   { ASN1_SCHEMA_TYPE_CERTIFICATION_REQUEST, "PKCS #10 certification request" },
+};
+
+/* an index built from a broken encoding may link to nodes not built */
+#define SCHEMA_NODE(index, i) \
+   ((i) < (index)->len ? (guint32)(i) : ASN1_INDEX_NONE)
+
+/* prototypes */
+static gboolean asn1_schema_accepts(asn1_index_t *index, guint32 node,
+                                    guint16 type);
+static int asn1_schema_match(asn1_index_t *index, guint32 node, guint16 type,
+                             gboolean implicit, asn1_schema_note_t *notes);
+static int asn1_schema_sequence(asn1_index_t *index, guint32 node,
+                                const asn1_schema_type_t *t,
+                                asn1_schema_note_t *notes);
+static int asn1_schema_set(asn1_index_t *index, guint32 node,
+                           const asn1_schema_type_t *t,
+                           asn1_schema_note_t *notes);
+
+
+/*************/
+
+void asn1_schema_notes_init(asn1_schema_note_t *notes, guint32 len)
+{
+   /* ASN1_SCHEMA_NONE in both members */
+   memset(notes, 0xff, len * sizeof(asn1_schema_note_t));
+}
+
+/*
+ * matches the element at node and everything below it against a
+ * type of the tables, noting for each node the type and component
+ * it has been matched to
+ *   - notes must hold one entry per node of the index
+ *   - on a mismatch -E_INVALID is returned and the nodes matched up
+ *     to there keep their notes
+ *   - a document exhausting the work budget of the index does not
+ *     match either, with the index error set to ASN1_INDEX_WORK
+ */
+int asn1_schema_decode(asn1_index_t *index, guint32 node, guint16 type,
+                       asn1_schema_note_t *notes)
+{
+   if (node >= index->len || type >= asn1_schema_ntypes)
+      return -E_INVALID;
+
+   index->work = 0;
+
+   return asn1_schema_match(index, node, type, FALSE, notes);
+}
+
+/*
+ * looks a named type up, ASN1_SCHEMA_NONE if unknown
+ */
+guint16 asn1_schema_find(const gchar *name)
+{
+   guint i;
+
+   for (i = 0; i < asn1_schema_ntypes; i++)
+      if (asn1_schema_types[i].name && !strcmp(asn1_schema_types[i].name, name))
+         return i;
+
+   return ASN1_SCHEMA_NONE;
+}
+
+/*
+ * decodes the element at node as the first document type it matches;
+ * NULL leaves no notes below node
+ */
+const asn1_schema_document_t* asn1_schema_recognize(asn1_index_t *index,
+                                     guint32 node, asn1_schema_note_t *notes)
+{
+   guint32 end;
+   guint i;
+
+   if (node >= index->len)
+      return NULL;
+
+   /* the subtree ends with the first node not deeper than node */
+   for (end = node + 1; end < index->len &&
+        index->nodes[end].depth > index->nodes[node].depth; end++);
+
+   /* the budget is spent on all the types tried */
+   index->work = 0;
+
+   for (i = 0; i < G_N_ELEMENTS(asn1_schema_documents); i++) {
+      if (asn1_schema_match(index, node, asn1_schema_documents[i].type,
+               FALSE, notes) == E_SUCCESS)
+         return &asn1_schema_documents[i];
+
+      asn1_schema_notes_init(notes + node, end - node);
+
+      if (index->limits.work && index->work > index->limits.work)
+         break;
+   }
+
+   return NULL;
+}
+
+/*
+ * the document decoded as type, NULL if it is none
+ */
+const asn1_schema_document_t* asn1_schema_document(guint16 type)
+{
+   guint i;
+
+   for (i = 0; i < G_N_ELEMENTS(asn1_schema_documents); i++)
+      if (asn1_schema_documents[i].type == type)
+         return &asn1_schema_documents[i];
+
+   return NULL;
+}
+
+/*
+ * appends the names of node and its ancestors, outermost first,
+ * e.g. "Certificate.tbsCertificate.extensions.Extension.extnID";
+ * elements without notes are named by their tag
+ */
+void asn1_schema_path(asn1_index_t *index, guint32 node,
+                      asn1_schema_note_t *notes, GString *path)
+{
+   guint32 chain[ASN1_INDEX_MAX_DEPTH + 1];
+   const gchar *name;
+   asn1_node_t *n;
+   guint len = 0;
+
+   for (; node != ASN1_INDEX_NONE && len < G_N_ELEMENTS(chain);
+        node = index->nodes[node].parent)
+      chain[len++] = node;
+
+   while (len--) {
+      n = &index->nodes[chain[len]];
+
+      if (notes && notes[chain[len]].field != ASN1_SCHEMA_NONE)
+         name = asn1_schema_fields[notes[chain[len]].field].name;
+      else if (notes && notes[chain[len]].type != ASN1_SCHEMA_NONE)
+         name = asn1_schema_types[notes[chain[len]].type].name;
+      else
+         name = NULL;
+
+      if (name == NULL)
+         name = asn1_tag_name(n->class, n->tag);
+
+      if (name)
+         g_string_append(path, name);
+      else if (n->class == ASN1_CLASS_CONTEXT_SPECIFIC)
+         g_string_append_printf(path, "[%u]", n->tag);
+      else
+         g_string_append_printf(path, "[%u %u]", n->class, n->tag);
+
+      if (len)
+         g_string_append_c(path, '.');
+   }
+}
+
+/*
+ * whether the tag of the node selects a type, for skipping OPTIONAL
+ * components and choosing alternatives
+ */
+static gboolean asn1_schema_accepts(asn1_index_t *index, guint32 node,
+                                    guint16 type)
+{
+   const asn1_schema_type_t *t = &asn1_schema_types[type];
+   asn1_node_t *n = ASN1_INDEX_NODE(index, node);
+   guint i;
+
+   switch (t->kind) {
+      case ASN1_SCHEMA_ANY:
+         return TRUE;
+
+      case ASN1_SCHEMA_CHOICE:
+         for (i = 0; i < t->count; i++)
+            if (asn1_schema_accepts(index, node,
+                     asn1_schema_fields[t->first + i].type))
+               return TRUE;
+         return FALSE;
+
+      default:
+         return n->class == t->class && n->tag == t->tag;
+   }
+}
+
+static int asn1_schema_match(asn1_index_t *index, guint32 node, guint16 type,
+                             gboolean implicit, asn1_schema_note_t *notes)
+{
+   const asn1_schema_type_t *t = &asn1_schema_types[type];
+   asn1_node_t *n = ASN1_INDEX_NODE(index, node);
+   guint32 child;
+   guint i;
+
+   if (index->limits.work && ++index->work > index->limits.work) {
+      index->error = ASN1_INDEX_WORK;
+      index->error_offset = n->offset;
+      return -E_INVALID;
+   }
+
+   /* an implicit tag has replaced the one of the type */
+   if (!implicit && t->kind != ASN1_SCHEMA_ANY && t->kind != ASN1_SCHEMA_CHOICE &&
+       (n->class != t->class || n->tag != t->tag))
+      return -E_INVALID;
+
+   /* the outermost named type describes the node best */
+   if (notes[node].type == ASN1_SCHEMA_NONE ||
+       asn1_schema_types[notes[node].type].name == NULL)
+      notes[node].type = type;
+
+   switch (t->kind) {
+      case ASN1_SCHEMA_PRIMITIVE:
+      case ASN1_SCHEMA_ANY:
+         return E_SUCCESS;
+
+      case ASN1_SCHEMA_TAGGED:
+         if (t->tagging == ASN1_SCHEMA_IMPLICIT)
+            return asn1_schema_match(index, node, t->first, TRUE, notes);
+
+         /* explicit tags wrap exactly one element */
+         child = SCHEMA_NODE(index, ASN1_INDEX_CHILD(index, node));
+         if (child == ASN1_INDEX_NONE ||
+             SCHEMA_NODE(index, ASN1_INDEX_NEXT(index, child)) != ASN1_INDEX_NONE)
+            return -E_INVALID;
+
+         return asn1_schema_match(index, child, t->first, FALSE, notes);
+
+      case ASN1_SCHEMA_CHOICE:
+         for (i = 0; i < t->count; i++) {
+            if (!asn1_schema_accepts(index, node,
+                     asn1_schema_fields[t->first + i].type))
+               continue;
+
+            /* an enclosing component name takes precedence later */
+            notes[node].field = t->first + i;
+            return asn1_schema_match(index, node,
+                  asn1_schema_fields[t->first + i].type, FALSE, notes);
+         }
+         return -E_INVALID;
+
+      case ASN1_SCHEMA_SEQUENCE:
+         return asn1_schema_sequence(index, node, t, notes);
+
+      case ASN1_SCHEMA_SET:
+         return asn1_schema_set(index, node, t, notes);
+
+      case ASN1_SCHEMA_SEQUENCE_OF:
+      case ASN1_SCHEMA_SET_OF:
+         for (child = SCHEMA_NODE(index, ASN1_INDEX_CHILD(index, node));
+              child != ASN1_INDEX_NONE;
+              child = SCHEMA_NODE(index, ASN1_INDEX_NEXT(index, child)))
+            if (asn1_schema_match(index, child, t->first, FALSE, notes) < 0)
+               return -E_INVALID;
+         return E_SUCCESS;
+   }
+
+   return -E_INVALID;
+}
+
+/*
+ * components in order, absent OPTIONAL and DEFAULT ones are told by
+ * the tag of the next element
+ */
+static int asn1_schema_sequence(asn1_index_t *index, guint32 node,
+                                const asn1_schema_type_t *t,
+                                asn1_schema_note_t *notes)
+{
+   const asn1_schema_field_t *f;
+   guint32 child;
+   guint i;
+
+   child = SCHEMA_NODE(index, ASN1_INDEX_CHILD(index, node));
+
+   for (i = 0; i < t->count; i++) {
+      f = &asn1_schema_fields[t->first + i];
+
+      if (child != ASN1_INDEX_NONE && asn1_schema_accepts(index, child, f->type)) {
+         if (asn1_schema_match(index, child, f->type, FALSE, notes) < 0)
+            return -E_INVALID;
+         notes[child].field = t->first + i;
+         child = SCHEMA_NODE(index, ASN1_INDEX_NEXT(index, child));
+      }
+      else if (!(f->flags & (ASN1_SCHEMA_OPTIONAL | ASN1_SCHEMA_DEFAULT))) {
+         return -E_INVALID;
+      }
+   }
+
+   /* trailing elements not in the schema */
+   return child == ASN1_INDEX_NONE ? E_SUCCESS : -E_INVALID;
+}
+
+/*
+ * components in any order, each at most once
+ */
+static int asn1_schema_set(asn1_index_t *index, guint32 node,
+                           const asn1_schema_type_t *t,
+                           asn1_schema_note_t *notes)
+{
+   const asn1_schema_field_t *f;
+   guint64 seen = 0;
+   guint32 child;
+   guint i;
+
+   for (child = SCHEMA_NODE(index, ASN1_INDEX_CHILD(index, node));
+        child != ASN1_INDEX_NONE;
+        child = SCHEMA_NODE(index, ASN1_INDEX_NEXT(index, child))) {
+
+      for (i = 0; i < t->count; i++)
+         if (!(seen & G_GUINT64_CONSTANT(1) << i) &&
+             asn1_schema_accepts(index, child, asn1_schema_fields[t->first + i].type))
+            break;
+
+      if (i == t->count)
+         return -E_INVALID;
+
+      seen |= G_GUINT64_CONSTANT(1) << i;
+      if (asn1_schema_match(index, child, asn1_schema_fields[t->first + i].type,
+               FALSE, notes) < 0)
+         return -E_INVALID;
+      notes[child].field = t->first + i;
+   }
+
+   for (i = 0; i < t->count; i++) {
+      f = &asn1_schema_fields[t->first + i];
+      if (!(seen & G_GUINT64_CONSTANT(1) << i) &&
+          !(f->flags & (ASN1_SCHEMA_OPTIONAL | ASN1_SCHEMA_DEFAULT)))
+         return -E_INVALID;
+   }
+
+   return E_SUCCESS;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,459 @@
+/* search.c - byte pattern search
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_search.h>
+#include <certalize_asn1.h>
+#include <certalize_debug.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* globals    */
+
+#define SEARCH_NONE                 G_MAXUINT32
+
+typedef struct search_pattern {
+   guchar *bytes;
+   gsize len;
+   /* as given by the user, for reporting */
+   gchar *expr;
+   /* next pattern ending in the same state */
+   guint32 next;
+} search_pattern_t;
+
+struct search {
+   GPtrArray *patterns;
+   /* automaton built on the next scan */
+   gboolean dirty;
+   /* transitions, 256 per state */
+   guint32 *delta;
+   guint32 nstates;
+   /* first pattern ending in a state */
+   guint32 *match;
+   /* nearest state on the failure chain with a match */
+   guint32 *dict;
+};
+
+/* prototypes */
+static void search_pattern_free(gpointer data);
+static guint32 search_new_state(search_t *search);
+static guint64 search_memmem(search_t *search, const guchar *data, gsize len,
+                             search_hit_cb cb, gpointer cb_data);
+static guint64 search_automaton(search_t *search, const guchar *data,
+                                gsize len, search_hit_cb cb, gpointer cb_data);
+static int search_parse_oid(const gchar *dotted, GByteArray *out);
+static int search_parse_hex(const gchar *hex, GByteArray *out);
+
+
+/*************/
+
+search_t* search_new(void)
+{
+   search_t *search = g_new0(search_t, 1);
+
+   search->patterns = g_ptr_array_new_with_free_func(search_pattern_free);
+
+   return search;
+}
+
+void search_free(search_t *search)
+{
+   if (search == NULL)
+      return;
+
+   g_ptr_array_free(search->patterns, TRUE);
+   g_free(search->delta);
+   g_free(search->match);
+   g_free(search->dict);
+   g_free(search);
+}
+
+static void search_pattern_free(gpointer data)
+{
+   search_pattern_t *p = data;
+
+   g_free(p->bytes);
+   g_free(p->expr);
+   g_free(p);
+}
+
+/*
+ * adds a pattern of raw bytes, expr names it in reports
+ */
+int search_add(search_t *search, const guchar *bytes, gsize len,
+               const gchar *expr)
+{
+   search_pattern_t *p;
+
+   if (len == 0 || len > SEARCH_MAX_PATTERN)
+      return -E_INVALID;
+
+   p = g_new0(search_pattern_t, 1);
+   p->bytes = g_malloc(len);
+   memcpy(p->bytes, bytes, len);
+   p->len = len;
+   p->expr = g_strdup(expr);
+   p->next = SEARCH_NONE;
+
+   g_ptr_array_add(search->patterns, p);
+   search->dirty = TRUE;
+
+   return E_SUCCESS;
+}
+
+/*
+ * adds a pattern given as
+ *   - "oid:2.5.29.14" or just "2.5.29.14": the encoded OBJECT IDENTIFIER
+ *     including identifier and length octets
+ *   - "text:CA": the characters as they are
+ *   - "hex:0414" or "04:14", "04 14", "0414": the bytes in hex
+ */
+int search_add_expr(search_t *search, const gchar *expr)
+{
+   GByteArray *bytes;
+   const gchar *p;
+   int res;
+
+   bytes = g_byte_array_new();
+
+   for (p = expr; *p && (g_ascii_isdigit(*p) || *p == '.'); p++);
+
+   if (g_str_has_prefix(expr, "oid:"))
+      res = search_parse_oid(expr + 4, bytes);
+   else if (*p == '\0' && strchr(expr, '.'))
+      res = search_parse_oid(expr, bytes);
+   else if (g_str_has_prefix(expr, "text:")) {
+      g_byte_array_append(bytes, (const guint8*)expr + 5, strlen(expr + 5));
+      res = E_SUCCESS;
+   }
+   else if (g_str_has_prefix(expr, "hex:"))
+      res = search_parse_hex(expr + 4, bytes);
+   else
+      res = search_parse_hex(expr, bytes);
+
+   if (res == E_SUCCESS)
+      res = search_add(search, bytes->data, bytes->len, expr);
+
+   g_byte_array_free(bytes, TRUE);
+
+   return res;
+}
+
+guint search_count(search_t *search)
+{
+   return search->patterns->len;
+}
+
+const gchar* search_expr(search_t *search, guint pattern)
+{
+   return ((search_pattern_t*)g_ptr_array_index(search->patterns,
+            pattern))->expr;
+}
+
+/*
+ * reports every occurrence of the patterns in data, returns their number
+ */
+guint64 search_scan(search_t *search, const guchar *data, gsize len,
+                    search_hit_cb cb, gpointer cb_data)
+{
+   if (search->patterns->len == 0)
+      return 0;
+
+   if (search->patterns->len == 1)
+      return search_memmem(search, data, len, cb, cb_data);
+
+   if (search->dirty)
+      search_compile(search);
+
+   return search_automaton(search, data, len, cb, cb_data);
+}
+
+/*
+ * first and last byte of the pattern are compared at 16 positions at
+ * once, only candidates matching both are compared in full
+ */
+static guint64 search_memmem(search_t *search, const guchar *data, gsize len,
+                             search_hit_cb cb, gpointer cb_data)
+{
+   search_pattern_t *p = g_ptr_array_index(search->patterns, 0);
+   const guchar *pos, *end;
+   guint64 hits = 0;
+   gsize i = 0;
+
+   if (len < p->len)
+      return 0;
+
+#ifdef __SSE2__
+   if (p->len > 1) {
+      __m128i first = _mm_set1_epi8(p->bytes[0]);
+      __m128i last = _mm_set1_epi8(p->bytes[p->len - 1]);
+      __m128i a, b;
+      guint mask, bit;
+
+      for (; i + p->len - 1 + 16 <= len; i += 16) {
+         a = _mm_loadu_si128((const __m128i*)(data + i));
+         b = _mm_loadu_si128((const __m128i*)(data + i + p->len - 1));
+         mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                  _mm_cmpeq_epi8(b, last)));
+
+         while (mask) {
+            bit = __builtin_ctz(mask);
+            if (!memcmp(data + i + bit + 1, p->bytes + 1, p->len - 2)) {
+               hits++;
+               if (cb && !cb(0, i + bit, p->len, cb_data))
+                  return hits;
+            }
+            mask &= mask - 1;
+         }
+      }
+   }
+#endif
+
+   /* the rest, or everything without SSE2: memchr for the first byte */
+   end = data + len - p->len + 1;
+   for (pos = data + i; pos < end; pos++) {
+      if ((pos = memchr(pos, p->bytes[0], end - pos)) == NULL)
+         break;
+      if (!memcmp(pos, p->bytes, p->len)) {
+         hits++;
+         if (cb && !cb(0, pos - data, p->len, cb_data))
+            return hits;
+      }
+   }
+
+   return hits;
+}
+
+static guint64 search_automaton(search_t *search, const guchar *data,
+                                gsize len, search_hit_cb cb, gpointer cb_data)
+{
+   const guint32 *delta = search->delta;
+   search_pattern_t *p;
+   guint64 hits = 0;
+   guint32 s = 0, t, k;
+   gsize i;
+
+   for (i = 0; i < len; i++) {
+      s = delta[(gsize)s << 8 | data[i]];
+
+      /* most states end no pattern at all */
+      if (search->match[s] == SEARCH_NONE && search->dict[s] == SEARCH_NONE)
+         continue;
+
+      for (t = search->match[s] != SEARCH_NONE ? s : search->dict[s];
+           t != SEARCH_NONE; t = search->dict[t]) {
+         for (k = search->match[t]; k != SEARCH_NONE; k = p->next) {
+            p = g_ptr_array_index(search->patterns, k);
+            hits++;
+            if (cb && !cb(k, i + 1 - p->len, p->len, cb_data))
+               return hits;
+         }
+      }
+   }
+
+   return hits;
+}
+
+static guint32 search_new_state(search_t *search)
+{
+   guint32 s = search->nstates++;
+
+   search->delta = g_renew(guint32, search->delta, (gsize)search->nstates << 8);
+   search->match = g_renew(guint32, search->match, search->nstates);
+   search->dict = g_renew(guint32, search->dict, search->nstates);
+
+   memset(search->delta + ((gsize)s << 8), 0xff, 256 * sizeof(guint32));
+   search->match[s] = SEARCH_NONE;
+   search->dict[s] = SEARCH_NONE;
+
+   return s;
+}
+
+/*
+ * builds the trie of all patterns, then resolves the missing
+ * transitions through the failure links breadth first
+ */
+void search_compile(search_t *search)
+{
+   search_pattern_t *p;
+   guint32 *fail, *queue;
+   guint32 s, t, head = 0, tail = 0;
+   guint i, b;
+   gsize j;
+
+   g_free(search->delta);
+   g_free(search->match);
+   g_free(search->dict);
+   search->delta = NULL;
+   search->match = NULL;
+   search->dict = NULL;
+   search->nstates = 0;
+
+   search_new_state(search);
+
+   for (i = 0; i < search->patterns->len; i++) {
+      p = g_ptr_array_index(search->patterns, i);
+
+      for (s = 0, j = 0; j < p->len; j++) {
+         t = search->delta[(gsize)s << 8 | p->bytes[j]];
+         if (t == SEARCH_NONE) {
+            t = search_new_state(search);
+            search->delta[(gsize)s << 8 | p->bytes[j]] = t;
+         }
+         s = t;
+      }
+
+      /* equal patterns end in the same state */
+      p->next = search->match[s];
+      search->match[s] = i;
+   }
+
+   fail = g_new0(guint32, search->nstates);
+   queue = g_new(guint32, search->nstates);
+
+   for (b = 0; b < 256; b++) {
+      t = search->delta[b];
+      if (t == SEARCH_NONE) {
+         search->delta[b] = 0;
+      }
+      else {
+         fail[t] = 0;
+         queue[tail++] = t;
+      }
+   }
+
+   while (head < tail) {
+      s = queue[head++];
+
+      for (b = 0; b < 256; b++) {
+         t = search->delta[(gsize)s << 8 | b];
+         if (t == SEARCH_NONE) {
+            search->delta[(gsize)s << 8 | b] =
+               search->delta[(gsize)fail[s] << 8 | b];
+         }
+         else {
+            fail[t] = search->delta[(gsize)fail[s] << 8 | b];
+            /* shorter patterns ending at the same position */
+            search->dict[t] = search->match[fail[t]] != SEARCH_NONE ?
+                  fail[t] : search->dict[fail[t]];
+            queue[tail++] = t;
+         }
+      }
+   }
+
+   DEBUG_MSG("search_compile: %u patterns, %u states",
+         search->patterns->len, search->nstates);
+
+   g_free(fail);
+   g_free(queue);
+
+   search->dirty = FALSE;
+}
+
+/*
+ * encodes a dotted object identifier as DER
+ */
+static int search_parse_oid(const gchar *dotted, GByteArray *out)
+{
+   guint64 arcs[ASN1_MAX_OID_LEN], value;
+   guint8 base128[10], header[3];
+   gchar **parts, *end;
+   guint n, i, k;
+   int res = E_SUCCESS;
+
+   parts = g_strsplit(dotted, ".", 0);
+   n = g_strv_length(parts);
+
+   if (n < 2 || n > ASN1_MAX_OID_LEN)
+      res = -E_INVALID;
+
+   for (i = 0; res == E_SUCCESS && i < n; i++) {
+      arcs[i] = g_ascii_strtoull(parts[i], &end, 10);
+      if (*parts[i] == '\0' || *end != '\0')
+         res = -E_INVALID;
+   }
+
+   g_strfreev(parts);
+
+   if (res != E_SUCCESS || arcs[0] > 2 || (arcs[0] < 2 && arcs[1] >= 40) ||
+       arcs[1] > G_MAXUINT64 - 80)
+      return -E_INVALID;
+
+   /* the first two arcs share a subidentifier */
+   arcs[1] += arcs[0] * 40;
+
+   for (i = 1; i < n; i++) {
+      value = arcs[i];
+      k = sizeof(base128);
+      do {
+         k--;
+         /* all but the last octet have the high bit set */
+         base128[k] = (value & 0x7f) | (k < sizeof(base128) - 1 ? 0x80 : 0);
+         value >>= 7;
+      } while (value);
+      g_byte_array_append(out, base128 + k, sizeof(base128) - k);
+   }
+
+   /* contents of up to 20 arcs need at most one length octet */
+   header[0] = ASN1_TAG_OID;
+   if (out->len < 0x80) {
+      header[1] = out->len;
+      g_byte_array_prepend(out, header, 2);
+   }
+   else {
+      header[1] = 0x81;
+      header[2] = out->len;
+      g_byte_array_prepend(out, header, 3);
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * pairs of hex digits, separated by spaces or colons or not at all
+ */
+static int search_parse_hex(const gchar *hex, GByteArray *out)
+{
+   guint8 byte;
+   gint hi, lo;
+
+   while (*hex) {
+      if (*hex == ' ' || *hex == ':') {
+         hex++;
+         continue;
+      }
+
+      hi = g_ascii_xdigit_value(hex[0]);
+      lo = hi < 0 ? -1 : g_ascii_xdigit_value(hex[1]);
+      if (lo < 0)
+         return -E_INVALID;
+
+      byte = hi << 4 | lo;
+      g_byte_array_append(out, &byte, 1);
+      hex += 2;
+   }
+
+   return out->len ? E_SUCCESS : -E_INVALID;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
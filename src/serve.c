@@ -0,0 +1,858 @@
+/* serve.c - parsing daemon on a UNIX domain socket
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* memfd_create() */
+#define _GNU_SOURCE
+
+#include <certalize.h>
+#include <certalize_serve.h>
+#include <certalize_batch.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+
+/* globals    */
+
+#define SERVE_KEY_LEN               32
+
+/* cached answer, linked in least recently used order */
+typedef struct serve_entry {
+   guint8 key[SERVE_KEY_LEN];
+   guint8 status;
+   GBytes *body;
+   GList link;
+} serve_entry_t;
+
+/* latency is kept per opcode */
+enum {
+   SERVE_HIST_JSON = 0,
+   SERVE_HIST_FIELDS,
+   SERVE_HISTS,
+};
+
+typedef struct serve_ctx {
+   /* of the parsers of all workers */
+   const asn1_limits_t *limits;
+   /* answers by digest of opcode and payload */
+   GMutex cache_lock;
+   GHashTable *cache;
+   GQueue lru;
+   gsize cache_bytes;
+   /* open connections, shut down on termination */
+   GMutex conn_lock;
+   GHashTable *conns;
+   GMutex stats_lock;
+   gint64 started;
+   guint64 connections;
+   guint64 requests;
+   guint64 errors;
+   guint64 hits;
+   guint64 misses;
+   guint64 hist[SERVE_HISTS][SERVE_HIST_BUCKETS];
+} serve_ctx_t;
+
+/* state of a pool thread, reused for all requests it handles */
+typedef struct serve_worker {
+   batch_t batch;
+   /* takes what does not fit into batch.outbuf, -1 if unavailable */
+   gint spill;
+   GChecksum *digest;
+   GByteArray *request;
+} serve_worker_t;
+
+/* prototypes */
+static gboolean serve_probe(const gchar *path);
+static void serve_connection(gpointer data, gpointer user_data);
+static int  serve_request(serve_worker_t *worker, gint fd, guint8 op,
+                          const guchar *payload, gsize len);
+static guint8 serve_parse(serve_worker_t *worker, guint8 op,
+                          const guchar *payload, gsize len,
+                          gsize *spilled);
+static void serve_stats(serve_worker_t *worker);
+static void serve_emit_histogram(json_writer_t *w, const gchar *key,
+                                 const guint64 *hist);
+static void serve_account(gint hist, gint hit, guint8 status,
+                          gint64 elapsed);
+static int  serve_read(gint fd, guchar *buf, gsize len);
+static int  serve_write(gint fd, const guchar *buf, gsize len);
+static int  serve_reply(gint fd, guint8 status, const guchar *body,
+                        gsize len);
+static int  serve_reply_spilled(gint fd, guint8 status, gint spill,
+                                gsize spilled, const guchar *body,
+                                gsize len);
+static GBytes* serve_cache_lookup(const guint8 *key, guint8 *status);
+static void serve_cache_insert(const guint8 *key, guint8 status,
+                               const guchar *body, gsize len);
+static guint serve_key_hash(gconstpointer key);
+static gboolean serve_key_equal(gconstpointer a, gconstpointer b);
+static void serve_entry_free(gpointer data);
+static void serve_spill_reset(serve_worker_t *worker);
+static serve_worker_t* serve_worker_get(void);
+static void serve_worker_free(gpointer data);
+
+static serve_ctx_t serve_ctx;
+static GPrivate serve_worker = G_PRIVATE_INIT(serve_worker_free);
+
+
+/*************/
+
+/*
+ * answers requests on the socket at path until SIGINT or SIGTERM
+ *   - every connection is served by a thread of the pool, idle
+ *     connections are closed after SERVE_IDLE_TIMEOUT seconds
+ *     so they do not hold on to their thread; beyond
+ *     SERVE_MAX_CONNECTIONS new ones are turned away
+ *   - answers are cached by payload, so certificates asked for
+ *     repeatedly are parsed once; the cache holds no more than
+ *     SERVE_CACHE_BYTES and no answer above SERVE_CACHE_MAX_ANSWER
+ *   - records exceeding the limits are answered as errors
+ */
+int serve_run(const gchar *path, const asn1_limits_t *limits)
+{
+   struct sockaddr_un addr;
+   struct pollfd fds[2];
+   struct stat st;
+   struct timeval timeout = { SERVE_IDLE_TIMEOUT, 0 };
+   GHashTableIter iter;
+   GThreadPool *pool;
+   GList *link;
+   gpointer conn;
+   sigset_t mask;
+   mode_t umask_old;
+   gint lfd, sfd, fd;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      g_printerr("socket path '%s' is too long\n", path);
+      return E_INVALID;
+   }
+
+   if (serve_probe(path)) {
+      g_printerr("'%s' is already served\n", path);
+      return E_INVALID;
+   }
+
+   /* a socket left behind by a previous instance, nothing else */
+   if (lstat(path, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         g_printerr("'%s' exists and is not a socket\n", path);
+         return E_INVALID;
+      }
+      unlink(path);
+   }
+
+   /* the signals are read from a signalfd, pool threads inherit the mask */
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGINT);
+   sigaddset(&mask, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+   signal(SIGPIPE, SIG_IGN);
+
+   if ((sfd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0) {
+      g_printerr("creating signalfd failed: %s\n", g_strerror(errno));
+      return E_INVALID;
+   }
+
+   if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+      g_printerr("creating socket failed: %s\n", g_strerror(errno));
+      close(sfd);
+      return E_INVALID;
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   /* only the owner may connect */
+   umask_old = umask(0077);
+
+   if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(lfd, SOMAXCONN) < 0) {
+      g_printerr("listening on '%s' failed: %s\n", path, g_strerror(errno));
+      umask(umask_old);
+      close(lfd);
+      close(sfd);
+      return E_INVALID;
+   }
+
+   umask(umask_old);
+
+   memset(&serve_ctx, 0, sizeof(serve_ctx_t));
+   serve_ctx.limits = limits;
+   g_mutex_init(&serve_ctx.cache_lock);
+   g_mutex_init(&serve_ctx.conn_lock);
+   g_mutex_init(&serve_ctx.stats_lock);
+   serve_ctx.cache = g_hash_table_new(serve_key_hash, serve_key_equal);
+   serve_ctx.conns = g_hash_table_new(NULL, NULL);
+   serve_ctx.started = g_get_monotonic_time();
+   g_queue_init(&serve_ctx.lru);
+
+   /* a thread waiting on an idle connection costs nothing but memory */
+   pool = g_thread_pool_new(serve_connection, NULL,
+         SERVE_MAX_CONNECTIONS, FALSE, NULL);
+
+   g_printerr("serving on %s\n", path);
+
+   fds[0].fd = lfd;
+   fds[0].events = POLLIN;
+   fds[1].fd = sfd;
+   fds[1].events = POLLIN;
+
+   for (;;) {
+      if (poll(fds, 2, -1) < 0) {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+
+      if (fds[1].revents)
+         break;
+
+      if (!(fds[0].revents & POLLIN))
+         continue;
+
+      if ((fd = accept(lfd, NULL, NULL)) < 0) {
+         DEBUG_MSG("serve_run: accept failed: %s", strerror(errno));
+         continue;
+      }
+
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+      /* every thread of the pool is busy */
+      g_mutex_lock(&serve_ctx.conn_lock);
+      if (g_hash_table_size(serve_ctx.conns) >= SERVE_MAX_CONNECTIONS) {
+         g_mutex_unlock(&serve_ctx.conn_lock);
+         serve_reply(fd, SERVE_STATUS_ERROR,
+               (const guchar*)"too many connections", 20);
+         serve_account(-1, -1, SERVE_STATUS_ERROR, 0);
+         close(fd);
+         continue;
+      }
+      g_hash_table_add(serve_ctx.conns, GINT_TO_POINTER(fd + 1));
+      g_mutex_unlock(&serve_ctx.conn_lock);
+
+      g_mutex_lock(&serve_ctx.stats_lock);
+      serve_ctx.connections++;
+      g_mutex_unlock(&serve_ctx.stats_lock);
+
+      /* off by one, the pool does not take NULL */
+      g_thread_pool_push(pool, GINT_TO_POINTER(fd + 1), NULL);
+   }
+
+   close(lfd);
+   close(sfd);
+   unlink(path);
+
+   /* the workers see the end of their connections and return */
+   g_mutex_lock(&serve_ctx.conn_lock);
+   g_hash_table_iter_init(&iter, serve_ctx.conns);
+   while (g_hash_table_iter_next(&iter, &conn, NULL))
+      shutdown(GPOINTER_TO_INT(conn) - 1, SHUT_RDWR);
+   g_mutex_unlock(&serve_ctx.conn_lock);
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   g_hash_table_destroy(serve_ctx.conns);
+   g_hash_table_destroy(serve_ctx.cache);
+   while ((link = g_queue_pop_head_link(&serve_ctx.lru)) != NULL)
+      serve_entry_free(link->data);
+   g_mutex_clear(&serve_ctx.cache_lock);
+   g_mutex_clear(&serve_ctx.conn_lock);
+   g_mutex_clear(&serve_ctx.stats_lock);
+
+   return E_SUCCESS;
+}
+
+/*
+ * true if another instance answers on path
+ */
+static gboolean serve_probe(const gchar *path)
+{
+   struct sockaddr_un addr;
+   gboolean alive;
+   gint fd;
+
+   if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+      return FALSE;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   alive = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+   close(fd);
+
+   return alive;
+}
+
+/*
+ * pool thread: answers the requests of one connection in order
+ */
+static void serve_connection(gpointer data, gpointer user_data _U_)
+{
+   serve_worker_t *worker = serve_worker_get();
+   guint32 length;
+   gint fd = GPOINTER_TO_INT(data) - 1;
+
+   for (;;) {
+      /* end of connection, idle timeout or shutdown */
+      if (serve_read(fd, (guchar*)&length, SERVE_HEADER_LEN) < 0)
+         break;
+
+      length = GUINT32_FROM_BE(length);
+
+      /* the stream can not be resynchronized after a bad frame */
+      if (length == 0 || length > SERVE_MAX_FRAME) {
+         serve_reply(fd, SERVE_STATUS_ERROR,
+               (const guchar*)"invalid frame length", 20);
+         serve_account(-1, -1, SERVE_STATUS_ERROR, 0);
+         break;
+      }
+
+      /* opcode and payload */
+      g_byte_array_set_size(worker->request, length);
+
+      if (serve_read(fd, worker->request->data, length) < 0)
+         break;
+
+      if (serve_request(worker, fd, worker->request->data[0],
+               worker->request->data + 1, length - 1) < 0)
+         break;
+
+      /* a large frame does not keep its buffer */
+      if (length > SERVE_KEEP_REQUEST) {
+         g_byte_array_free(worker->request, TRUE);
+         worker->request = g_byte_array_new();
+      }
+   }
+
+   g_mutex_lock(&serve_ctx.conn_lock);
+   g_hash_table_remove(serve_ctx.conns, data);
+   close(fd);
+   g_mutex_unlock(&serve_ctx.conn_lock);
+}
+
+/*
+ * answers one request, from the cache if the payload has been seen
+ */
+static int serve_request(serve_worker_t *worker, gint fd, guint8 op,
+                         const guchar *payload, gsize len)
+{
+   guint8 key[SERVE_KEY_LEN];
+   gsize keylen = sizeof(key);
+   json_writer_t *w = &worker->batch.json;
+   gint64 start = g_get_monotonic_time();
+   const guchar *data;
+   GBytes *body;
+   gboolean hit;
+   guint8 status;
+   gsize size, spilled;
+   int res;
+
+   switch (op) {
+      case SERVE_OP_JSON:
+      case SERVE_OP_FIELDS:
+         break;
+      case SERVE_OP_STATS:
+         serve_stats(worker);
+         serve_account(-1, -1, SERVE_STATUS_OK, 0);
+         return serve_reply(fd, SERVE_STATUS_OK, w->buffer, w->pos);
+      default:
+         serve_account(-1, -1, SERVE_STATUS_ERROR, 0);
+         return serve_reply(fd, SERVE_STATUS_ERROR,
+               (const guchar*)"unknown opcode", 14);
+   }
+
+   /* the answer depends on nothing but the opcode and the payload */
+   g_checksum_reset(worker->digest);
+   g_checksum_update(worker->digest, &op, 1);
+   g_checksum_update(worker->digest, payload, len);
+   g_checksum_get_digest(worker->digest, key, &keylen);
+
+   hit = (body = serve_cache_lookup(key, &status)) != NULL;
+
+   if (hit) {
+      data = g_bytes_get_data(body, &size);
+      res = serve_reply(fd, status, data, size);
+      g_bytes_unref(body);
+   }
+   else {
+      status = serve_parse(worker, op, payload, len, &spilled);
+
+      if (spilled == 0) {
+         res = serve_reply(fd, status, w->buffer, w->pos);
+         if (w->pos <= SERVE_CACHE_MAX_ANSWER)
+            serve_cache_insert(key, status, w->buffer, w->pos);
+      }
+      else {
+         res = serve_reply_spilled(fd, status, worker->spill, spilled,
+               w->buffer, w->pos);
+         serve_spill_reset(worker);
+      }
+   }
+
+   serve_account(op == SERVE_OP_FIELDS ? SERVE_HIST_FIELDS : SERVE_HIST_JSON,
+         hit, status, g_get_monotonic_time() - start);
+
+   return res;
+}
+
+/*
+ * decodes the certificates of the payload into the worker's writer
+ *   - the payload is decoded once, output not fitting into the buffer
+ *     goes to the worker's spill file; spilled is set to its length,
+ *     the answer continues with the buffer
+ *   - answers above SERVE_MAX_ANSWER are replaced by an error
+ */
+static guint8 serve_parse(serve_worker_t *worker, guint8 op,
+                          const guchar *payload, gsize len,
+                          gsize *spilled)
+{
+   batch_t *batch = &worker->batch;
+   json_writer_t *w = &batch->json;
+   off_t end = 0;
+
+   batch->brief = (op == SERVE_OP_FIELDS);
+
+   /* without a spill file the answer has to fit into the buffer */
+   json_init(w, worker->spill, batch->outbuf, JSON_DEFAULT_BUFSIZE);
+
+   json_array_begin(w);
+   batch_process_data(batch, "request", payload, len);
+   json_array_end(w);
+
+   if (worker->spill >= 0)
+      end = lseek(worker->spill, 0, SEEK_CUR);
+
+   if (!w->error && end >= 0 && end + w->pos <= SERVE_MAX_ANSWER) {
+      *spilled = end;
+      return SERVE_STATUS_OK;
+   }
+
+   if (end != 0)
+      serve_spill_reset(worker);
+
+   *spilled = 0;
+   json_init(w, -1, batch->outbuf, JSON_DEFAULT_BUFSIZE);
+   json_raw(w, "answer too large", 16);
+
+   return SERVE_STATUS_ERROR;
+}
+
+/*
+ * writes the counters and latency histograms into the worker's writer
+ */
+static void serve_stats(serve_worker_t *worker)
+{
+   json_writer_t *w = &worker->batch.json;
+   guint entries;
+   gsize bytes;
+
+   json_init(w, -1, worker->batch.outbuf, JSON_DEFAULT_BUFSIZE);
+
+   g_mutex_lock(&serve_ctx.cache_lock);
+   entries = serve_ctx.lru.length;
+   bytes = serve_ctx.cache_bytes;
+   g_mutex_unlock(&serve_ctx.cache_lock);
+
+   g_mutex_lock(&serve_ctx.stats_lock);
+
+   json_object_begin(w);
+   json_member_uint(w, "uptime",
+         (g_get_monotonic_time() - serve_ctx.started) / G_USEC_PER_SEC);
+   json_member_uint(w, "connections", serve_ctx.connections);
+   json_member_uint(w, "requests", serve_ctx.requests);
+   json_member_uint(w, "errors", serve_ctx.errors);
+
+   json_key(w, "cache");
+   json_object_begin(w);
+   json_member_uint(w, "entries", entries);
+   json_member_uint(w, "capacity", SERVE_CACHE_ENTRIES);
+   json_member_uint(w, "bytes", bytes);
+   json_member_uint(w, "max_bytes", SERVE_CACHE_BYTES);
+   json_member_uint(w, "hits", serve_ctx.hits);
+   json_member_uint(w, "misses", serve_ctx.misses);
+   json_object_end(w);
+
+   json_key(w, "latency");
+   json_object_begin(w);
+   serve_emit_histogram(w, "json", serve_ctx.hist[SERVE_HIST_JSON]);
+   serve_emit_histogram(w, "fields", serve_ctx.hist[SERVE_HIST_FIELDS]);
+   json_object_end(w);
+
+   json_object_end(w);
+
+   g_mutex_unlock(&serve_ctx.stats_lock);
+}
+
+/*
+ * writes "key": {"count": .., "p50_us": .., "p99_us": .., "buckets": [..]}
+ *   - bucket n counts latencies below 2^n microseconds not counted
+ *     by a smaller bucket, only buckets in use are listed
+ *   - the percentiles are the upper bounds of their buckets
+ */
+static void serve_emit_histogram(json_writer_t *w, const gchar *key,
+                                 const guint64 *hist)
+{
+   guint64 count = 0, seen = 0;
+   guint64 p50 = 0, p99 = 0;
+   guint i;
+
+   for (i = 0; i < SERVE_HIST_BUCKETS; i++)
+      count += hist[i];
+
+   for (i = 0; i < SERVE_HIST_BUCKETS; i++) {
+      seen += hist[i];
+      if (p50 == 0 && seen * 2 >= count && hist[i])
+         p50 = G_GUINT64_CONSTANT(1) << i;
+      if (p99 == 0 && seen * 100 >= count * 99 && hist[i])
+         p99 = G_GUINT64_CONSTANT(1) << i;
+   }
+
+   json_key(w, key);
+   json_object_begin(w);
+   json_member_uint(w, "count", count);
+   json_member_uint(w, "p50_us", p50);
+   json_member_uint(w, "p99_us", p99);
+
+   json_key(w, "buckets");
+   json_array_begin(w);
+   for (i = 0; i < SERVE_HIST_BUCKETS; i++) {
+      if (hist[i] == 0)
+         continue;
+      json_object_begin(w);
+      json_member_uint(w, "lt_us", G_GUINT64_CONSTANT(1) << i);
+      json_member_uint(w, "count", hist[i]);
+      json_object_end(w);
+   }
+   json_array_end(w);
+
+   json_object_end(w);
+}
+
+/*
+ * counts a request; hist and hit are -1 for requests
+ * not going through the cache
+ */
+static void serve_account(gint hist, gint hit, guint8 status, gint64 elapsed)
+{
+   guint bucket;
+
+   /* latencies of up to 2^n - 1 us fall into bucket n */
+   bucket = elapsed > 0 ? g_bit_storage(elapsed) : 0;
+   bucket = MIN(bucket, SERVE_HIST_BUCKETS - 1);
+
+   g_mutex_lock(&serve_ctx.stats_lock);
+
+   serve_ctx.requests++;
+
+   if (status != SERVE_STATUS_OK)
+      serve_ctx.errors++;
+
+   if (hit == TRUE)
+      serve_ctx.hits++;
+   else if (hit == FALSE)
+      serve_ctx.misses++;
+
+   if (hist >= 0)
+      serve_ctx.hist[hist][bucket]++;
+
+   g_mutex_unlock(&serve_ctx.stats_lock);
+}
+
+/*
+ * reads exactly len bytes
+ *   - returns -E_NOTFOUND at the end of the connection or on timeout
+ */
+static int serve_read(gint fd, guchar *buf, gsize len)
+{
+   gssize ret;
+   gsize done = 0;
+
+   while (done < len) {
+      ret = read(fd, buf + done, len - done);
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret <= 0)
+         return -E_NOTFOUND;
+
+      done += ret;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * writes all of buf
+ */
+static int serve_write(gint fd, const guchar *buf, gsize len)
+{
+   gssize ret;
+   gsize done = 0;
+
+   while (done < len) {
+      ret = write(fd, buf + done, len - done);
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret < 0) {
+         DEBUG_MSG("serve_write: write failed: %s", strerror(errno));
+         return -E_INVALID;
+      }
+
+      done += ret;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * writes a response frame with one writev() in the common case
+ */
+static int serve_reply(gint fd, guint8 status, const guchar *body, gsize len)
+{
+   guint8 header[SERVE_HEADER_LEN + 1];
+   struct iovec iov[2];
+   guint32 length = GUINT32_TO_BE(len + 1);
+   guint i = 0;
+   gssize ret;
+
+   memcpy(header, &length, SERVE_HEADER_LEN);
+   header[SERVE_HEADER_LEN] = status;
+
+   iov[0].iov_base = header;
+   iov[0].iov_len = sizeof(header);
+   iov[1].iov_base = (guchar*)body;
+   iov[1].iov_len = len;
+
+   while (i < 2) {
+      ret = writev(fd, iov + i, 2 - i);
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret < 0) {
+         DEBUG_MSG("serve_reply: write failed: %s", strerror(errno));
+         return -E_INVALID;
+      }
+
+      /* skip what has been written */
+      while (i < 2 && (gsize)ret >= iov[i].iov_len) {
+         ret -= iov[i].iov_len;
+         i++;
+      }
+      if (i < 2) {
+         iov[i].iov_base = (guchar*)iov[i].iov_base + ret;
+         iov[i].iov_len -= ret;
+      }
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * writes a response frame whose body starts with the first spilled
+ * bytes of the spill file and continues with body
+ */
+static int serve_reply_spilled(gint fd, guint8 status, gint spill,
+                               gsize spilled, const guchar *body,
+                               gsize len)
+{
+   guint8 header[SERVE_HEADER_LEN + 1];
+   guint32 length = GUINT32_TO_BE(spilled + len + 1);
+   off_t offset = 0;
+   gssize ret;
+
+   memcpy(header, &length, SERVE_HEADER_LEN);
+   header[SERVE_HEADER_LEN] = status;
+
+   if (serve_write(fd, header, sizeof(header)) < 0)
+      return -E_INVALID;
+
+   /* straight from the page cache into the socket */
+   while ((gsize)offset < spilled) {
+      ret = sendfile(fd, spill, &offset, spilled - offset);
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret <= 0) {
+         DEBUG_MSG("serve_reply_spilled: sendfile failed: %s",
+               strerror(errno));
+         return -E_INVALID;
+      }
+   }
+
+   return serve_write(fd, body, len);
+}
+
+/*
+ * returns a reference to the cached answer and marks it recently used
+ */
+static GBytes* serve_cache_lookup(const guint8 *key, guint8 *status)
+{
+   serve_entry_t *entry;
+   GBytes *body = NULL;
+
+   g_mutex_lock(&serve_ctx.cache_lock);
+
+   if ((entry = g_hash_table_lookup(serve_ctx.cache, key)) != NULL) {
+      g_queue_unlink(&serve_ctx.lru, &entry->link);
+      g_queue_push_head_link(&serve_ctx.lru, &entry->link);
+      body = g_bytes_ref(entry->body);
+      *status = entry->status;
+   }
+
+   g_mutex_unlock(&serve_ctx.cache_lock);
+
+   return body;
+}
+
+/*
+ * keeps a copy of the answer, evicting the least recently used ones
+ * beyond SERVE_CACHE_ENTRIES or SERVE_CACHE_BYTES
+ */
+static void serve_cache_insert(const guint8 *key, guint8 status,
+                               const guchar *body, gsize len)
+{
+   serve_entry_t *entry, *old;
+   GList *link, *evicted = NULL;
+
+   entry = g_new0(serve_entry_t, 1);
+   memcpy(entry->key, key, SERVE_KEY_LEN);
+   entry->status = status;
+   entry->body = g_bytes_new(body, len);
+   entry->link.data = entry;
+
+   g_mutex_lock(&serve_ctx.cache_lock);
+
+   /* another worker has answered the same payload meanwhile */
+   if (g_hash_table_contains(serve_ctx.cache, entry->key)) {
+      g_mutex_unlock(&serve_ctx.cache_lock);
+      serve_entry_free(entry);
+      return;
+   }
+
+   g_hash_table_insert(serve_ctx.cache, entry->key, entry);
+   g_queue_push_head_link(&serve_ctx.lru, &entry->link);
+   serve_ctx.cache_bytes += len;
+
+   while (serve_ctx.lru.length > SERVE_CACHE_ENTRIES ||
+          serve_ctx.cache_bytes > SERVE_CACHE_BYTES) {
+      link = g_queue_pop_tail_link(&serve_ctx.lru);
+      old = link->data;
+      g_hash_table_remove(serve_ctx.cache, old->key);
+      serve_ctx.cache_bytes -= g_bytes_get_size(old->body);
+      /* the entry's own link is free to chain the evicted ones */
+      link->next = evicted;
+      evicted = link;
+   }
+
+   g_mutex_unlock(&serve_ctx.cache_lock);
+
+   while (evicted) {
+      link = evicted;
+      evicted = link->next;
+      serve_entry_free(link->data);
+   }
+}
+
+/* the keys are digests, any part of them hashes well */
+static guint serve_key_hash(gconstpointer key)
+{
+   guint hash;
+
+   memcpy(&hash, key, sizeof(hash));
+
+   return hash;
+}
+
+static gboolean serve_key_equal(gconstpointer a, gconstpointer b)
+{
+   return memcmp(a, b, SERVE_KEY_LEN) == 0;
+}
+
+static void serve_entry_free(gpointer data)
+{
+   serve_entry_t *entry = data;
+
+   g_bytes_unref(entry->body);
+   g_free(entry);
+}
+
+/*
+ * empties the spill file and returns its pages
+ */
+static void serve_spill_reset(serve_worker_t *worker)
+{
+   if (ftruncate(worker->spill, 0) < 0 ||
+       lseek(worker->spill, 0, SEEK_SET) < 0) {
+      DEBUG_MSG("serve_spill_reset: %s", strerror(errno));
+      /* large answers fail from now on rather than go astray */
+      close(worker->spill);
+      worker->spill = -1;
+   }
+}
+
+/*
+ * the parse state of the calling pool thread, created on first use
+ */
+static serve_worker_t* serve_worker_get(void)
+{
+   serve_worker_t *worker = g_private_get(&serve_worker);
+
+   if (worker == NULL) {
+      worker = g_new0(serve_worker_t, 1);
+      batch_init(&worker->batch, OUTPUT_JSON, -1);
+      worker->spill = memfd_create("certalize-answer", MFD_CLOEXEC);
+      asn1_index_set_limits(&worker->batch.tlv_index, serve_ctx.limits);
+      worker->digest = g_checksum_new(G_CHECKSUM_SHA256);
+      worker->request = g_byte_array_new();
+      g_private_set(&serve_worker, worker);
+   }
+
+   return worker;
+}
+
+static void serve_worker_free(gpointer data)
+{
+   serve_worker_t *worker = data;
+
+   batch_finish(&worker->batch);
+   g_checksum_free(worker->digest);
+   g_byte_array_free(worker->request, TRUE);
+   if (worker->spill >= 0)
+      close(worker->spill);
+   g_free(worker);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,355 @@
+/* sketch.c - mergeable summaries of fixed size
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_sketch.h>
+#include <certalize_debug.h>
+
+#include <math.h>
+
+/* globals    */
+
+/* prototypes */
+static gint qsketch_index(gint64 value);
+static void topk_insert(topk_t *t, const gchar *key, guint64 count);
+static void topk_decrement(topk_t *t, guint64 by);
+static gint topk_compare(gconstpointer a, gconstpointer b);
+static gint topk_compare_count(gconstpointer a, gconstpointer b);
+
+
+/*************/
+
+/*
+ * 64 bit FNV-1a, with the bits mixed once more at the end, since
+ * HyperLogLog takes the register from the upper bits
+ */
+guint64 sketch_hash(const guchar *data, gsize len)
+{
+   guint64 h = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+   gsize i;
+
+   for (i = 0; i < len; i++) {
+      h ^= data[i];
+      h *= G_GUINT64_CONSTANT(0x100000001b3);
+   }
+
+   /* splitmix64 finalizer */
+   h ^= h >> 30;
+   h *= G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+   h ^= h >> 27;
+   h *= G_GUINT64_CONSTANT(0x94d049bb133111eb);
+   h ^= h >> 31;
+
+   return h;
+}
+
+void hll_init(hll_t *hll)
+{
+   memset(hll, 0, sizeof(hll_t));
+}
+
+void hll_add(hll_t *hll, guint64 hash)
+{
+   guint index = hash >> (64 - HLL_PRECISION);
+   /* the marker bit limits the rank if the remaining bits are 0 */
+   guint64 rest = hash << HLL_PRECISION | (1ULL << (HLL_PRECISION - 1));
+   guint8 rank = __builtin_clzll(rest) + 1;
+
+   if (rank > hll->registers[index])
+      hll->registers[index] = rank;
+}
+
+void hll_merge(hll_t *hll, const hll_t *other)
+{
+   guint i;
+
+   for (i = 0; i < HLL_REGISTERS; i++)
+      if (other->registers[i] > hll->registers[i])
+         hll->registers[i] = other->registers[i];
+}
+
+/*
+ * estimated number of distinct hashes added; 64 bit hashes need no
+ * correction for large counts
+ */
+guint64 hll_count(const hll_t *hll)
+{
+   gdouble m = HLL_REGISTERS, sum = 0, estimate;
+   guint i, zeros = 0;
+
+   for (i = 0; i < HLL_REGISTERS; i++) {
+      sum += ldexp(1.0, -hll->registers[i]);
+      if (hll->registers[i] == 0)
+         zeros++;
+   }
+
+   estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+   /* small counts are told better by the empty registers */
+   if (estimate <= 2.5 * m && zeros)
+      estimate = m * log(m / zeros);
+
+   return (guint64)(estimate + 0.5);
+}
+
+void qsketch_init(qsketch_t *q)
+{
+   memset(q, 0, sizeof(qsketch_t));
+}
+
+void qsketch_add(qsketch_t *q, gint64 value)
+{
+   if (q->count == 0 || value < q->min)
+      q->min = value;
+   if (q->count == 0 || value > q->max)
+      q->max = value;
+   q->count++;
+
+   if (value < 0)
+      q->negative++;
+   else if (value == 0)
+      q->zero++;
+   else
+      q->buckets[qsketch_index(value)]++;
+}
+
+void qsketch_merge(qsketch_t *q, const qsketch_t *other)
+{
+   guint i;
+
+   if (other->count == 0)
+      return;
+
+   if (q->count == 0 || other->min < q->min)
+      q->min = other->min;
+   if (q->count == 0 || other->max > q->max)
+      q->max = other->max;
+
+   q->count += other->count;
+   q->zero += other->zero;
+   q->negative += other->negative;
+
+   for (i = 0; i < QSKETCH_BUCKETS; i++)
+      q->buckets[i] += other->buckets[i];
+}
+
+/*
+ * the value at rank 0.0 (minimum) to 1.0 (maximum); negative values
+ * are only known by the minimum
+ */
+gint64 qsketch_quantile(const qsketch_t *q, gdouble rank)
+{
+   gdouble gamma = (1 + QSKETCH_ACCURACY) / (1 - QSKETCH_ACCURACY);
+   guint64 target, seen;
+   gint64 value;
+   guint i;
+
+   if (q->count == 0)
+      return 0;
+
+   target = (guint64)(CLAMP(rank, 0.0, 1.0) * (q->count - 1));
+
+   if (target < q->negative)
+      return q->min;
+
+   seen = q->negative + q->zero;
+   if (target < seen)
+      return 0;
+
+   for (i = 0; i < QSKETCH_BUCKETS; i++) {
+      seen += q->buckets[i];
+      if (target < seen)
+         break;
+   }
+
+   /* the middle of the bucket in terms of relative error */
+   value = (gint64)(2 * pow(gamma, i) / (gamma + 1) + 0.5);
+
+   return CLAMP(value, q->min, q->max);
+}
+
+void topk_init(topk_t *t, guint k)
+{
+   t->k = k;
+   t->counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+   t->total = 0;
+}
+
+void topk_destroy(topk_t *t)
+{
+   g_hash_table_destroy(t->counts);
+}
+
+void topk_add(topk_t *t, const gchar *key)
+{
+   guint64 *count;
+
+   t->total++;
+
+   if ((count = g_hash_table_lookup(t->counts, key)) != NULL) {
+      (*count)++;
+      return;
+   }
+
+   if (g_hash_table_size(t->counts) < t->k) {
+      topk_insert(t, key, 1);
+      return;
+   }
+
+   /* no counter left: all of them, the new one included, drop by one */
+   topk_decrement(t, 1);
+}
+
+/*
+ * adds the counts of other; of more than k strings, the count of
+ * the (k+1)th most frequent is taken off all of them
+ */
+void topk_merge(topk_t *t, const topk_t *other)
+{
+   GHashTableIter iter;
+   gpointer key, value;
+   guint64 *count;
+   GArray *counts;
+
+   t->total += other->total;
+
+   g_hash_table_iter_init(&iter, other->counts);
+   while (g_hash_table_iter_next(&iter, &key, &value)) {
+      if ((count = g_hash_table_lookup(t->counts, key)) != NULL)
+         *count += *(guint64*)value;
+      else
+         topk_insert(t, key, *(guint64*)value);
+   }
+
+   if (g_hash_table_size(t->counts) <= t->k)
+      return;
+
+   counts = g_array_sized_new(FALSE, FALSE, sizeof(guint64),
+         g_hash_table_size(t->counts));
+
+   g_hash_table_iter_init(&iter, t->counts);
+   while (g_hash_table_iter_next(&iter, NULL, &value))
+      g_array_append_val(counts, *(guint64*)value);
+
+   g_array_sort(counts, topk_compare_count);
+   topk_decrement(t, g_array_index(counts, guint64, t->k));
+
+   g_array_free(counts, TRUE);
+}
+
+/*
+ * the strings kept, most frequent first; the keys are valid until
+ * the summary changes
+ */
+GArray* topk_sorted(const topk_t *t)
+{
+   GHashTableIter iter;
+   gpointer key, value;
+   topk_entry_t entry;
+   GArray *entries;
+
+   entries = g_array_sized_new(FALSE, FALSE, sizeof(topk_entry_t),
+         g_hash_table_size(t->counts));
+
+   g_hash_table_iter_init(&iter, t->counts);
+   while (g_hash_table_iter_next(&iter, &key, &value)) {
+      entry.key = key;
+      entry.count = *(guint64*)value;
+      g_array_append_val(entries, entry);
+   }
+
+   g_array_sort(entries, topk_compare);
+
+   return entries;
+}
+
+/*
+ * the occurrences not reflected in the counts kept: those of strings
+ * dropped and what has been taken off the others; 0 while no more
+ * than k distinct strings have been added
+ */
+guint64 topk_uncounted(const topk_t *t)
+{
+   GHashTableIter iter;
+   gpointer value;
+   guint64 counted = 0;
+
+   g_hash_table_iter_init(&iter, t->counts);
+   while (g_hash_table_iter_next(&iter, NULL, &value))
+      counted += *(guint64*)value;
+
+   return t->total - counted;
+}
+
+/*
+ * bucket i holds the values in (gamma^(i-1), gamma^i]
+ */
+static gint qsketch_index(gint64 value)
+{
+   gdouble gamma = (1 + QSKETCH_ACCURACY) / (1 - QSKETCH_ACCURACY);
+   gint i;
+
+   i = (gint)ceil(log((gdouble)value) / log(gamma));
+
+   return CLAMP(i, 0, QSKETCH_BUCKETS - 1);
+}
+
+static void topk_insert(topk_t *t, const gchar *key, guint64 count)
+{
+   guint64 *value = g_new(guint64, 1);
+
+   *value = count;
+   g_hash_table_insert(t->counts, g_strdup(key), value);
+}
+
+static void topk_decrement(topk_t *t, guint64 by)
+{
+   GHashTableIter iter;
+   gpointer value;
+
+   g_hash_table_iter_init(&iter, t->counts);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      if (*(guint64*)value <= by)
+         g_hash_table_iter_remove(&iter);
+      else
+         *(guint64*)value -= by;
+   }
+}
+
+static gint topk_compare(gconstpointer a, gconstpointer b)
+{
+   const topk_entry_t *x = a, *y = b;
+
+   if (x->count != y->count)
+      return x->count > y->count ? -1 : 1;
+
+   return strcmp(x->key, y->key);
+}
+
+/* descending */
+static gint topk_compare_count(gconstpointer a, gconstpointer b)
+{
+   guint64 x = *(const guint64*)a, y = *(const guint64*)b;
+
+   return x > y ? -1 : x < y;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
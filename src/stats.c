@@ -0,0 +1,599 @@
+/* stats.c - statistics of a corpus
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_stats.h>
+#include <certalize_sketch.h>
+#include <certalize_store.h>
+#include <certalize_stream.h>
+#include <certalize_loader.h>
+#include <certalize_index.h>
+#include <certalize_x509.h>
+#include <certalize_oid.h>
+#include <certalize_json.h>
+#include <certalize_debug.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/* globals    */
+
+/*
+ * what one worker thread has seen; the size does not depend on the
+ * number of certificates, only on the number of distinct algorithms
+ * and extensions
+ */
+typedef struct stats_acc {
+   asn1_index_t index;
+   cstream_t stream;
+   guint64 records;
+   /* records which are no certificates */
+   guint64 invalid;
+   /* files which could not be read completely */
+   guint64 errors;
+   /* exact up to STATS_TOP_COUNTS distinct names */
+   topk_t signatures;
+   topk_t keys;
+   topk_t extensions;
+   topk_t issuers;
+   hll_t issuer_names;
+   hll_t subject_names;
+   /* notAfter - notBefore in seconds */
+   qsketch_t validity;
+   /* certificates not matching are not counted */
+   filter_t *filter;
+   filter_fields_t fields;
+   const gchar *filename;
+} stats_acc_t;
+
+/* prototypes */
+static stats_acc_t* stats_acc_new(filter_t *filter,
+                                  const asn1_limits_t *limits);
+static void stats_acc_free(stats_acc_t *acc);
+static void stats_acc_merge(stats_acc_t *acc, stats_acc_t *other);
+static void stats_job_run(gpointer data, gpointer user_data);
+static int  stats_record(const guchar *der, gsize len, guint64 offset,
+                         gpointer data);
+static void stats_emit(stats_acc_t *acc);
+static void stats_emit_counts(json_writer_t *w, const gchar *key,
+                              topk_t *counts);
+static void stats_emit_entries(json_writer_t *w, const gchar *key,
+                               GArray *entries);
+static void stats_emit_validity(json_writer_t *w, qsketch_t *validity);
+static void stats_emit_days(json_writer_t *w, const gchar *key,
+                            gint64 seconds);
+static gboolean stats_is_store(const gchar *filename);
+static int  stats_store(const gchar *filename, filter_t *filter);
+static gint stats_compare(gconstpointer a, gconstpointer b);
+
+
+/*************/
+
+/*
+ * prints statistics of the certificates of all files and directories
+ * which match the filter, if any, as one JSON object; records
+ * exceeding the limits are counted as invalid
+ *
+ * the files are read by a thread pool; every thread adds up into an
+ * accumulator of its own, which are merged when all files are done
+ */
+int stats_run(GPtrArray *files, filter_t *filter,
+              const asn1_limits_t *limits)
+{
+   GAsyncQueue *accs;
+   GThreadPool *pool;
+   GPtrArray *inputs;
+   stats_acc_t *total, *acc;
+   guint i, threads;
+   int res;
+
+   inputs = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < files->len; i++)
+      loader_expand(inputs, g_ptr_array_index(files, i));
+
+   /* a column store is answered from its columns alone */
+   if (inputs->len == 1 && stats_is_store(g_ptr_array_index(inputs, 0))) {
+      res = stats_store(g_ptr_array_index(inputs, 0), filter);
+      g_ptr_array_free(inputs, TRUE);
+      return res;
+   }
+
+   /* a job takes an accumulator not in use by another thread */
+   threads = g_get_num_processors();
+   accs = g_async_queue_new();
+   for (i = 0; i < threads; i++)
+      g_async_queue_push(accs, stats_acc_new(filter, limits));
+
+   pool = g_thread_pool_new(stats_job_run, accs, threads, FALSE, NULL);
+
+   for (i = 0; i < inputs->len; i++)
+      g_thread_pool_push(pool, g_ptr_array_index(inputs, i), NULL);
+
+   g_thread_pool_free(pool, FALSE, TRUE);
+
+   total = g_async_queue_pop(accs);
+   while ((acc = g_async_queue_try_pop(accs)) != NULL) {
+      stats_acc_merge(total, acc);
+      stats_acc_free(acc);
+   }
+
+   stats_emit(total);
+
+   res = total->errors ? E_INVALID : E_SUCCESS;
+
+   stats_acc_free(total);
+   g_async_queue_unref(accs);
+   g_ptr_array_free(inputs, TRUE);
+
+   return res;
+}
+
+static stats_acc_t* stats_acc_new(filter_t *filter,
+                                  const asn1_limits_t *limits)
+{
+   stats_acc_t *acc = g_new0(stats_acc_t, 1);
+
+   asn1_index_init(&acc->index);
+   asn1_index_set_limits(&acc->index, limits);
+   cstream_init(&acc->stream, stats_record, acc);
+   topk_init(&acc->signatures, STATS_TOP_COUNTS);
+   topk_init(&acc->keys, STATS_TOP_COUNTS);
+   topk_init(&acc->extensions, STATS_TOP_COUNTS);
+   topk_init(&acc->issuers, STATS_TOP_ISSUERS);
+   hll_init(&acc->issuer_names);
+   hll_init(&acc->subject_names);
+   qsketch_init(&acc->validity);
+   acc->filter = filter;
+   filter_fields_init(&acc->fields);
+
+   return acc;
+}
+
+static void stats_acc_free(stats_acc_t *acc)
+{
+   asn1_index_destroy(&acc->index);
+   cstream_destroy(&acc->stream);
+   topk_destroy(&acc->signatures);
+   topk_destroy(&acc->keys);
+   topk_destroy(&acc->extensions);
+   topk_destroy(&acc->issuers);
+   filter_fields_destroy(&acc->fields);
+   g_free(acc);
+}
+
+static void stats_acc_merge(stats_acc_t *acc, stats_acc_t *other)
+{
+   acc->records += other->records;
+   acc->invalid += other->invalid;
+   acc->errors += other->errors;
+   topk_merge(&acc->signatures, &other->signatures);
+   topk_merge(&acc->keys, &other->keys);
+   topk_merge(&acc->extensions, &other->extensions);
+   topk_merge(&acc->issuers, &other->issuers);
+   hll_merge(&acc->issuer_names, &other->issuer_names);
+   hll_merge(&acc->subject_names, &other->subject_names);
+   qsketch_merge(&acc->validity, &other->validity);
+}
+
+/*
+ * worker: splits one input file into records
+ */
+static void stats_job_run(gpointer data, gpointer user_data)
+{
+   const gchar *filename = data;
+   GAsyncQueue *accs = user_data;
+   stats_acc_t *acc;
+
+   acc = g_async_queue_pop(accs);
+   acc->filename = filename;
+
+   if (loader_stream(filename, &acc->stream) < 0)
+      acc->errors++;
+
+   g_async_queue_push(accs, acc);
+}
+
+/*
+ * adds one record to the accumulator of the thread
+ */
+static int stats_record(const guchar *der, gsize len, guint64 offset,
+                        gpointer data)
+{
+   stats_acc_t *acc = data;
+   x509_cert_t cert;
+   x509_key_t key;
+   const oid_entry_t *entry;
+   asn1_tlv_t ext, oid;
+   asn1_oid_t value;
+   cbuf_t cbuf;
+   const gchar *name;
+   gchar tmp[X509_NAME_MAXLEN], label[X509_NAME_MAXLEN + 16];
+   int res;
+
+   if (der == NULL) {
+      acc->invalid++;
+      return E_SUCCESS;
+   }
+
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = (guchar*)der;
+   cbuf.length = len;
+
+   if (asn1_index_element(&acc->index, &cbuf, 0) < 0 ||
+       x509_parse_index(&cbuf, &acc->index, 0, &cert) < 0) {
+      acc->invalid++;
+      return E_SUCCESS;
+   }
+
+   if (acc->filter) {
+      filter_fields_decode(&acc->fields, filter_mask(acc->filter), &cbuf,
+            &cert, acc->filename, offset);
+      if (!filter_match(acc->filter, &acc->fields))
+         return E_SUCCESS;
+   }
+
+   acc->records++;
+
+   name = x509_algorithm_name(&cbuf, &cert.signature_algorithm, tmp,
+         sizeof(tmp));
+   topk_add(&acc->signatures, name ? name : "invalid");
+
+   /* keys by algorithm and size, e.g. "rsaEncryption 2048" */
+   name = x509_algorithm_name(&cbuf, &cert.spki_algorithm, tmp, sizeof(tmp));
+   if (name && x509_public_key(&cbuf, &cert, &key) == E_SUCCESS && key.bits)
+      g_snprintf(label, sizeof(label), "%s %u", name, key.bits);
+   else
+      g_strlcpy(label, name ? name : "invalid", sizeof(label));
+   topk_add(&acc->keys, label);
+
+   qsketch_add(&acc->validity, cert.not_after_time - cert.not_before_time);
+
+   /* distinct names by their encoding */
+   hll_add(&acc->issuer_names, sketch_hash(der + cert.issuer.offset,
+            cert.issuer.hdr_len + cert.issuer.length));
+   hll_add(&acc->subject_names, sketch_hash(der + cert.subject.offset,
+            cert.subject.hdr_len + cert.subject.length));
+
+   x509_name_to_string(&cbuf, &cert.issuer, tmp, sizeof(tmp));
+   topk_add(&acc->issuers, tmp);
+
+   if (cert.extensions.length == 0)
+      return E_SUCCESS;
+
+   /* Extension ::= SEQUENCE { extnID OBJECT IDENTIFIER, ... } */
+   for (res = asn1_first_child(&cbuf, &cert.extensions, &ext);
+        res == E_SUCCESS; res = asn1_next_child(&cbuf, &cert.extensions, &ext)) {
+
+      if (asn1_first_child(&cbuf, &ext, &oid) < 0 ||
+          !ASN1_IS(&oid, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID))
+         continue;
+
+      entry = oid_lookup(ASN1_CONTENT(&cbuf, &oid), oid.length);
+      if (entry) {
+         topk_add(&acc->extensions, entry->name);
+      }
+      else if (asn1_decode_oid(&cbuf, &oid, &value) == E_SUCCESS) {
+         asn1_oid_to_string(&value, tmp, sizeof(tmp));
+         topk_add(&acc->extensions, tmp);
+      }
+   }
+
+   return E_SUCCESS;
+}
+
+static void stats_emit(stats_acc_t *acc)
+{
+   json_writer_t w;
+   guchar *buffer;
+   GArray *top;
+   topk_entry_t *entry;
+   guint i;
+
+   buffer = g_malloc(JSON_DEFAULT_BUFSIZE);
+   json_init(&w, STDOUT_FILENO, buffer, JSON_DEFAULT_BUFSIZE);
+
+   json_object_begin(&w);
+   json_member_uint(&w, "certificates", acc->records);
+   json_member_uint(&w, "invalid", acc->invalid);
+
+   stats_emit_counts(&w, "signature_algorithms", &acc->signatures);
+   stats_emit_counts(&w, "public_keys", &acc->keys);
+
+   stats_emit_validity(&w, &acc->validity);
+
+   /* the counts of the top issuers are lower bounds */
+   json_key(&w, "issuers");
+   json_object_begin(&w);
+   json_member_uint(&w, "distinct", hll_count(&acc->issuer_names));
+   json_key(&w, "top");
+   json_array_begin(&w);
+   top = topk_sorted(&acc->issuers);
+   for (i = 0; i < top->len; i++) {
+      entry = &g_array_index(top, topk_entry_t, i);
+      json_object_begin(&w);
+      json_member_string(&w, "name", entry->key);
+      json_member_uint(&w, "count", entry->count);
+      json_object_end(&w);
+   }
+   g_array_free(top, TRUE);
+   json_array_end(&w);
+   json_object_end(&w);
+
+   json_key(&w, "subjects");
+   json_object_begin(&w);
+   json_member_uint(&w, "distinct", hll_count(&acc->subject_names));
+   json_object_end(&w);
+
+   stats_emit_counts(&w, "extensions", &acc->extensions);
+
+   json_object_end(&w);
+   json_newline(&w);
+   json_flush(&w);
+
+   g_free(buffer);
+}
+
+/*
+ * "key": { "name": count, ... }, most frequent first, followed by
+ * "key_uncounted": n; counts are lower bounds unless n is 0
+ */
+static void stats_emit_counts(json_writer_t *w, const gchar *key,
+                              topk_t *counts)
+{
+   GArray *entries;
+   gchar *uncounted;
+
+   entries = topk_sorted(counts);
+   stats_emit_entries(w, key, entries);
+   g_array_free(entries, TRUE);
+
+   uncounted = g_strconcat(key, "_uncounted", NULL);
+   json_member_uint(w, uncounted, topk_uncounted(counts));
+   g_free(uncounted);
+}
+
+static void stats_emit_entries(json_writer_t *w, const gchar *key,
+                               GArray *entries)
+{
+   topk_entry_t *entry;
+   guint i;
+
+   json_key(w, key);
+   json_object_begin(w);
+
+   for (i = 0; i < entries->len; i++) {
+      entry = &g_array_index(entries, topk_entry_t, i);
+      json_member_uint(w, entry->key, entry->count);
+   }
+
+   json_object_end(w);
+}
+
+static void stats_emit_validity(json_writer_t *w, qsketch_t *validity)
+{
+   json_key(w, "validity_days");
+   json_object_begin(w);
+   if (validity->count) {
+      stats_emit_days(w, "min", validity->min);
+      stats_emit_days(w, "p10", qsketch_quantile(validity, 0.10));
+      stats_emit_days(w, "p50", qsketch_quantile(validity, 0.50));
+      stats_emit_days(w, "p90", qsketch_quantile(validity, 0.90));
+      stats_emit_days(w, "p99", qsketch_quantile(validity, 0.99));
+      stats_emit_days(w, "max", validity->max);
+   }
+   json_member_uint(w, "negative", validity->negative);
+   json_object_end(w);
+}
+
+static void stats_emit_days(json_writer_t *w, const gchar *key,
+                            gint64 seconds)
+{
+   gchar tmp[G_ASCII_DTOSTR_BUF_SIZE];
+
+   g_ascii_formatd(tmp, sizeof(tmp), "%.1f", seconds / 86400.0);
+   json_key(w, key);
+   json_raw(w, tmp, strlen(tmp));
+}
+
+/*
+ * TRUE if the file starts like a column store
+ */
+static gboolean stats_is_store(const gchar *filename)
+{
+   guchar header[STORE_HEADER_SIZE];
+   gssize n;
+   gint fd;
+
+   if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+      return FALSE;
+
+   n = read(fd, header, sizeof(header));
+   close(fd);
+
+   return n == sizeof(header) && store_probe(header, n);
+}
+
+/*
+ * statistics of a column store, reading only the columns of names,
+ * keys and validity and those the filter refers to; the counts of issuers and subjects are exact,
+ * algorithms and extensions are not part of the store
+ */
+static int stats_store(const gchar *filename, filter_t *filter)
+{
+   filter_fields_t fields;
+   store_t store;
+   json_writer_t w;
+   qsketch_t validity;
+   GHashTable *keys;
+   GHashTableIter iter;
+   GPtrArray *labels;
+   GArray *entries;
+   topk_entry_t entry, *top;
+   guint64 *issuers, *subjects, row, names, i, distinct, matches = 0;
+   guint32 mask;
+   gpointer key, value;
+   guchar *buffer;
+   const guchar *name;
+   gsize len;
+   guint kb;
+
+   if (store_open(&store, filename) != E_SUCCESS)
+      return E_INVALID;
+
+   mask = filter ? filter_mask(filter) : 0;
+
+   if (store_load(&store, mask | STORE_MASK(STORE_COL_ISSUER) |
+          STORE_MASK(STORE_COL_SUBJECT) | STORE_MASK(STORE_COL_KEY_TYPE) |
+          STORE_MASK(STORE_COL_KEY_BITS) | STORE_MASK(STORE_COL_NOT_BEFORE) |
+          STORE_MASK(STORE_COL_NOT_AFTER)) != E_SUCCESS) {
+      g_printerr("%s: damaged column store\n", filename);
+      store_close(&store);
+      return E_INVALID;
+   }
+
+   names = store.columns[STORE_COL_NAMES].count;
+   issuers = g_new0(guint64, MAX(names, 1));
+   subjects = g_new0(guint64, MAX(names, 1));
+   /* key type << 24 | bits to count */
+   keys = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+   qsketch_init(&validity);
+   filter_fields_init(&fields);
+
+   for (row = 0; row < store.rows; row++) {
+      if (filter) {
+         filter_fields_load(&fields, mask, &store, row);
+         if (!filter_match(filter, &fields))
+            continue;
+      }
+      matches++;
+
+      i = STORE_U32(&store, STORE_COL_ISSUER, row);
+      if (i < names)
+         issuers[i]++;
+      i = STORE_U32(&store, STORE_COL_SUBJECT, row);
+      if (i < names)
+         subjects[i]++;
+
+      kb = STORE_U8(&store, STORE_COL_KEY_TYPE, row) << 24 |
+           MIN(STORE_U32(&store, STORE_COL_KEY_BITS, row), 0xffffff);
+      if ((value = g_hash_table_lookup(keys, GUINT_TO_POINTER(kb))) == NULL) {
+         value = g_new0(guint64, 1);
+         g_hash_table_insert(keys, GUINT_TO_POINTER(kb), value);
+      }
+      (*(guint64*)value)++;
+
+      qsketch_add(&validity, STORE_I64(&store, STORE_COL_NOT_AFTER, row) -
+            STORE_I64(&store, STORE_COL_NOT_BEFORE, row));
+   }
+
+   buffer = g_malloc(JSON_DEFAULT_BUFSIZE);
+   json_init(&w, STDOUT_FILENO, buffer, JSON_DEFAULT_BUFSIZE);
+   labels = g_ptr_array_new_with_free_func(g_free);
+   entries = g_array_new(FALSE, FALSE, sizeof(topk_entry_t));
+
+   json_object_begin(&w);
+   json_member_uint(&w, "certificates", matches);
+
+   /* keys by type and size, e.g. "RSA 2048" */
+   g_hash_table_iter_init(&iter, keys);
+   while (g_hash_table_iter_next(&iter, &key, &value)) {
+      kb = GPOINTER_TO_UINT(key);
+      if (kb & 0xffffff)
+         entry.key = g_strdup_printf("%s %u", x509_key_type_name(kb >> 24),
+               kb & 0xffffff);
+      else
+         entry.key = g_strdup(x509_key_type_name(kb >> 24));
+      entry.count = *(guint64*)value;
+      g_ptr_array_add(labels, (gpointer)entry.key);
+      g_array_append_val(entries, entry);
+   }
+   g_array_sort(entries, stats_compare);
+   stats_emit_entries(&w, "public_keys", entries);
+   g_array_set_size(entries, 0);
+
+   stats_emit_validity(&w, &validity);
+
+   distinct = 0;
+   for (i = 0; i < names; i++) {
+      if (issuers[i] == 0)
+         continue;
+      distinct++;
+      name = store_bytes(&store, STORE_COL_NAMES, i, &len);
+      entry.key = g_strndup((const gchar*)name, len);
+      entry.count = issuers[i];
+      g_ptr_array_add(labels, (gpointer)entry.key);
+      g_array_append_val(entries, entry);
+   }
+   g_array_sort(entries, stats_compare);
+
+   json_key(&w, "issuers");
+   json_object_begin(&w);
+   json_member_uint(&w, "distinct", distinct);
+   json_key(&w, "top");
+   json_array_begin(&w);
+   for (i = 0; i < MIN(entries->len, STATS_TOP_ISSUERS); i++) {
+      top = &g_array_index(entries, topk_entry_t, i);
+      json_object_begin(&w);
+      json_member_string(&w, "name", top->key);
+      json_member_uint(&w, "count", top->count);
+      json_object_end(&w);
+   }
+   json_array_end(&w);
+   json_object_end(&w);
+
+   distinct = 0;
+   for (i = 0; i < names; i++)
+      if (subjects[i])
+         distinct++;
+
+   json_key(&w, "subjects");
+   json_object_begin(&w);
+   json_member_uint(&w, "distinct", distinct);
+   json_object_end(&w);
+
+   json_object_end(&w);
+   json_newline(&w);
+   json_flush(&w);
+
+   g_array_free(entries, TRUE);
+   g_ptr_array_free(labels, TRUE);
+   g_hash_table_destroy(keys);
+   filter_fields_destroy(&fields);
+   g_free(issuers);
+   g_free(subjects);
+   g_free(buffer);
+   store_close(&store);
+
+   return E_SUCCESS;
+}
+
+/* by count, descending */
+static gint stats_compare(gconstpointer a, gconstpointer b)
+{
+   const topk_entry_t *x = a, *y = b;
+
+   if (x->count != y->count)
+      return x->count > y->count ? -1 : 1;
+
+   return strcmp(x->key, y->key);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,725 @@
+/* store.c - column store of extracted certificate fields
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <certalize.h>
+#include <certalize_store.h>
+#include <certalize_decomp.h>
+#include <certalize_debug.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#elif defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+/* globals    */
+
+/* bytes per value, 0 for columns of variable width */
+static const guint store_widths[STORE_COLUMNS] = {
+   [STORE_COL_FILE] = 4,
+   [STORE_COL_OFFSET] = 8,
+   [STORE_COL_SERIAL] = 0,
+   [STORE_COL_ISSUER] = 4,
+   [STORE_COL_SUBJECT] = 4,
+   [STORE_COL_NOT_BEFORE] = 8,
+   [STORE_COL_NOT_AFTER] = 8,
+   [STORE_COL_KEY_TYPE] = 1,
+   [STORE_COL_KEY_BITS] = 4,
+   [STORE_COL_SAN] = 0,
+   [STORE_COL_FINGERPRINT] = 32,
+   [STORE_COL_NAMES] = 0,
+   [STORE_COL_FILES] = 0,
+};
+
+static const gchar *store_names[STORE_COLUMNS] = {
+   [STORE_COL_FILE] = "file",
+   [STORE_COL_OFFSET] = "offset",
+   [STORE_COL_SERIAL] = "serial",
+   [STORE_COL_ISSUER] = "issuer",
+   [STORE_COL_SUBJECT] = "subject",
+   [STORE_COL_NOT_BEFORE] = "notBefore",
+   [STORE_COL_NOT_AFTER] = "notAfter",
+   [STORE_COL_KEY_TYPE] = "keyType",
+   [STORE_COL_KEY_BITS] = "keyBits",
+   [STORE_COL_SAN] = "san",
+   [STORE_COL_FINGERPRINT] = "fingerprint",
+   [STORE_COL_NAMES] = "names",
+   [STORE_COL_FILES] = "files",
+};
+
+/* prototypes */
+static void    store_put(store_writer_t *w, guint col, const void *value,
+                         gsize len);
+static void    store_put_u32(store_writer_t *w, guint col, guint32 value);
+static void    store_put_u64(store_writer_t *w, guint col, guint64 value);
+static void    store_end_value(store_writer_t *w, guint col);
+static guint32 store_dict(store_writer_t *w, GHashTable *dict, guint col,
+                          const gchar *str, gsize len);
+static guint32* store_merge_dict(store_writer_t *w, store_writer_t *other,
+                                 GHashTable *dict, guint col);
+static void    store_merge_refs(store_writer_t *w, store_writer_t *other,
+                                guint col, const guint32 *map);
+static guchar* store_serialize(store_writer_t *w, guint col, gsize *len);
+static guchar* store_compress(const guchar *raw, gsize len, guint *codec,
+                              gsize *outlen);
+static int     store_write_all(gint fd, const guchar *buf, gsize len);
+static int     store_check(store_t *store, guint col);
+
+
+/*************/
+
+void store_writer_init(store_writer_t *w)
+{
+   guint i;
+
+   memset(w, 0, sizeof(store_writer_t));
+
+   for (i = 0; i < STORE_COLUMNS; i++) {
+      w->data[i] = g_byte_array_new();
+      if (store_widths[i] == 0) {
+         w->offsets[i] = g_array_new(FALSE, FALSE, sizeof(guint64));
+         store_end_value(w, i);
+      }
+   }
+
+   w->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+   w->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+   w->digest = g_checksum_new(G_CHECKSUM_SHA256);
+}
+
+void store_writer_destroy(store_writer_t *w)
+{
+   guint i;
+
+   for (i = 0; i < STORE_COLUMNS; i++) {
+      g_byte_array_free(w->data[i], TRUE);
+      if (w->offsets[i])
+         g_array_free(w->offsets[i], TRUE);
+   }
+
+   g_hash_table_destroy(w->names);
+   g_hash_table_destroy(w->files);
+   g_checksum_free(w->digest);
+}
+
+/*
+ * appends the row of a parsed certificate, read from offset of file
+ */
+int store_writer_add(store_writer_t *w, cbuf_t *cbuf, x509_cert_t *cert,
+                     const gchar *file, guint64 offset)
+{
+   gchar name[X509_NAME_MAXLEN];
+   guint8 digest[32];
+   gsize len, digest_len = sizeof(digest);
+   x509_key_t key;
+   guint8 type;
+
+   if (!CBUF_HAS(cbuf, cert->certificate.offset,
+            cert->certificate.hdr_len + cert->certificate.length))
+      return -E_INVALID;
+
+   store_put_u32(w, STORE_COL_FILE,
+         store_dict(w, w->files, STORE_COL_FILES, file, strlen(file)));
+   store_put_u64(w, STORE_COL_OFFSET, offset);
+
+   if (cert->serial.length)
+      store_put(w, STORE_COL_SERIAL, ASN1_CONTENT(cbuf, &cert->serial),
+            cert->serial.length);
+   store_end_value(w, STORE_COL_SERIAL);
+
+   len = x509_name_to_string(cbuf, &cert->issuer, name, sizeof(name));
+   store_put_u32(w, STORE_COL_ISSUER,
+         store_dict(w, w->names, STORE_COL_NAMES, name, len));
+   len = x509_name_to_string(cbuf, &cert->subject, name, sizeof(name));
+   store_put_u32(w, STORE_COL_SUBJECT,
+         store_dict(w, w->names, STORE_COL_NAMES, name, len));
+
+   store_put_u64(w, STORE_COL_NOT_BEFORE, cert->not_before_time);
+   store_put_u64(w, STORE_COL_NOT_AFTER, cert->not_after_time);
+
+   if (x509_public_key(cbuf, cert, &key) < 0)
+      memset(&key, 0, sizeof(x509_key_t));
+   type = key.type;
+   store_put(w, STORE_COL_KEY_TYPE, &type, 1);
+   store_put_u32(w, STORE_COL_KEY_BITS, key.bits);
+
+   x509_subject_alt_names(cbuf, cert, w->data[STORE_COL_SAN]);
+   store_end_value(w, STORE_COL_SAN);
+
+   g_checksum_reset(w->digest);
+   g_checksum_update(w->digest, cbuf->buffer + cert->certificate.offset,
+         cert->certificate.hdr_len + cert->certificate.length);
+   g_checksum_get_digest(w->digest, digest, &digest_len);
+   store_put(w, STORE_COL_FINGERPRINT, digest, sizeof(digest));
+
+   w->rows++;
+
+   return E_SUCCESS;
+}
+
+/*
+ * appends the rows of other to w, with the file and name indices of
+ * other translated to those of w
+ */
+void store_writer_merge(store_writer_t *w, store_writer_t *other)
+{
+   guint64 base, offset;
+   guint32 *map;
+   guint i, col;
+
+   map = store_merge_dict(w, other, w->files, STORE_COL_FILES);
+   store_merge_refs(w, other, STORE_COL_FILE, map);
+   g_free(map);
+
+   map = store_merge_dict(w, other, w->names, STORE_COL_NAMES);
+   store_merge_refs(w, other, STORE_COL_ISSUER, map);
+   store_merge_refs(w, other, STORE_COL_SUBJECT, map);
+   g_free(map);
+
+   for (col = 0; col < STORE_COLUMNS; col++) {
+      switch (col) {
+         case STORE_COL_FILE:
+         case STORE_COL_ISSUER:
+         case STORE_COL_SUBJECT:
+         case STORE_COL_NAMES:
+         case STORE_COL_FILES:
+            continue;
+      }
+
+      if (store_widths[col]) {
+         g_byte_array_append(w->data[col], other->data[col]->data,
+               other->data[col]->len);
+         continue;
+      }
+
+      base = w->data[col]->len;
+      g_byte_array_append(w->data[col], other->data[col]->data,
+            other->data[col]->len);
+
+      for (i = 1; i < other->offsets[col]->len; i++) {
+         offset = base + g_array_index(other->offsets[col], guint64, i);
+         g_array_append_val(w->offsets[col], offset);
+      }
+   }
+
+   w->rows += other->rows;
+}
+
+/*
+ * writes the store to filename; it is written to a temporary file
+ * first, which replaces filename when complete
+ */
+int store_writer_save(store_writer_t *w, const gchar *filename)
+{
+   guchar header[STORE_HEADER_SIZE], entry[STORE_DIRENT_SIZE];
+   guchar *raw[STORE_COLUMNS], *stored[STORE_COLUMNS];
+   gsize raw_len[STORE_COLUMNS], stored_len[STORE_COLUMNS];
+   guint codec[STORE_COLUMNS];
+   guint64 offset, value, count;
+   guint32 word;
+   static const guchar pad[8];
+   gchar *tmp;
+   guint col;
+   gint fd;
+   int res = E_SUCCESS;
+
+   for (col = 0; col < STORE_COLUMNS; col++) {
+      raw[col] = store_serialize(w, col, &raw_len[col]);
+      stored[col] = store_compress(raw[col], raw_len[col], &codec[col],
+            &stored_len[col]);
+   }
+
+   tmp = g_strconcat(filename, ".tmp", NULL);
+
+   fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      g_printerr("creating '%s' failed: %s\n", tmp, g_strerror(errno));
+      res = -E_INVALID;
+      goto out;
+   }
+
+   memset(header, 0, sizeof(header));
+   memcpy(header, STORE_MAGIC, STORE_MAGIC_LEN);
+   word = GUINT32_TO_LE(STORE_VERSION);
+   memcpy(header + 8, &word, 4);
+   word = GUINT32_TO_LE(STORE_COLUMNS);
+   memcpy(header + 12, &word, 4);
+   value = GUINT64_TO_LE(w->rows);
+   memcpy(header + 16, &value, 8);
+   res = store_write_all(fd, header, sizeof(header));
+
+   offset = STORE_HEADER_SIZE + STORE_COLUMNS * STORE_DIRENT_SIZE;
+
+   for (col = 0; col < STORE_COLUMNS && res == E_SUCCESS; col++) {
+      count = store_widths[col] ? raw_len[col] / store_widths[col] :
+                                  w->offsets[col]->len - 1;
+
+      word = GUINT32_TO_LE(col);
+      memcpy(entry, &word, 4);
+      word = GUINT32_TO_LE(codec[col]);
+      memcpy(entry + 4, &word, 4);
+      value = GUINT64_TO_LE(offset);
+      memcpy(entry + 8, &value, 8);
+      value = GUINT64_TO_LE(stored_len[col]);
+      memcpy(entry + 16, &value, 8);
+      value = GUINT64_TO_LE(raw_len[col]);
+      memcpy(entry + 24, &value, 8);
+      value = GUINT64_TO_LE(count);
+      memcpy(entry + 32, &value, 8);
+
+      res = store_write_all(fd, entry, sizeof(entry));
+      offset += (stored_len[col] + 7) & ~(guint64)7;
+   }
+
+   for (col = 0; col < STORE_COLUMNS && res == E_SUCCESS; col++) {
+      res = store_write_all(fd, stored[col], stored_len[col]);
+      if (res == E_SUCCESS && stored_len[col] % 8)
+         res = store_write_all(fd, pad, 8 - stored_len[col] % 8);
+   }
+
+   if (close(fd) < 0 && res == E_SUCCESS) {
+      g_printerr("writing '%s' failed: %s\n", tmp, g_strerror(errno));
+      res = -E_INVALID;
+   }
+
+   if (res == E_SUCCESS && rename(tmp, filename) < 0) {
+      g_printerr("renaming '%s' failed: %s\n", tmp, g_strerror(errno));
+      res = -E_INVALID;
+   }
+
+   if (res != E_SUCCESS)
+      unlink(tmp);
+
+out:
+   for (col = 0; col < STORE_COLUMNS; col++) {
+      if (stored[col] != raw[col])
+         g_free(stored[col]);
+      g_free(raw[col]);
+   }
+   g_free(tmp);
+
+   return res;
+}
+
+/*
+ * TRUE if data starts like a column store
+ */
+gboolean store_probe(const guchar *data, gsize len)
+{
+   return len >= STORE_HEADER_SIZE &&
+          memcmp(data, STORE_MAGIC, STORE_MAGIC_LEN) == 0;
+}
+
+/*
+ * maps a store and reads its directory; no column is loaded yet
+ */
+int store_open(store_t *store, const gchar *filename)
+{
+   GError *error = NULL;
+   const guchar *data, *entry;
+   gsize length;
+   guint32 columns, id, i;
+   guint64 offset, size;
+
+   memset(store, 0, sizeof(store_t));
+
+   if ((store->map = g_mapped_file_new(filename, FALSE, &error)) == NULL) {
+      g_printerr("reading file '%s' failed: '%s'\n", filename,
+            error->message);
+      g_error_free(error);
+      return -E_NOTFOUND;
+   }
+
+   data = (const guchar*)g_mapped_file_get_contents(store->map);
+   length = g_mapped_file_get_length(store->map);
+
+   if (!store_probe(data, length))
+      goto invalid;
+
+   if (GUINT32_FROM_LE(*(const guint32*)(data + 8)) != STORE_VERSION) {
+      g_printerr("%s: unsupported column store version\n", filename);
+      store_close(store);
+      return -E_VERSION;
+   }
+
+   columns = GUINT32_FROM_LE(*(const guint32*)(data + 12));
+   store->rows = GUINT64_FROM_LE(*(const guint64*)(data + 16));
+
+   if (columns > (length - STORE_HEADER_SIZE) / STORE_DIRENT_SIZE)
+      goto invalid;
+
+   for (i = 0; i < columns; i++) {
+      entry = data + STORE_HEADER_SIZE + i * STORE_DIRENT_SIZE;
+      id = GUINT32_FROM_LE(*(const guint32*)entry);
+      offset = GUINT64_FROM_LE(*(const guint64*)(entry + 8));
+      size = GUINT64_FROM_LE(*(const guint64*)(entry + 16));
+
+      if (offset > length || size > length - offset)
+         goto invalid;
+
+      /* columns of later versions are skipped */
+      if (id < STORE_COLUMNS)
+         store->entries[id] = entry;
+   }
+
+   return E_SUCCESS;
+
+invalid:
+   g_printerr("%s: not a valid column store\n", filename);
+   store_close(store);
+   return -E_INVALID;
+}
+
+/*
+ * makes the columns of mask available, decompressing those which
+ * are not loaded yet; the dictionaries of file and name columns are
+ * loaded with them
+ */
+int store_load(store_t *store, guint32 mask)
+{
+   const guchar *entry, *data;
+   store_column_t *column;
+   guint64 offset, length;
+   guint codec, format, col;
+   gsize size;
+   int res;
+
+   data = (const guchar*)g_mapped_file_get_contents(store->map);
+
+   /* along with the dictionaries the indices refer to */
+   if (mask & STORE_MASK(STORE_COL_FILE))
+      mask |= STORE_MASK(STORE_COL_FILES);
+   if (mask & (STORE_MASK(STORE_COL_ISSUER) | STORE_MASK(STORE_COL_SUBJECT)))
+      mask |= STORE_MASK(STORE_COL_NAMES);
+
+   for (col = 0; col < STORE_COLUMNS; col++) {
+      column = &store->columns[col];
+      if (!(mask & STORE_MASK(col)) || column->loaded)
+         continue;
+
+      if ((entry = store->entries[col]) == NULL)
+         return -E_NOTFOUND;
+
+      codec = GUINT32_FROM_LE(*(const guint32*)(entry + 4));
+      offset = GUINT64_FROM_LE(*(const guint64*)(entry + 8));
+      length = GUINT64_FROM_LE(*(const guint64*)(entry + 16));
+      size = GUINT64_FROM_LE(*(const guint64*)(entry + 24));
+      column->count = GUINT64_FROM_LE(*(const guint64*)(entry + 32));
+
+      switch (codec) {
+         case STORE_CODEC_NONE:
+            /* the values are read in place */
+            if (offset % 8 || length != size)
+               return -E_INVALID;
+            column->data = data + offset;
+            column->size = length;
+            break;
+
+         case STORE_CODEC_GZIP:
+         case STORE_CODEC_ZSTD:
+            format = codec == STORE_CODEC_GZIP ? DECOMP_GZIP : DECOMP_ZSTD;
+            /* the column can not expand beyond its stated size */
+            column->owned = decomp_buffer(format, data + offset, length,
+                  MAX(size, 1), &column->size);
+            if (column->owned == NULL)
+               return -E_NOTHANDLED;
+            column->data = column->owned;
+            if (column->size != size)
+               return -E_INVALID;
+            break;
+
+         default:
+            return -E_NOTHANDLED;
+      }
+
+      if ((res = store_check(store, col)) != E_SUCCESS)
+         return res;
+
+      column->loaded = TRUE;
+   }
+
+   return E_SUCCESS;
+}
+
+void store_close(store_t *store)
+{
+   guint col;
+
+   for (col = 0; col < STORE_COLUMNS; col++)
+      g_free(store->columns[col].owned);
+
+   if (store->map)
+      g_mapped_file_unref(store->map);
+
+   memset(store, 0, sizeof(store_t));
+}
+
+/*
+ * the value of row in a loaded column of variable width
+ */
+const guchar* store_bytes(store_t *store, guint col, guint64 row, gsize *len)
+{
+   store_column_t *column = &store->columns[col];
+   const guint64 *offsets = (const guint64*)column->data;
+   guint64 start = GUINT64_FROM_LE(offsets[row]);
+
+   *len = GUINT64_FROM_LE(offsets[row + 1]) - start;
+
+   return column->data + (column->count + 1) * 8 + start;
+}
+
+const gchar* store_column_name(guint col)
+{
+   return col < STORE_COLUMNS ? store_names[col] : NULL;
+}
+
+static void store_put(store_writer_t *w, guint col, const void *value,
+                      gsize len)
+{
+   g_byte_array_append(w->data[col], value, len);
+}
+
+static void store_put_u32(store_writer_t *w, guint col, guint32 value)
+{
+   value = GUINT32_TO_LE(value);
+   store_put(w, col, &value, sizeof(value));
+}
+
+static void store_put_u64(store_writer_t *w, guint col, guint64 value)
+{
+   value = GUINT64_TO_LE(value);
+   store_put(w, col, &value, sizeof(value));
+}
+
+/*
+ * closes the current value of a column of variable width
+ */
+static void store_end_value(store_writer_t *w, guint col)
+{
+   guint64 offset = w->data[col]->len;
+
+   g_array_append_val(w->offsets[col], offset);
+}
+
+/*
+ * index of str in the dictionary column, added if it is new
+ */
+static guint32 store_dict(store_writer_t *w, GHashTable *dict, guint col,
+                          const gchar *str, gsize len)
+{
+   gchar *key = g_strndup(str, len);
+   gpointer value;
+   guint32 index;
+
+   if ((value = g_hash_table_lookup(dict, key)) != NULL) {
+      g_free(key);
+      return GPOINTER_TO_UINT(value) - 1;
+   }
+
+   index = w->offsets[col]->len - 1;
+   store_put(w, col, str, len);
+   store_end_value(w, col);
+   g_hash_table_insert(dict, key, GUINT_TO_POINTER(index + 1));
+
+   return index;
+}
+
+/*
+ * adds the dictionary of other to w; returns the index in w of each
+ * index in other
+ */
+static guint32* store_merge_dict(store_writer_t *w, store_writer_t *other,
+                                 GHashTable *dict, guint col)
+{
+   GArray *offsets = other->offsets[col];
+   guint64 start, i;
+   guint32 *map;
+
+   map = g_new(guint32, offsets->len);
+
+   for (i = 0; i + 1 < offsets->len; i++) {
+      start = g_array_index(offsets, guint64, i);
+      map[i] = store_dict(w, dict, col,
+            (const gchar*)other->data[col]->data + start,
+            g_array_index(offsets, guint64, i + 1) - start);
+   }
+
+   return map;
+}
+
+/*
+ * appends the dictionary indices of col in other, translated by map
+ */
+static void store_merge_refs(store_writer_t *w, store_writer_t *other,
+                             guint col, const guint32 *map)
+{
+   const guint32 *values = (const guint32*)other->data[col]->data;
+   guint64 i;
+
+   for (i = 0; i < other->rows; i++)
+      store_put_u32(w, col, map[GUINT32_FROM_LE(values[i])]);
+}
+
+/*
+ * the column as stored in the file, before compression
+ */
+static guchar* store_serialize(store_writer_t *w, guint col, gsize *len)
+{
+   GArray *offsets = w->offsets[col];
+   guint64 *out;
+   guint i;
+
+   if (store_widths[col]) {
+      *len = w->data[col]->len;
+      out = g_malloc(MAX(*len, 1));
+      memcpy(out, w->data[col]->data, *len);
+      return (guchar*)out;
+   }
+
+   *len = offsets->len * 8 + w->data[col]->len;
+   out = g_malloc(*len);
+
+   for (i = 0; i < offsets->len; i++)
+      out[i] = GUINT64_TO_LE(g_array_index(offsets, guint64, i));
+   memcpy(out + offsets->len, w->data[col]->data, w->data[col]->len);
+
+   return (guchar*)out;
+}
+
+/*
+ * compresses a column with zstd or else gzip; raw itself is returned
+ * if neither is available or it does not get smaller
+ */
+static guchar* store_compress(const guchar *raw, gsize len, guint *codec,
+                              gsize *outlen)
+{
+   guchar *out = NULL;
+
+   *codec = STORE_CODEC_NONE;
+   *outlen = len;
+
+   if (len < STORE_COMPRESS_MIN)
+      return (guchar*)raw;
+
+#ifdef HAVE_ZSTD
+   {
+      gsize bound = ZSTD_compressBound(len), n;
+
+      out = g_malloc(bound);
+      n = ZSTD_compress(out, bound, raw, len, 3);
+      if (!ZSTD_isError(n) && n < len) {
+         *codec = STORE_CODEC_ZSTD;
+         *outlen = n;
+         return out;
+      }
+   }
+#elif defined(HAVE_ZLIB)
+   {
+      z_stream z;
+      gsize bound;
+
+      memset(&z, 0, sizeof(z));
+      /* with a gzip header, as decomp_run() expects */
+      if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+               8, Z_DEFAULT_STRATEGY) == Z_OK) {
+         bound = deflateBound(&z, len);
+         if (bound <= G_MAXUINT32 && len <= G_MAXUINT32) {
+            out = g_malloc(bound);
+            z.next_in = (Bytef*)raw;
+            z.avail_in = len;
+            z.next_out = out;
+            z.avail_out = bound;
+            if (deflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out < len) {
+               *codec = STORE_CODEC_GZIP;
+               *outlen = z.total_out;
+               deflateEnd(&z);
+               return out;
+            }
+         }
+         deflateEnd(&z);
+      }
+   }
+#endif
+
+   g_free(out);
+
+   return (guchar*)raw;
+}
+
+static int store_write_all(gint fd, const guchar *buf, gsize len)
+{
+   gssize n;
+
+   while (len) {
+      n = write(fd, buf, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n < 0) {
+         g_printerr("writing column store failed: %s\n", g_strerror(errno));
+         return -E_INVALID;
+      }
+      buf += n;
+      len -= n;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * a loaded column must hold as many values as there are rows, and
+ * the offsets of a column of variable width must stay within it
+ */
+static int store_check(store_t *store, guint col)
+{
+   store_column_t *column = &store->columns[col];
+   const guint64 *offsets;
+   guint64 i, prev = 0, next, bytes;
+
+   if (col != STORE_COL_NAMES && col != STORE_COL_FILES &&
+       column->count != store->rows)
+      return -E_INVALID;
+
+   if (store_widths[col])
+      return column->size / store_widths[col] == column->count &&
+             column->size % store_widths[col] == 0 ? E_SUCCESS : -E_INVALID;
+
+   if (column->count >= column->size / 8)
+      return -E_INVALID;
+
+   offsets = (const guint64*)column->data;
+   bytes = column->size - (column->count + 1) * 8;
+
+   for (i = 0; i <= column->count; i++) {
+      next = GUINT64_FROM_LE(offsets[i]);
+      if (next < prev || next > bytes || (i == 0 && next != 0))
+         return -E_INVALID;
+      prev = next;
+   }
+
+   return E_SUCCESS;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,437 @@
+/* stream.c - splitting streams of concatenated DER and PEM records
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_stream.h>
+#include <certalize_base64.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+
+/* globals    */
+
+/* states of a PEM block */
+enum {
+   PEM_OUTSIDE = 0,
+   PEM_CERTIFICATE,
+   PEM_OTHER,
+};
+
+/* labels of the PEM blocks holding a certificate */
+static const gchar *cstream_pem_labels[] = {
+   "CERTIFICATE",
+   "X509 CERTIFICATE",
+   "TRUSTED CERTIFICATE",
+};
+
+/* base64 of the largest record */
+#define CSTREAM_MAX_BASE64          (CSTREAM_MAX_RECORD / 3 * 4 + 4)
+
+/* prototypes */
+static int cstream_der(cstream_t *stream, const guchar *buf, gsize len,
+                       gsize *used);
+static int cstream_der_header(const guchar *head, gsize len);
+static int cstream_text(cstream_t *stream, const guchar *buf, gsize len);
+static int cstream_pem_line(cstream_t *stream);
+static gboolean cstream_pem_certificate(const gchar *line);
+
+
+/*************/
+
+void cstream_init(cstream_t *stream, cstream_record_cb callback,
+                  gpointer data)
+{
+   memset(stream, 0, sizeof(cstream_t));
+
+   stream->mode = CSTREAM_DETECT;
+   stream->boundary = TRUE;
+   stream->record = g_byte_array_new();
+   stream->line = g_string_sized_new(128);
+   stream->base64 = g_string_sized_new(4096);
+   stream->callback = callback;
+   stream->data = data;
+}
+
+/*
+ * starts over with a new stream, keeping the buffers
+ */
+void cstream_reset(cstream_t *stream)
+{
+   stream->mode = CSTREAM_DETECT;
+   stream->boundary = TRUE;
+   stream->head_len = 0;
+   stream->offset = 0;
+   stream->record_offset = 0;
+   stream->line_offset = 0;
+   stream->pem_state = PEM_OUTSIDE;
+   g_byte_array_set_size(stream->record, 0);
+   g_string_truncate(stream->line, 0);
+   g_string_truncate(stream->base64, 0);
+}
+
+void cstream_destroy(cstream_t *stream)
+{
+   g_byte_array_free(stream->record, TRUE);
+   g_string_free(stream->line, TRUE);
+   g_string_free(stream->base64, TRUE);
+}
+
+/*
+ * feeds the next chunk of the stream;
+ * every record completed by it is handed to the callback right away
+ *
+ * PEM records which fail to decode are reported with a NULL buffer,
+ * broken DER framing can not be recovered from and is returned
+ * as error
+ *
+ * DER is only taken at the start, after another record or after
+ * whitespace following one, and only if a SEQUENCE header follows;
+ * anything else is text, so lines of text starting with '0' (0x30)
+ * like the hex dumps of 'openssl x509 -text' stay text
+ */
+int cstream_feed(cstream_t *stream, const guchar *buf, gsize len)
+{
+   const guchar *eol;
+   gsize pos = 0, used, n;
+   int res;
+
+   while (pos < len) {
+
+      switch (stream->mode) {
+
+         case CSTREAM_DETECT:
+            if (stream->head_len == 0) {
+               /* skip whitespace between records */
+               if (g_ascii_isspace(buf[pos])) {
+                  pos++;
+                  stream->offset++;
+                  break;
+               }
+
+               stream->record_offset = stream->offset;
+
+               if (buf[pos] != 0x30 || !stream->boundary) {
+                  /* PEM or text preceding it */
+                  if ((res = cstream_text(stream, NULL, 0)) < 0)
+                     return res;
+                  break;
+               }
+            }
+
+            /* the header of a SEQUENCE may be split over chunks */
+            stream->head[stream->head_len++] = buf[pos++];
+            stream->offset++;
+
+            res = cstream_der_header(stream->head, stream->head_len);
+            if (res == 0)
+               break;
+
+            n = stream->head_len;
+            stream->head_len = 0;
+
+            if (res < 0) {
+               if ((res = cstream_text(stream, stream->head, n)) < 0)
+                  return res;
+               break;
+            }
+
+            /* DER encoded SEQUENCE */
+            stream->mode = CSTREAM_DER;
+            asn1_stream_init(&stream->asn1, NULL, NULL);
+            g_byte_array_set_size(stream->record, 0);
+
+            /* a complete header, shorter than any element */
+            if ((res = cstream_der(stream, stream->head, n, &used)) < 0)
+               return res;
+            break;
+
+         case CSTREAM_DER:
+            if ((res = cstream_der(stream, buf + pos, len - pos, &used)) < 0)
+               return res;
+
+            pos += used;
+            stream->offset += used;
+            break;
+
+         case CSTREAM_PEM:
+            /* PEM is processed line by line */
+            eol = memchr(buf + pos, '\n', len - pos);
+            n = eol ? (gsize)(eol - (buf + pos)) + 1 : len - pos;
+
+            if (stream->line->len + n > CSTREAM_MAX_LINE)
+               return -E_INVALID;
+
+            if (stream->line->len == 0)
+               stream->line_offset = stream->offset;
+
+            g_string_append_len(stream->line, (const gchar*)buf + pos, n);
+            pos += n;
+            stream->offset += n;
+
+            if (eol && (res = cstream_pem_line(stream)) < 0)
+               return res;
+            break;
+      }
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * the stream has ended; a pending record is truncated
+ */
+int cstream_finish(cstream_t *stream)
+{
+   int res;
+
+   /* the last PEM line may lack its line feed */
+   if (stream->mode == CSTREAM_PEM && stream->line->len) {
+      if ((res = cstream_pem_line(stream)) < 0)
+         return res;
+   }
+
+   if (stream->mode != CSTREAM_DETECT || stream->head_len) {
+      DEBUG_MSG("cstream_finish: truncated record at %lu",
+            stream->record_offset);
+      return -E_INVALID;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * reads the stream from fd in chunks until end of file;
+ * idle is called whenever the next read may block
+ */
+int cstream_read_fd(cstream_t *stream, gint fd,
+                    void (*idle)(gpointer), gpointer data)
+{
+   guchar *buf;
+   gssize len;
+   int res = E_SUCCESS;
+
+   buf = g_malloc(CSTREAM_READ_SIZE);
+
+   for (;;) {
+      if (idle)
+         idle(data);
+
+      len = read(fd, buf, CSTREAM_READ_SIZE);
+      if (len < 0) {
+         if (errno == EINTR)
+            continue;
+         g_printerr("reading stream failed: %s\n", g_strerror(errno));
+         res = -E_INVALID;
+         break;
+      }
+
+      if (len == 0) {
+         res = cstream_finish(stream);
+         break;
+      }
+
+      if ((res = cstream_feed(stream, buf, len)) < 0)
+         break;
+   }
+
+   g_free(buf);
+
+   return res;
+}
+
+/*
+ * feeds DER of the current record, used tells how much of it belongs
+ * to the record
+ */
+static int cstream_der(cstream_t *stream, const guchar *buf, gsize len,
+                       gsize *used)
+{
+   int res;
+
+   res = asn1_stream_feed(&stream->asn1, buf, len, used);
+   if (res < 0)
+      return res;
+
+   /*
+    * a record announcing more than it may hold is rejected
+    * at its header rather than after being buffered
+    */
+   if (stream->record->len + *used > CSTREAM_MAX_RECORD ||
+       (stream->asn1.depth &&
+        ASN1_END(&stream->asn1.stack[0]) > CSTREAM_MAX_RECORD))
+      return -E_INVALID;
+
+   g_byte_array_append(stream->record, buf, *used);
+
+   if (res == ASN1_ELEMENT_COMPLETE) {
+      stream->mode = CSTREAM_DETECT;
+      stream->boundary = TRUE;
+      stream->record_mode = CSTREAM_DER;
+      res = stream->callback(stream->record->data, stream->record->len,
+            stream->record_offset, stream->data);
+      if (res < 0)
+         return res;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * whether the bytes starting with 0x30 are the header of a SEQUENCE:
+ * > 0 if so, 0 if more are needed, < 0 if they are text
+ *   - a long form length is minimal and of at most 4 octets
+ *   - a short form length, which text can produce as well, is followed
+ *     by a SEQUENCE, a SET or a byte no text has
+ */
+static int cstream_der_header(const guchar *head, gsize len)
+{
+   gsize n;
+
+   if (len < 2)
+      return 0;
+
+   if (head[1] < 0x80) {
+      if (head[1] == 0)
+         return 1;
+      if (len < 3)
+         return 0;
+      if (head[2] == 0x30 || head[2] == 0x31 ||
+          !(g_ascii_isprint(head[2]) || g_ascii_isspace(head[2])))
+         return 1;
+      return -1;
+   }
+
+   /* indefinite lengths are no DER */
+   n = head[1] & 0x7f;
+   if (n == 0 || n > 4)
+      return -1;
+
+   if (len < 3)
+      return 0;
+
+   if (head[2] == 0 || (n == 1 && head[2] < 0x80))
+      return -1;
+
+   return len < 2 + n ? 0 : 1;
+}
+
+/*
+ * switches to PEM or text preceding it, starting the line with the
+ * bytes already taken
+ */
+static int cstream_text(cstream_t *stream, const guchar *buf, gsize len)
+{
+   stream->mode = CSTREAM_PEM;
+   stream->pem_state = PEM_OUTSIDE;
+   stream->line_offset = stream->record_offset;
+   g_string_truncate(stream->line, 0);
+   g_string_append_len(stream->line, (const gchar*)buf, len);
+
+   /* a header rejected at its line feed */
+   if (len && buf[len - 1] == '\n')
+      return cstream_pem_line(stream);
+
+   return E_SUCCESS;
+}
+
+/*
+ * processes one complete line of PEM
+ */
+static int cstream_pem_line(cstream_t *stream)
+{
+   GString *line = stream->line;
+   gssize dlen;
+   gsize i;
+   int res = E_SUCCESS;
+
+   g_strchomp(line->str);
+   line->len = strlen(line->str);
+
+   if (g_str_has_prefix(line->str, "-----BEGIN ")) {
+      stream->record_offset = stream->line_offset;
+      stream->pem_state = cstream_pem_certificate(line->str) ?
+         PEM_CERTIFICATE : PEM_OTHER;
+      g_string_truncate(stream->base64, 0);
+   }
+   else if (g_str_has_prefix(line->str, "-----END ")) {
+
+      if (stream->pem_state == PEM_CERTIFICATE) {
+         stream->record_mode = CSTREAM_PEM;
+         g_byte_array_set_size(stream->record, (stream->base64->len / 4) * 3);
+         dlen = base64_decode(stream->base64->str, stream->base64->len,
+               (gchar*)stream->record->data);
+
+         if (dlen < 0)
+            res = stream->callback(NULL, 0, stream->record_offset,
+                  stream->data);
+         else
+            res = stream->callback(stream->record->data, dlen,
+                  stream->record_offset, stream->data);
+      }
+
+      stream->pem_state = PEM_OUTSIDE;
+      stream->mode = CSTREAM_DETECT;
+      stream->boundary = TRUE;
+   }
+   else if (stream->pem_state == PEM_CERTIFICATE && !strchr(line->str, ':')) {
+      /* an unterminated block is rejected like an oversized record */
+      if (stream->base64->len + line->len > CSTREAM_MAX_BASE64)
+         res = -E_INVALID;
+
+      /* base64 content, encapsulated headers are skipped */
+      for (i = 0; res == E_SUCCESS && i < line->len; i++)
+         if (!g_ascii_isspace(line->str[i]))
+            g_string_append_c(stream->base64, line->str[i]);
+   }
+   else if (stream->pem_state == PEM_OUTSIDE) {
+      /* explanatory text between records, no DER follows it */
+      stream->mode = CSTREAM_DETECT;
+      stream->boundary = FALSE;
+   }
+
+   g_string_truncate(line, 0);
+
+   return res;
+}
+
+/*
+ * whether "-----BEGIN LABEL-----" is one of the certificate labels,
+ * other labels merely containing them like "CERTIFICATE REQUEST" are not
+ */
+static gboolean cstream_pem_certificate(const gchar *line)
+{
+   const gchar *label = line + strlen("-----BEGIN ");
+   gsize len, i;
+
+   if (!g_str_has_suffix(label, "-----"))
+      return FALSE;
+
+   len = strlen(label) - strlen("-----");
+
+   for (i = 0; i < G_N_ELEMENTS(cstream_pem_labels); i++)
+      if (strlen(cstream_pem_labels[i]) == len &&
+          !strncmp(label, cstream_pem_labels[i], len))
+         return TRUE;
+
+   return FALSE;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
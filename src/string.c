@@ -0,0 +1,323 @@
+/* string.c - ASN.1 character strings to UTF-8
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_string.h>
+#include <certalize_debug.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* globals    */
+
+#ifdef __SSE2__
+/* bytes lo to hi; bytes from 0x80 compare negative and never match */
+#define STRING_RANGE(v, lo, hi) \
+   _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), \
+                 _mm_cmplt_epi8(v, _mm_set1_epi8((hi) + 1)))
+#define STRING_IS(v, c) \
+   _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#endif
+
+/* prototypes */
+static gboolean string_allowed(guint tag, guchar c);
+static gsize    string_span(const guchar *s, gsize len, guint tag);
+static gboolean string_utf8_valid(const guchar *s, gsize len);
+static gboolean string_put(gchar *buf, gsize size, gsize *pos, gunichar c);
+
+
+/*************/
+
+/*
+ * TRUE for the universal character string types
+ */
+gboolean asn1_is_string(asn1_tlv_t *tlv)
+{
+   if (tlv->class != ASN1_CLASS_UNIVERSAL || tlv->constructed)
+      return FALSE;
+
+   switch (tlv->tag) {
+      case ASN1_TAG_UTF8STRING:
+      case ASN1_TAG_NUMERIC_STRING:
+      case ASN1_TAG_PRINTABLE_STRING:
+      case ASN1_TAG_TG1_STRING:
+      case ASN1_TAG_VIDEO_STRING:
+      case ASN1_TAG_IA5_STRING:
+      case ASN1_TAG_GRAPHIC_STRING:
+      case ASN1_TAG_VISIBLE_STRING:
+      case ASN1_TAG_GENERAL_STRING:
+      case ASN1_TAG_UNIVERSAL_STRING:
+      case ASN1_TAG_BMP_STRING:
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+/*
+ * decodes a character string to UTF-8
+ *   - UTF-8, and ASCII in any of the other types, is validated and
+ *     handed back as view into the cbuf
+ *   - BMPString (UCS-2) and UniversalString (UCS-4) are converted
+ *   - TeletexString, VideotexString, GraphicString and GeneralString
+ *     are taken as ISO 8859-1, as other X.509 implementations do
+ *   - characters outside the set of Numeric-, Printable-, Visible-
+ *     and IA5String are kept, but flagged with ASN1_STRING_CHARSET
+ *   - converted strings are cut at a character boundary if they do
+ *     not fit into size bytes of buf
+ *
+ * fails with -E_INVALID if the contents do not encode characters
+ * of the type at all
+ */
+int asn1_decode_string(cbuf_t *cbuf, asn1_tlv_t *tlv, gchar *buf,
+                       gsize size, asn1_string_t *str)
+{
+   const guchar *s;
+   gsize i, n, pos = 0;
+   gboolean converted = TRUE, full = FALSE;
+   gunichar c;
+
+   memset(str, 0, sizeof(asn1_string_t));
+
+   if (!asn1_is_string(tlv))
+      return -E_NOTHANDLED;
+
+   if (!CBUF_HAS(cbuf, tlv->offset + tlv->hdr_len, tlv->length))
+      return -E_INVALID;
+
+   s = ASN1_CONTENT(cbuf, tlv);
+   n = tlv->length;
+
+   switch (tlv->tag) {
+      case ASN1_TAG_UTF8STRING:
+         i = string_span(s, n, ASN1_TAG_IA5_STRING);
+         if (i < n && !string_utf8_valid(s + i, n - i))
+            return -E_INVALID;
+         converted = FALSE;
+         break;
+
+      case ASN1_TAG_BMP_STRING:
+         if (n % 2)
+            return -E_INVALID;
+
+         for (i = 0; i < n; i += 2) {
+            c = s[i] << 8 | s[i + 1];
+            /* surrogates are not characters of the BMP */
+            if (c >= 0xd800 && c <= 0xdfff)
+               return -E_INVALID;
+            full = full || !string_put(buf, size, &pos, c);
+         }
+         break;
+
+      case ASN1_TAG_UNIVERSAL_STRING:
+         if (n % 4)
+            return -E_INVALID;
+
+         for (i = 0; i < n; i += 4) {
+            c = (gunichar)s[i] << 24 | s[i + 1] << 16 | s[i + 2] << 8 |
+                s[i + 3];
+            if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+               return -E_INVALID;
+            full = full || !string_put(buf, size, &pos, c);
+         }
+         break;
+
+      default:
+         i = string_span(s, n, tlv->tag);
+         if (i == n) {
+            converted = FALSE;
+            break;
+         }
+
+         /* the restricted types may still be plain ASCII */
+         if (tlv->tag != ASN1_TAG_TG1_STRING &&
+             tlv->tag != ASN1_TAG_VIDEO_STRING &&
+             tlv->tag != ASN1_TAG_GRAPHIC_STRING &&
+             tlv->tag != ASN1_TAG_GENERAL_STRING) {
+            str->flags |= ASN1_STRING_CHARSET;
+            if (string_span(s + i, n - i, ASN1_TAG_IA5_STRING) == n - i) {
+               converted = FALSE;
+               break;
+            }
+         }
+
+         /* ISO 8859-1 maps to the first 256 code points */
+         for (i = 0; i < n && !full; i++)
+            full = !string_put(buf, size, &pos, s[i]);
+         break;
+   }
+
+   if (converted) {
+      str->str = buf;
+      str->len = pos;
+      if (full)
+         str->flags |= ASN1_STRING_TRUNCATED;
+   }
+   else {
+      str->str = (const gchar*)s;
+      str->len = n;
+      str->flags |= ASN1_STRING_BORROWED;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * TRUE if c is one of the characters of the restricted string type
+ */
+static gboolean string_allowed(guint tag, guchar c)
+{
+   switch (tag) {
+      case ASN1_TAG_NUMERIC_STRING:
+         return g_ascii_isdigit(c) || c == ' ';
+
+      case ASN1_TAG_PRINTABLE_STRING:
+         return g_ascii_isalnum(c) || c == ' ' ||
+                (c >= '\'' && c <= '/' && c != '*') ||
+                c == ':' || c == '=' || c == '?';
+
+      case ASN1_TAG_VISIBLE_STRING:
+         return c >= 0x20 && c <= 0x7e;
+
+      default:
+         return c < 0x80;
+   }
+}
+
+/*
+ * number of leading bytes allowed in the string type, 16 at a time
+ * with SSE2; types other than Numeric-, Printable- and VisibleString
+ * accept ASCII here
+ */
+static gsize string_span(const guchar *s, gsize len, guint tag)
+{
+   gsize i = 0;
+
+#ifdef __SSE2__
+   __m128i v, ok;
+   guint mask;
+
+   for (; i + 16 <= len; i += 16) {
+      v = _mm_loadu_si128((const __m128i*)(s + i));
+
+      switch (tag) {
+         case ASN1_TAG_NUMERIC_STRING:
+            ok = _mm_or_si128(STRING_RANGE(v, '0', '9'), STRING_IS(v, ' '));
+            break;
+
+         case ASN1_TAG_PRINTABLE_STRING:
+            ok = _mm_or_si128(
+                  STRING_RANGE(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                  STRING_RANGE(v, '0', '9'));
+            ok = _mm_or_si128(ok, _mm_andnot_si128(STRING_IS(v, '*'),
+                  STRING_RANGE(v, '\'', '/')));
+            ok = _mm_or_si128(ok, _mm_or_si128(
+                  _mm_or_si128(STRING_IS(v, ' '), STRING_IS(v, ':')),
+                  _mm_or_si128(STRING_IS(v, '='), STRING_IS(v, '?'))));
+            break;
+
+         case ASN1_TAG_VISIBLE_STRING:
+            ok = STRING_RANGE(v, 0x20, 0x7e);
+            break;
+
+         default:
+            /* ASCII has the high bit clear */
+            ok = _mm_cmpgt_epi8(v, _mm_set1_epi8(-1));
+            break;
+      }
+
+      mask = _mm_movemask_epi8(ok);
+      if (mask != 0xffff)
+         return i + __builtin_ctz(~mask);
+   }
+#endif
+
+   for (; i < len && string_allowed(tag, s[i]); i++);
+
+   return i;
+}
+
+/*
+ * strict UTF-8: no overlong forms, surrogates or code points above
+ * U+10FFFF
+ */
+static gboolean string_utf8_valid(const guchar *s, gsize len)
+{
+   gsize i = 0, n, k;
+   gunichar c, min;
+
+   while (i < len) {
+      if (s[i] < 0x80) {
+         i++;
+         continue;
+      }
+
+      if ((s[i] & 0xe0) == 0xc0) {
+         n = 1; min = 0x80; c = s[i] & 0x1f;
+      }
+      else if ((s[i] & 0xf0) == 0xe0) {
+         n = 2; min = 0x800; c = s[i] & 0x0f;
+      }
+      else if ((s[i] & 0xf8) == 0xf0) {
+         n = 3; min = 0x10000; c = s[i] & 0x07;
+      }
+      else {
+         return FALSE;
+      }
+
+      if (n >= len - i)
+         return FALSE;
+
+      for (k = 1; k <= n; k++) {
+         if ((s[i + k] & 0xc0) != 0x80)
+            return FALSE;
+         c = c << 6 | (s[i + k] & 0x3f);
+      }
+
+      if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+         return FALSE;
+
+      i += n + 1;
+   }
+
+   return TRUE;
+}
+
+/*
+ * appends c as UTF-8 if it fits completely; FALSE once it does not
+ */
+static gboolean string_put(gchar *buf, gsize size, gsize *pos, gunichar c)
+{
+   gchar tmp[6];
+   gint n;
+
+   n = g_unichar_to_utf8(c, tmp);
+   if (*pos + n > size)
+      return FALSE;
+
+   memcpy(buf + *pos, tmp, n);
+   *pos += n;
+
+   return TRUE;
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -22,32 +22,61 @@
 #include <certalize_ui.h>
 #include <certalize_buf.h>
 #include <certalize_asn1.h>
+#include <certalize_ui_model.h>
+#include <certalize_search.h>
+#include <certalize_diff.h>
+#include "certalize_globals.h"
 
 /* globals    */
 GObject *window = NULL;
-GObject *detailsview = NULL;
-GObject *offsetgrid = NULL;
-GObject *bytesgrid = NULL;
-GObject *asciigrid = NULL;
+GObject *notebook = NULL;
+/* open documents, most recently shown first */
+GQueue tabs = G_QUEUE_INIT;
 
 /* prototypes */
 static void cb_activate(GApplication *app, gpointer data);
 static void cb_shutdown(GApplication *app, gpointer data);
+static gboolean cb_startup_drawn(GtkWidget *widget, cairo_t *cr,
+      gpointer app);
 static gboolean cb_tree_view_buttonpressed(GtkWidget *widget, 
       GdkEvent *event, gpointer data);
 static gboolean cb_tree_selected(GtkTreeSelection *selection, 
       GtkTreeModel *model, GtkTreePath *path, gboolean selected, 
       gpointer data);
+static void cb_switch_page(GtkNotebook *nb, GtkWidget *page, guint num,
+      gpointer data);
+static void cb_tab_destroy(GtkWidget *page, gpointer data);
 
 static void ui_shutdown(GSimpleAction *action, GVariant *value, gpointer data);
 static void ui_new(GSimpleAction *action, GVariant *value, gpointer data);
 static void ui_open(GSimpleAction *action, GVariant *value, gpointer data);
 static void ui_prefs(GSimpleAction *action, GVariant *value, gpointer data);
-
-static void ui_analyze_certificate(cbuf_t *cbuf);
-static void ui_dump_bytes(cbuf_t *cbuf);
-static void ui_byteselect(bytepointer_t *bp);
-static void ui_dissect_signed_certificate(GtkTreeStore *store, cbuf_t *cbuf);
+static void ui_compare(GSimpleAction *action, GVariant *value, gpointer data);
+
+static ui_tab_t* ui_open_file(const gchar *filename);
+static ui_tab_t* ui_analyze_certificate(const gchar *filename, cbuf_t *cbuf);
+static GtkWidget* ui_tab_label(GtkWidget *page, const gchar *name,
+      const gchar *tooltip);
+static void ui_tab_present(ui_tab_t *tab);
+static void ui_tab_show(ui_tab_t *tab);
+static void ui_tab_release(ui_tab_t *tab);
+static void ui_tab_close(ui_tab_t *tab);
+static void ui_tab_save_row(GtkTreeView *view, GtkTreePath *path,
+      gpointer data);
+static void ui_tabs_evict(ui_tab_t *shown);
+static int  ui_diff_entry(diff_t *diff, const diff_entry_t *entry,
+      gpointer data);
+static void ui_diff_side(parser_t *parser, guint32 node, gchar **range,
+      gchar **value);
+static void ui_build_hexview(ui_tab_t *tab);
+static void ui_dump_bytes(ui_tab_t *tab);
+static void ui_byteselect(ui_tab_t *tab, bytepointer_t *bp);
+static void ui_search_bytes(ui_tab_t *tab, const gchar *text);
+static gboolean ui_search_hit(guint pattern, guint64 offset, gsize len,
+      gpointer data);
+static void ui_mark_bytes(ui_tab_t *tab, guint64 offset, gsize len);
+static void cb_search_activate(GtkSearchEntry *entry, gpointer data);
+static void cb_search_changed(GtkSearchEntry *entry, gpointer data);
 
 
 /*************/
@@ -60,7 +89,11 @@ int ui_start(void)
    GtkApplication *app = NULL;
    int status;
 
-   app = gtk_application_new("org.gnome.Certalize", G_APPLICATION_FLAGS_NONE);
+   /*
+    * every invocation gets its own window for the file it was given,
+    * which also saves the session bus round trip of a unique instance
+    */
+   app = gtk_application_new("org.gnome.Certalize", G_APPLICATION_NON_UNIQUE);
 
    /* main signal handlers */
    g_signal_connect(app, "activate", G_CALLBACK(cb_activate), NULL);
@@ -74,38 +107,19 @@ int ui_start(void)
 }
 
 /*
- * build widgets from resource file
+ * build widgets from the resources compiled into the binary
+ *   - the byte view and the dialogs are built on first use
  */
 static void cb_activate(GApplication *app, gpointer data _U_)
 {
    GObject *menu;
-   GError *err = NULL;
-   GFile *file;
    GtkBuilder *widgets, *menus;
-   GtkTreeSelection *selection;
    GtkCssProvider *provider;
-   gchar *widgets_filename = INSTALL_UIDIR "/widgets.ui";
-   gchar *menus_filename = INSTALL_UIDIR "/menus.ui";
-   gchar *style_filename = INSTALL_UIDIR "/style.css";
+   ui_tab_t *tab, *first = NULL;
    guint i;
-   cbuf_t *cbuf = NULL;
-
-   /* Load UI from XML file */
-   widgets = gtk_builder_new();
-   if (!gtk_builder_add_from_file(widgets, widgets_filename, &err)) {
-      g_print("GtkBuilder could not load from file '%s': %s\n",
-            widgets_filename, err->message);
-      g_error_free(err);
-      return;
-   }
 
-   menus = gtk_builder_new();
-   if (!gtk_builder_add_from_file(menus, menus_filename, &err)) {
-      g_print("GtkBuilder could not load from file '%s': %s\n",
-            menus_filename, err->message);
-      g_error_free(err);
-      return;
-   }
+   widgets = gtk_builder_new_from_resource(UI_RESOURCE_PATH "/widgets.ui");
+   menus = gtk_builder_new_from_resource(UI_RESOURCE_PATH "/menus.ui");
 
    /* show application window */
    window = gtk_builder_get_object(widgets, "main-window");
@@ -115,21 +129,16 @@ static void cb_activate(GApplication *app, gpointer data _U_)
    menu = gtk_builder_get_object(menus, "app-menu");
    gtk_application_set_app_menu(GTK_APPLICATION(app), G_MENU_MODEL(menu));
 
-   /* get main widgets to be used later */
-   detailsview = gtk_builder_get_object(widgets, "details-view");
-   offsetgrid = gtk_builder_get_object(widgets, "offset-grid");
-   bytesgrid = gtk_builder_get_object(widgets, "bytes-grid");
-   asciigrid = gtk_builder_get_object(widgets, "ascii-grid");
-
-   /* set selection function to select bytes */
-   selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(detailsview));
-   gtk_tree_selection_set_select_function(selection, cb_tree_selected, 
-         NULL, NULL);
+   /* every open document is a page of the notebook */
+   notebook = gtk_builder_get_object(widgets, "documents");
+   g_signal_connect(notebook, "switch-page",
+         G_CALLBACK(cb_switch_page), NULL);
 
    /* define accelerators */
    static ui_accel_map_t accels[] = {
       {"app.new", {"<Primary>n", NULL}},
       {"app.open", {"<Primary>o", NULL}},
+      {"app.compare", {"<Primary>d", NULL}},
       {"app.quit", {"<Primary>q", NULL}}
    };
 
@@ -138,6 +147,7 @@ static void cb_activate(GApplication *app, gpointer data _U_)
       {"new", ui_new, NULL, NULL, NULL, {}},
       {"open", ui_open, NULL, NULL, NULL, {}},
       {"prefs", ui_prefs, NULL, NULL, NULL, {}},
+      {"compare", ui_compare, NULL, NULL, NULL, {}},
       {"quit", ui_shutdown, NULL, NULL, NULL, {}}
    };
 
@@ -152,34 +162,47 @@ static void cb_activate(GApplication *app, gpointer data _U_)
 
    /* load custom style */
    provider = gtk_css_provider_new();
-   file = g_file_new_for_path(style_filename);
-   if (gtk_css_provider_load_from_file(provider, file, &err)) {
-      gtk_style_context_add_provider_for_screen(
-            gdk_screen_get_default(), GTK_STYLE_PROVIDER(provider),
-            GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-   }
-   else {
-      g_warning("Could not load CSS file: %s", err->message);
-      g_error_free(err);
-   }
+   gtk_css_provider_load_from_resource(provider,
+         UI_RESOURCE_PATH "/style.css");
+   gtk_style_context_add_provider_for_screen(
+         gdk_screen_get_default(), GTK_STYLE_PROVIDER(provider),
+         GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+   g_object_unref(provider);
+
+   if (global_startup_time)
+      g_signal_connect_after(window, "draw",
+            G_CALLBACK(cb_startup_drawn), app);
    
    /* show all widgets */
    gtk_widget_show_all(GTK_WIDGET(window));
 
    g_object_unref(widgets);
    g_object_unref(menus);
-   g_object_unref(file);
 
-   if (global_filename) {
-      cbuf = cbuf_load_file(global_filename);
-      /* TODO Infobar for error message */
-      if (cbuf == NULL) {
-         DEBUG_MSG("cb_activate: error parsing file");
-      }
-      else {
-         ui_analyze_certificate(cbuf);
-      }
+   /* a tab for each file given, the first one is shown */
+   for (i = 0; i < global_files->len; i++) {
+      tab = ui_open_file(g_ptr_array_index(global_files, i));
+      if (first == NULL)
+         first = tab;
    }
+
+   if (first)
+      ui_tab_present(first);
+}
+
+/*
+ * callback for the first frame of the main window with --startup-time
+ */
+static gboolean cb_startup_drawn(GtkWidget *widget, cairo_t *cr _U_,
+      gpointer app)
+{
+   g_print("%" G_GINT64_FORMAT " us\n",
+         g_get_monotonic_time() - global_starttime);
+
+   g_signal_handlers_disconnect_by_func(widget, cb_startup_drawn, app);
+   g_application_quit(G_APPLICATION(app));
+
+   return FALSE;
 }
 
 /*
@@ -189,6 +212,9 @@ static void cb_activate(GApplication *app, gpointer data _U_)
 static void cb_shutdown(GApplication *app _U_, gpointer data _U_)
 {
    DEBUG_MSG("cb_shutdown");
+
+   while (tabs.head)
+      ui_tab_close(tabs.head->data);
 }
 
 /*
@@ -217,22 +243,43 @@ static gboolean cb_tree_view_buttonpressed(GtkWidget *widget, GdkEvent *event,
  */
 static gboolean cb_tree_selected(GtkTreeSelection *selection _U_, 
       GtkTreeModel *model, GtkTreePath *path, gboolean selected _U_, 
-      gpointer data _U_)
+      gpointer data)
 {
    GtkTreeIter iter;
-   bytepointer_t *bp;
+   bytepointer_t bp;
    gchar *title;
 
    if (gtk_tree_model_get_iter(model, &iter, path)) {
-      gtk_tree_model_get(model, &iter, 0, &title, 1, &bp, -1);
+      gtk_tree_model_get(model, &iter,
+            UI_NODE_MODEL_COL_LABEL, &title,
+            UI_NODE_MODEL_COL_OFFSET, &bp.offset,
+            UI_NODE_MODEL_COL_LENGTH, &bp.length, -1);
       g_print("'%s' selected\n", title);
       g_free(title);
-      ui_byteselect(bp);
+      ui_byteselect(data, &bp);
    }
 
    return TRUE;
 }
 
+/*
+ * callback when a tab is shown, also for the first page added;
+ * nothing is rebuilt while the window goes away
+ */
+static void cb_switch_page(GtkNotebook *nb, GtkWidget *page,
+      guint num _U_, gpointer data _U_)
+{
+   ui_tab_t *tab;
+
+   if (gtk_widget_in_destruction(GTK_WIDGET(nb)))
+      return;
+
+   /* pages of differences have no document */
+   tab = g_object_get_data(G_OBJECT(page), "tab");
+   if (tab)
+      ui_tab_show(tab);
+}
+
 
 /*
  * request to shutdown application
@@ -253,48 +300,45 @@ static void ui_new(GSimpleAction *action _U_, GVariant *value _U_, gpointer data
 
 /*
  * Open file dialog
+ *   - built on first use and hidden afterwards
  */
 static void ui_open(GSimpleAction *action _U_, GVariant *value _U_, gpointer data _U_)
 {
-   GtkWidget *dialog, *chooser, *content;
+   static GtkWidget *dialog = NULL, *chooser = NULL;
+   GtkWidget *content;
    gchar *filename;
    gint response = 0;
-   cbuf_t *cbuf;
+   ui_tab_t *tab;
 
    DEBUG_MSG("ui_open");
 
-   dialog = gtk_dialog_new_with_buttons("Select a Certificate file",
-         GTK_WINDOW(window),
-         GTK_DIALOG_DESTROY_WITH_PARENT | GTK_DIALOG_USE_HEADER_BAR,
-         "_Cancel", GTK_RESPONSE_CANCEL,
-         "_OK",     GTK_RESPONSE_OK,
-         NULL);
-   gtk_container_set_border_width(GTK_CONTAINER(dialog), 10);
-
-   content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-   chooser = gtk_file_chooser_widget_new(GTK_FILE_CHOOSER_ACTION_OPEN);
-   gtk_container_add(GTK_CONTAINER(content), chooser);
-   gtk_widget_show(chooser);
+   if (dialog == NULL) {
+      dialog = gtk_dialog_new_with_buttons("Select a Certificate file",
+            GTK_WINDOW(window),
+            GTK_DIALOG_DESTROY_WITH_PARENT | GTK_DIALOG_USE_HEADER_BAR,
+            "_Cancel", GTK_RESPONSE_CANCEL,
+            "_OK",     GTK_RESPONSE_OK,
+            NULL);
+      gtk_container_set_border_width(GTK_CONTAINER(dialog), 10);
+      g_signal_connect(dialog, "destroy",
+            G_CALLBACK(gtk_widget_destroyed), &dialog);
+
+      content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+      chooser = gtk_file_chooser_widget_new(GTK_FILE_CHOOSER_ACTION_OPEN);
+      gtk_container_add(GTK_CONTAINER(content), chooser);
+      gtk_widget_show(chooser);
+   }
 
    response = gtk_dialog_run(GTK_DIALOG(dialog));
+   gtk_widget_hide(dialog);
 
    if (response == GTK_RESPONSE_OK) {
-      gtk_widget_hide(dialog);
       filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
-      gtk_widget_destroy(dialog);
-      cbuf = cbuf_load_file(filename);
+      tab = ui_open_file(filename);
       g_free(filename);
 
-      /* TODO Infobar for error message */
-      if (cbuf == NULL) {
-         DEBUG_MSG("ui_open: error parsing file");
-      }
-      else {
-         ui_analyze_certificate(cbuf);
-      }
-   }
-   else {
-      gtk_widget_destroy(dialog);
+      if (tab)
+         ui_tab_present(tab);
    }
 }
 
@@ -306,74 +350,496 @@ static void ui_prefs(GSimpleAction *action _U_, GVariant *value _U_, gpointer da
    DEBUG_MSG("ui_prefs");
 }
 
+/*
+ * compares the documents of the two tabs shown last, the earlier one
+ * as the old, in a new page listing their differences side by side
+ */
+static void ui_compare(GSimpleAction *action _U_, GVariant *value _U_,
+      gpointer data _U_)
+{
+   static const gchar *titles[UI_DIFF_N_COLUMNS] = {
+      "", "Element", "Old Bytes", "Old Value", "New Bytes", "New Value"
+   };
+   GtkListStore *store;
+   GtkWidget *view, *scroll, *label;
+   GtkTreeViewColumn *column;
+   ui_tab_t *a, *b;
+   diff_t diff;
+   gchar *name, *tooltip, *na, *nb;
+   guint i;
+   int res;
+
+   DEBUG_MSG("ui_compare");
+
+   if (tabs.length < 2) {
+      gtk_widget_error_bell(GTK_WIDGET(window));
+      return;
+   }
+
+   b = tabs.head->data;
+   a = tabs.head->next->data;
+
+   store = gtk_list_store_new(UI_DIFF_N_COLUMNS, G_TYPE_STRING,
+         G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+         G_TYPE_STRING);
+
+   diff_init(&diff);
+   res = diff_documents(&diff, a->cbuf->buffer, a->cbuf->length,
+         b->cbuf->buffer, b->cbuf->length, ui_diff_entry, store);
+   diff_destroy(&diff);
+
+   /* TODO Infobar for error message */
+   if (res < 0) {
+      DEBUG_MSG("ui_compare: error parsing documents");
+      gtk_widget_error_bell(GTK_WIDGET(window));
+      g_object_unref(store);
+      return;
+   }
+
+   view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+   g_object_unref(store);
+
+   for (i = 0; i < UI_DIFF_N_COLUMNS; i++) {
+      column = gtk_tree_view_column_new_with_attributes(titles[i],
+            gtk_cell_renderer_text_new(), "text", i, NULL);
+      gtk_tree_view_column_set_resizable(column, TRUE);
+      gtk_tree_view_append_column(GTK_TREE_VIEW(view), column);
+   }
+
+   scroll = gtk_scrolled_window_new(NULL, NULL);
+   gtk_container_add(GTK_CONTAINER(scroll), view);
+   gtk_widget_show_all(scroll);
+
+   na = g_path_get_basename(a->filename);
+   nb = g_path_get_basename(b->filename);
+   name = g_strdup_printf("%s vs. %s", na, nb);
+   tooltip = g_strdup_printf("%s\n%s", a->filename, b->filename);
+   label = ui_tab_label(scroll, name, tooltip);
+   g_free(na);
+   g_free(nb);
+   g_free(name);
+   g_free(tooltip);
+
+   gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook),
+         gtk_notebook_append_page(GTK_NOTEBOOK(notebook), scroll, label));
+}
+
+/*
+ * one row of the page of differences
+ */
+static int ui_diff_entry(diff_t *diff, const diff_entry_t *entry,
+      gpointer data)
+{
+   static const gchar *kinds[] = { "~", "-", "+" };
+   GtkTreeIter iter;
+   GString *path;
+   gchar *ra = NULL, *va = NULL, *rb = NULL, *vb = NULL;
+
+   path = g_string_new(NULL);
+   if (entry->b != ASN1_INDEX_NONE)
+      parser_path(&diff->b, entry->b, path);
+   else
+      parser_path(&diff->a, entry->a, path);
+
+   if (entry->a != ASN1_INDEX_NONE)
+      ui_diff_side(&diff->a, entry->a, &ra, &va);
+   if (entry->b != ASN1_INDEX_NONE)
+      ui_diff_side(&diff->b, entry->b, &rb, &vb);
+
+   gtk_list_store_insert_with_values(data, &iter, -1,
+         UI_DIFF_COL_KIND, kinds[entry->kind],
+         UI_DIFF_COL_PATH, path->str,
+         UI_DIFF_COL_OLD_RANGE, ra,
+         UI_DIFF_COL_OLD_VALUE, va,
+         UI_DIFF_COL_NEW_RANGE, rb,
+         UI_DIFF_COL_NEW_VALUE, vb, -1);
+
+   g_string_free(path, TRUE);
+   g_free(ra);
+   g_free(va);
+   g_free(rb);
+   g_free(vb);
+
+   return E_SUCCESS;
+}
+
+static void ui_diff_side(parser_t *parser, guint32 node, gchar **range,
+      gchar **value)
+{
+   asn1_node_t *n = &parser->index.nodes[node];
+   GString *str;
+
+   *range = g_strdup_printf("%" G_GUINT64_FORMAT "+%" G_GUINT64_FORMAT,
+         n->offset, n->hdr_len + n->length);
+
+   str = g_string_new(NULL);
+   diff_preview(parser, node, str);
+   *value = g_string_free(str, FALSE);
+}
+
+/*
+ * shows a file in a tab, the one it already has if it is open;
+ * NULL if it could not be read
+ */
+static ui_tab_t* ui_open_file(const gchar *filename)
+{
+   ui_tab_t *tab;
+   cbuf_t *cbuf;
+   gchar *path;
+   GList *l;
+
+   /* the same file given by another name is the same document */
+   path = realpath(filename, NULL);
+   if (path == NULL)
+      path = g_strdup(filename);
+
+   for (l = tabs.head; l; l = l->next) {
+      tab = l->data;
+      if (!strcmp(tab->filename, path)) {
+         free(path);
+         return tab;
+      }
+   }
+
+   cbuf = cbuf_load_file(path, 0);
+   /* TODO Infobar for error message */
+   if (cbuf == NULL) {
+      DEBUG_MSG("ui_open_file: error parsing file");
+      free(path);
+      return NULL;
+   }
+
+   tab = ui_analyze_certificate(path, cbuf);
+   free(path);
+
+   return tab;
+}
+
 /*
  * This is the main routing to dissect the certificate
+ *   - every document gets a tab of its own, appended in the
+ *     background; its model and byte view are built when shown
  */
-static void ui_analyze_certificate(cbuf_t *cbuf)
+static ui_tab_t* ui_analyze_certificate(const gchar *filename, cbuf_t *cbuf)
 {
+   GtkBuilder *builder;
    GtkTreeView *tree;
-   GtkTreeStore *store;
-   GtkTreeIter iter;
+   GtkTreeSelection *selection;
    GtkTreeViewColumn *column;
    GtkCellRenderer *renderer;
-   guint offset;
+   GtkWidget *label;
+   ui_tab_t *tab;
+   gchar *name;
 
    DEBUG_MSG("ui_analyze_certificate");
 
-   ui_dump_bytes(cbuf);
+   tab = g_new0(ui_tab_t, 1);
+   tab->filename = g_strdup(filename);
+   tab->cbuf = cbuf;
+   tab->expanded = g_ptr_array_new_with_free_func(g_free);
+   tab->bytesmatched = g_ptr_array_new();
+   tab->link.data = tab;
 
-   offset = 0;
-   tree = GTK_TREE_VIEW(detailsview);
+   builder = gtk_builder_new_from_resource(UI_RESOURCE_PATH "/document.ui");
 
+   tab->page = GTK_WIDGET(gtk_builder_get_object(builder, "document-pane"));
+   tab->detailsview = GTK_WIDGET(gtk_builder_get_object(builder,
+            "details-view"));
+   tab->bytesbox = GTK_WIDGET(gtk_builder_get_object(builder, "bytes-box"));
+   g_object_set_data(G_OBJECT(tab->page), "tab", tab);
+   g_signal_connect(tab->page, "destroy", G_CALLBACK(cb_tab_destroy), tab);
 
+   /* fixed sizing lets the view format only the visible labels */
+   tree = GTK_TREE_VIEW(tab->detailsview);
    renderer = gtk_cell_renderer_text_new();
    column = gtk_tree_view_column_new();
    gtk_tree_view_column_pack_start(column, renderer, FALSE);
-   gtk_tree_view_column_add_attribute(column, renderer, "text", 0);
+   gtk_tree_view_column_add_attribute(column, renderer, "text",
+         UI_NODE_MODEL_COL_LABEL);
+   gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
    gtk_tree_view_append_column(tree, column);
    gtk_tree_view_set_headers_visible(tree, FALSE);
+   gtk_tree_view_set_fixed_height_mode(tree, TRUE);
 
-   store = gtk_tree_store_new(2, G_TYPE_STRING, G_TYPE_POINTER);
-   ui_dissect_signed_certificate(store, cbuf);
+   /* set selection function to select bytes */
+   selection = gtk_tree_view_get_selection(tree);
+   gtk_tree_selection_set_select_function(selection, cb_tree_selected,
+         tab, NULL);
 
-   gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
+   g_signal_connect(tree, "button-press-event", 
+         G_CALLBACK(cb_tree_view_buttonpressed), tab);
 
-   g_object_unref(store);
+   name = g_path_get_basename(filename);
+   label = ui_tab_label(tab->page, name, filename);
+   g_free(name);
 
-   g_signal_connect(tree, "button-press-event", 
-         G_CALLBACK(cb_tree_view_buttonpressed), NULL);
+   /* the least recently shown until it is switched to */
+   g_queue_push_tail_link(&tabs, &tab->link);
 
-   gtk_widget_show_all(GTK_WIDGET(tree));
+   /* the first page is shown as soon as it is added */
+   gtk_widget_show_all(tab->page);
+   gtk_notebook_append_page(GTK_NOTEBOOK(notebook), tab->page, label);
+   gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(notebook), tab->page, TRUE);
 
+   g_object_unref(builder);
+
+   return tab;
+}
+
+/*
+ * the label of a page, naming it and closing it by a button
+ */
+static GtkWidget* ui_tab_label(GtkWidget *page, const gchar *name,
+      const gchar *tooltip)
+{
+   GtkWidget *box, *label, *button;
+
+   label = gtk_label_new(name);
+   gtk_widget_set_tooltip_text(label, tooltip);
+
+   button = gtk_button_new_from_icon_name("window-close-symbolic",
+         GTK_ICON_SIZE_MENU);
+   gtk_button_set_relief(GTK_BUTTON(button), GTK_RELIEF_NONE);
+   g_signal_connect_swapped(button, "clicked",
+         G_CALLBACK(gtk_widget_destroy), page);
+
+   box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+   gtk_box_pack_start(GTK_BOX(box), label, TRUE, TRUE, 0);
+   gtk_box_pack_start(GTK_BOX(box), button, FALSE, FALSE, 0);
+   gtk_widget_show_all(box);
+
+   return box;
+}
+
+/*
+ * switches the notebook to the tab
+ */
+static void ui_tab_present(ui_tab_t *tab)
+{
+   gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook),
+         gtk_notebook_page_num(GTK_NOTEBOOK(notebook), tab->page));
+}
+
+/*
+ * makes the tab the most recently shown, rebuilding what was released
+ * of it, and releases other tabs beyond the memory budget
+ */
+static void ui_tab_show(ui_tab_t *tab)
+{
+   GtkTreeView *tree = GTK_TREE_VIEW(tab->detailsview);
+   GtkTreePath *path;
+   guint i;
+
+   DEBUG_MSG("ui_tab_show: %s", tab->filename);
+
+   g_queue_unlink(&tabs, &tab->link);
+   g_queue_push_head_link(&tabs, &tab->link);
+
+   /* before the model, restoring the cursor selects bytes */
+   if (tab->bytespane == NULL) {
+      ui_build_hexview(tab);
+      ui_dump_bytes(tab);
+   }
+
+   if (tab->model == NULL) {
+      /* rows are presented straight from the document's index */
+      tab->model = GTK_TREE_MODEL(ui_node_model_new(tab->cbuf));
+      gtk_tree_view_set_model(tree, tab->model);
+
+      /* as the tab was left when it was released */
+      for (i = 0; i < tab->expanded->len; i++) {
+         path = gtk_tree_path_new_from_string(
+               g_ptr_array_index(tab->expanded, i));
+         gtk_tree_view_expand_to_path(tree, path);
+         gtk_tree_path_free(path);
+      }
+      g_ptr_array_set_size(tab->expanded, 0);
+
+      if (tab->cursor) {
+         path = gtk_tree_path_new_from_string(tab->cursor);
+         gtk_tree_view_set_cursor(tree, path, NULL, FALSE);
+         gtk_tree_path_free(path);
+         g_free(tab->cursor);
+         tab->cursor = NULL;
+      }
+   }
+
+   tab->cost = ui_node_model_get_size(UI_NODE_MODEL(tab->model)) +
+      (gsize)tab->cbuf->length * UI_HEXVIEW_BYTE_COST;
+
+   ui_tabs_evict(tab);
+}
+
+/*
+ * releases the model and the byte view of a tab in the background;
+ * the expanded rows and the cursor are kept to restore them
+ */
+static void ui_tab_release(ui_tab_t *tab)
+{
+   GtkTreeView *tree = GTK_TREE_VIEW(tab->detailsview);
+   GtkTreePath *path = NULL;
+
+   DEBUG_MSG("ui_tab_release: %s", tab->filename);
+
+   if (tab->model) {
+      g_ptr_array_set_size(tab->expanded, 0);
+      gtk_tree_view_map_expanded_rows(tree, ui_tab_save_row, tab->expanded);
+
+      g_free(tab->cursor);
+      tab->cursor = NULL;
+      gtk_tree_view_get_cursor(tree, &path, NULL);
+      if (path) {
+         tab->cursor = gtk_tree_path_to_string(path);
+         gtk_tree_path_free(path);
+      }
+
+      /* the index goes with the last reference to the model */
+      gtk_tree_view_set_model(tree, NULL);
+      g_object_unref(tab->model);
+      tab->model = NULL;
+   }
+
+   if (tab->bytespane) {
+      g_ptr_array_set_size(tab->bytesmatched, 0);
+      gtk_widget_destroy(tab->bytespane);
+      tab->bytespane = NULL;
+      tab->offsetgrid = NULL;
+      tab->bytesgrid = NULL;
+      tab->asciigrid = NULL;
+      tab->bytessearch = NULL;
+   }
+
+   tab->cost = 0;
+}
+
+static void ui_tab_save_row(GtkTreeView *view _U_, GtkTreePath *path,
+      gpointer data)
+{
+   g_ptr_array_add(data, gtk_tree_path_to_string(path));
+}
+
+/*
+ * releases the least recently shown tabs until the rest fits into
+ * the memory budget; the tab shown is always kept
+ */
+static void ui_tabs_evict(ui_tab_t *shown)
+{
+   guint64 budget = (guint64)global_memory * 1024 * 1024;
+   guint64 total = 0;
+   ui_tab_t *tab;
+   GList *l, *prev;
+
+   for (l = tabs.head; l; l = l->next)
+      total += ((ui_tab_t*)l->data)->cost;
+
+   for (l = tabs.tail; l && total > budget; l = prev) {
+      prev = l->prev;
+      tab = l->data;
+      if (tab == shown || tab->cost == 0)
+         continue;
+      total -= tab->cost;
+      ui_tab_release(tab);
+   }
+}
+
+/*
+ * closes the tab, its state is released as the page is destroyed
+ * like by the button of its label
+ */
+static void ui_tab_close(ui_tab_t *tab)
+{
+   DEBUG_MSG("ui_tab_close: %s", tab->filename);
+
+   gtk_widget_destroy(tab->page);
+}
+
+/*
+ * callback when the page of a tab is destroyed, by closing the tab or
+ * with the window; the model is detached first as its rows point into
+ * the document's arena
+ */
+static void cb_tab_destroy(GtkWidget *page _U_, gpointer data)
+{
+   ui_tab_t *tab = data;
+
+   g_queue_unlink(&tabs, &tab->link);
+
+   if (tab->model) {
+      gtk_tree_view_set_model(GTK_TREE_VIEW(tab->detailsview), NULL);
+      g_object_unref(tab->model);
+   }
+
+   cbuf_free(tab->cbuf);
+   g_ptr_array_free(tab->expanded, TRUE);
+   g_ptr_array_free(tab->bytesmatched, TRUE);
+   g_free(tab->cursor);
+   g_free(tab->filename);
+   g_free(tab);
+}
+
+/*
+ * loads the byte view into the pane of the tab
+ */
+static void ui_build_hexview(ui_tab_t *tab)
+{
+   GtkBuilder *builder;
+
+   DEBUG_MSG("ui_build_hexview");
+
+   builder = gtk_builder_new_from_resource(UI_RESOURCE_PATH "/hexview.ui");
+
+   tab->bytespane = GTK_WIDGET(gtk_builder_get_object(builder, "bytes-pane"));
+   gtk_box_pack_start(GTK_BOX(tab->bytesbox), tab->bytespane, TRUE, TRUE, 0);
+
+   tab->offsetgrid = gtk_builder_get_object(builder, "offset-grid");
+   tab->bytesgrid = gtk_builder_get_object(builder, "bytes-grid");
+   tab->asciigrid = gtk_builder_get_object(builder, "ascii-grid");
+   tab->bytessearch = gtk_builder_get_object(builder, "bytes-search");
+
+   /* every enter finds the next match */
+   g_signal_connect(tab->bytessearch, "activate",
+         G_CALLBACK(cb_search_activate), tab);
+   g_signal_connect(tab->bytessearch, "search-changed",
+         G_CALLBACK(cb_search_changed), tab);
+
+   gtk_widget_show_all(tab->bytespane);
+
+   g_object_unref(builder);
 }
 
 /*
  * printing bytes in the byte text view pane
  */
-static void ui_dump_bytes(cbuf_t *cbuf)
+static void ui_dump_bytes(ui_tab_t *tab)
 {
+   cbuf_t *cbuf = tab->cbuf;
    GtkTextBuffer *offsetbuf, *asciibuf;
    GtkTextIter offsetiter, asciiiter;
    GtkTextIter startiter, enditer;
    GtkGrid *grid;
    GtkWidget *label;
    guchar buf[16], *ptr, *fstr;
-   guint offset = 0, remain, i, row = 0;
+   guint64 offset = 0;
+   guint remain, i, row = 0;
 
    DEBUG_MSG("ui_dump_bytes");
 
+   /* the marked labels go with the grids */
+   g_ptr_array_set_size(tab->bytesmatched, 0);
+   tab->searchoffset = 0;
+
    ptr = buf;
 
    /* clear offset grid */
-   gtk_grid_remove_column(GTK_GRID(offsetgrid), 0);
+   gtk_grid_remove_column(GTK_GRID(tab->offsetgrid), 0);
 
    /* clear bytes grid */
    for (i = 0; i < 17; i++)
-      gtk_grid_remove_column(GTK_GRID(bytesgrid), i);
+      gtk_grid_remove_column(GTK_GRID(tab->bytesgrid), i);
 
    /* clear ascii grid */
    for (i = 0; i < 8; i++)
-      gtk_grid_remove_column(GTK_GRID(asciigrid), i);
+      gtk_grid_remove_column(GTK_GRID(tab->asciigrid), i);
 
    /* dump 16 bytes each line */
    while (cbuf_length_remaining(cbuf, offset) > 16) {
@@ -381,26 +847,26 @@ static void ui_dump_bytes(cbuf_t *cbuf)
       cbuf_get_bytes(cbuf, &ptr, offset, 16);
 
       /* offset */
-      fstr = g_strdup_printf("%08x", offset);
+      fstr = g_strdup_printf("%08" G_GINT64_MODIFIER "x", offset);
       label = gtk_label_new(fstr);
-      gtk_grid_attach(GTK_GRID(offsetgrid), label, 0, row, 1, 1);
+      gtk_grid_attach(GTK_GRID(tab->offsetgrid), label, 0, row, 1, 1);
       g_free(fstr);
 
       /* bytes */
       for (i = 0; i < 8; i++) {
          fstr = g_strdup_printf("%02x", buf[i]);
          label = gtk_label_new(fstr);
-         gtk_grid_attach(GTK_GRID(bytesgrid), label, i, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, i, row, 1, 1);
          g_free(fstr);
       }
       
       label = gtk_label_new(" ");
-      gtk_grid_attach(GTK_GRID(bytesgrid), label, 8, row, 1, 1);
+      gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, 8, row, 1, 1);
 
       for (i = 8; i < 16; i++) {
          fstr = g_strdup_printf("%02x", buf[i]);
          label = gtk_label_new(fstr);
-         gtk_grid_attach(GTK_GRID(bytesgrid), label, i+1, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, i+1, row, 1, 1);
          g_free(fstr);
       }
 
@@ -408,7 +874,7 @@ static void ui_dump_bytes(cbuf_t *cbuf)
       for (i = 0; i < 16; i++) {
          fstr = g_strdup_printf("%c", g_ascii_isprint(buf[i]) ? buf[i] : '.');
          label = gtk_label_new(fstr);
-         gtk_grid_attach(GTK_GRID(asciigrid), label, i, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->asciigrid), label, i, row, 1, 1);
          g_free(fstr);
       }
 
@@ -423,27 +889,27 @@ static void ui_dump_bytes(cbuf_t *cbuf)
       cbuf_get_bytes(cbuf, &ptr, offset, remain);
 
       /* offset */
-      fstr = g_strdup_printf("%08x\n", offset);
+      fstr = g_strdup_printf("%08" G_GINT64_MODIFIER "x\n", offset);
       label = gtk_label_new(fstr);
-      gtk_grid_attach(GTK_GRID(offsetgrid), label, 0, row, 1, 1);
+      gtk_grid_attach(GTK_GRID(tab->offsetgrid), label, 0, row, 1, 1);
       g_free(fstr);
 
       /* bytes */
       for (i = 0; i < (remain > 8 ? 8 : remain); i++) {
          fstr = g_strdup_printf("%02x", buf[i]);
          label = gtk_label_new(fstr);
-         gtk_grid_attach(GTK_GRID(bytesgrid), label, i, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, i, row, 1, 1);
          g_free(fstr);
       }
       
       if (remain > 8) {
          label = gtk_label_new(" ");
-         gtk_grid_attach(GTK_GRID(bytesgrid), label, 8, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, 8, row, 1, 1);
 
          for (i = 8; i < remain; i++) {
             fstr = g_strdup_printf("%02x", buf[i]);
             label = gtk_label_new(fstr);
-            gtk_grid_attach(GTK_GRID(bytesgrid), label, i+1, row, 1, 1);
+            gtk_grid_attach(GTK_GRID(tab->bytesgrid), label, i+1, row, 1, 1);
             g_free(fstr);
          }
       }
@@ -452,18 +918,18 @@ static void ui_dump_bytes(cbuf_t *cbuf)
       for (i = 0; i < remain; i++) {
          fstr = g_strdup_printf("%c", g_ascii_isprint(buf[i]) ? buf[i] : '.');
          label = gtk_label_new(fstr);
-         gtk_grid_attach(GTK_GRID(asciigrid), label, i, row, 1, 1);
+         gtk_grid_attach(GTK_GRID(tab->asciigrid), label, i, row, 1, 1);
          g_free(fstr);
       }
    }
 
-   gtk_widget_show_all(GTK_WIDGET(offsetgrid));
-   gtk_widget_show_all(GTK_WIDGET(bytesgrid));
-   gtk_widget_show_all(GTK_WIDGET(asciigrid));
+   gtk_widget_show_all(GTK_WIDGET(tab->offsetgrid));
+   gtk_widget_show_all(GTK_WIDGET(tab->bytesgrid));
+   gtk_widget_show_all(GTK_WIDGET(tab->asciigrid));
 
 }
 
-static void ui_byteselect(bytepointer_t *bp)
+static void ui_byteselect(ui_tab_t *tab, bytepointer_t *bp)
 {
    GtkTextBuffer *bytesbuf, *asciibuf, *offsetbuf;
    GtkTextIter startiter, enditer;
@@ -475,7 +941,7 @@ static void ui_byteselect(bytepointer_t *bp)
 
    DEBUG_MSG("ui_byteselect");
 
-   grid = GTK_GRID(bytesgrid);
+   grid = GTK_GRID(tab->bytesgrid);
 
    bp->offset = 3;
    bp->length = 32;
@@ -529,44 +995,132 @@ static void ui_byteselect(bytepointer_t *bp)
 
 }
 
-void ui_dissect_signed_certificate(GtkTreeStore *store, cbuf_t *cbuf)
+/*
+ * callback for enter in the search entry of the byte view
+ */
+static void cb_search_activate(GtkSearchEntry *entry, gpointer data)
 {
-   GtkTreeIter iter, child;
-   int res;
-   asn1_hdr_t *asn1;
-   bytepointer_t *bptr;
+   ui_search_bytes(data, gtk_entry_get_text(GTK_ENTRY(entry)));
+}
 
-   DEBUG_MSG("ui_dissect_signed_certificate\n");
+/*
+ * a changed search starts over at the beginning of the document
+ */
+static void cb_search_changed(GtkSearchEntry *entry _U_, gpointer data)
+{
+   ((ui_tab_t*)data)->searchoffset = 0;
+}
 
-   asn1 = g_malloc0(sizeof(asn1_hdr_t));
+/*
+ * finds the next match of the patterns in the document, wrapping
+ * around at its end; the bytes are marked and the element enclosing
+ * them is selected in the tree
+ */
+static void ui_search_bytes(ui_tab_t *tab, const gchar *text)
+{
+   cbuf_t *document = tab->cbuf;
+   GtkTreePath *path;
+   search_t *search;
+   searchmatch_t hit;
+   gchar **exprs;
+   guint i;
 
-   if ((res = asn1_parse_hdr(cbuf, asn1)) < 0) {
-      DEBUG_MSG("Error in parsing ASN1 header\n");
+   if (*text == '\0')
       return;
+
+   DEBUG_MSG("ui_search_bytes('%s')", text);
+
+   search = search_new();
+
+   exprs = g_strsplit(text, "|", 0);
+   for (i = 0; exprs[i]; i++) {
+      g_strstrip(exprs[i]);
+      if (*exprs[i] && search_add_expr(search, exprs[i]) < 0) {
+         gtk_widget_error_bell(GTK_WIDGET(tab->bytessearch));
+         g_strfreev(exprs);
+         search_free(search);
+         return;
+      }
+   }
+   g_strfreev(exprs);
+
+   hit.from = tab->searchoffset;
+   hit.match.length = 0;
+   search_scan(search, document->buffer, document->length, ui_search_hit,
+         &hit);
+
+   if (hit.match.length == 0 && tab->searchoffset > 0) {
+      hit.from = 0;
+      search_scan(search, document->buffer, document->length,
+            ui_search_hit, &hit);
    }
 
-   if (!asn1->constructed && asn1->tag != ASN1_TAG_SEQUENCE) {
-      DEBUG_MSG("X.509 certificate must start with a Sequence\n");
+   search_free(search);
+
+   if (hit.match.length == 0) {
+      gtk_widget_error_bell(GTK_WIDGET(tab->bytessearch));
       return;
    }
 
-   /* set bytepointer for byte selection */
-   bptr = g_malloc0(sizeof(bytepointer_t));
-   bptr->offset = cbuf->offset;
-   bptr->length = asn1->length + res;
+   tab->searchoffset = hit.match.offset + 1;
 
-   /* create top-level */
-   gtk_tree_store_append(store, &iter, NULL);
-   gtk_tree_store_set(store, &iter, 
-         0, "X.509 signed certificate", 1, bptr, -1);
+   ui_mark_bytes(tab, hit.match.offset, hit.match.length);
 
-   /* forward offset to already parsed bytes */
-   cbuf->offset += res;
+   /* the tab searched in is shown, its model is built */
+   path = ui_node_model_find(UI_NODE_MODEL(tab->model), hit.match.offset,
+         hit.match.length);
+   if (path) {
+      gtk_tree_view_expand_to_path(GTK_TREE_VIEW(tab->detailsview), path);
+      gtk_tree_view_set_cursor(GTK_TREE_VIEW(tab->detailsview), path, NULL,
+            FALSE);
+      gtk_tree_path_free(path);
+   }
+}
+
+static gboolean ui_search_hit(guint pattern _U_, guint64 offset, gsize len,
+      gpointer data)
+{
+   searchmatch_t *hit = data;
 
-   /* prepare sublevels and start parsing */
+   if (offset < hit->from)
+      return TRUE;
 
-   g_free(asn1);
+   hit->match.offset = offset;
+   hit->match.length = len;
 
+   return FALSE;
+}
+
+/*
+ * marks the bytes in the hex and ascii columns, unmarking the
+ * previous ones
+ */
+static void ui_mark_bytes(ui_tab_t *tab, guint64 offset, gsize len)
+{
+   GPtrArray *bytesmatched = tab->bytesmatched;
+   GtkWidget *label;
+   guint64 pos;
+   guint i;
+
+   for (i = 0; i < bytesmatched->len; i++)
+      gtk_widget_set_name(g_ptr_array_index(bytesmatched, i), "");
+   g_ptr_array_set_size(bytesmatched, 0);
+
+   for (pos = offset; pos < offset + len; pos++) {
+      /* the hex columns have a gap after the eighth byte */
+      label = gtk_grid_get_child_at(GTK_GRID(tab->bytesgrid),
+            pos % 16 + (pos % 16 >= 8), pos / 16);
+      if (label) {
+         gtk_widget_set_name(label, "matched");
+         g_ptr_array_add(bytesmatched, label);
+      }
+
+      label = gtk_grid_get_child_at(GTK_GRID(tab->asciigrid), pos % 16, pos / 16);
+      if (label) {
+         gtk_widget_set_name(label, "matched");
+         g_ptr_array_add(bytesmatched, label);
+      }
+   }
 }
 
 /* EOF */
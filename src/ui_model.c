@@ -0,0 +1,634 @@
+/* ui_model.c - tree model over the structural index of a document
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_ui_model.h>
+#include <certalize_schema.h>
+#include <certalize_oid.h>
+#include <certalize_string.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* longest value shown in a label */
+#define UI_LABEL_MAX_VALUE          64
+
+/*
+ * the rows are the nodes of the index, nothing is copied per row;
+ * an iter carries the node number in user_data
+ */
+struct _UiNodeModel {
+   GObject parent;
+   gint stamp;
+   /* the document, owned by the caller and outliving the model */
+   cbuf_t *cbuf;
+   asn1_index_t index;
+   /* position of every node among its siblings */
+   guint32 *position;
+   /* schema type and component of every node */
+   asn1_schema_note_t *notes;
+};
+
+#define NODE(iter)         GPOINTER_TO_UINT((iter)->user_data)
+#define SET_ITER(m, iter, i) \
+   do { (iter)->stamp = (m)->stamp; \
+        (iter)->user_data = GUINT_TO_POINTER(i); } while (0)
+
+/* prototypes */
+static void ui_node_model_tree_model_init(GtkTreeModelIface *iface);
+static void ui_node_model_finalize(GObject *object);
+
+static GtkTreeModelFlags ui_node_model_get_flags(GtkTreeModel *model);
+static gint ui_node_model_get_n_columns(GtkTreeModel *model);
+static GType ui_node_model_get_column_type(GtkTreeModel *model, gint column);
+static gboolean ui_node_model_get_iter(GtkTreeModel *model, GtkTreeIter *iter,
+      GtkTreePath *path);
+static GtkTreePath* ui_node_model_get_path(GtkTreeModel *model,
+      GtkTreeIter *iter);
+static void ui_node_model_get_value(GtkTreeModel *model, GtkTreeIter *iter,
+      gint column, GValue *value);
+static gboolean ui_node_model_iter_next(GtkTreeModel *model,
+      GtkTreeIter *iter);
+static gboolean ui_node_model_iter_previous(GtkTreeModel *model,
+      GtkTreeIter *iter);
+static gboolean ui_node_model_iter_children(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *parent);
+static gboolean ui_node_model_iter_has_child(GtkTreeModel *model,
+      GtkTreeIter *iter);
+static gint ui_node_model_iter_n_children(GtkTreeModel *model,
+      GtkTreeIter *iter);
+static gboolean ui_node_model_iter_nth_child(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *parent, gint n);
+static gboolean ui_node_model_iter_parent(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *child);
+
+static guint32 ui_node_model_child(UiNodeModel *m, guint32 parent);
+static guint32 ui_node_model_nth(UiNodeModel *m, guint32 parent, guint32 n);
+static guint32 ui_node_model_count(UiNodeModel *m, guint32 parent);
+static guint32 ui_node_model_end(UiNodeModel *m, guint32 parent);
+static guint32 ui_node_model_ancestor(UiNodeModel *m, guint32 i,
+      guint32 parent);
+static void ui_node_model_annotate(UiNodeModel *m);
+static gchar* ui_node_model_label(UiNodeModel *m, guint32 i);
+
+G_DEFINE_TYPE_WITH_CODE(UiNodeModel, ui_node_model, G_TYPE_OBJECT,
+      G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+         ui_node_model_tree_model_init))
+
+
+/*************/
+
+/*
+ * indexes the document and returns a model presenting its elements;
+ * on malformed input the elements up to the defect are shown
+ */
+UiNodeModel* ui_node_model_new(cbuf_t *cbuf)
+{
+   UiNodeModel *m;
+   guint32 i, next;
+
+   m = g_object_new(UI_TYPE_NODE_MODEL, NULL);
+   m->cbuf = cbuf;
+
+   if (asn1_index_range(&m->index, cbuf, 0, cbuf->length) < 0) {
+      DEBUG_MSG("ui_node_model_new: structure broken at %" G_GUINT64_FORMAT,
+            m->index.error_offset);
+   }
+
+   /* siblings follow each other in index order */
+   m->position = g_new0(guint32, MAX(m->index.len, 1));
+   for (i = 0; i < m->index.len; i++) {
+      next = m->index.nodes[i].next;
+      if (next != ASN1_INDEX_NONE && next < m->index.len)
+         m->position[next] = m->position[i] + 1;
+   }
+
+   ui_node_model_annotate(m);
+
+   DEBUG_MSG("ui_node_model_new: %u nodes", m->index.len);
+
+   return m;
+}
+
+/*
+ * bytes of the index and its annotations, released with the model
+ */
+gsize ui_node_model_get_size(UiNodeModel *m)
+{
+   return (gsize)m->index.size * sizeof(asn1_node_t) +
+      (gsize)MAX(m->index.len, 1) *
+      (sizeof(guint32) + sizeof(asn1_schema_note_t));
+}
+
+/*
+ * path of the innermost element enclosing length bytes from offset,
+ * NULL if there is none
+ */
+GtkTreePath* ui_node_model_find(UiNodeModel *m, guint64 offset,
+      guint64 length)
+{
+   GtkTreeIter iter;
+   guint32 i;
+
+   i = asn1_index_find(&m->index, offset, length);
+   if (i == ASN1_INDEX_NONE)
+      return NULL;
+
+   SET_ITER(m, &iter, i);
+
+   return ui_node_model_get_path(GTK_TREE_MODEL(m), &iter);
+}
+
+static void ui_node_model_init(UiNodeModel *m)
+{
+   m->stamp = g_random_int();
+   asn1_index_init(&m->index);
+}
+
+static void ui_node_model_class_init(UiNodeModelClass *klass)
+{
+   G_OBJECT_CLASS(klass)->finalize = ui_node_model_finalize;
+}
+
+static void ui_node_model_tree_model_init(GtkTreeModelIface *iface)
+{
+   iface->get_flags = ui_node_model_get_flags;
+   iface->get_n_columns = ui_node_model_get_n_columns;
+   iface->get_column_type = ui_node_model_get_column_type;
+   iface->get_iter = ui_node_model_get_iter;
+   iface->get_path = ui_node_model_get_path;
+   iface->get_value = ui_node_model_get_value;
+   iface->iter_next = ui_node_model_iter_next;
+   iface->iter_previous = ui_node_model_iter_previous;
+   iface->iter_children = ui_node_model_iter_children;
+   iface->iter_has_child = ui_node_model_iter_has_child;
+   iface->iter_n_children = ui_node_model_iter_n_children;
+   iface->iter_nth_child = ui_node_model_iter_nth_child;
+   iface->iter_parent = ui_node_model_iter_parent;
+}
+
+static void ui_node_model_finalize(GObject *object)
+{
+   UiNodeModel *m = UI_NODE_MODEL(object);
+
+   asn1_index_destroy(&m->index);
+   g_free(m->position);
+   g_free(m->notes);
+
+   G_OBJECT_CLASS(ui_node_model_parent_class)->finalize(object);
+}
+
+static GtkTreeModelFlags ui_node_model_get_flags(GtkTreeModel *model _U_)
+{
+   /* the index never changes while it is shown */
+   return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint ui_node_model_get_n_columns(GtkTreeModel *model _U_)
+{
+   return UI_NODE_MODEL_N_COLUMNS;
+}
+
+static GType ui_node_model_get_column_type(GtkTreeModel *model _U_,
+      gint column)
+{
+   switch (column) {
+      case UI_NODE_MODEL_COL_LABEL:
+         return G_TYPE_STRING;
+      case UI_NODE_MODEL_COL_OFFSET:
+      case UI_NODE_MODEL_COL_LENGTH:
+         return G_TYPE_UINT64;
+      default:
+         return G_TYPE_INVALID;
+   }
+}
+
+static gboolean ui_node_model_get_iter(GtkTreeModel *model, GtkTreeIter *iter,
+      GtkTreePath *path)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 i = ASN1_INDEX_NONE;
+   gint *indices, depth, d;
+
+   indices = gtk_tree_path_get_indices(path);
+   depth = gtk_tree_path_get_depth(path);
+
+   for (d = 0; d < depth; d++) {
+      if (indices[d] < 0)
+         return FALSE;
+      i = ui_node_model_nth(m, i, indices[d]);
+      if (i == ASN1_INDEX_NONE)
+         return FALSE;
+   }
+
+   if (i == ASN1_INDEX_NONE)
+      return FALSE;
+
+   SET_ITER(m, iter, i);
+
+   return TRUE;
+}
+
+static GtkTreePath* ui_node_model_get_path(GtkTreeModel *model,
+      GtkTreeIter *iter)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   GtkTreePath *path;
+   guint32 i;
+
+   g_return_val_if_fail(iter->stamp == m->stamp, NULL);
+
+   path = gtk_tree_path_new();
+   for (i = NODE(iter); i != ASN1_INDEX_NONE; i = m->index.nodes[i].parent)
+      gtk_tree_path_prepend_index(path, m->position[i]);
+
+   return path;
+}
+
+static void ui_node_model_get_value(GtkTreeModel *model, GtkTreeIter *iter,
+      gint column, GValue *value)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   asn1_node_t *node;
+
+   g_return_if_fail(iter->stamp == m->stamp);
+
+   node = ASN1_INDEX_NODE(&m->index, NODE(iter));
+
+   switch (column) {
+      case UI_NODE_MODEL_COL_LABEL:
+         g_value_init(value, G_TYPE_STRING);
+         g_value_take_string(value, ui_node_model_label(m, NODE(iter)));
+         break;
+
+      case UI_NODE_MODEL_COL_OFFSET:
+         g_value_init(value, G_TYPE_UINT64);
+         g_value_set_uint64(value, node->offset);
+         break;
+
+      case UI_NODE_MODEL_COL_LENGTH:
+         g_value_init(value, G_TYPE_UINT64);
+         g_value_set_uint64(value, node->hdr_len + node->length);
+         break;
+   }
+}
+
+static gboolean ui_node_model_iter_next(GtkTreeModel *model,
+      GtkTreeIter *iter)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 next;
+
+   next = m->index.nodes[NODE(iter)].next;
+   if (next == ASN1_INDEX_NONE || next >= m->index.len) {
+      iter->stamp = 0;
+      return FALSE;
+   }
+
+   SET_ITER(m, iter, next);
+
+   return TRUE;
+}
+
+static gboolean ui_node_model_iter_previous(GtkTreeModel *model,
+      GtkTreeIter *iter)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 i = NODE(iter);
+
+   if (m->position[i] == 0) {
+      iter->stamp = 0;
+      return FALSE;
+   }
+
+   SET_ITER(m, iter, ui_node_model_nth(m, m->index.nodes[i].parent,
+            m->position[i] - 1));
+
+   return TRUE;
+}
+
+static gboolean ui_node_model_iter_children(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *parent)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 i;
+
+   i = ui_node_model_child(m, parent ? NODE(parent) : ASN1_INDEX_NONE);
+   if (i == ASN1_INDEX_NONE)
+      return FALSE;
+
+   SET_ITER(m, iter, i);
+
+   return TRUE;
+}
+
+static gboolean ui_node_model_iter_has_child(GtkTreeModel *model,
+      GtkTreeIter *iter)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+
+   return ui_node_model_child(m, NODE(iter)) != ASN1_INDEX_NONE;
+}
+
+static gint ui_node_model_iter_n_children(GtkTreeModel *model,
+      GtkTreeIter *iter)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+
+   return ui_node_model_count(m, iter ? NODE(iter) : ASN1_INDEX_NONE);
+}
+
+static gboolean ui_node_model_iter_nth_child(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 i;
+
+   if (n < 0)
+      return FALSE;
+
+   i = ui_node_model_nth(m, parent ? NODE(parent) : ASN1_INDEX_NONE, n);
+   if (i == ASN1_INDEX_NONE)
+      return FALSE;
+
+   SET_ITER(m, iter, i);
+
+   return TRUE;
+}
+
+static gboolean ui_node_model_iter_parent(GtkTreeModel *model,
+      GtkTreeIter *iter, GtkTreeIter *child)
+{
+   UiNodeModel *m = UI_NODE_MODEL(model);
+   guint32 parent;
+
+   parent = m->index.nodes[NODE(child)].parent;
+   if (parent == ASN1_INDEX_NONE)
+      return FALSE;
+
+   SET_ITER(m, iter, parent);
+
+   return TRUE;
+}
+
+/*
+ * first child of parent, the first top-level node for ASN1_INDEX_NONE;
+ * a partial index may lack the children of the last elements
+ */
+static guint32 ui_node_model_child(UiNodeModel *m, guint32 parent)
+{
+   guint32 i;
+
+   if (parent == ASN1_INDEX_NONE)
+      i = 0;
+   else
+      i = ASN1_INDEX_CHILD(&m->index, parent);
+
+   return i < m->index.len ? i : ASN1_INDEX_NONE;
+}
+
+/*
+ * the n-th child of parent
+ *   - the position of the child containing a node increases with
+ *     the node number, so the child is found by bisecting the
+ *     subtree of parent instead of walking all siblings
+ */
+static guint32 ui_node_model_nth(UiNodeModel *m, guint32 parent, guint32 n)
+{
+   guint32 lo, hi, mid, child;
+
+   lo = ui_node_model_child(m, parent);
+   if (lo == ASN1_INDEX_NONE)
+      return ASN1_INDEX_NONE;
+   hi = ui_node_model_end(m, parent);
+
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      child = ui_node_model_ancestor(m, mid, parent);
+
+      if (m->position[child] == n)
+         return child;
+
+      if (m->position[child] < n)
+         lo = mid + 1;
+      else
+         hi = child;
+   }
+
+   return ASN1_INDEX_NONE;
+}
+
+/*
+ * number of children, i.e. the position of the last child plus one
+ */
+static guint32 ui_node_model_count(UiNodeModel *m, guint32 parent)
+{
+   guint32 end;
+
+   if (ui_node_model_child(m, parent) == ASN1_INDEX_NONE)
+      return 0;
+
+   end = ui_node_model_end(m, parent);
+
+   return m->position[ui_node_model_ancestor(m, end - 1, parent)] + 1;
+}
+
+/*
+ * first node following the subtree of parent
+ */
+static guint32 ui_node_model_end(UiNodeModel *m, guint32 parent)
+{
+   guint32 i;
+
+   for (i = parent; i != ASN1_INDEX_NONE; i = m->index.nodes[i].parent) {
+      if (m->index.nodes[i].next != ASN1_INDEX_NONE)
+         return MIN(m->index.nodes[i].next, m->index.len);
+   }
+
+   return m->index.len;
+}
+
+/*
+ * the child of parent whose subtree contains node i
+ */
+static guint32 ui_node_model_ancestor(UiNodeModel *m, guint32 i,
+      guint32 parent)
+{
+   while (m->index.nodes[i].parent != parent)
+      i = m->index.nodes[i].parent;
+
+   return i;
+}
+
+/*
+ * matches every top-level element against the known documents;
+ * an element matching none of them completely keeps no notes and is
+ * shown by its tags alone
+ */
+static void ui_node_model_annotate(UiNodeModel *m)
+{
+   guint32 i;
+
+   m->notes = g_new(asn1_schema_note_t, MAX(m->index.len, 1));
+   asn1_schema_notes_init(m->notes, m->index.len);
+
+   for (i = 0; i < m->index.len; i = m->index.nodes[i].next)
+      asn1_schema_recognize(&m->index, i, m->notes);
+}
+
+/*
+ * formats the label of a row when it is rendered
+ */
+static gchar* ui_node_model_label(UiNodeModel *m, guint32 i)
+{
+   asn1_node_t *node = ASN1_INDEX_NODE(&m->index, i);
+   const oid_entry_t *entry;
+   const gchar *name;
+   const guchar *ptr;
+   const asn1_schema_note_t *note = &m->notes[i];
+   const asn1_schema_document_t *document;
+   asn1_tlv_t tlv;
+   asn1_oid_t oid;
+   asn1_string_t str;
+   const gchar *p;
+   gunichar c;
+   guint64 value;
+   gchar tmp[128];
+   gchar text[UI_LABEL_MAX_VALUE * 4];
+   GString *label;
+   gsize j, len;
+
+   asn1_index_tlv(&m->index, i, &tlv);
+   ptr = ASN1_CONTENT(m->cbuf, &tlv);
+
+   /* top-level documents are recognized by their structure */
+   if (node->depth == 0 &&
+       (document = asn1_schema_document(note->type)) != NULL)
+      return g_strdup(document->title);
+
+   label = g_string_sized_new(32);
+
+   /* the component name, or the type of an element of a list */
+   if (note->field != ASN1_SCHEMA_NONE)
+      g_string_append_printf(label, "%s: ", asn1_schema_fields[note->field].name);
+   else if (note->type != ASN1_SCHEMA_NONE && asn1_schema_types[note->type].name)
+      g_string_append_printf(label, "%s: ", asn1_schema_types[note->type].name);
+
+   name = asn1_tag_name(tlv.class, tlv.tag);
+   if (name)
+      g_string_append(label, name);
+   else if (tlv.class == ASN1_CLASS_CONTEXT_SPECIFIC)
+      g_string_append_printf(label, "[%u]", tlv.tag);
+   else if (tlv.class == ASN1_CLASS_APPLICATION)
+      g_string_append_printf(label, "[APPLICATION %u]", tlv.tag);
+   else if (tlv.class == ASN1_CLASS_PRIVATE)
+      g_string_append_printf(label, "[PRIVATE %u]", tlv.tag);
+   else
+      g_string_append_printf(label, "[UNIVERSAL %u]", tlv.tag);
+
+   if (tlv.constructed || tlv.class != ASN1_CLASS_UNIVERSAL) {
+      g_string_append_printf(label, " (%" G_GUINT64_FORMAT " bytes)",
+            tlv.length);
+      return g_string_free(label, FALSE);
+   }
+
+   switch (tlv.tag) {
+      case ASN1_TAG_BOOLEAN:
+         g_string_append(label, tlv.length && ptr[0] ? " TRUE" : " FALSE");
+         break;
+
+      case ASN1_TAG_INTEGER:
+      case ASN1_TAG_ENUMERATED:
+         if (asn1_decode_uint(m->cbuf, &tlv, &value) == E_SUCCESS) {
+            g_string_append_printf(label, " %" G_GUINT64_FORMAT, value);
+            break;
+         }
+         g_string_append(label, " 0x");
+         for (j = 0; j < MIN(tlv.length, UI_LABEL_MAX_VALUE / 2); j++)
+            g_string_append_printf(label, "%02x", ptr[j]);
+         if (tlv.length > UI_LABEL_MAX_VALUE / 2)
+            g_string_append(label, "...");
+         break;
+
+      case ASN1_TAG_OID:
+         if (asn1_decode_oid(m->cbuf, &tlv, &oid) < 0)
+            break;
+         asn1_oid_to_string(&oid, tmp, sizeof(tmp));
+         g_string_append_printf(label, " %s", tmp);
+         entry = oid_lookup(ptr, tlv.length);
+         if (entry)
+            g_string_append_printf(label, " (%s)", entry->name);
+         break;
+
+      case ASN1_TAG_UTF8STRING:
+      case ASN1_TAG_NUMERIC_STRING:
+      case ASN1_TAG_PRINTABLE_STRING:
+      case ASN1_TAG_TG1_STRING:
+      case ASN1_TAG_VIDEO_STRING:
+      case ASN1_TAG_IA5_STRING:
+      case ASN1_TAG_GRAPHIC_STRING:
+      case ASN1_TAG_VISIBLE_STRING:
+      case ASN1_TAG_GENERAL_STRING:
+      case ASN1_TAG_UNIVERSAL_STRING:
+      case ASN1_TAG_BMP_STRING:
+         if (asn1_decode_string(m->cbuf, &tlv, text, sizeof(text), &str) < 0) {
+            g_string_append_printf(label, " (%" G_GUINT64_FORMAT
+                  " bytes, invalid)", tlv.length);
+            break;
+         }
+
+         g_string_append(label, " '");
+         p = str.str;
+         for (j = 0; j < UI_LABEL_MAX_VALUE && p < str.str + str.len; j++) {
+            c = g_utf8_get_char(p);
+            if (c < 0x20 || c == 0x7f)
+               g_string_append_c(label, '.');
+            else
+               g_string_append_unichar(label, c);
+            p = g_utf8_next_char(p);
+         }
+         g_string_append(label, p < str.str + str.len ||
+               (str.flags & ASN1_STRING_TRUNCATED) ? "...'" : "'");
+         break;
+
+      case ASN1_TAG_UTC_TIME:
+      case ASN1_TAG_GERNERALIZED_TIME:
+         len = MIN(tlv.length, UI_LABEL_MAX_VALUE);
+         g_string_append(label, " '");
+         /* labels have to be valid UTF-8 */
+         for (j = 0; j < len; j++)
+            g_string_append_c(label, g_ascii_isprint(ptr[j]) ? ptr[j] : '.');
+         g_string_append(label, tlv.length > len ? "...'" : "'");
+         break;
+
+      case ASN1_TAG_NULL:
+         break;
+
+      default:
+         g_string_append_printf(label, " (%" G_GUINT64_FORMAT " bytes)",
+               tlv.length);
+         break;
+   }
+
+   return g_string_free(label, FALSE);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
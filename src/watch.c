@@ -0,0 +1,850 @@
+/* watch.c - incremental index of certificate directories
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <certalize.h>
+#include <certalize_watch.h>
+#include <certalize_buf.h>
+#include <certalize_loader.h>
+#include <certalize_stream.h>
+#include <certalize_index.h>
+#include <certalize_x509.h>
+#include <certalize_json.h>
+#include <certalize_debug.h>
+
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+/* globals    */
+
+/*
+ * files are parsed once they are closed after writing or moved in,
+ * not while being written
+ */
+#define WATCH_INOTIFY_MASK \
+   (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | \
+    IN_MOVE_SELF | IN_ONLYDIR)
+
+/* the fields kept of every certificate */
+#define WATCH_FIELDS \
+   (STORE_MASK(STORE_COL_SERIAL) | STORE_MASK(STORE_COL_ISSUER) | \
+    STORE_MASK(STORE_COL_SUBJECT) | STORE_MASK(STORE_COL_FINGERPRINT))
+
+typedef struct watch_file watch_file_t;
+
+/* an indexed certificate */
+typedef struct watch_cert {
+   watch_file_t *file;
+   guint64 offset;
+   gint64 not_after;
+   gchar *serial;
+   gchar *subject;
+   gchar *issuer;
+   gchar fingerprint[32 * 2 + 1];
+   /* a certificate of the issuer, if one is indexed */
+   struct watch_cert *link;
+   gboolean expired;
+   /* still contained after the file changed */
+   gboolean kept;
+} watch_cert_t;
+
+struct watch_file {
+   gchar *path;
+   gint wd;
+   /* unchanged files are skipped by a rescan */
+   gint64 mtime;
+   gint64 size;
+   GPtrArray *certs;
+};
+
+typedef struct watch {
+   gint ifd;
+   /* directory paths by watch descriptor */
+   GHashTable *dirs;
+   /* watch_file_t by path */
+   GHashTable *files;
+   /* arrays of the certificates by subject and by issuer name */
+   GHashTable *subjects;
+   GHashTable *issuers;
+   /* certificates not yet expired, ordered by notAfter */
+   GTree *expiry;
+   guint64 certificates;
+   asn1_index_t index;
+   /* splits a file into its records */
+   cstream_t stream;
+   /* the file being parsed again, its certificates before and after */
+   watch_file_t *current;
+   GHashTable *old;
+   GPtrArray *certs;
+   filter_t *filter;
+   guint32 mask;
+   filter_fields_t fields;
+   json_writer_t json;
+   guchar *outbuf;
+} watch_t;
+
+/* prototypes */
+static int  watch_add_dir(watch_t *w, const gchar *dir);
+static void watch_scan(watch_t *w, gint wd, const gchar *dir);
+static void watch_rescan(watch_t *w);
+static void watch_remove_dir(watch_t *w, gint wd);
+static int  watch_read(watch_t *w);
+static void watch_file_update(watch_t *w, const gchar *path, gint wd);
+static int  watch_record(const guchar *der, gsize len, guint64 offset,
+                         gpointer data);
+static void watch_file_remove(watch_t *w, const gchar *path);
+static void watch_file_free(gpointer data);
+static watch_cert_t* watch_cert_new(watch_t *w, watch_file_t *file,
+                                    x509_cert_t *x509, guint64 offset);
+static void watch_cert_add(watch_t *w, watch_cert_t *cert);
+static void watch_cert_remove(watch_t *w, watch_cert_t *cert);
+static void watch_cert_free(watch_cert_t *cert);
+static void watch_names_add(GHashTable *names, const gchar *name,
+                            watch_cert_t *cert);
+static void watch_names_remove(GHashTable *names, const gchar *name,
+                               watch_cert_t *cert);
+static watch_cert_t* watch_names_first(GHashTable *names,
+                                       const gchar *name);
+static gint watch_expire(watch_t *w);
+static gint watch_expiry_compare(gconstpointer a, gconstpointer b);
+static gboolean watch_expiry_first(gpointer key, gpointer value,
+                                   gpointer data);
+static void watch_emit_issuer(json_writer_t *jw, watch_cert_t *cert);
+static void watch_emit_added(watch_t *w, watch_cert_t *cert);
+static void watch_emit_event(watch_t *w, const gchar *event,
+                             watch_cert_t *cert);
+static void watch_emit_link(watch_t *w, watch_cert_t *cert);
+static void watch_emit_error(watch_t *w, const gchar *path,
+                             guint64 offset, const gchar *message);
+static void watch_emit_ready(watch_t *w);
+
+
+/*************/
+
+/*
+ * indexes the certificates of the directories and reports their
+ * changes until SIGINT or SIGTERM
+ *   - only the files named by an inotify event are parsed again,
+ *     split into records by loader_stream(), and compared by
+ *     fingerprint with what the index holds of them
+ *   - an overflow of the event queue rescans the directories,
+ *     skipping the files whose size and time did not change
+ *   - certificates are linked to an indexed certificate of their
+ *     issuer by name
+ */
+int watch_run(GPtrArray *dirs, filter_t *filter,
+              const asn1_limits_t *limits)
+{
+   struct pollfd fds[2];
+   sigset_t mask;
+   watch_t w;
+   gint sfd, timeout;
+   guint i;
+   int res = E_SUCCESS;
+
+   if (dirs->len == 0) {
+      g_printerr("no directory to watch\n");
+      return E_INVALID;
+   }
+
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGINT);
+   sigaddset(&mask, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+   if ((sfd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0) {
+      g_printerr("creating signalfd failed: %s\n", g_strerror(errno));
+      return E_INVALID;
+   }
+
+   memset(&w, 0, sizeof(watch_t));
+
+   if ((w.ifd = inotify_init1(IN_CLOEXEC)) < 0) {
+      g_printerr("initializing inotify failed: %s\n", g_strerror(errno));
+      close(sfd);
+      return E_INVALID;
+   }
+
+   w.dirs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+   w.files = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+         watch_file_free);
+   w.subjects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+         (GDestroyNotify)g_ptr_array_unref);
+   w.issuers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+         (GDestroyNotify)g_ptr_array_unref);
+   w.expiry = g_tree_new(watch_expiry_compare);
+   w.filter = filter;
+   w.mask = WATCH_FIELDS | (filter ? filter_mask(filter) : 0);
+   w.outbuf = g_malloc(JSON_DEFAULT_BUFSIZE);
+   asn1_index_init(&w.index);
+   asn1_index_set_limits(&w.index, limits);
+   cstream_init(&w.stream, watch_record, &w);
+   filter_fields_init(&w.fields);
+   json_init(&w.json, STDOUT_FILENO, w.outbuf, JSON_DEFAULT_BUFSIZE);
+
+   /* watched before they are scanned so no change is missed */
+   for (i = 0; i < dirs->len && res == E_SUCCESS; i++)
+      res = watch_add_dir(&w, g_ptr_array_index(dirs, i));
+
+   if (res == E_SUCCESS) {
+      watch_emit_ready(&w);
+
+      fds[0].fd = w.ifd;
+      fds[0].events = POLLIN;
+      fds[1].fd = sfd;
+      fds[1].events = POLLIN;
+
+      /* the deltas are written as soon as they are known */
+      while (g_hash_table_size(w.dirs)) {
+         timeout = watch_expire(&w);
+         json_flush(&w.json);
+
+         if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR)
+               continue;
+            break;
+         }
+
+         if (fds[1].revents)
+            break;
+
+         if ((fds[0].revents & POLLIN) && watch_read(&w) < 0)
+            break;
+      }
+   }
+
+   json_flush(&w.json);
+
+   close(w.ifd);
+   close(sfd);
+
+   g_tree_destroy(w.expiry);
+   g_hash_table_destroy(w.subjects);
+   g_hash_table_destroy(w.issuers);
+   g_hash_table_destroy(w.files);
+   g_hash_table_destroy(w.dirs);
+   asn1_index_destroy(&w.index);
+   cstream_destroy(&w.stream);
+   filter_fields_destroy(&w.fields);
+   g_free(w.outbuf);
+
+   return res;
+}
+
+/*
+ * watches the directory and indexes the files it holds
+ */
+static int watch_add_dir(watch_t *w, const gchar *dir)
+{
+   gint wd;
+
+   if (!g_file_test(dir, G_FILE_TEST_IS_DIR)) {
+      g_printerr("'%s' is not a directory\n", dir);
+      return E_INVALID;
+   }
+
+   if ((wd = inotify_add_watch(w->ifd, dir, WATCH_INOTIFY_MASK)) < 0) {
+      g_printerr("watching '%s' failed: %s\n", dir, g_strerror(errno));
+      return E_INVALID;
+   }
+
+   g_hash_table_insert(w->dirs, GINT_TO_POINTER(wd), g_strdup(dir));
+   watch_scan(w, wd, dir);
+
+   return E_SUCCESS;
+}
+
+/*
+ * brings the index of a directory up to date with its content
+ */
+static void watch_scan(watch_t *w, gint wd, const gchar *dir)
+{
+   GHashTableIter iter;
+   GPtrArray *paths, *gone;
+   GHashTable *seen;
+   watch_file_t *file;
+   struct stat st;
+   const gchar *path;
+   gchar *base;
+   guint i;
+
+   paths = g_ptr_array_new_with_free_func(g_free);
+   seen = g_hash_table_new(g_str_hash, g_str_equal);
+   loader_expand(paths, dir);
+
+   for (i = 0; i < paths->len; i++) {
+      path = g_ptr_array_index(paths, i);
+
+      base = g_path_get_basename(path);
+      if (*base == '.') {
+         g_free(base);
+         continue;
+      }
+      g_free(base);
+
+      g_hash_table_add(seen, (gpointer)path);
+
+      file = g_hash_table_lookup(w->files, path);
+      if (file && stat(path, &st) == 0 && file->size == st.st_size &&
+          file->mtime == st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+             st.st_mtim.tv_nsec)
+         continue;
+
+      watch_file_update(w, path, wd);
+   }
+
+   /* files which went away while events were lost */
+   gone = g_ptr_array_new();
+   g_hash_table_iter_init(&iter, w->files);
+   while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&file))
+      if (file->wd == wd && !g_hash_table_contains(seen, file->path))
+         g_ptr_array_add(gone, g_strdup(file->path));
+
+   for (i = 0; i < gone->len; i++) {
+      watch_file_remove(w, g_ptr_array_index(gone, i));
+      g_free(g_ptr_array_index(gone, i));
+   }
+
+   g_ptr_array_free(gone, TRUE);
+   g_hash_table_destroy(seen);
+   g_ptr_array_free(paths, TRUE);
+}
+
+static void watch_rescan(watch_t *w)
+{
+   GHashTableIter iter;
+   gpointer wd, dir;
+
+   DEBUG_MSG("watch_rescan: event queue overflow");
+
+   g_hash_table_iter_init(&iter, w->dirs);
+   while (g_hash_table_iter_next(&iter, &wd, &dir))
+      watch_scan(w, GPOINTER_TO_INT(wd), dir);
+}
+
+/*
+ * drops the files of a directory which is no longer watched
+ */
+static void watch_remove_dir(watch_t *w, gint wd)
+{
+   GHashTableIter iter;
+   watch_file_t *file;
+   GPtrArray *gone;
+   guint i;
+
+   gone = g_ptr_array_new_with_free_func(g_free);
+   g_hash_table_iter_init(&iter, w->files);
+   while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&file))
+      if (file->wd == wd)
+         g_ptr_array_add(gone, g_strdup(file->path));
+
+   for (i = 0; i < gone->len; i++)
+      watch_file_remove(w, g_ptr_array_index(gone, i));
+
+   g_ptr_array_free(gone, TRUE);
+   g_hash_table_remove(w->dirs, GINT_TO_POINTER(wd));
+}
+
+/*
+ * handles the pending inotify events
+ */
+static int watch_read(watch_t *w)
+{
+   guchar buf[WATCH_EVENT_BUFSIZE]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+   const struct inotify_event *event;
+   const gchar *dir;
+   gchar *path;
+   gssize len;
+   gsize pos;
+
+   if ((len = read(w->ifd, buf, sizeof(buf))) < 0)
+      return errno == EINTR ? E_SUCCESS : -E_INVALID;
+
+   for (pos = 0; pos < (gsize)len;
+        pos += sizeof(struct inotify_event) + event->len) {
+      event = (const struct inotify_event*)(buf + pos);
+
+      if (event->mask & IN_Q_OVERFLOW) {
+         watch_rescan(w);
+         continue;
+      }
+
+      /* the directory was deleted, moved away or unmounted */
+      if (event->mask & IN_IGNORED) {
+         watch_remove_dir(w, event->wd);
+         continue;
+      }
+
+      if (event->mask & IN_MOVE_SELF) {
+         inotify_rm_watch(w->ifd, event->wd);
+         continue;
+      }
+
+      if (event->len == 0 || event->name[0] == '.')
+         continue;
+
+      if ((dir = g_hash_table_lookup(w->dirs,
+            GINT_TO_POINTER(event->wd))) == NULL)
+         continue;
+
+      path = g_build_filename(dir, event->name, NULL);
+
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+         watch_file_update(w, path, event->wd);
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+         watch_file_remove(w, path);
+
+      g_free(path);
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * parses the file again and reports the certificates it gained and
+ * lost; those it still holds are matched by fingerprint, one for one
+ * when the file carries the same certificate more than once
+ */
+static void watch_file_update(watch_t *w, const gchar *path, gint wd)
+{
+   watch_file_t *file;
+   watch_cert_t *cert;
+   struct stat st;
+   GList *same;
+   guint i;
+   int res;
+
+   if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+      watch_file_remove(w, path);
+      return;
+   }
+
+   DEBUG_MSG("watch_file_update('%s')", path);
+
+   if ((file = g_hash_table_lookup(w->files, path)) == NULL) {
+      file = g_new0(watch_file_t, 1);
+      file->path = g_strdup(path);
+      file->certs = g_ptr_array_new();
+      g_hash_table_insert(w->files, file->path, file);
+   }
+
+   file->wd = wd;
+   file->size = st.st_size;
+   file->mtime = st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+      st.st_mtim.tv_nsec;
+
+   /* fingerprint -> the certificates carrying it, in file order */
+   w->old = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+         (GDestroyNotify)g_list_free);
+   for (i = file->certs->len; i > 0; i--) {
+      cert = g_ptr_array_index(file->certs, i - 1);
+      cert->kept = FALSE;
+      same = g_hash_table_lookup(w->old, cert->fingerprint);
+      g_hash_table_steal(w->old, cert->fingerprint);
+      g_hash_table_insert(w->old, cert->fingerprint,
+            g_list_prepend(same, cert));
+   }
+
+   w->current = file;
+   w->certs = g_ptr_array_new();
+
+   /* PEM bundles and compressed files hold many records */
+   res = loader_stream(path, &w->stream);
+   if (res == -E_NOTFOUND)
+      watch_emit_error(w, path, 0, "unable to load file");
+   else if (res < 0)
+      watch_emit_error(w, path, w->stream.record_offset,
+            "invalid or truncated record");
+
+   g_hash_table_destroy(w->old);
+   w->old = NULL;
+   w->current = NULL;
+
+   /* removed after the new ones are in, so issuers are relinked once */
+   for (i = 0; i < file->certs->len; i++) {
+      cert = g_ptr_array_index(file->certs, i);
+      if (!cert->kept) {
+         watch_cert_remove(w, cert);
+         watch_cert_free(cert);
+      }
+   }
+
+   g_ptr_array_free(file->certs, TRUE);
+   file->certs = w->certs;
+   w->certs = NULL;
+}
+
+/*
+ * matches one record of the file being parsed with the certificates
+ * it held before, a new one is entered into the index
+ */
+static int watch_record(const guchar *der, gsize len, guint64 offset,
+                        gpointer data)
+{
+   watch_t *w = data;
+   watch_file_t *file = w->current;
+   watch_cert_t *cert;
+   x509_cert_t x509;
+   GList *same;
+   cbuf_t cbuf;
+
+   if (der == NULL) {
+      watch_emit_error(w, file->path, offset, "invalid PEM record");
+      return E_SUCCESS;
+   }
+
+   /* the record is only borrowed for the time of the callback */
+   memset(&cbuf, 0, sizeof(cbuf_t));
+   cbuf.buffer = (guchar*)der;
+   cbuf.length = len;
+
+   if (asn1_index_element(&w->index, &cbuf, 0) < 0 ||
+       x509_parse_index(&cbuf, &w->index, 0, &x509) < 0) {
+      watch_emit_error(w, file->path, offset,
+            w->index.error > ASN1_INDEX_MALFORMED ?
+            asn1_index_strerror(&w->index) : "invalid certificate");
+      return E_SUCCESS;
+   }
+
+   filter_fields_decode(&w->fields, w->mask, &cbuf, &x509, file->path,
+         offset);
+   if (w->filter && !filter_match(w->filter, &w->fields))
+      return E_SUCCESS;
+
+   same = g_hash_table_lookup(w->old, w->fields.fingerprint);
+   if (same) {
+      cert = same->data;
+      g_hash_table_steal(w->old, cert->fingerprint);
+      same = g_list_delete_link(same, same);
+      if (same) {
+         g_hash_table_insert(w->old,
+               ((watch_cert_t *)same->data)->fingerprint, same);
+      }
+      cert->kept = TRUE;
+      cert->offset = offset;
+   }
+   else {
+      cert = watch_cert_new(w, file, &x509, offset);
+      watch_cert_add(w, cert);
+   }
+
+   g_ptr_array_add(w->certs, cert);
+
+   return E_SUCCESS;
+}
+
+static void watch_file_remove(watch_t *w, const gchar *path)
+{
+   watch_file_t *file;
+   guint i;
+
+   if ((file = g_hash_table_lookup(w->files, path)) == NULL)
+      return;
+
+   DEBUG_MSG("watch_file_remove('%s')", path);
+
+   for (i = 0; i < file->certs->len; i++)
+      watch_cert_remove(w, g_ptr_array_index(file->certs, i));
+
+   g_hash_table_remove(w->files, file->path);
+}
+
+static void watch_file_free(gpointer data)
+{
+   watch_file_t *file = data;
+   guint i;
+
+   for (i = 0; i < file->certs->len; i++)
+      watch_cert_free(g_ptr_array_index(file->certs, i));
+
+   g_ptr_array_free(file->certs, TRUE);
+   g_free(file->path);
+   g_free(file);
+}
+
+/*
+ * the index entry of the certificate whose fields were just decoded
+ */
+static watch_cert_t* watch_cert_new(watch_t *w, watch_file_t *file,
+                                    x509_cert_t *x509, guint64 offset)
+{
+   filter_fields_t *f = &w->fields;
+   watch_cert_t *cert;
+
+   cert = g_new0(watch_cert_t, 1);
+   cert->file = file;
+   cert->offset = offset;
+   cert->not_after = x509->not_after_time;
+   cert->serial = g_strndup(f->strs[STORE_COL_SERIAL],
+         f->lens[STORE_COL_SERIAL]);
+   cert->subject = g_strndup(f->strs[STORE_COL_SUBJECT],
+         f->lens[STORE_COL_SUBJECT]);
+   cert->issuer = g_strndup(f->strs[STORE_COL_ISSUER],
+         f->lens[STORE_COL_ISSUER]);
+   g_strlcpy(cert->fingerprint, f->fingerprint, sizeof(cert->fingerprint));
+
+   return cert;
+}
+
+/*
+ * enters the certificate into the index and links it to its issuer
+ * and to the certificates it issued which had none so far
+ */
+static void watch_cert_add(watch_t *w, watch_cert_t *cert)
+{
+   GPtrArray *issued;
+   watch_cert_t *child;
+   guint i;
+
+   watch_names_add(w->subjects, cert->subject, cert);
+   watch_names_add(w->issuers, cert->issuer, cert);
+   cert->link = watch_names_first(w->subjects, cert->issuer);
+
+   cert->expired = cert->not_after < g_get_real_time() / G_USEC_PER_SEC;
+   if (!cert->expired)
+      g_tree_insert(w->expiry, cert, cert);
+
+   w->certificates++;
+   watch_emit_added(w, cert);
+
+   if ((issued = g_hash_table_lookup(w->issuers, cert->subject)) == NULL)
+      return;
+
+   for (i = 0; i < issued->len; i++) {
+      child = g_ptr_array_index(issued, i);
+      if (child != cert && child->link == NULL) {
+         child->link = cert;
+         watch_emit_link(w, child);
+      }
+   }
+}
+
+/*
+ * takes the certificate out of the index; the certificates linked
+ * to it move on to another one of the same name, if any
+ */
+static void watch_cert_remove(watch_t *w, watch_cert_t *cert)
+{
+   GPtrArray *issued;
+   watch_cert_t *child;
+   guint i;
+
+   watch_names_remove(w->subjects, cert->subject, cert);
+   watch_names_remove(w->issuers, cert->issuer, cert);
+
+   if (!cert->expired)
+      g_tree_remove(w->expiry, cert);
+
+   w->certificates--;
+   watch_emit_event(w, "removed", cert);
+
+   if ((issued = g_hash_table_lookup(w->issuers, cert->subject)) == NULL)
+      return;
+
+   for (i = 0; i < issued->len; i++) {
+      child = g_ptr_array_index(issued, i);
+      if (child->link == cert) {
+         child->link = watch_names_first(w->subjects, cert->subject);
+         watch_emit_link(w, child);
+      }
+   }
+}
+
+static void watch_cert_free(watch_cert_t *cert)
+{
+   g_free(cert->serial);
+   g_free(cert->subject);
+   g_free(cert->issuer);
+   g_free(cert);
+}
+
+static void watch_names_add(GHashTable *names, const gchar *name,
+                            watch_cert_t *cert)
+{
+   GPtrArray *certs;
+
+   if ((certs = g_hash_table_lookup(names, name)) == NULL) {
+      certs = g_ptr_array_new();
+      g_hash_table_insert(names, g_strdup(name), certs);
+   }
+
+   g_ptr_array_add(certs, cert);
+}
+
+static void watch_names_remove(GHashTable *names, const gchar *name,
+                               watch_cert_t *cert)
+{
+   GPtrArray *certs;
+
+   if ((certs = g_hash_table_lookup(names, name)) == NULL)
+      return;
+
+   g_ptr_array_remove_fast(certs, cert);
+
+   if (certs->len == 0)
+      g_hash_table_remove(names, name);
+}
+
+static watch_cert_t* watch_names_first(GHashTable *names,
+                                       const gchar *name)
+{
+   GPtrArray *certs;
+
+   certs = g_hash_table_lookup(names, name);
+
+   return certs && certs->len ? g_ptr_array_index(certs, 0) : NULL;
+}
+
+/*
+ * reports the certificates which expired by now; returns the
+ * milliseconds until the next one does or -1 if none will
+ */
+static gint watch_expire(watch_t *w)
+{
+   watch_cert_t *cert;
+   gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+   for (;;) {
+      cert = NULL;
+      g_tree_foreach(w->expiry, watch_expiry_first, &cert);
+
+      if (cert == NULL)
+         return -1;
+
+      if (cert->not_after >= now)
+         break;
+
+      g_tree_remove(w->expiry, cert);
+      cert->expired = TRUE;
+      watch_emit_event(w, "expired", cert);
+   }
+
+   return (gint)MIN((cert->not_after - now + 1) * 1000, G_MAXINT);
+}
+
+static gint watch_expiry_compare(gconstpointer a, gconstpointer b)
+{
+   const watch_cert_t *x = a, *y = b;
+
+   if (x->not_after != y->not_after)
+      return x->not_after < y->not_after ? -1 : 1;
+
+   return x < y ? -1 : x > y;
+}
+
+static gboolean watch_expiry_first(gpointer key, gpointer value,
+                                   gpointer data)
+{
+   *(watch_cert_t**)data = value;
+
+   return TRUE;
+}
+
+static void watch_emit_issuer(json_writer_t *jw, watch_cert_t *cert)
+{
+   json_key(jw, "issuer_fingerprint");
+   if (cert->link)
+      json_string(jw, cert->link->fingerprint, -1);
+   else
+      json_null(jw);
+}
+
+static void watch_emit_added(watch_t *w, watch_cert_t *cert)
+{
+   json_writer_t *jw = &w->json;
+   gchar tmp[X509_NAME_MAXLEN];
+   gsize len;
+
+   json_object_begin(jw);
+   json_member_string(jw, "event", "added");
+   json_member_string(jw, "file", cert->file->path);
+   json_member_uint(jw, "offset", cert->offset);
+   json_member_string(jw, "fingerprint", cert->fingerprint);
+   json_member_string(jw, "serial", cert->serial);
+   json_member_string(jw, "subject", cert->subject);
+   json_member_string(jw, "issuer", cert->issuer);
+
+   len = x509_time_to_string(cert->not_after, tmp, sizeof(tmp));
+   json_key(jw, "not_after");
+   json_string(jw, tmp, len);
+
+   watch_emit_issuer(jw, cert);
+   json_member_bool(jw, "expired", cert->expired);
+   json_object_end(jw);
+   json_newline(jw);
+}
+
+static void watch_emit_event(watch_t *w, const gchar *event,
+                             watch_cert_t *cert)
+{
+   json_writer_t *jw = &w->json;
+
+   json_object_begin(jw);
+   json_member_string(jw, "event", event);
+   json_member_string(jw, "file", cert->file->path);
+   json_member_uint(jw, "offset", cert->offset);
+   json_member_string(jw, "fingerprint", cert->fingerprint);
+   json_object_end(jw);
+   json_newline(jw);
+}
+
+static void watch_emit_link(watch_t *w, watch_cert_t *cert)
+{
+   json_writer_t *jw = &w->json;
+
+   json_object_begin(jw);
+   json_member_string(jw, "event", "linked");
+   json_member_string(jw, "fingerprint", cert->fingerprint);
+   watch_emit_issuer(jw, cert);
+   json_object_end(jw);
+   json_newline(jw);
+}
+
+static void watch_emit_error(watch_t *w, const gchar *path,
+                             guint64 offset, const gchar *message)
+{
+   json_writer_t *jw = &w->json;
+
+   json_object_begin(jw);
+   json_member_string(jw, "event", "error");
+   json_member_string(jw, "file", path);
+   json_member_uint(jw, "offset", offset);
+   json_member_string(jw, "error", message);
+   json_object_end(jw);
+   json_newline(jw);
+}
+
+static void watch_emit_ready(watch_t *w)
+{
+   json_writer_t *jw = &w->json;
+
+   json_object_begin(jw);
+   json_member_string(jw, "event", "ready");
+   json_member_uint(jw, "files", g_hash_table_size(w->files));
+   json_member_uint(jw, "certificates", w->certificates);
+   json_object_end(jw);
+   json_newline(jw);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
@@ -0,0 +1,602 @@
+/* x509.c - decoding X.509 certificate fields
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <certalize.h>
+#include <certalize_x509.h>
+#include <certalize_oid.h>
+#include <certalize_string.h>
+#include <certalize_debug.h>
+
+/* globals    */
+
+/* OID contents and what they stand for */
+typedef struct x509_oid_value {
+   const gchar *der;
+   gsize der_len;
+   guint value;
+} x509_oid_value_t;
+
+/* public key algorithms by type */
+static const x509_oid_value_t x509_key_algorithms[] = {
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x01", 9, X509_KEY_RSA },
+   { "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0a", 9, X509_KEY_RSA },
+   { "\x2a\x86\x48\xce\x38\x04\x01", 7, X509_KEY_DSA },
+   { "\x2a\x86\x48\xce\x3d\x02\x01", 7, X509_KEY_EC },
+   { "\x2b\x65\x70", 3, X509_KEY_ED25519 },
+   { "\x2b\x65\x71", 3, X509_KEY_ED448 },
+};
+
+/* named curves by field size */
+static const x509_oid_value_t x509_curves[] = {
+   { "\x2a\x86\x48\xce\x3d\x03\x01\x07", 8, 256 },     /* prime256v1 */
+   { "\x2b\x81\x04\x00\x22", 5, 384 },                    /* secp384r1 */
+   { "\x2b\x81\x04\x00\x23", 5, 521 },                    /* secp521r1 */
+   { "\x2b\x81\x04\x00\x21", 5, 224 },                    /* secp224r1 */
+   { "\x2b\x81\x04\x00\x0a", 5, 256 },                    /* secp256k1 */
+   { "\x2b\x24\x03\x03\x02\x08\x01\x01\x07", 9, 256 }, /* brainpoolP256r1 */
+   { "\x2b\x24\x03\x03\x02\x08\x01\x01\x0b", 9, 384 }, /* brainpoolP384r1 */
+   { "\x2b\x24\x03\x03\x02\x08\x01\x01\x0d", 9, 512 }, /* brainpoolP512r1 */
+};
+
+/* id-ce-subjectAltName */
+#define X509_OID_SAN                "\x55\x1d\x11"
+
+/* prototypes */
+static int   x509_node(asn1_index_t *index, guint32 n, asn1_tlv_t *tlv);
+static guint x509_oid_value(const x509_oid_value_t *table, guint count,
+                            cbuf_t *cbuf, asn1_tlv_t *oid);
+static guint x509_integer_bits(cbuf_t *cbuf, asn1_tlv_t *integer);
+static void  x509_append_general_name(GByteArray *out, cbuf_t *cbuf,
+                                      asn1_tlv_t *name);
+static gsize x509_append(gchar *buf, gsize size, gsize pos,
+                         const gchar *str, gsize len);
+static gsize x509_append_hex(gchar *buf, gsize size, gsize pos,
+                             const guchar *data, gsize len);
+
+
+/*************/
+
+/*
+ * decodes the certificate at offset
+ */
+int x509_parse(cbuf_t *cbuf, guint64 offset, x509_cert_t *cert)
+{
+   asn1_index_t index;
+   int res;
+
+   asn1_index_init(&index);
+
+   res = asn1_index_element(&index, cbuf, offset);
+   if (res == E_SUCCESS)
+      res = x509_parse_index(cbuf, &index, 0, cert);
+
+   asn1_index_destroy(&index);
+
+   return res;
+}
+
+/*
+ * decodes the certificate at node of the index,
+ * no header is decoded again
+ *
+ *   Certificate  ::=  SEQUENCE  {
+ *        tbsCertificate       TBSCertificate,
+ *        signatureAlgorithm   AlgorithmIdentifier,
+ *        signatureValue       BIT STRING  }
+ */
+int x509_parse_index(cbuf_t *cbuf, asn1_index_t *index, guint32 node,
+                     x509_cert_t *cert)
+{
+   guint32 tbs, n;
+
+   memset(cert, 0, sizeof(x509_cert_t));
+
+   if (asn1_index_tlv(index, node, &cert->certificate) < 0 ||
+       !cert->certificate.constructed ||
+       !ASN1_IS(&cert->certificate, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE)) {
+      DEBUG_MSG("x509_parse: certificate must start with a Sequence");
+      return -E_INVALID;
+   }
+
+   /* TBSCertificate */
+   tbs = ASN1_INDEX_CHILD(index, node);
+   if (x509_node(index, tbs, &cert->tbs) < 0 ||
+       !ASN1_IS(&cert->tbs, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE))
+      return -E_INVALID;
+
+   n = ASN1_INDEX_NEXT(index, tbs);
+   if (x509_node(index, n, &cert->signature_algorithm) < 0)
+      return -E_INVALID;
+
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->signature_value) < 0 ||
+       !ASN1_IS(&cert->signature_value, ASN1_CLASS_UNIVERSAL, ASN1_TAG_BITSTRING))
+      return -E_INVALID;
+
+   /* version  [0]  EXPLICIT Version DEFAULT v1 */
+   n = ASN1_INDEX_CHILD(index, tbs);
+   if (n == ASN1_INDEX_NONE)
+      return -E_INVALID;
+
+   cert->version = 1;
+   if (ASN1_INDEX_NODE(index, n)->class == ASN1_CLASS_CONTEXT_SPECIFIC &&
+       ASN1_INDEX_NODE(index, n)->tag == 0) {
+      asn1_tlv_t version;
+      guint64 value;
+
+      if (x509_node(index, ASN1_INDEX_CHILD(index, n), &version) < 0 ||
+          asn1_decode_uint(cbuf, &version, &value) < 0 || value > 2)
+         return -E_INVALID;
+      cert->version = value + 1;
+
+      n = ASN1_INDEX_NEXT(index, n);
+   }
+
+   /* serialNumber */
+   if (x509_node(index, n, &cert->serial) < 0 ||
+       !ASN1_IS(&cert->serial, ASN1_CLASS_UNIVERSAL, ASN1_TAG_INTEGER))
+      return -E_INVALID;
+
+   /* signature */
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->signature) < 0)
+      return -E_INVALID;
+
+   /* issuer */
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->issuer) < 0)
+      return -E_INVALID;
+
+   /* validity */
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->validity) < 0)
+      return -E_INVALID;
+
+   if (x509_node(index, ASN1_INDEX_CHILD(index, n), &cert->not_before) < 0 ||
+       asn1_decode_time(cbuf, &cert->not_before, &cert->not_before_time) < 0)
+      return -E_INVALID;
+
+   if (x509_node(index, ASN1_INDEX_NEXT(index, ASN1_INDEX_CHILD(index, n)),
+            &cert->not_after) < 0 ||
+       asn1_decode_time(cbuf, &cert->not_after, &cert->not_after_time) < 0)
+      return -E_INVALID;
+
+   /* subject */
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->subject) < 0)
+      return -E_INVALID;
+
+   /* subjectPublicKeyInfo */
+   n = ASN1_INDEX_NEXT(index, n);
+   if (x509_node(index, n, &cert->spki) < 0)
+      return -E_INVALID;
+
+   if (x509_node(index, ASN1_INDEX_CHILD(index, n), &cert->spki_algorithm) < 0)
+      return -E_INVALID;
+
+   if (x509_node(index, ASN1_INDEX_NEXT(index, ASN1_INDEX_CHILD(index, n)),
+            &cert->spki_key) < 0 ||
+       !ASN1_IS(&cert->spki_key, ASN1_CLASS_UNIVERSAL, ASN1_TAG_BITSTRING))
+      return -E_INVALID;
+
+   /* skip unique identifiers, pick up the extensions */
+   while ((n = ASN1_INDEX_NEXT(index, n)) != ASN1_INDEX_NONE) {
+      if (ASN1_INDEX_NODE(index, n)->class == ASN1_CLASS_CONTEXT_SPECIFIC &&
+          ASN1_INDEX_NODE(index, n)->tag == 3) {
+         if (x509_node(index, ASN1_INDEX_CHILD(index, n), &cert->extensions) < 0)
+            return -E_INVALID;
+         break;
+      }
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * decodes the subject public key of the certificate; the RSA key is
+ * read in place from the BIT STRING
+ *
+ *   RSAPublicKey ::= SEQUENCE {
+ *        modulus              INTEGER,
+ *        publicExponent       INTEGER  }
+ *
+ *   Dss-Parms ::= SEQUENCE { p INTEGER, q INTEGER, g INTEGER }
+ *
+ * keys of unknown algorithms are X509_KEY_UNKNOWN, not an error
+ */
+int x509_public_key(cbuf_t *cbuf, x509_cert_t *cert, x509_key_t *key)
+{
+   asn1_tlv_t algorithm, params, rsa, p;
+   gboolean has_params;
+
+   memset(key, 0, sizeof(x509_key_t));
+
+   if (asn1_first_child(cbuf, &cert->spki_algorithm, &algorithm) < 0 ||
+       !ASN1_IS(&algorithm, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID))
+      return -E_INVALID;
+
+   params = algorithm;
+   has_params = asn1_next_child(cbuf, &cert->spki_algorithm,
+         &params) == E_SUCCESS;
+
+   key->type = x509_oid_value(x509_key_algorithms,
+         G_N_ELEMENTS(x509_key_algorithms), cbuf, &algorithm);
+
+   switch (key->type) {
+      case X509_KEY_RSA:
+         /* the key follows the octet of unused bits, which must be 0 */
+         if (cert->spki_key.length < 1 ||
+             ASN1_CONTENT(cbuf, &cert->spki_key)[0] != 0 ||
+             asn1_read_tlv(cbuf, cert->spki_key.offset +
+                cert->spki_key.hdr_len + 1, &rsa) < 0 ||
+             ASN1_END(&rsa) > ASN1_END(&cert->spki_key) ||
+             !ASN1_IS(&rsa, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE))
+            return -E_INVALID;
+
+         if (asn1_first_child(cbuf, &rsa, &key->modulus) < 0 ||
+             !ASN1_IS(&key->modulus, ASN1_CLASS_UNIVERSAL, ASN1_TAG_INTEGER))
+            return -E_INVALID;
+
+         key->exponent = key->modulus;
+         if (asn1_next_child(cbuf, &rsa, &key->exponent) < 0 ||
+             !ASN1_IS(&key->exponent, ASN1_CLASS_UNIVERSAL, ASN1_TAG_INTEGER))
+            return -E_INVALID;
+
+         key->bits = x509_integer_bits(cbuf, &key->modulus);
+         break;
+
+      case X509_KEY_DSA:
+         /* the parameters may be inherited from the issuer */
+         if (has_params &&
+             ASN1_IS(&params, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE) &&
+             asn1_first_child(cbuf, &params, &p) == E_SUCCESS &&
+             ASN1_IS(&p, ASN1_CLASS_UNIVERSAL, ASN1_TAG_INTEGER))
+            key->bits = x509_integer_bits(cbuf, &p);
+         break;
+
+      case X509_KEY_EC:
+         /* explicit curve parameters are left alone */
+         if (has_params &&
+             ASN1_IS(&params, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID)) {
+            key->curve = params;
+            key->bits = x509_oid_value(x509_curves,
+                  G_N_ELEMENTS(x509_curves), cbuf, &params);
+         }
+         break;
+
+      case X509_KEY_ED25519:
+         key->bits = 256;
+         break;
+
+      case X509_KEY_ED448:
+         key->bits = 456;
+         break;
+   }
+
+   return E_SUCCESS;
+}
+
+/*
+ * formats a distinguished name as "CN=foo, O=bar" in encoding order,
+ * the values converted to UTF-8
+ * returns the length of the string written to buf
+ */
+gsize x509_name_to_string(cbuf_t *cbuf, asn1_tlv_t *name,
+                          gchar *buf, gsize size)
+{
+   asn1_tlv_t rdn, atv, type, value;
+   const oid_entry_t *entry;
+   asn1_string_t str;
+   asn1_oid_t oid;
+   gchar dotted[128];
+   gchar text[X509_NAME_MAXLEN];
+   gsize pos = 0;
+   int res;
+
+   if (size == 0)
+      return 0;
+   buf[0] = 0;
+
+   /* Name ::= SEQUENCE OF RelativeDistinguishedName */
+   for (res = asn1_first_child(cbuf, name, &rdn); res == E_SUCCESS;
+        res = asn1_next_child(cbuf, name, &rdn)) {
+
+      /* RelativeDistinguishedName ::= SET OF AttributeTypeAndValue */
+      for (res = asn1_first_child(cbuf, &rdn, &atv); res == E_SUCCESS;
+           res = asn1_next_child(cbuf, &rdn, &atv)) {
+
+         if (asn1_first_child(cbuf, &atv, &type) < 0)
+            return pos;
+         value = type;
+         if (asn1_next_child(cbuf, &atv, &value) < 0)
+            return pos;
+
+         if (pos)
+            pos = x509_append(buf, size, pos, ", ", 2);
+
+         entry = oid_lookup(ASN1_CONTENT(cbuf, &type), type.length);
+         if (entry && entry->short_name) {
+            pos = x509_append(buf, size, pos, entry->short_name,
+                  strlen(entry->short_name));
+         }
+         else if (asn1_decode_oid(cbuf, &type, &oid) == E_SUCCESS) {
+            asn1_oid_to_string(&oid, dotted, sizeof(dotted));
+            pos = x509_append(buf, size, pos, dotted, strlen(dotted));
+         }
+         pos = x509_append(buf, size, pos, "=", 1);
+
+         /* other values as "#" and their encoding in hex, see RFC 4514 */
+         if (asn1_decode_string(cbuf, &value, text, sizeof(text),
+                  &str) == E_SUCCESS)
+            pos = x509_append(buf, size, pos, str.str, str.len);
+         else
+            pos = x509_append_hex(buf, size, pos, cbuf->buffer + value.offset,
+                  value.hdr_len + value.length);
+      }
+   }
+
+   return pos;
+}
+
+/*
+ * returns the name of the algorithm of an AlgorithmIdentifier;
+ * unknown algorithms are formatted in dotted notation into buf
+ */
+const gchar* x509_algorithm_name(cbuf_t *cbuf, asn1_tlv_t *algid,
+                                 gchar *buf, gsize size)
+{
+   const oid_entry_t *entry;
+   asn1_tlv_t algorithm;
+   asn1_oid_t oid;
+
+   if (asn1_first_child(cbuf, algid, &algorithm) < 0 ||
+       !ASN1_IS(&algorithm, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID))
+      return NULL;
+
+   entry = oid_lookup(ASN1_CONTENT(cbuf, &algorithm), algorithm.length);
+   if (entry)
+      return entry->name;
+
+   if (asn1_decode_oid(cbuf, &algorithm, &oid) < 0)
+      return NULL;
+
+   asn1_oid_to_string(&oid, buf, size);
+
+   return buf;
+}
+
+/*
+ * appends the subjectAltName entries naming a host or a mailbox to
+ * out as "TYPE:value" strings, each one terminated by NUL; TYPE is
+ * one of DNS, IP, email or URI
+ */
+void x509_subject_alt_names(cbuf_t *cbuf, x509_cert_t *cert, GByteArray *out)
+{
+   asn1_tlv_t ext, oid, value, names, name;
+   int res;
+
+   if (cert->extensions.length == 0)
+      return;
+
+   /* Extension ::= SEQUENCE { extnID, critical DEFAULT FALSE, extnValue } */
+   for (res = asn1_first_child(cbuf, &cert->extensions, &ext);
+        res == E_SUCCESS; res = asn1_next_child(cbuf, &cert->extensions, &ext)) {
+
+      if (asn1_first_child(cbuf, &ext, &oid) < 0 ||
+          !ASN1_IS(&oid, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OID) ||
+          oid.length != sizeof(X509_OID_SAN) - 1 ||
+          memcmp(ASN1_CONTENT(cbuf, &oid), X509_OID_SAN, oid.length))
+         continue;
+
+      value = oid;
+      while (asn1_next_child(cbuf, &ext, &value) == E_SUCCESS &&
+             !ASN1_IS(&value, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OCTETSTRING));
+
+      if (!ASN1_IS(&value, ASN1_CLASS_UNIVERSAL, ASN1_TAG_OCTETSTRING) ||
+          asn1_read_tlv(cbuf, value.offset + value.hdr_len, &names) < 0 ||
+          ASN1_END(&names) > ASN1_END(&value) ||
+          !ASN1_IS(&names, ASN1_CLASS_UNIVERSAL, ASN1_TAG_SEQUENCE))
+         return;
+
+      for (res = asn1_first_child(cbuf, &names, &name); res == E_SUCCESS;
+           res = asn1_next_child(cbuf, &names, &name))
+         x509_append_general_name(out, cbuf, &name);
+
+      return;
+   }
+}
+
+/*
+ * short name of a X509_KEY_* type
+ */
+const gchar* x509_key_type_name(guint type)
+{
+   switch (type) {
+      case X509_KEY_RSA:
+         return "RSA";
+      case X509_KEY_DSA:
+         return "DSA";
+      case X509_KEY_EC:
+         return "EC";
+      case X509_KEY_ED25519:
+         return "Ed25519";
+      case X509_KEY_ED448:
+         return "Ed448";
+   }
+
+   return "unknown";
+}
+
+/*
+ * formats seconds since the epoch as ISO 8601 UTC timestamp
+ */
+gsize x509_time_to_string(gint64 time, gchar *buf, gsize size)
+{
+   gint64 days, secs, era, doe, yoe, doy, mp;
+   gint year, month, day;
+
+   days = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+   secs = time - days * 86400;
+
+   /* civil date from days since the epoch */
+   days += 719468;
+   era = (days >= 0 ? days : days - 146096) / 146097;
+   doe = days - era * 146097;
+   yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+   doy = doe - (365*yoe + yoe/4 - yoe/100);
+   mp = (5*doy + 2) / 153;
+   day = doy - (153*mp + 2) / 5 + 1;
+   month = mp < 10 ? mp + 3 : mp - 9;
+   year = yoe + era * 400 + (month <= 2);
+
+   return g_snprintf(buf, size, "%04d-%02d-%02dT%02d:%02d:%02dZ",
+         year, month, day, (gint)(secs / 3600), (gint)(secs / 60 % 60),
+         (gint)(secs % 60));
+}
+
+/*
+ * copies node n of the index, failing if it is not present
+ */
+static int x509_node(asn1_index_t *index, guint32 n, asn1_tlv_t *tlv)
+{
+   if (n == ASN1_INDEX_NONE)
+      return -E_INVALID;
+
+   return asn1_index_tlv(index, n, tlv);
+}
+
+/*
+ * the value the OID stands for in the table, 0 if not listed
+ */
+static guint x509_oid_value(const x509_oid_value_t *table, guint count,
+                            cbuf_t *cbuf, asn1_tlv_t *oid)
+{
+   guint i;
+
+   for (i = 0; i < count; i++)
+      if (table[i].der_len == oid->length &&
+          !memcmp(table[i].der, ASN1_CONTENT(cbuf, oid), oid->length))
+         return table[i].value;
+
+   return 0;
+}
+
+/*
+ * size of a non-negative INTEGER without its leading zero octets
+ */
+static guint x509_integer_bits(cbuf_t *cbuf, asn1_tlv_t *integer)
+{
+   const guchar *p = ASN1_CONTENT(cbuf, integer);
+   gsize len = integer->length;
+
+   while (len && *p == 0) {
+      p++;
+      len--;
+   }
+
+   if (len == 0)
+      return 0;
+
+   return (len - 1) * 8 + g_bit_storage(*p);
+}
+
+/*
+ * appends to a fixed size buffer, truncating if necessary
+ */
+static gsize x509_append(gchar *buf, gsize size, gsize pos,
+                         const gchar *str, gsize len)
+{
+   if (pos + len >= size) {
+      len = size - pos - 1;
+      /* never cut a UTF-8 sequence */
+      while (len && (str[len] & 0xc0) == 0x80)
+         len--;
+   }
+
+   memcpy(buf + pos, str, len);
+   buf[pos + len] = 0;
+
+   return pos + len;
+}
+
+static gsize x509_append_hex(gchar *buf, gsize size, gsize pos,
+                             const guchar *data, gsize len)
+{
+   gsize i;
+
+   pos = x509_append(buf, size, pos, "#", 1);
+
+   for (i = 0; i < len && pos + 2 < size; i++)
+      pos += g_snprintf(buf + pos, size - pos, "%02x", data[i]);
+
+   return pos;
+}
+
+/*
+ * GeneralName of the types naming a host or a mailbox; the others
+ * are skipped
+ */
+static void x509_append_general_name(GByteArray *out, cbuf_t *cbuf,
+                                     asn1_tlv_t *name)
+{
+   const guchar *s = ASN1_CONTENT(cbuf, name);
+   gchar tmp[48];
+   gsize i;
+
+   if (name->class != ASN1_CLASS_CONTEXT_SPECIFIC || name->constructed)
+      return;
+
+   switch (name->tag) {
+      case 1:
+         g_byte_array_append(out, (const guint8*)"email:", 6);
+         break;
+      case 2:
+         g_byte_array_append(out, (const guint8*)"DNS:", 4);
+         break;
+      case 6:
+         g_byte_array_append(out, (const guint8*)"URI:", 4);
+         break;
+      case 7:
+         if (name->length == 4) {
+            g_snprintf(tmp, sizeof(tmp), "IP:%u.%u.%u.%u",
+                  s[0], s[1], s[2], s[3]);
+         }
+         else if (name->length == 16) {
+            g_strlcpy(tmp, "IP:", sizeof(tmp));
+            for (i = 0; i < 16; i += 2)
+               g_snprintf(tmp + strlen(tmp), sizeof(tmp) - strlen(tmp),
+                     i ? ":%x" : "%x", s[i] << 8 | s[i + 1]);
+         }
+         else {
+            return;
+         }
+         g_byte_array_append(out, (const guint8*)tmp, strlen(tmp) + 1);
+         return;
+      default:
+         return;
+   }
+
+   /* IA5String contents, cut at an embedded NUL */
+   g_byte_array_append(out, s, strnlen((const gchar*)s, name->length));
+   g_byte_array_append(out, (const guint8*)"", 1);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab
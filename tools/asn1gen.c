@@ -0,0 +1,868 @@
+/* asn1gen.c - generates the schema decode tables from ASN.1 modules
+ *
+ * Copyright (C) 2019 Alexander Koeppe
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * usage: asn1gen TABLES.c TYPES.h MODULE...
+ *
+ * runs at build time and depends on the C library only; reads the
+ * type assignments of X.680 (1988 syntax) modules with EXPLICIT or
+ * IMPLICIT tagging. Value assignments, constraints, named numbers
+ * and DEFAULT values are parsed and dropped, as the tables only
+ * describe structure. All modules share one namespace, IMPORTS are
+ * resolved against the other modules given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+/* globals    */
+
+/* must match certalize_schema.h */
+enum {
+   KIND_PRIMITIVE = 0,
+   KIND_ANY,
+   KIND_SEQUENCE,
+   KIND_SET,
+   KIND_SEQUENCE_OF,
+   KIND_SET_OF,
+   KIND_CHOICE,
+   KIND_TAGGED,
+   /* generator only: alias of another type, resolved before output */
+   KIND_REF,
+   /* generator only: referenced but not assigned yet */
+   KIND_UNDEFINED,
+};
+
+static const char *kind_names[] = {
+   "ASN1_SCHEMA_PRIMITIVE", "ASN1_SCHEMA_ANY", "ASN1_SCHEMA_SEQUENCE",
+   "ASN1_SCHEMA_SET", "ASN1_SCHEMA_SEQUENCE_OF", "ASN1_SCHEMA_SET_OF",
+   "ASN1_SCHEMA_CHOICE", "ASN1_SCHEMA_TAGGED",
+};
+
+enum { TAGGING_EXPLICIT = 0, TAGGING_IMPLICIT };
+enum { CLASS_UNIVERSAL = 0, CLASS_APPLICATION, CLASS_CONTEXT, CLASS_PRIVATE };
+
+#define FLAG_OPTIONAL   0x01
+#define FLAG_DEFAULT    0x02
+
+/* components of a SET are tracked in a 64 bit mask by the interpreter */
+#define MAX_COMPONENTS  64
+
+enum { TOK_EOF = 0, TOK_IDENT, TOK_NUMBER, TOK_PUNCT };
+
+typedef struct token {
+   int kind;
+   char text[128];
+   int line;
+} token_t;
+
+typedef struct parser {
+   const char *file;
+   token_t *toks;
+   int ntoks;
+   int pos;
+   /* default tagging of the module */
+   int tagging;
+} parser_t;
+
+typedef struct gen_type {
+   char *name;
+   int kind;
+   int tagging;
+   int class;
+   unsigned tag;
+   /* element type of OF, TAGGED and REF */
+   int inner;
+   int first;
+   int count;
+   int used;
+} gen_type_t;
+
+typedef struct gen_field {
+   char *name;
+   int type;
+   int flags;
+} gen_field_t;
+
+static gen_type_t *types;
+static int ntypes, types_size;
+static gen_field_t *fields;
+static int nfields, fields_size;
+
+/* universal types known by name */
+static const struct {
+   const char *name;
+   unsigned tag;
+} builtins[] = {
+   { "BOOLEAN", 1 },
+   { "NULL", 5 },
+   { "UTF8String", 12 },
+   { "NumericString", 18 },
+   { "PrintableString", 19 },
+   { "TeletexString", 20 },
+   { "T61String", 20 },
+   { "VideotexString", 21 },
+   { "IA5String", 22 },
+   { "UTCTime", 23 },
+   { "GeneralizedTime", 24 },
+   { "GraphicString", 25 },
+   { "VisibleString", 26 },
+   { "ISO646String", 26 },
+   { "GeneralString", 27 },
+   { "UniversalString", 28 },
+   { "BMPString", 30 },
+};
+
+/* prototypes */
+static void fail(parser_t *p, const char *fmt, ...);
+static void tokenize(parser_t *p, const char *file);
+static token_t* peek(parser_t *p);
+static token_t* next(parser_t *p);
+static int  accept(parser_t *p, const char *text);
+static void expect(parser_t *p, const char *text);
+static void skip_balanced(parser_t *p, const char *open, const char *close);
+static void parse_module(parser_t *p);
+static int  parse_type(parser_t *p);
+static int  parse_components(parser_t *p, int kind);
+static char* copy_string(const char *s);
+static int  new_type(int kind, int class, unsigned tag);
+static int  builtin_type(int kind, unsigned tag);
+static int  named_type(parser_t *p, const char *name);
+static void resolve(void);
+static void mark_used(int t);
+static void mangle(const char *name, char *out, size_t size);
+static void write_tables(const char *path, int argc, char **argv);
+static void write_header(const char *path);
+
+
+/*************/
+
+int main(int argc, char **argv)
+{
+   parser_t p;
+   int i;
+
+   if (argc < 4) {
+      fprintf(stderr, "usage: %s TABLES.c TYPES.h MODULE...\n", argv[0]);
+      return 1;
+   }
+
+   for (i = 3; i < argc; i++) {
+      memset(&p, 0, sizeof(p));
+      tokenize(&p, argv[i]);
+      parse_module(&p);
+      free(p.toks);
+   }
+
+   resolve();
+
+   write_tables(argv[1], argc - 3, argv + 3);
+   write_header(argv[2]);
+
+   return 0;
+}
+
+static void fail(parser_t *p, const char *fmt, ...)
+{
+   va_list ap;
+
+   if (p && p->toks)
+      fprintf(stderr, "%s:%d: ", p->file, peek(p)->line);
+   else if (p)
+      fprintf(stderr, "%s: ", p->file);
+
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+   fputc('\n', stderr);
+
+   exit(1);
+}
+
+/*
+ * splits the module into tokens, comments are dropped
+ */
+static void tokenize(parser_t *p, const char *file)
+{
+   static const char *puncts[] = { "::=", "...", "..", "{", "}", "(", ")",
+      "[", "]", ",", ";", "|", "<", ">", "@", "!", "^", ":", "." };
+   char *buf;
+   long len, i, j;
+   int line = 1, size = 0;
+   unsigned k;
+   FILE *f;
+
+   p->file = file;
+
+   if ((f = fopen(file, "rb")) == NULL)
+      fail(p, "cannot open file");
+
+   fseek(f, 0, SEEK_END);
+   len = ftell(f);
+   fseek(f, 0, SEEK_SET);
+   buf = malloc(len + 1);
+   if (fread(buf, 1, len, f) != (size_t)len)
+      fail(p, "cannot read file");
+   buf[len] = 0;
+   fclose(f);
+
+   for (i = 0; i < len; ) {
+      if (buf[i] == '\n') {
+         line++;
+         i++;
+         continue;
+      }
+      if (isspace((unsigned char)buf[i])) {
+         i++;
+         continue;
+      }
+
+      /* "--" comments end at the next "--" or the end of the line */
+      if (buf[i] == '-' && buf[i + 1] == '-') {
+         for (i += 2; i < len && buf[i] != '\n'; i++)
+            if (buf[i] == '-' && buf[i + 1] == '-') {
+               i += 2;
+               break;
+            }
+         continue;
+      }
+      if (buf[i] == '/' && buf[i + 1] == '*') {
+         for (i += 2; i < len && !(buf[i] == '*' && buf[i + 1] == '/'); i++)
+            if (buf[i] == '\n')
+               line++;
+         i += 2;
+         continue;
+      }
+
+      if (p->ntoks == size) {
+         size = size ? size * 2 : 256;
+         p->toks = realloc(p->toks, size * sizeof(token_t));
+      }
+      memset(&p->toks[p->ntoks], 0, sizeof(token_t));
+      p->toks[p->ntoks].line = line;
+
+      j = i;
+      if (isalpha((unsigned char)buf[i])) {
+         /* hyphens inside, but neither trailing nor doubled */
+         while (isalnum((unsigned char)buf[j]) ||
+                (buf[j] == '-' && isalnum((unsigned char)buf[j + 1])))
+            j++;
+         p->toks[p->ntoks].kind = TOK_IDENT;
+      }
+      else if (isdigit((unsigned char)buf[i])) {
+         while (isdigit((unsigned char)buf[j]))
+            j++;
+         p->toks[p->ntoks].kind = TOK_NUMBER;
+      }
+      else {
+         for (k = 0; k < sizeof(puncts) / sizeof(puncts[0]); k++)
+            if (!strncmp(buf + i, puncts[k], strlen(puncts[k])))
+               break;
+         if (k == sizeof(puncts) / sizeof(puncts[0])) {
+            fprintf(stderr, "%s:%d: unexpected character '%c'\n", file, line,
+                  buf[i]);
+            exit(1);
+         }
+         j = i + strlen(puncts[k]);
+         p->toks[p->ntoks].kind = TOK_PUNCT;
+      }
+
+      if (j - i >= (long)sizeof(p->toks[0].text)) {
+         fprintf(stderr, "%s:%d: token too long\n", file, line);
+         exit(1);
+      }
+      memcpy(p->toks[p->ntoks].text, buf + i, j - i);
+      p->ntoks++;
+      i = j;
+   }
+
+   /* terminating token */
+   if (p->ntoks == size)
+      p->toks = realloc(p->toks, (size + 1) * sizeof(token_t));
+   memset(&p->toks[p->ntoks], 0, sizeof(token_t));
+   p->toks[p->ntoks].kind = TOK_EOF;
+   p->toks[p->ntoks].line = line;
+
+   free(buf);
+}
+
+static token_t* peek(parser_t *p)
+{
+   return &p->toks[p->pos];
+}
+
+static token_t* next(parser_t *p)
+{
+   token_t *t = &p->toks[p->pos];
+
+   if (t->kind != TOK_EOF)
+      p->pos++;
+
+   return t;
+}
+
+static int accept(parser_t *p, const char *text)
+{
+   if (peek(p)->kind == TOK_EOF || strcmp(peek(p)->text, text))
+      return 0;
+
+   p->pos++;
+   return 1;
+}
+
+static void expect(parser_t *p, const char *text)
+{
+   if (!accept(p, text))
+      fail(p, "expected '%s' instead of '%s'", text, peek(p)->text);
+}
+
+/*
+ * skips a bracketed construct starting at the current token
+ */
+static void skip_balanced(parser_t *p, const char *open, const char *close)
+{
+   int depth = 0;
+
+   do {
+      if (peek(p)->kind == TOK_EOF)
+         fail(p, "unbalanced '%s'", open);
+      if (!strcmp(peek(p)->text, open))
+         depth++;
+      else if (!strcmp(peek(p)->text, close))
+         depth--;
+      next(p);
+   } while (depth);
+}
+
+/*
+ * ModuleIdentifier DEFINITIONS [tagging TAGS] ::= BEGIN ... END
+ */
+static void parse_module(parser_t *p)
+{
+   token_t *name;
+   int t, inner;
+
+   if (next(p)->kind != TOK_IDENT)
+      fail(p, "module name expected");
+
+   if (!strcmp(peek(p)->text, "{"))
+      skip_balanced(p, "{", "}");
+
+   expect(p, "DEFINITIONS");
+
+   p->tagging = TAGGING_EXPLICIT;
+   if (accept(p, "IMPLICIT"))
+      p->tagging = TAGGING_IMPLICIT;
+   else if (accept(p, "AUTOMATIC"))
+      fail(p, "AUTOMATIC TAGS are not supported");
+   else
+      accept(p, "EXPLICIT");
+   accept(p, "TAGS");
+
+   if (accept(p, "EXTENSIBILITY"))
+      expect(p, "IMPLIED");
+
+   expect(p, "::=");
+   expect(p, "BEGIN");
+
+   /* imported names are resolved in the shared namespace */
+   if (accept(p, "EXPORTS"))
+      while (!accept(p, ";"))
+         if (next(p)->kind == TOK_EOF)
+            fail(p, "unterminated EXPORTS");
+   if (accept(p, "IMPORTS"))
+      while (!accept(p, ";"))
+         if (next(p)->kind == TOK_EOF)
+            fail(p, "unterminated IMPORTS");
+
+   while (!accept(p, "END")) {
+      name = next(p);
+      if (name->kind != TOK_IDENT)
+         fail(p, "assignment expected instead of '%s'", name->text);
+
+      /* value assignments start lower case and are dropped */
+      if (islower((unsigned char)name->text[0])) {
+         while (!accept(p, "::="))
+            if (next(p)->kind == TOK_EOF)
+               fail(p, "unterminated value assignment");
+         if (!strcmp(peek(p)->text, "{"))
+            skip_balanced(p, "{", "}");
+         else
+            next(p);
+         continue;
+      }
+
+      expect(p, "::=");
+
+      t = named_type(p, name->text);
+      if (types[t].kind != KIND_UNDEFINED)
+         fail(p, "type '%s' assigned twice", name->text);
+
+      /* the name refers to the type, resolved once all are known */
+      types[t].kind = KIND_REF;
+      inner = parse_type(p);
+      types[t].inner = inner;
+   }
+}
+
+/*
+ * parses a type and returns its index; tags, references and the
+ * constructed types create new entries, builtin types are shared
+ */
+static int parse_type(parser_t *p)
+{
+   token_t *tok;
+   int t, class, tagging;
+   unsigned tag, i;
+
+   if (accept(p, "[")) {
+      class = CLASS_CONTEXT;
+      if (accept(p, "UNIVERSAL"))
+         class = CLASS_UNIVERSAL;
+      else if (accept(p, "APPLICATION"))
+         class = CLASS_APPLICATION;
+      else if (accept(p, "PRIVATE"))
+         class = CLASS_PRIVATE;
+
+      if (peek(p)->kind != TOK_NUMBER)
+         fail(p, "tag number expected");
+      tag = strtoul(next(p)->text, NULL, 10);
+      expect(p, "]");
+
+      tagging = p->tagging;
+      if (accept(p, "IMPLICIT"))
+         tagging = TAGGING_IMPLICIT;
+      else if (accept(p, "EXPLICIT"))
+         tagging = TAGGING_EXPLICIT;
+
+      t = new_type(KIND_TAGGED, class, tag);
+      types[t].tagging = tagging;
+      /* parsing may move the table */
+      i = parse_type(p);
+      types[t].inner = i;
+
+      return t;
+   }
+
+   tok = next(p);
+   if (tok->kind != TOK_IDENT)
+      fail(p, "type expected instead of '%s'", tok->text);
+
+   if (!strcmp(tok->text, "INTEGER")) {
+      t = builtin_type(KIND_PRIMITIVE, 2);
+      /* named numbers */
+      if (!strcmp(peek(p)->text, "{"))
+         skip_balanced(p, "{", "}");
+   }
+   else if (!strcmp(tok->text, "ENUMERATED")) {
+      t = builtin_type(KIND_PRIMITIVE, 10);
+      skip_balanced(p, "{", "}");
+   }
+   else if (!strcmp(tok->text, "BIT")) {
+      expect(p, "STRING");
+      t = builtin_type(KIND_PRIMITIVE, 3);
+      /* named bits */
+      if (!strcmp(peek(p)->text, "{"))
+         skip_balanced(p, "{", "}");
+   }
+   else if (!strcmp(tok->text, "OCTET")) {
+      expect(p, "STRING");
+      t = builtin_type(KIND_PRIMITIVE, 4);
+   }
+   else if (!strcmp(tok->text, "OBJECT")) {
+      expect(p, "IDENTIFIER");
+      t = builtin_type(KIND_PRIMITIVE, 6);
+   }
+   else if (!strcmp(tok->text, "ANY")) {
+      t = builtin_type(KIND_ANY, 0);
+      if (accept(p, "DEFINED")) {
+         expect(p, "BY");
+         next(p);
+      }
+   }
+   else if (!strcmp(tok->text, "SEQUENCE") || !strcmp(tok->text, "SET")) {
+      int set = !strcmp(tok->text, "SET");
+
+      /* SEQUENCE SIZE (1..MAX) OF */
+      if (accept(p, "SIZE"))
+         skip_balanced(p, "(", ")");
+      else if (!strcmp(peek(p)->text, "("))
+         skip_balanced(p, "(", ")");
+
+      if (accept(p, "OF")) {
+         t = new_type(set ? KIND_SET_OF : KIND_SEQUENCE_OF, CLASS_UNIVERSAL,
+               set ? 17 : 16);
+         /* an element may be named: SEQUENCE OF name Type */
+         if (peek(p)->kind == TOK_IDENT &&
+             islower((unsigned char)peek(p)->text[0]))
+            next(p);
+         i = parse_type(p);
+         types[t].inner = i;
+      }
+      else {
+         t = parse_components(p, set ? KIND_SET : KIND_SEQUENCE);
+      }
+   }
+   else if (!strcmp(tok->text, "CHOICE")) {
+      t = parse_components(p, KIND_CHOICE);
+   }
+   else {
+      t = -1;
+      for (i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+         if (!strcmp(tok->text, builtins[i].name))
+            t = builtin_type(KIND_PRIMITIVE, builtins[i].tag);
+
+      /* a reference to an assigned type */
+      if (t < 0) {
+         if (!isupper((unsigned char)tok->text[0]))
+            fail(p, "unknown type '%s'", tok->text);
+         t = named_type(p, tok->text);
+      }
+   }
+
+   /* constraints */
+   while (!strcmp(peek(p)->text, "("))
+      skip_balanced(p, "(", ")");
+
+   return t;
+}
+
+/*
+ * { name Type [OPTIONAL | DEFAULT value], ... }
+ *   - the components of one type are stored as a run of fields,
+ *     nested types are completed before their parent
+ */
+static int parse_components(parser_t *p, int kind)
+{
+   gen_field_t run[MAX_COMPONENTS];
+   token_t *name;
+   int count = 0, t, i;
+
+   expect(p, "{");
+
+   while (!accept(p, "}")) {
+      /* extension markers do not change the encoding */
+      if (accept(p, "...")) {
+         accept(p, ",");
+         continue;
+      }
+
+      if (count == MAX_COMPONENTS)
+         fail(p, "more than %d components", MAX_COMPONENTS);
+
+      name = next(p);
+      if (name->kind != TOK_IDENT || !islower((unsigned char)name->text[0]))
+         fail(p, "component name expected instead of '%s'", name->text);
+
+      run[count].name = copy_string(name->text);
+      run[count].type = parse_type(p);
+      run[count].flags = 0;
+
+      if (accept(p, "OPTIONAL")) {
+         run[count].flags = FLAG_OPTIONAL;
+      }
+      else if (accept(p, "DEFAULT")) {
+         run[count].flags = FLAG_DEFAULT;
+         if (!strcmp(peek(p)->text, "{"))
+            skip_balanced(p, "{", "}");
+         else
+            next(p);
+      }
+
+      count++;
+
+      if (!accept(p, ",")) {
+         expect(p, "}");
+         break;
+      }
+   }
+
+   /* a CHOICE carries the tag of the alternative present */
+   t = new_type(kind, CLASS_UNIVERSAL,
+         kind == KIND_CHOICE ? 0 : kind == KIND_SET ? 17 : 16);
+   types[t].first = nfields;
+   types[t].count = count;
+
+   for (i = 0; i < count; i++) {
+      if (nfields == fields_size) {
+         fields_size = fields_size ? fields_size * 2 : 64;
+         fields = realloc(fields, fields_size * sizeof(gen_field_t));
+      }
+      fields[nfields++] = run[i];
+   }
+
+   return t;
+}
+
+static char* copy_string(const char *s)
+{
+   char *copy = malloc(strlen(s) + 1);
+
+   return strcpy(copy, s);
+}
+
+static int new_type(int kind, int class, unsigned tag)
+{
+   if (ntypes == types_size) {
+      types_size = types_size ? types_size * 2 : 64;
+      types = realloc(types, types_size * sizeof(gen_type_t));
+   }
+
+   memset(&types[ntypes], 0, sizeof(gen_type_t));
+   types[ntypes].kind = kind;
+   types[ntypes].class = class;
+   types[ntypes].tag = tag;
+   types[ntypes].inner = -1;
+
+   return ntypes++;
+}
+
+/*
+ * anonymous universal types exist once
+ */
+static int builtin_type(int kind, unsigned tag)
+{
+   int i;
+
+   for (i = 0; i < ntypes; i++)
+      if (types[i].name == NULL && types[i].kind == kind &&
+          types[i].class == CLASS_UNIVERSAL && types[i].tag == tag)
+         return i;
+
+   return new_type(kind, CLASS_UNIVERSAL, tag);
+}
+
+/*
+ * returns the entry of a type reference, creating it on first use
+ */
+static int named_type(parser_t *p, const char *name)
+{
+   int i;
+
+   (void)p;
+
+   for (i = 0; i < ntypes; i++)
+      if (types[i].name && !strcmp(types[i].name, name))
+         return i;
+
+   i = new_type(KIND_UNDEFINED, 0, 0);
+   types[i].name = copy_string(name);
+
+   return i;
+}
+
+/*
+ * replaces every reference by a copy of the type it refers to and
+ * settles the tagging of implicitly tagged untagged types
+ */
+static void resolve(void)
+{
+   int i, t, hops;
+
+   for (i = 0; i < ntypes; i++) {
+      if (types[i].kind == KIND_UNDEFINED) {
+         fprintf(stderr, "asn1gen: type '%s' is not defined\n", types[i].name);
+         exit(1);
+      }
+
+      if (types[i].kind != KIND_REF)
+         continue;
+
+      /* follow the chain of aliases */
+      for (t = types[i].inner, hops = 0; types[t].kind == KIND_REF;
+           t = types[t].inner)
+         if (++hops > ntypes) {
+            fprintf(stderr, "asn1gen: '%s' refers to itself\n", types[i].name);
+            exit(1);
+         }
+
+      types[i].kind = types[t].kind;
+      types[i].tagging = types[t].tagging;
+      types[i].class = types[t].class;
+      types[i].tag = types[t].tag;
+      types[i].inner = types[t].inner;
+      types[i].first = types[t].first;
+      types[i].count = types[t].count;
+   }
+
+   /* element types may still name an alias, which is a copy by now */
+
+   /* a CHOICE or ANY has no tag of its own to replace (X.680 31.2.7) */
+   for (i = 0; i < ntypes; i++)
+      if (types[i].kind == KIND_TAGGED &&
+          (types[types[i].inner].kind == KIND_CHOICE ||
+           types[types[i].inner].kind == KIND_ANY))
+         types[i].tagging = TAGGING_EXPLICIT;
+
+   /* only what the named types reach is written */
+   for (i = 0; i < ntypes; i++)
+      if (types[i].name)
+         mark_used(i);
+}
+
+static void mark_used(int t)
+{
+   int i;
+
+   if (types[t].used)
+      return;
+   types[t].used = 1;
+
+   if (types[t].inner >= 0)
+      mark_used(types[t].inner);
+
+   if (types[t].kind == KIND_SEQUENCE || types[t].kind == KIND_SET ||
+       types[t].kind == KIND_CHOICE)
+      for (i = 0; i < types[t].count; i++)
+         mark_used(fields[types[t].first + i].type);
+}
+
+/*
+ * TBSCertificate -> TBS_CERTIFICATE, PKCS-10 -> PKCS_10
+ */
+static void mangle(const char *name, char *out, size_t size)
+{
+   size_t i, o = 0;
+
+   for (i = 0; name[i] && o + 2 < size; i++) {
+      if (i && isupper((unsigned char)name[i]) &&
+          (islower((unsigned char)name[i - 1]) ||
+           isdigit((unsigned char)name[i - 1]) ||
+           islower((unsigned char)name[i + 1])) &&
+          name[i - 1] != '-')
+         out[o++] = '_';
+      out[o++] = name[i] == '-' ? '_' : toupper((unsigned char)name[i]);
+   }
+   out[o] = 0;
+}
+
+static void write_tables(const char *path, int argc, char **argv)
+{
+   static const char *classes[] = { "ASN1_CLASS_UNIVERSAL",
+      "ASN1_CLASS_APPLICATION", "ASN1_CLASS_CONTEXT_SPECIFIC",
+      "ASN1_CLASS_PRIVATE" };
+   int *type_map, *field_map;
+   int i, j, n, nf;
+   FILE *f;
+
+   if ((f = fopen(path, "w")) == NULL) {
+      fprintf(stderr, "asn1gen: cannot write '%s'\n", path);
+      exit(1);
+   }
+
+   /* new positions of the types and component runs written */
+   type_map = malloc((ntypes + 1) * sizeof(int));
+   field_map = malloc((nfields + 1) * sizeof(int));
+   for (i = 0; i < nfields; i++)
+      field_map[i] = -1;
+
+   for (i = 0, n = 0; i < ntypes; i++)
+      type_map[i] = types[i].used ? n++ : -1;
+
+   fprintf(f, "/* generated by asn1gen from");
+   for (i = 0; i < argc; i++)
+      fprintf(f, " %s", strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 :
+            argv[i]);
+   fprintf(f, ", do not edit */\n\n");
+   fprintf(f, "#include <certalize.h>\n#include <certalize_asn1.h>\n"
+         "#include <certalize_schema.h>\n\n");
+
+   /* component runs in order of the types using them */
+   fprintf(f, "const asn1_schema_field_t asn1_schema_fields[] = {\n");
+   for (i = 0, nf = 0; i < ntypes; i++) {
+      if (!types[i].used || (types[i].kind != KIND_SEQUENCE &&
+          types[i].kind != KIND_SET && types[i].kind != KIND_CHOICE))
+         continue;
+      if (types[i].count == 0 || field_map[types[i].first] >= 0)
+         continue;
+
+      field_map[types[i].first] = nf;
+      for (j = types[i].first; j < types[i].first + types[i].count; j++)
+         fprintf(f, "   /* %3d */ { \"%s\", %d, %d },\n", nf++,
+               fields[j].name, type_map[fields[j].type], fields[j].flags);
+   }
+   if (nf == 0)
+      fprintf(f, "   { NULL, 0, 0 },\n");
+   fprintf(f, "};\n\n");
+
+   fprintf(f, "const asn1_schema_type_t asn1_schema_types[] = {\n");
+   for (i = 0; i < ntypes; i++) {
+      if (!types[i].used)
+         continue;
+
+      fprintf(f, "   /* %3d */ { ", type_map[i]);
+      if (types[i].name)
+         fprintf(f, "\"%s\", ", types[i].name);
+      else
+         fprintf(f, "NULL, ");
+
+      fprintf(f, "%s, %s, %s, %u, %d, %d },\n", kind_names[types[i].kind],
+            types[i].tagging == TAGGING_IMPLICIT ? "ASN1_SCHEMA_IMPLICIT" :
+               "ASN1_SCHEMA_EXPLICIT",
+            classes[types[i].class], types[i].tag,
+            types[i].inner >= 0 ? type_map[types[i].inner] :
+               types[i].count ? field_map[types[i].first] : 0,
+            types[i].inner >= 0 ? 0 : types[i].count);
+   }
+   fprintf(f, "};\n\n");
+
+   fprintf(f, "const guint asn1_schema_ntypes = G_N_ELEMENTS(asn1_schema_types);\n");
+
+   fclose(f);
+
+   /* the header refers to the new positions */
+   for (i = 0; i < ntypes; i++)
+      types[i].used = type_map[i];
+
+   free(type_map);
+   free(field_map);
+}
+
+static void write_header(const char *path)
+{
+   char mangled[256];
+   int i;
+   FILE *f;
+
+   if ((f = fopen(path, "w")) == NULL) {
+      fprintf(stderr, "asn1gen: cannot write '%s'\n", path);
+      exit(1);
+   }
+
+   fprintf(f, "/* generated by asn1gen, do not edit */\n\n");
+   fprintf(f, "#ifndef CERTALIZE_SCHEMA_TYPES_H\n"
+         "#define CERTALIZE_SCHEMA_TYPES_H\n\n");
+
+   for (i = 0; i < ntypes; i++) {
+      if (types[i].name == NULL)
+         continue;
+      mangle(types[i].name, mangled, sizeof(mangled));
+      fprintf(f, "#define ASN1_SCHEMA_TYPE_%-32s %d\n", mangled, types[i].used);
+   }
+
+   fprintf(f, "\n#endif   /* CERTALIZE_SCHEMA_TYPES_H */\n");
+
+   fclose(f);
+}
+
+/* EOF */
+
+// vim:ts=3:expandtab